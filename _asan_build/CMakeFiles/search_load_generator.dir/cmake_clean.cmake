@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/search_load_generator.dir/search_load_generator.cpp.o"
+  "CMakeFiles/search_load_generator.dir/search_load_generator.cpp.o.d"
+  "search_load_generator"
+  "search_load_generator.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/search_load_generator.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
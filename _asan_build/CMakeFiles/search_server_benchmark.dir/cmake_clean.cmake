@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/search_server_benchmark.dir/search_server_benchmark.cpp.o"
+  "CMakeFiles/search_server_benchmark.dir/search_server_benchmark.cpp.o.d"
+  "search_server_benchmark"
+  "search_server_benchmark.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/search_server_benchmark.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
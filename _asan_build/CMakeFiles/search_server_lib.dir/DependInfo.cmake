@@ -0,0 +1,38 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/async_search_server.cpp" "CMakeFiles/search_server_lib.dir/async_search_server.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/async_search_server.cpp.o.d"
+  "/root/repo/document_loader.cpp" "CMakeFiles/search_server_lib.dir/document_loader.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/document_loader.cpp.o.d"
+  "/root/repo/generators.cpp" "CMakeFiles/search_server_lib.dir/generators.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/generators.cpp.o.d"
+  "/root/repo/http_service.cpp" "CMakeFiles/search_server_lib.dir/http_service.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/http_service.cpp.o.d"
+  "/root/repo/numa_search_server.cpp" "CMakeFiles/search_server_lib.dir/numa_search_server.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/numa_search_server.cpp.o.d"
+  "/root/repo/position_list.cpp" "CMakeFiles/search_server_lib.dir/position_list.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/position_list.cpp.o.d"
+  "/root/repo/process_queries.cpp" "CMakeFiles/search_server_lib.dir/process_queries.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/process_queries.cpp.o.d"
+  "/root/repo/profiler.cpp" "CMakeFiles/search_server_lib.dir/profiler.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/profiler.cpp.o.d"
+  "/root/repo/query_arena.cpp" "CMakeFiles/search_server_lib.dir/query_arena.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/query_arena.cpp.o.d"
+  "/root/repo/read_input_functions.cpp" "CMakeFiles/search_server_lib.dir/read_input_functions.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/read_input_functions.cpp.o.d"
+  "/root/repo/remove_duplicates.cpp" "CMakeFiles/search_server_lib.dir/remove_duplicates.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/remove_duplicates.cpp.o.d"
+  "/root/repo/request_queue.cpp" "CMakeFiles/search_server_lib.dir/request_queue.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/request_queue.cpp.o.d"
+  "/root/repo/request_statistics.cpp" "CMakeFiles/search_server_lib.dir/request_statistics.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/request_statistics.cpp.o.d"
+  "/root/repo/search_server.cpp" "CMakeFiles/search_server_lib.dir/search_server.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/search_server.cpp.o.d"
+  "/root/repo/shard_transport.cpp" "CMakeFiles/search_server_lib.dir/shard_transport.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/shard_transport.cpp.o.d"
+  "/root/repo/sharded_search_server.cpp" "CMakeFiles/search_server_lib.dir/sharded_search_server.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/sharded_search_server.cpp.o.d"
+  "/root/repo/string_processing.cpp" "CMakeFiles/search_server_lib.dir/string_processing.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/string_processing.cpp.o.d"
+  "/root/repo/term_trie.cpp" "CMakeFiles/search_server_lib.dir/term_trie.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/term_trie.cpp.o.d"
+  "/root/repo/text_analyzer.cpp" "CMakeFiles/search_server_lib.dir/text_analyzer.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/text_analyzer.cpp.o.d"
+  "/root/repo/write_ahead_log.cpp" "CMakeFiles/search_server_lib.dir/write_ahead_log.cpp.o" "gcc" "CMakeFiles/search_server_lib.dir/write_ahead_log.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,49 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/search_server_lib.dir/async_search_server.cpp.o"
+  "CMakeFiles/search_server_lib.dir/async_search_server.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/document_loader.cpp.o"
+  "CMakeFiles/search_server_lib.dir/document_loader.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/generators.cpp.o"
+  "CMakeFiles/search_server_lib.dir/generators.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/http_service.cpp.o"
+  "CMakeFiles/search_server_lib.dir/http_service.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/numa_search_server.cpp.o"
+  "CMakeFiles/search_server_lib.dir/numa_search_server.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/position_list.cpp.o"
+  "CMakeFiles/search_server_lib.dir/position_list.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/process_queries.cpp.o"
+  "CMakeFiles/search_server_lib.dir/process_queries.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/profiler.cpp.o"
+  "CMakeFiles/search_server_lib.dir/profiler.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/query_arena.cpp.o"
+  "CMakeFiles/search_server_lib.dir/query_arena.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/read_input_functions.cpp.o"
+  "CMakeFiles/search_server_lib.dir/read_input_functions.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/remove_duplicates.cpp.o"
+  "CMakeFiles/search_server_lib.dir/remove_duplicates.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/request_queue.cpp.o"
+  "CMakeFiles/search_server_lib.dir/request_queue.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/request_statistics.cpp.o"
+  "CMakeFiles/search_server_lib.dir/request_statistics.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/search_server.cpp.o"
+  "CMakeFiles/search_server_lib.dir/search_server.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/shard_transport.cpp.o"
+  "CMakeFiles/search_server_lib.dir/shard_transport.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/sharded_search_server.cpp.o"
+  "CMakeFiles/search_server_lib.dir/sharded_search_server.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/string_processing.cpp.o"
+  "CMakeFiles/search_server_lib.dir/string_processing.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/term_trie.cpp.o"
+  "CMakeFiles/search_server_lib.dir/term_trie.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/text_analyzer.cpp.o"
+  "CMakeFiles/search_server_lib.dir/text_analyzer.cpp.o.d"
+  "CMakeFiles/search_server_lib.dir/write_ahead_log.cpp.o"
+  "CMakeFiles/search_server_lib.dir/write_ahead_log.cpp.o.d"
+  "libsearch_server_lib.a"
+  "libsearch_server_lib.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/search_server_lib.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "libsearch_server_lib.a"
+)
@@ -0,0 +1,8 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo
+# Build directory: /root/repo/_asan_build
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(search_server_tests "/root/repo/_asan_build/search_server")
+set_tests_properties(search_server_tests PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/CMakeLists.txt;189;add_test;/root/repo/CMakeLists.txt;0;")
@@ -0,0 +1,172 @@
+#include "async_search_server.h"
+
+#include <algorithm>
+#include <exception>
+
+using namespace std;
+
+struct AsyncSearchServer::Request {
+    RequestKey key;
+    chrono::steady_clock::time_point submitted;
+    promise<Result> result;
+    shared_future<Result> future = result.get_future().share();
+    bool done = false;
+    vector<function<void()>> waiters;
+};
+
+AsyncSearchServer::AsyncSearchServer(const SearchServer& search_server)
+    : AsyncSearchServer(search_server, Options{})
+{}
+
+AsyncSearchServer::AsyncSearchServer(const SearchServer& search_server, Options options)
+    : search_server_(search_server)
+    , options_(options)
+    , worker_count_(options_.worker_threads > 0 ? options_.worker_threads : max(1u, thread::hardware_concurrency()))
+{
+    workers_.reserve(worker_count_);
+    for (size_t i = 0; i < worker_count_; ++i) {
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+AsyncSearchServer::~AsyncSearchServer() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    has_work_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+shared_ptr<AsyncSearchServer::Request> AsyncSearchServer::Submit(string_view raw_query, DocumentStatus status) {
+    RequestKey key(string(raw_query), status);
+    shared_ptr<Request> request;
+    {
+        lock_guard guard(mutex_);
+        ++counters_.submitted;
+        const auto it = in_flight_.find(key);
+        if (it != in_flight_.end()) {
+            ++counters_.deduplicated;
+            return it->second;
+        }
+        request = make_shared<Request>();
+        request->key = move(key);
+        request->submitted = chrono::steady_clock::now();
+        in_flight_.emplace(request->key, request);
+        pending_.push_back(request);
+    }
+    has_work_.notify_one();
+    return request;
+}
+
+shared_future<AsyncSearchServer::Result> AsyncSearchServer::GetFuture(const Request& request) {
+    return request.future;
+}
+
+shared_future<AsyncSearchServer::Result> AsyncSearchServer::FindTopDocumentsAsync(string_view raw_query, DocumentStatus status) {
+    return Submit(raw_query, status)->future;
+}
+
+#if defined(__cpp_impl_coroutine)
+AsyncSearchServer::Awaitable AsyncSearchServer::FindTopDocumentsAwaitable(string_view raw_query, DocumentStatus status) {
+    return Awaitable(this, Submit(raw_query, status));
+}
+#endif
+
+AsyncSearchServer::Counters AsyncSearchServer::GetCounters() const {
+    lock_guard guard(mutex_);
+    return counters_;
+}
+
+bool AsyncSearchServer::AddWaiter(const shared_ptr<Request>& request, function<void()> waiter) {
+    lock_guard guard(mutex_);
+    if (request->done) {
+        return false;
+    }
+    request->waiters.push_back(move(waiter));
+    return true;
+}
+
+void AsyncSearchServer::WorkerLoop() {
+    vector<shared_ptr<Request>> batch;
+    while (true) {
+        {
+            unique_lock lock(mutex_);
+            const auto has_pending = [this] { return pending_begin_ < pending_.size(); };
+            has_work_.wait(lock, [&] { return stopping_ || has_pending(); });
+            if (!has_pending()) {
+                return;
+            }
+            const auto has_ready = [this] { return pending_begin_ < ready_end_; };
+            if (!has_ready()) {
+                //добираем пакет, пока не истекло окно первого запроса
+                const auto deadline = pending_[pending_begin_]->submitted + options_.batch_window;
+                has_work_.wait_until(lock, deadline, [&] {
+                    return stopping_ || !has_pending() || has_ready()
+                        || pending_.size() - pending_begin_ >= options_.max_batch_size;
+                });
+                if (!has_pending()) {
+                    continue; //пакет забрал другой поток
+                }
+                if (!has_ready()) {
+                    ready_end_ = pending_begin_ + min(pending_.size() - pending_begin_, options_.max_batch_size);
+                    ++counters_.batches;
+                }
+            }
+            //пакет делится между рабочими потоками: каждый берёт свою долю, остаток сразу
+            //забирают другие, не дожидаясь нового окна
+            const size_t ready = ready_end_ - pending_begin_;
+            const size_t count = (ready + worker_count_ - 1) / worker_count_;
+            batch.assign(pending_.begin() + pending_begin_, pending_.begin() + pending_begin_ + count);
+            pending_begin_ += count;
+            if (pending_begin_ == pending_.size()) {
+                pending_.clear();
+                pending_begin_ = 0;
+                ready_end_ = 0;
+            }
+            counters_.executed += count;
+            if (has_ready()) {
+                has_work_.notify_all();
+            }
+        }
+        for (const shared_ptr<Request>& request : batch) {
+            try {
+                request->result.set_value(Execute(*request));
+            }
+            catch (...) {
+                request->result.set_exception(current_exception());
+            }
+            Complete(request);
+        }
+        batch.clear();
+    }
+}
+
+AsyncSearchServer::Result AsyncSearchServer::Execute(const Request& request) {
+    const auto& [raw_query, status] = request.key;
+    if (options_.limits.IsUnlimited()) {
+        return search_server_.FindTopDocuments(raw_query, status);
+    }
+    BudgetedSearchResult result = search_server_.FindTopDocumentsWithBudget(raw_query, status,
+        options_.limits.MakeBudget(request.submitted));
+    if (result.is_truncated) {
+        lock_guard guard(mutex_);
+        ++counters_.truncated;
+    }
+    return move(result.documents);
+}
+
+void AsyncSearchServer::Complete(const shared_ptr<Request>& request) {
+    vector<function<void()>> waiters;
+    {
+        lock_guard guard(mutex_);
+        request->done = true;
+        waiters.swap(request->waiters);
+        in_flight_.erase(request->key);
+    }
+    for (const function<void()>& waiter : waiters) {
+        waiter();
+    }
+}
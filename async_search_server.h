@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+#include "document.h"
+#include "search_server.h"
+
+// Асинхронный поиск поверх SearchServer.
+//
+// Запросы копятся в очереди и забираются рабочими потоками пакетами: поток ждёт не дольше
+// batch_window от прихода первого запроса пакета или пока не наберётся max_batch_size.
+// Собранный пакет выполняют все рабочие потоки: каждый берёт долю 1/worker_threads.
+// Одинаковые запросы (текст и статус), ещё не получившие ответа, выполняются один раз:
+// все вызывающие получают один и тот же shared_future.
+//
+// Результат можно ждать через std::shared_future или, в C++20, через co_await:
+//   std::vector<Document> documents = co_await async_server.FindTopDocumentsAwaitable("cat"s);
+// Корутина продолжается в рабочем потоке, который выполнил запрос.
+//
+// С limits каждый запрос выполняется с бюджетом (FindTopDocumentsWithBudget), срок отсчитывается
+// от постановки в очередь: ожидание пакета тоже входит в задержку, которую видит вызывающий.
+//
+// SearchServer нельзя изменять, пока через него идут асинхронные запросы.
+class AsyncSearchServer {
+public:
+    using Result = std::vector<Document>;
+
+    struct Options {
+        size_t worker_threads = 0;                          // 0 - по числу ядер
+        size_t max_batch_size = 64;
+        std::chrono::microseconds batch_window{ 200 };
+        QueryLimits limits;                                 // по умолчанию без ограничений
+    };
+
+    struct Counters {
+        uint64_t submitted = 0;     // все вызовы
+        uint64_t deduplicated = 0;  // присоединились к такому же запросу в полёте
+        uint64_t executed = 0;      // действительно выполненные запросы
+        uint64_t batches = 0;
+        uint64_t truncated = 0;     // выдача обрезана бюджетом
+    };
+
+    explicit AsyncSearchServer(const SearchServer& search_server);
+    AsyncSearchServer(const SearchServer& search_server, Options options);
+    // дожидается выполнения всех принятых запросов
+    ~AsyncSearchServer();
+
+    AsyncSearchServer(const AsyncSearchServer&) = delete;
+    AsyncSearchServer& operator=(const AsyncSearchServer&) = delete;
+
+    std::shared_future<Result> FindTopDocumentsAsync(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+#if defined(__cpp_impl_coroutine)
+    class Awaitable;
+    Awaitable FindTopDocumentsAwaitable(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+#endif
+
+    Counters GetCounters() const;
+
+private:
+    struct Request;
+    using RequestKey = std::pair<std::string, DocumentStatus>;
+
+    const SearchServer& search_server_;
+    const Options options_;
+    const size_t worker_count_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::vector<std::shared_ptr<Request>> pending_;
+    size_t pending_begin_ = 0;   // pending_ - очередь, забранное начало сдвигается пачкой
+    size_t ready_end_ = 0;       // [pending_begin_, ready_end_) - собранный пакет, ещё не разобранный потоками
+    std::map<RequestKey, std::shared_ptr<Request>> in_flight_;
+    Counters counters_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+
+    std::shared_ptr<Request> Submit(std::string_view raw_query, DocumentStatus status);
+    void WorkerLoop();
+    Result Execute(const Request& request);
+    void Complete(const std::shared_ptr<Request>& request);
+
+    // false - ответ уже готов и ждать не нужно
+    bool AddWaiter(const std::shared_ptr<Request>& request, std::function<void()> waiter);
+    static std::shared_future<Result> GetFuture(const Request& request);
+};
+
+#if defined(__cpp_impl_coroutine)
+class AsyncSearchServer::Awaitable {
+public:
+    bool await_ready() const {
+        return future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        return server_->AddWaiter(request_, [handle] { handle.resume(); });
+    }
+
+    Result await_resume() const {
+        return future_.get();
+    }
+
+private:
+    friend class AsyncSearchServer;
+
+    Awaitable(AsyncSearchServer* server, std::shared_ptr<Request> request)
+        : server_(server)
+        , request_(std::move(request))
+        , future_(GetFuture(*request_))
+    {}
+
+    AsyncSearchServer* server_;
+    std::shared_ptr<Request> request_;
+    std::shared_future<Result> future_;
+};
+#endif
@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include <string_view>
+
 struct Document { //ID, релевантность и рейтинг
     Document() = default;
     Document(int id, double relevance, int rating)
@@ -17,4 +19,9 @@ enum class DocumentStatus {
     IRRELEVANT,
     BANNED,
     REMOVED,
-};
\ No newline at end of file
+};
+//поле документа: name - title, tags и т.п., пустое имя - основной текст
+struct DocumentField {
+    std::string_view name;
+    std::string_view text;
+};
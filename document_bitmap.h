@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Множество id документов битовой картой: бит на id от 0 до наибольшего добавленного.
+// Для слов, которые есть в заметной доле документов: проверка документа - одно чтение
+// слова памяти вместо поиска по дереву постингов, а карта на N документов занимает N / 8 байт.
+class DocumentBitmap {
+public:
+    void Insert(int document_id) {
+        const size_t word = static_cast<size_t>(document_id) / 64;
+        if (word >= words_.size()) {
+            words_.resize(word + 1);
+        }
+        const uint64_t mask = uint64_t{ 1 } << (document_id % 64);
+        count_ += (words_[word] & mask) == 0;
+        words_[word] |= mask;
+    }
+
+    void Erase(int document_id) {
+        const size_t word = static_cast<size_t>(document_id) / 64;
+        if (word < words_.size()) {
+            const uint64_t mask = uint64_t{ 1 } << (document_id % 64);
+            count_ -= (words_[word] & mask) != 0;
+            words_[word] &= ~mask;
+        }
+    }
+
+    bool Contains(int document_id) const {
+        const size_t word = static_cast<size_t>(document_id) / 64;
+        return word < words_.size() && (words_[word] >> (document_id % 64) & 1) != 0;
+    }
+
+    size_t GetCount() const {
+        return count_;
+    }
+
+    size_t GetMemoryUsage() const {
+        return words_.capacity() * sizeof(uint64_t);
+    }
+
+    // байт на карту с наибольшим id max_document_id
+    static size_t GetMemoryUsage(int max_document_id) {
+        return (static_cast<size_t>(max_document_id) / 64 + 1) * sizeof(uint64_t);
+    }
+
+private:
+    std::vector<uint64_t> words_;
+    size_t count_ = 0;
+};
@@ -0,0 +1,555 @@
+#include "document_loader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DOCUMENT_LOADER_HAS_MMAP
+#endif
+
+using namespace std;
+
+namespace {
+
+// Файл, отображённый в память только для чтения. Если отобразить не удалось
+// (нет mmap, пустой файл, не обычный файл), содержимое читается в буфер.
+class MappedFile {
+public:
+    explicit MappedFile(const string& path) {
+#ifdef DOCUMENT_LOADER_HAS_MMAP
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("Cannot open "s + path);
+        }
+        struct stat file_stat {};
+        if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+            const size_t size = static_cast<size_t>(file_stat.st_size);
+            void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                madvise(address, size, MADV_SEQUENTIAL);
+                mapped_address_ = address;
+                data_ = string_view(static_cast<const char*>(address), size);
+            }
+        }
+        close(fd);
+        if (mapped_address_ != nullptr) {
+            return;
+        }
+#endif
+        ifstream input(path, ios::binary);
+        if (!input) {
+            throw runtime_error("Cannot open "s + path);
+        }
+        buffer_.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+        data_ = buffer_;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef DOCUMENT_LOADER_HAS_MMAP
+        if (mapped_address_ != nullptr) {
+            munmap(mapped_address_, data_.size());
+        }
+#endif
+    }
+
+    string_view GetData() const {
+        return data_;
+    }
+
+private:
+    void* mapped_address_ = nullptr;
+    string buffer_;
+    string_view data_;
+};
+
+[[noreturn]] void ThrowInvalidRecord(string_view line, const string& reason) {
+    const size_t shown = min<size_t>(line.size(), 80);
+    throw invalid_argument("Invalid record ("s + reason + "): "s + string(line.substr(0, shown)));
+}
+
+int ParseInt(string_view text, string_view line) {
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (error != errc() || end != text.data() + text.size()) {
+        ThrowInvalidRecord(line, "bad number '"s + string(text) + "'"s);
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(string_view text, string_view line) {
+    static const pair<string_view, DocumentStatus> names[] = {
+        { "ACTUAL"sv, DocumentStatus::ACTUAL },
+        { "IRRELEVANT"sv, DocumentStatus::IRRELEVANT },
+        { "BANNED"sv, DocumentStatus::BANNED },
+        { "REMOVED"sv, DocumentStatus::REMOVED },
+    };
+    for (const auto& [name, status] : names) {
+        if (text == name) {
+            return status;
+        }
+    }
+    const int value = ParseInt(text, line);
+    if (value < 0 || value > static_cast<int>(DocumentStatus::REMOVED)) {
+        ThrowInvalidRecord(line, "bad status"s);
+    }
+    return static_cast<DocumentStatus>(value);
+}
+
+void ParseRatings(string_view text, vector<int>& ratings, string_view line) {
+    while (!text.empty()) {
+        const size_t space = text.find(' ');
+        const string_view rating = text.substr(0, space);
+        if (!rating.empty()) {
+            ratings.push_back(ParseInt(rating, line));
+        }
+        if (space == text.npos) {
+            break;
+        }
+        text.remove_prefix(space + 1);
+    }
+}
+
+string_view NextTsvField(string_view& rest, string_view line) {
+    const size_t tab = rest.find('\t');
+    if (tab == rest.npos) {
+        ThrowInvalidRecord(line, "expected 4 tab-separated fields"s);
+    }
+    const string_view field = rest.substr(0, tab);
+    rest.remove_prefix(tab + 1);
+    return field;
+}
+
+// Минимальный разбор плоского JSON-объекта: числа, строки, массивы чисел;
+// значения прочих ключей пропускаются.
+class JsonRecordParser {
+public:
+    JsonRecordParser(string_view line, deque<string>& storage)
+        : line_(line)
+        , storage_(storage) {
+    }
+
+    DocumentRecord Parse() {
+        DocumentRecord record;
+        bool has_id = false;
+        bool has_text = false;
+        Expect('{');
+        SkipSpaces();
+        if (Peek() == '}') {
+            ThrowInvalidRecord(line_, "empty object"s);
+        }
+        while (true) {
+            const string_view key = ParseString();
+            Expect(':');
+            SkipSpaces();
+            if (key == "id"sv) {
+                record.id = ParseInt(ParseNumber(), line_);
+                has_id = true;
+            }
+            else if (key == "status"sv) {
+                record.status = ParseStatus(Peek() == '"' ? ParseString() : ParseNumber(), line_);
+            }
+            else if (key == "ratings"sv) {
+                ParseRatingsArray(record.ratings);
+            }
+            else if (key == "text"sv) {
+                record.text = ParseString();
+                has_text = true;
+            }
+            else {
+                SkipValue();
+            }
+            SkipSpaces();
+            if (Peek() == ',') {
+                ++pos_;
+                SkipSpaces();
+                continue;
+            }
+            Expect('}');
+            break;
+        }
+        if (!has_id || !has_text) {
+            ThrowInvalidRecord(line_, "id and text are required"s);
+        }
+        return record;
+    }
+
+private:
+    string_view line_;
+    deque<string>& storage_;
+    size_t pos_ = 0;
+
+    char Peek() const {
+        return pos_ < line_.size() ? line_[pos_] : '\0';
+    }
+
+    void SkipSpaces() {
+        while (pos_ < line_.size() && (line_[pos_] == ' ' || line_[pos_] == '\t' || line_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    void Expect(char c) {
+        SkipSpaces();
+        if (Peek() != c) {
+            ThrowInvalidRecord(line_, "expected '"s + c + "'"s);
+        }
+        ++pos_;
+    }
+
+    string_view ParseNumber() {
+        const size_t begin = pos_;
+        while (pos_ < line_.size() && (isdigit(static_cast<unsigned char>(line_[pos_])) || line_[pos_] == '-'
+            || line_[pos_] == '+' || line_[pos_] == '.' || line_[pos_] == 'e' || line_[pos_] == 'E')) {
+            ++pos_;
+        }
+        return line_.substr(begin, pos_ - begin);
+    }
+
+    // строка без escape-последовательностей возвращается без копирования
+    string_view ParseString() {
+        Expect('"');
+        const size_t begin = pos_;
+        while (pos_ < line_.size() && line_[pos_] != '"' && line_[pos_] != '\\') {
+            ++pos_;
+        }
+        if (Peek() == '"') {
+            return line_.substr(begin, pos_++ - begin);
+        }
+        string& decoded = storage_.emplace_back(line_.substr(begin, pos_ - begin));
+        while (pos_ < line_.size() && line_[pos_] != '"') {
+            if (line_[pos_] != '\\') {
+                decoded.push_back(line_[pos_++]);
+                continue;
+            }
+            ++pos_;
+            switch (Peek()) {
+            case '"': decoded.push_back('"'); break;
+            case '\\': decoded.push_back('\\'); break;
+            case '/': decoded.push_back('/'); break;
+            case 'b': decoded.push_back('\b'); break;
+            case 'f': decoded.push_back('\f'); break;
+            case 'n': decoded.push_back('\n'); break;
+            case 'r': decoded.push_back('\r'); break;
+            case 't': decoded.push_back('\t'); break;
+            case 'u': AppendCodePoint(decoded); continue;
+            default: ThrowInvalidRecord(line_, "bad escape sequence"s);
+            }
+            ++pos_;
+        }
+        Expect('"');
+        return decoded;
+    }
+
+    uint32_t ParseHex4() {
+        if (pos_ + 4 > line_.size()) {
+            ThrowInvalidRecord(line_, "bad \\u escape"s);
+        }
+        uint32_t value = 0;
+        const auto [end, error] = from_chars(line_.data() + pos_, line_.data() + pos_ + 4, value, 16);
+        if (error != errc() || end != line_.data() + pos_ + 4) {
+            ThrowInvalidRecord(line_, "bad \\u escape"s);
+        }
+        pos_ += 4;
+        return value;
+    }
+
+    // pos_ указывает на 'u' после обратной косой черты
+    void AppendCodePoint(string& out) {
+        ++pos_;
+        uint32_t code_point = ParseHex4();
+        if (code_point >= 0xD800 && code_point <= 0xDBFF && line_.substr(pos_, 2) == "\\u"sv) {
+            pos_ += 2;
+            const uint32_t low = ParseHex4();
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+        }
+        if (code_point < 0x80) {
+            out.push_back(static_cast<char>(code_point));
+        }
+        else if (code_point < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        }
+        else if (code_point < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        }
+        else {
+            out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        }
+    }
+
+    void ParseRatingsArray(vector<int>& ratings) {
+        Expect('[');
+        SkipSpaces();
+        if (Peek() == ']') {
+            ++pos_;
+            return;
+        }
+        while (true) {
+            SkipSpaces();
+            ratings.push_back(ParseInt(ParseNumber(), line_));
+            SkipSpaces();
+            if (Peek() == ',') {
+                ++pos_;
+                continue;
+            }
+            Expect(']');
+            return;
+        }
+    }
+
+    void SkipValue() {
+        SkipSpaces();
+        const char c = Peek();
+        if (c == '"') {
+            ParseString();
+        }
+        else if (c == '[' || c == '{') {
+            //вложенные структуры пропускаются с учётом строк внутри них
+            int depth = 0;
+            do {
+                const char current = Peek();
+                if (current == '"') {
+                    ParseString();
+                    continue;
+                }
+                if (current == '\0') {
+                    ThrowInvalidRecord(line_, "unterminated value"s);
+                }
+                if (current == '[' || current == '{') {
+                    ++depth;
+                }
+                else if (current == ']' || current == '}') {
+                    --depth;
+                }
+                ++pos_;
+            } while (depth > 0);
+        }
+        else {
+            while (pos_ < line_.size() && line_[pos_] != ',' && line_[pos_] != '}') {
+                ++pos_;
+            }
+        }
+    }
+};
+
+struct ParsedChunk {
+    vector<DocumentRecord> records;
+    deque<string> storage;
+    size_t skipped = 0;
+    exception_ptr error;
+    bool ready = false;
+};
+
+// режет данные на куски примерно по chunk_size байт, каждый кусок заканчивается на границе строки
+vector<string_view> SplitIntoChunks(string_view data, size_t chunk_size) {
+    vector<string_view> chunks;
+    chunk_size = max<size_t>(chunk_size, 1);
+    while (!data.empty()) {
+        size_t end = min(chunk_size, data.size());
+        if (end < data.size()) {
+            const size_t newline = data.find('\n', end - 1);
+            end = newline == data.npos ? data.size() : newline + 1;
+        }
+        chunks.push_back(data.substr(0, end));
+        data.remove_prefix(end);
+    }
+    return chunks;
+}
+
+ParsedChunk ParseChunk(string_view chunk, const LoadOptions& options) {
+    ParsedChunk result;
+    while (!chunk.empty()) {
+        const size_t newline = chunk.find('\n');
+        string_view line = chunk.substr(0, newline);
+        chunk.remove_prefix(newline == chunk.npos ? chunk.size() : newline + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            result.records.push_back(options.format == DumpFormat::TSV
+                ? ParseTsvRecord(line)
+                : ParseJsonRecord(line, result.storage));
+        }
+        catch (const invalid_argument&) {
+            if (!options.skip_invalid) {
+                throw;
+            }
+            ++result.skipped;
+        }
+    }
+    return result;
+}
+
+// Конвейер: потоки разбора берут куски по порядку, вызывающий поток добавляет
+// готовые куски в индекс строго в порядке файла. Потоки разбора опережают добавление
+// не больше чем на max_in_flight кусков, чтобы не держать в памяти весь разобранный дамп.
+class LoadPipeline {
+public:
+    LoadPipeline(vector<string_view> chunks, const LoadOptions& options)
+        : chunks_(move(chunks))
+        , parsed_(chunks_.size())
+        , options_(options) {
+        size_t thread_count = options.parser_threads;
+        if (thread_count == 0) {
+            thread_count = max(1u, thread::hardware_concurrency());
+        }
+        thread_count = min(thread_count, max<size_t>(chunks_.size(), 1));
+        max_in_flight_ = options.max_chunks_in_flight != 0 ? options.max_chunks_in_flight : 2 * thread_count;
+        for (size_t i = 0; i < thread_count; ++i) {
+            parsers_.emplace_back([this] { ParserLoop(); });
+        }
+    }
+
+    LoadPipeline(const LoadPipeline&) = delete;
+    LoadPipeline& operator=(const LoadPipeline&) = delete;
+
+    ~LoadPipeline() {
+        {
+            lock_guard guard(mutex_);
+            stopped_ = true;
+        }
+        changed_.notify_all();
+        for (thread& parser : parsers_) {
+            parser.join();
+        }
+    }
+
+    size_t GetChunkCount() const {
+        return chunks_.size();
+    }
+
+    // ждёт разбора куска index и забирает его; куски нужно забирать по порядку
+    ParsedChunk TakeChunk(size_t index) {
+        unique_lock lock(mutex_);
+        changed_.wait(lock, [this, index] { return parsed_[index].ready; });
+        ParsedChunk chunk = move(parsed_[index]);
+        lock.unlock();
+        if (chunk.error) {
+            rethrow_exception(chunk.error);
+        }
+        return chunk;
+    }
+
+    void MarkInserted() {
+        {
+            lock_guard guard(mutex_);
+            ++inserted_;
+        }
+        changed_.notify_all();
+    }
+
+private:
+    vector<string_view> chunks_;
+    vector<ParsedChunk> parsed_;
+    const LoadOptions& options_;
+    size_t max_in_flight_ = 1;
+
+    mutex mutex_;
+    condition_variable changed_;
+    size_t next_to_parse_ = 0;
+    size_t inserted_ = 0;
+    bool stopped_ = false;
+    vector<thread> parsers_;
+
+    void ParserLoop() {
+        while (true) {
+            size_t index = 0;
+            {
+                unique_lock lock(mutex_);
+                changed_.wait(lock, [this] {
+                    return stopped_ || next_to_parse_ >= chunks_.size() || next_to_parse_ < inserted_ + max_in_flight_;
+                });
+                if (stopped_ || next_to_parse_ >= chunks_.size()) {
+                    return;
+                }
+                index = next_to_parse_++;
+            }
+            ParsedChunk chunk;
+            try {
+                chunk = ParseChunk(chunks_[index], options_);
+            }
+            catch (...) {
+                chunk.error = current_exception();
+            }
+            chunk.ready = true;
+            {
+                lock_guard guard(mutex_);
+                parsed_[index] = move(chunk);
+            }
+            changed_.notify_all();
+        }
+    }
+};
+
+} // namespace
+
+DocumentRecord ParseTsvRecord(string_view line) {
+    DocumentRecord record;
+    string_view rest = line;
+    record.id = ParseInt(NextTsvField(rest, line), line);
+    record.status = ParseStatus(NextTsvField(rest, line), line);
+    ParseRatings(NextTsvField(rest, line), record.ratings, line);
+    record.text = rest;
+    return record;
+}
+
+DocumentRecord ParseJsonRecord(string_view line, deque<string>& storage) {
+    return JsonRecordParser(line, storage).Parse();
+}
+
+LoadStats LoadDocumentsFromBuffer(SearchServer& search_server, string_view data, const LoadOptions& options) {
+    const auto start_time = chrono::steady_clock::now();
+    LoadStats stats;
+    stats.bytes = data.size();
+
+    LoadPipeline pipeline(SplitIntoChunks(data, options.chunk_size), options);
+    for (size_t index = 0; index < pipeline.GetChunkCount(); ++index) {
+        const ParsedChunk chunk = pipeline.TakeChunk(index);
+        stats.skipped += chunk.skipped;
+        for (const DocumentRecord& record : chunk.records) {
+            try {
+                search_server.AddDocument(record.id, record.text, record.status, record.ratings);
+                ++stats.documents;
+            }
+            catch (const invalid_argument&) {
+                if (!options.skip_invalid) {
+                    throw;
+                }
+                ++stats.skipped;
+            }
+        }
+        pipeline.MarkInserted();
+    }
+
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    return stats;
+}
+
+LoadStats LoadDocuments(SearchServer& search_server, const string& path, const LoadOptions& options) {
+    const MappedFile file(path);
+    return LoadDocumentsFromBuffer(search_server, file.GetData(), options);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Массовая загрузка документов из дампа.
+//
+// TSV: одна строка - один документ, поля через табуляцию:
+//   id <TAB> status <TAB> ratings через пробел <TAB> text
+// JSONL: один JSON-объект на строку:
+//   {"id": 1, "status": "ACTUAL", "ratings": [1, 2, 3], "text": "funny pet"}
+// status - имя из DocumentStatus (ACTUAL, BANNED, ...) или его числовое значение.
+//
+// Файл отображается в память и режется на куски по границам строк. Куски разбираются
+// параллельно без копирования текста, а добавление в индекс идёт в вызывающем потоке
+// в исходном порядке, одновременно с разбором следующих кусков.
+
+enum class DumpFormat {
+    TSV,
+    JSONL,
+};
+
+struct LoadOptions {
+    DumpFormat format = DumpFormat::TSV;
+    size_t parser_threads = 0;            // 0 - по числу ядер
+    size_t chunk_size = 4 << 20;          // примерный размер куска в байтах
+    size_t max_chunks_in_flight = 0;      // 0 - вдвое больше потоков разбора
+    bool skip_invalid = false;            // пропускать некорректные записи вместо исключения
+};
+
+struct LoadStats {
+    size_t documents = 0;
+    size_t skipped = 0;
+    size_t bytes = 0;
+    double seconds = 0.0;
+
+    double DocumentsPerSecond() const {
+        return seconds > 0 ? documents / seconds : 0.0;
+    }
+    double MegabytesPerSecond() const {
+        return seconds > 0 ? bytes / seconds / (1 << 20) : 0.0;
+    }
+};
+
+struct DocumentRecord {
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string_view text;
+};
+
+LoadStats LoadDocuments(SearchServer& search_server, const std::string& path, const LoadOptions& options = {});
+
+// то же для дампа, уже лежащего в памяти
+LoadStats LoadDocumentsFromBuffer(SearchServer& search_server, std::string_view data, const LoadOptions& options = {});
+
+// разбор одной записи; строка без завершающего '\n'. Если в JSON-строке были escape-последовательности,
+// раскодированный текст кладётся в storage, иначе запись ссылается прямо на line.
+DocumentRecord ParseTsvRecord(std::string_view line);
+DocumentRecord ParseJsonRecord(std::string_view line, std::deque<std::string>& storage);
@@ -0,0 +1,92 @@
+#include "generators.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+string GenerateWord(mt19937& generator, int max_length) {
+    const int length = uniform_int_distribution(1, max_length)(generator);
+    string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(uniform_int_distribution(0, 26)(generator) + 'a');
+    }
+    return word;
+}
+
+vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
+    vector<string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    words.erase(unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob) {
+    string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    }
+    return query;
+}
+
+vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+ZipfDistribution::ZipfDistribution(size_t n, double exponent) {
+    cumulative_.reserve(n);
+    double sum = 0;
+    for (size_t k = 0; k < n; ++k) {
+        sum += 1.0 / pow(static_cast<double>(k + 1), exponent);
+        cumulative_.push_back(sum);
+    }
+}
+
+size_t ZipfDistribution::operator()(mt19937& generator) const {
+    const double value = uniform_real_distribution<>(0, cumulative_.back())(generator);
+    const auto it = upper_bound(cumulative_.begin(), cumulative_.end(), value);
+    return min(static_cast<size_t>(it - cumulative_.begin()), cumulative_.size() - 1);
+}
+
+string GenerateZipfQuery(mt19937& generator, const vector<string>& dictionary,
+    const ZipfDistribution& distribution, int word_count, double minus_prob)
+{
+    string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[distribution(generator)];
+    }
+    return query;
+}
+
+vector<string> GenerateZipfQueries(mt19937& generator, const vector<string>& dictionary,
+    double exponent, int query_count, int word_count, double minus_prob)
+{
+    const ZipfDistribution distribution(dictionary.size(), exponent);
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateZipfQuery(generator, dictionary, distribution, word_count, minus_prob));
+    }
+    return queries;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+//генераторы случайных слов, документов и запросов для тестов производительности
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count);
+
+// Распределение Ципфа на [0, n): вероятность индекса k пропорциональна 1 / (k + 1)^exponent.
+// Первые слова словаря получаются частыми, как служебные слова в живых текстах.
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t n, double exponent);
+
+    size_t operator()(std::mt19937& generator) const;
+
+private:
+    std::vector<double> cumulative_;
+};
+
+std::string GenerateZipfQuery(std::mt19937& generator, const std::vector<std::string>& dictionary,
+    const ZipfDistribution& distribution, int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateZipfQueries(std::mt19937& generator, const std::vector<std::string>& dictionary,
+    double exponent, int query_count, int word_count, double minus_prob = 0);
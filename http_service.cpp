@@ -0,0 +1,868 @@
+#include "http_service.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t MAX_HEADER_SIZE = 64 << 10;
+constexpr size_t MAX_BODY_SIZE = 16 << 20;
+constexpr size_t READ_CHUNK_SIZE = 64 << 10;
+constexpr size_t MAX_PAGE_SIZE = 1000;
+constexpr size_t MAX_TIMEOUT_MS = 60 * 60 * 1000;
+
+bool EqualsIgnoreCase(string_view lhs, string_view rhs) {
+    return lhs.size() == rhs.size() && equal(lhs.begin(), lhs.end(), rhs.begin(), [](char l, char r) {
+        return tolower(static_cast<unsigned char>(l)) == tolower(static_cast<unsigned char>(r));
+    });
+}
+
+string_view Trim(string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// обходит строки заголовков между стартовой строкой и пустой строкой
+template <typename Function>
+void ForEachHeader(string_view headers, Function function) {
+    while (!headers.empty()) {
+        const size_t line_end = headers.find("\r\n"sv);
+        const string_view line = headers.substr(0, line_end);
+        headers.remove_prefix(line_end == string_view::npos ? headers.size() : line_end + 2);
+        const size_t colon = line.find(':');
+        if (colon == string_view::npos) {
+            throw invalid_argument("Malformed HTTP header"s);
+        }
+        function(Trim(line.substr(0, colon)), Trim(line.substr(colon + 1)));
+    }
+}
+
+size_t ParseContentLength(string_view value) {
+    size_t length = 0;
+    const auto [end, error] = from_chars(value.data(), value.data() + value.size(), length);
+    if (error != errc() || end != value.data() + value.size()) {
+        throw invalid_argument("Bad Content-Length"s);
+    }
+    if (length > MAX_BODY_SIZE) {
+        throw invalid_argument("HTTP body is too large"s);
+    }
+    return length;
+}
+
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+string DecodeQueryComponent(string_view text) {
+    string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '+') {
+            result.push_back(' ');
+        }
+        else if (text[i] == '%') {
+            const int high = i + 2 < text.size() ? HexValue(text[i + 1]) : -1;
+            const int low = high >= 0 ? HexValue(text[i + 2]) : -1;
+            if (low < 0) {
+                throw invalid_argument("Bad percent-encoding in query string"s);
+            }
+            result.push_back(static_cast<char>(high * 16 + low));
+            i += 2;
+        }
+        else {
+            result.push_back(text[i]);
+        }
+    }
+    return result;
+}
+
+int ParseIntParameter(string_view query_string, string_view name) {
+    bool found = false;
+    const string text = GetQueryParameter(query_string, name, &found);
+    if (!found) {
+        throw invalid_argument("Missing parameter "s + string(name));
+    }
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (error != errc() || end != text.data() + text.size()) {
+        throw invalid_argument("Parameter "s + string(name) + " is not a number"s);
+    }
+    return value;
+}
+
+size_t ParseCountParameter(string_view query_string, string_view name, size_t default_value) {
+    bool found = false;
+    const string text = GetQueryParameter(query_string, name, &found);
+    if (!found) {
+        return default_value;
+    }
+    size_t value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (error != errc() || end != text.data() + text.size()) {
+        throw invalid_argument("Parameter "s + string(name) + " is not a number"s);
+    }
+    return value;
+}
+
+// курсор after=<relevance>,<rating>,<id> - поле next из ответа на предыдущую страницу
+optional<Document> ParseCursorParameter(string_view query_string) {
+    bool found = false;
+    const string text = GetQueryParameter(query_string, "after"sv, &found);
+    if (!found) {
+        return nullopt;
+    }
+    Document cursor;
+    const char* position = text.data();
+    const char* const last = text.data() + text.size();
+    auto result = from_chars(position, last, cursor.relevance);
+    if (result.ec == errc() && result.ptr != last && *result.ptr == ',') {
+        result = from_chars(result.ptr + 1, last, cursor.rating);
+        if (result.ec == errc() && result.ptr != last && *result.ptr == ',') {
+            result = from_chars(result.ptr + 1, last, cursor.id);
+            if (result.ec == errc() && result.ptr == last) {
+                return cursor;
+            }
+        }
+    }
+    throw invalid_argument("Bad cursor "s + text);
+}
+
+string RequireParameter(string_view query_string, string_view name) {
+    bool found = false;
+    string value = GetQueryParameter(query_string, name, &found);
+    if (!found) {
+        throw invalid_argument("Missing parameter "s + string(name));
+    }
+    return value;
+}
+
+constexpr string_view STATUS_NAMES[] = { "ACTUAL"sv, "IRRELEVANT"sv, "BANNED"sv, "REMOVED"sv };
+
+DocumentStatus ParseStatusParameter(string_view query_string) {
+    bool found = false;
+    const string text = GetQueryParameter(query_string, "status"sv, &found);
+    if (!found) {
+        return DocumentStatus::ACTUAL;
+    }
+    const auto it = find(begin(STATUS_NAMES), end(STATUS_NAMES), text);
+    if (it == end(STATUS_NAMES)) {
+        throw invalid_argument("Unknown status "s + text);
+    }
+    return static_cast<DocumentStatus>(it - begin(STATUS_NAMES));
+}
+
+vector<int> ParseRatingsParameter(string_view query_string) {
+    const string text = GetQueryParameter(query_string, "ratings"sv);
+    vector<int> ratings;
+    string_view rest = text;
+    while (!rest.empty()) {
+        const size_t comma = rest.find(',');
+        const string_view item = rest.substr(0, comma);
+        int rating = 0;
+        const auto [end, error] = from_chars(item.data(), item.data() + item.size(), rating);
+        if (error != errc() || end != item.data() + item.size()) {
+            throw invalid_argument("Bad rating "s + string(item));
+        }
+        ratings.push_back(rating);
+        rest.remove_prefix(comma == string_view::npos ? rest.size() : comma + 1);
+    }
+    return ratings;
+}
+
+//---- запись JSON прямо в выходной буфер ----
+
+void AppendJsonString(string& out, string_view text) {
+    out.push_back('"');
+    for (const char c : text) {
+        switch (c) {
+        case '"': out += "\\\""sv; break;
+        case '\\': out += "\\\\"sv; break;
+        case '\n': out += "\\n"sv; break;
+        case '\r': out += "\\r"sv; break;
+        case '\t': out += "\\t"sv; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                static constexpr char HEX[] = "0123456789abcdef";
+                out += "\\u00"sv;
+                out.push_back(HEX[c >> 4]);
+                out.push_back(HEX[c & 0xF]);
+            }
+            else {
+                out.push_back(c);
+            }
+        }
+    }
+    out.push_back('"');
+}
+
+template <typename Number>
+void AppendNumber(string& out, Number value) {
+    char buffer[32];
+    const auto [end, error] = to_chars(begin(buffer), std::end(buffer), value);
+    out.append(buffer, end);
+}
+
+void AppendSearchPage(string& out, const SearchPage& page, bool is_budgeted) {
+    out += "{\"documents\":["sv;
+    for (size_t i = 0; i < page.documents.size(); ++i) {
+        const Document& document = page.documents[i];
+        out += i == 0 ? "{\"id\":"sv : ",{\"id\":"sv;
+        AppendNumber(out, document.id);
+        out += ",\"relevance\":"sv;
+        AppendNumber(out, document.relevance);
+        out += ",\"rating\":"sv;
+        AppendNumber(out, document.rating);
+        out.push_back('}');
+    }
+    out += "],\"total\":"sv;
+    AppendNumber(out, page.total_count);
+    if (is_budgeted) {
+        out += page.is_truncated ? ",\"truncated\":true"sv : ",\"truncated\":false"sv;
+    }
+    if (page.next_cursor) {
+        out += ",\"next\":\""sv;
+        AppendNumber(out, page.next_cursor->relevance);
+        out.push_back(',');
+        AppendNumber(out, page.next_cursor->rating);
+        out.push_back(',');
+        AppendNumber(out, page.next_cursor->id);
+        out.push_back('"');
+    }
+    out.push_back('}');
+}
+
+void AppendDocumentCount(string& out, const SearchServer& server) {
+    out += "{\"document_count\":"sv;
+    AppendNumber(out, server.GetDocumentCount());
+    out.push_back('}');
+}
+
+string_view ReasonPhrase(int status) {
+    switch (status) {
+    case 200: return "OK"sv;
+    case 400: return "Bad Request"sv;
+    case 404: return "Not Found"sv;
+    case 405: return "Method Not Allowed"sv;
+    default: return "Internal Server Error"sv;
+    }
+}
+
+// тело ответа в out, возвращает код статуса
+int Route(SearchServer& server, const HttpRequest& request, string& out) {
+    const bool is_get = request.method == "GET"sv;
+    if (request.path == "/search"sv) {
+        if (!is_get) {
+            return 405;
+        }
+        const string query = RequireParameter(request.query_string, "query"sv);
+        PageRequest page;
+        page.offset = ParseCountParameter(request.query_string, "offset"sv, 0);
+        page.page_size = ParseCountParameter(request.query_string, "page_size"sv, MAX_RESULT_DOCUMENT_COUNT);
+        if (page.page_size == 0 || page.page_size > MAX_PAGE_SIZE) {
+            throw invalid_argument("page_size must be from 1 to "s + to_string(MAX_PAGE_SIZE));
+        }
+        page.search_after = ParseCursorParameter(request.query_string);
+        page.budget.max_postings = ParseCountParameter(request.query_string, "max_postings"sv, 0);
+        const size_t timeout_ms = ParseCountParameter(request.query_string, "timeout_ms"sv, 0);
+        if (timeout_ms > MAX_TIMEOUT_MS) {
+            throw invalid_argument("timeout_ms must be at most "s + to_string(MAX_TIMEOUT_MS));
+        }
+        if (timeout_ms > 0) {
+            page.budget.deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+        }
+        AppendSearchPage(out, server.FindPage(query, ParseStatusParameter(request.query_string), page),
+            !page.budget.IsUnlimited());
+        return 200;
+    }
+    if (request.path == "/match"sv) {
+        if (!is_get) {
+            return 405;
+        }
+        const int document_id = ParseIntParameter(request.query_string, "id"sv);
+        const string query = RequireParameter(request.query_string, "query"sv);
+        const auto [words, status] = server.MatchDocument(query, document_id);
+        out += "{\"words\":["sv;
+        for (size_t i = 0; i < words.size(); ++i) {
+            if (i > 0) {
+                out.push_back(',');
+            }
+            AppendJsonString(out, words[i]);
+        }
+        out += "],\"status\":"sv;
+        AppendJsonString(out, STATUS_NAMES[static_cast<int>(status)]);
+        out.push_back('}');
+        return 200;
+    }
+    if (request.path == "/documents"sv) {
+        if (request.method == "POST"sv) {
+            server.AddDocument(ParseIntParameter(request.query_string, "id"sv), request.body,
+                ParseStatusParameter(request.query_string), ParseRatingsParameter(request.query_string));
+        }
+        else if (request.method == "DELETE"sv) {
+            server.RemoveDocument(ParseIntParameter(request.query_string, "id"sv));
+        }
+        else if (request.method == "PATCH"sv) {
+            //меняется только переданное; всё разбирается заранее, чтобы ошибка не оставила документ изменённым наполовину
+            const int document_id = ParseIntParameter(request.query_string, "id"sv);
+            bool has_status = false;
+            bool has_ratings = false;
+            GetQueryParameter(request.query_string, "status"sv, &has_status);
+            GetQueryParameter(request.query_string, "ratings"sv, &has_ratings);
+            const DocumentStatus status = ParseStatusParameter(request.query_string);
+            const vector<int> ratings = ParseRatingsParameter(request.query_string);
+            if (!request.body.empty()) {
+                server.UpdateDocument(document_id, request.body);
+            }
+            if (has_status) {
+                server.SetStatus(document_id, status);
+            }
+            if (has_ratings) {
+                server.SetRatings(document_id, ratings);
+            }
+        }
+        else {
+            return 405;
+        }
+        AppendDocumentCount(out, server);
+        return 200;
+    }
+    if (request.path == "/stats"sv) {
+        if (!is_get) {
+            return 405;
+        }
+        AppendDocumentCount(out, server);
+        return 200;
+    }
+    return 404;
+}
+
+void AppendError(string& out, string_view message) {
+    out += "{\"error\":"sv;
+    AppendJsonString(out, message);
+    out.push_back('}');
+}
+
+void AppendHttpResponse(string& out, int status, bool keep_alive, string_view body) {
+    out += "HTTP/1.1 "sv;
+    AppendNumber(out, status);
+    out.push_back(' ');
+    out += ReasonPhrase(status);
+    out += "\r\nContent-Type: application/json\r\n"sv;
+    if (!keep_alive) {
+        out += "Connection: close\r\n"sv;
+    }
+    out += "Content-Length: "sv;
+    AppendNumber(out, body.size());
+    out += "\r\n\r\n"sv;
+    out += body;
+}
+
+// ParseHttpRequest, который для неполного запроса сообщает в required_size, сколько байт
+// займёт запрос целиком: больше этого из сокета читать незачем
+size_t ParseRequest(string_view data, HttpRequest& request, size_t& required_size) {
+    const size_t header_end = data.find("\r\n\r\n"sv);
+    if (header_end == string_view::npos) {
+        required_size = MAX_HEADER_SIZE + 4;
+        if (data.size() > MAX_HEADER_SIZE) {
+            throw invalid_argument("HTTP header is too large"s);
+        }
+        return 0;
+    }
+    const string_view head = data.substr(0, header_end);
+    const size_t line_end = head.find("\r\n"sv);
+    const string_view request_line = head.substr(0, line_end);
+    const size_t method_end = request_line.find(' ');
+    const size_t target_end = method_end == string_view::npos ? string_view::npos : request_line.find(' ', method_end + 1);
+    if (target_end == string_view::npos) {
+        throw invalid_argument("Malformed HTTP request line"s);
+    }
+    request = HttpRequest{};
+    request.method = request_line.substr(0, method_end);
+    const string_view target = request_line.substr(method_end + 1, target_end - method_end - 1);
+    const string_view version = request_line.substr(target_end + 1);
+    if (version != "HTTP/1.1"sv && version != "HTTP/1.0"sv) {
+        throw invalid_argument("Unsupported HTTP version"s);
+    }
+    request.keep_alive = version == "HTTP/1.1"sv;
+    const size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    if (question != string_view::npos) {
+        request.query_string = target.substr(question + 1);
+    }
+
+    size_t content_length = 0;
+    if (line_end != string_view::npos) {
+        ForEachHeader(head.substr(line_end + 2), [&](string_view name, string_view value) {
+            if (EqualsIgnoreCase(name, "Content-Length"sv)) {
+                content_length = ParseContentLength(value);
+            }
+            else if (EqualsIgnoreCase(name, "Connection"sv)) {
+                if (EqualsIgnoreCase(value, "close"sv)) {
+                    request.keep_alive = false;
+                }
+                else if (EqualsIgnoreCase(value, "keep-alive"sv)) {
+                    request.keep_alive = true;
+                }
+            }
+            else if (EqualsIgnoreCase(name, "Transfer-Encoding"sv)) {
+                throw invalid_argument("Transfer-Encoding is not supported"s);
+            }
+        });
+    }
+    const size_t body_begin = header_end + 4;
+    required_size = body_begin + content_length;
+    if (data.size() - body_begin < content_length) {
+        return 0;
+    }
+    request.body = data.substr(body_begin, content_length);
+    return body_begin + content_length;
+}
+
+} // namespace
+
+size_t ParseHttpRequest(string_view data, HttpRequest& request) {
+    size_t required_size = 0;
+    return ParseRequest(data, request, required_size);
+}
+
+string GetQueryParameter(string_view query_string, string_view name, bool* found) {
+    while (!query_string.empty()) {
+        const size_t amp = query_string.find('&');
+        const string_view pair = query_string.substr(0, amp);
+        query_string.remove_prefix(amp == string_view::npos ? query_string.size() : amp + 1);
+        const size_t equals = pair.find('=');
+        if (pair.substr(0, equals) == name) {
+            if (found) {
+                *found = true;
+            }
+            return equals == string_view::npos ? string() : DecodeQueryComponent(pair.substr(equals + 1));
+        }
+    }
+    if (found) {
+        *found = false;
+    }
+    return {};
+}
+
+void HandleHttpRequest(SearchServer& server, const HttpRequest& request, string& response) {
+    //тело собирается в буфере потока, который переиспользуется от запроса к запросу
+    thread_local string body;
+    body.clear();
+    int status = 500;
+    try {
+        status = Route(server, request, body);
+        if (status != 200) {
+            AppendError(body, ReasonPhrase(status));
+        }
+    }
+    catch (const invalid_argument& e) {
+        body.clear();
+        status = 400;
+        AppendError(body, e.what());
+    }
+    catch (const out_of_range&) {
+        body.clear();
+        status = 404;
+        AppendError(body, "Document not found"sv);
+    }
+    catch (const exception& e) {
+        body.clear();
+        status = 500;
+        AppendError(body, e.what());
+    }
+
+    AppendHttpResponse(response, status, request.keep_alive, body);
+}
+
+//==================== HttpSearchService ====================
+
+HttpSearchService::HttpSearchService(SearchServer& server, uint16_t port, string_view address)
+    : server_(server)
+{
+    sockaddr_in socket_address{};
+    socket_address.sin_family = AF_INET;
+    socket_address.sin_port = htons(port);
+    if (::inet_pton(AF_INET, string(address).c_str(), &socket_address.sin_addr) != 1) {
+        throw invalid_argument("Bad IPv4 address "s + string(address));
+    }
+    try {
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            throw system_error(errno, generic_category(), "HTTP socket"s);
+        }
+        const int enable = 1;
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&socket_address), sizeof(socket_address)) != 0
+            || ::listen(listen_fd_, SOMAXCONN) != 0)
+        {
+            throw system_error(errno, generic_category(), "Listen on port "s + to_string(port));
+        }
+        socklen_t length = sizeof(socket_address);
+        ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&socket_address), &length);
+        port_ = ntohs(socket_address.sin_port);
+
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        stop_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd_ < 0 || stop_fd_ < 0) {
+            throw system_error(errno, generic_category(), "epoll/eventfd"s);
+        }
+        for (const int fd : { listen_fd_, stop_fd_ }) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+                throw system_error(errno, generic_category(), "epoll_ctl"s);
+            }
+        }
+    }
+    catch (...) {
+        for (const int fd : { listen_fd_, epoll_fd_, stop_fd_ }) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        throw;
+    }
+}
+
+HttpSearchService::~HttpSearchService() {
+    for (const auto& [fd, connection] : connections_) {
+        ::close(fd);
+    }
+    ::close(listen_fd_);
+    ::close(epoll_fd_);
+    ::close(stop_fd_);
+}
+
+void HttpSearchService::Stop() {
+    const uint64_t one = 1;
+    //write допустим в обработчике сигнала; при переполнении счётчика остановка уже запрошена
+    [[maybe_unused]] const ssize_t written = ::write(stop_fd_, &one, sizeof(one));
+}
+
+void HttpSearchService::Run() {
+    epoll_event events[64];
+    while (true) {
+        const int count = ::epoll_wait(epoll_fd_, events, size(events), -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "epoll_wait"s);
+        }
+        for (int i = 0; i < count; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == stop_fd_) {
+                uint64_t value = 0;
+                [[maybe_unused]] const ssize_t received = ::read(stop_fd_, &value, sizeof(value));
+                return;
+            }
+            if (fd == listen_fd_) {
+                Accept();
+                continue;
+            }
+            const auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                continue;
+            }
+            bool alive = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                alive = OnReadable(fd, it->second);
+            }
+            if (alive && (events[i].events & EPOLLOUT)) {
+                alive = Flush(fd, it->second);
+            }
+            if (!alive) {
+                CloseConnection(fd);
+            }
+        }
+    }
+}
+
+void HttpSearchService::Accept() {
+    while (true) {
+        const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EMFILE || errno == ENFILE) {
+                return;
+            }
+            throw system_error(errno, generic_category(), "accept"s);
+        }
+        //ответы короткие, ждать склейки пакетов по Нейглу незачем
+        const int enable = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            ::close(fd);
+            continue;
+        }
+        Connection connection;
+        connection.input_limit = MAX_HEADER_SIZE + 4;
+        connections_.emplace(fd, move(connection));
+    }
+}
+
+bool HttpSearchService::OnReadable(int fd, Connection& connection) {
+    bool peer_closed = false;
+    //пока клиент не забирает ответы, новые запросы остаются в сокете
+    while (!connection.close_after_write && !connection.waiting_writable) {
+        //читаем не дальше конца первого необработанного запроса: заголовок не больше
+        //MAX_HEADER_SIZE, тело - не больше Content-Length
+        const size_t old_size = connection.input.size();
+        const size_t chunk_size = min(READ_CHUNK_SIZE, connection.input_limit - old_size);
+        connection.input.resize(old_size + chunk_size);
+        const ssize_t received = ::recv(fd, connection.input.data() + old_size, chunk_size, 0);
+        connection.input.resize(old_size + max<ssize_t>(received, 0));
+        if (received > 0) {
+            ProcessInput(connection);
+            if (!Flush(fd, connection)) {
+                return false;
+            }
+            continue;
+        }
+        if (received == 0) {
+            peer_closed = true;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        break;
+    }
+
+    if (peer_closed && connection.output.size() == connection.output_offset) {
+        return false;
+    }
+    if (peer_closed) {
+        connection.close_after_write = true;
+    }
+    return Flush(fd, connection);
+}
+
+void HttpSearchService::ProcessInput(Connection& connection) {
+    //в буфере может оказаться сразу несколько запросов (pipelining), отвечаем на все по порядку
+    size_t consumed = 0;
+    while (!connection.close_after_write) {
+        HttpRequest request;
+        size_t required_size = 0;
+        size_t length = 0;
+        try {
+            length = ParseRequest(string_view(connection.input).substr(consumed), request, required_size);
+        }
+        catch (const invalid_argument& e) {
+            string body;
+            AppendError(body, e.what());
+            AppendHttpResponse(connection.output, 400, false, body);
+            connection.close_after_write = true;
+            break;
+        }
+        if (length == 0) {
+            connection.input_limit = required_size;
+            break;
+        }
+        HandleHttpRequest(server_, request, connection.output);
+        connection.close_after_write = !request.keep_alive;
+        consumed += length;
+    }
+    connection.input.erase(0, consumed);
+}
+
+bool HttpSearchService::Flush(int fd, Connection& connection) {
+    while (connection.output_offset < connection.output.size()) {
+        const ssize_t written = ::send(fd, connection.output.data() + connection.output_offset,
+            connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return false;
+            }
+            //сокет заполнен - допишем, когда epoll сообщит о свободном месте; до тех пор
+            //не читаем, иначе конвейер запросов копил бы ответы в output без ограничения
+            if (!connection.waiting_writable) {
+                epoll_event event{};
+                event.events = EPOLLOUT;
+                event.data.fd = fd;
+                ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event);
+                connection.waiting_writable = true;
+            }
+            return true;
+        }
+        connection.output_offset += static_cast<size_t>(written);
+    }
+    connection.output.clear();
+    connection.output_offset = 0;
+    if (connection.close_after_write) {
+        return false;
+    }
+    if (connection.waiting_writable) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event);
+        connection.waiting_writable = false;
+    }
+    return true;
+}
+
+void HttpSearchService::CloseConnection(int fd) {
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    connections_.erase(fd);
+}
+
+//==================== HttpClient ====================
+
+HttpClient::HttpClient(string_view address, uint16_t port) {
+    sockaddr_in socket_address{};
+    socket_address.sin_family = AF_INET;
+    socket_address.sin_port = htons(port);
+    if (::inet_pton(AF_INET, string(address).c_str(), &socket_address.sin_addr) != 1) {
+        throw invalid_argument("Bad IPv4 address "s + string(address));
+    }
+    socket_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_fd_ < 0) {
+        throw system_error(errno, generic_category(), "HTTP client socket"s);
+    }
+    if (::connect(socket_fd_, reinterpret_cast<const sockaddr*>(&socket_address), sizeof(socket_address)) != 0) {
+        const int error = errno;
+        ::close(socket_fd_);
+        throw system_error(error, generic_category(), "Connect to "s + string(address) + ":"s + to_string(port));
+    }
+    const int enable = 1;
+    ::setsockopt(socket_fd_, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+}
+
+HttpClient::~HttpClient() {
+    ::close(socket_fd_);
+}
+
+HttpClient::Response HttpClient::Request(string_view method, string_view target, string_view body) {
+    string request;
+    request.reserve(method.size() + target.size() + body.size() + 64);
+    request += method;
+    request.push_back(' ');
+    request += target;
+    request += " HTTP/1.1\r\nHost: localhost\r\nContent-Length: "sv;
+    AppendNumber(request, body.size());
+    request += "\r\n\r\n"sv;
+    request += body;
+    for (size_t sent = 0; sent < request.size();) {
+        const ssize_t written = ::send(socket_fd_, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "HTTP client write"s);
+        }
+        sent += static_cast<size_t>(written);
+    }
+
+    //читаем, пока в буфере не окажется ответ целиком
+    size_t header_end = string::npos;
+    size_t total_size = 0;
+    Response response;
+    while (true) {
+        if (header_end == string::npos) {
+            header_end = buffer_.find("\r\n\r\n"sv);
+            if (header_end != string::npos) {
+                const string_view head = string_view(buffer_).substr(0, header_end);
+                const size_t line_end = head.find("\r\n"sv);
+                const string_view status_line = head.substr(0, line_end);
+                const size_t space = status_line.find(' ');
+                if (space == string_view::npos
+                    || from_chars(status_line.data() + space + 1, status_line.data() + status_line.size(), response.status).ec != errc())
+                {
+                    throw runtime_error("Malformed HTTP status line"s);
+                }
+                size_t content_length = 0;
+                if (line_end != string_view::npos) {
+                    ForEachHeader(head.substr(line_end + 2), [&](string_view name, string_view value) {
+                        if (EqualsIgnoreCase(name, "Content-Length"sv)) {
+                            content_length = ParseContentLength(value);
+                        }
+                    });
+                }
+                total_size = header_end + 4 + content_length;
+            }
+        }
+        if (header_end != string::npos && buffer_.size() >= total_size) {
+            break;
+        }
+        char chunk[16 << 10];
+        const ssize_t received = ::recv(socket_fd_, chunk, sizeof(chunk), 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "HTTP client read"s);
+        }
+        if (received == 0) {
+            throw runtime_error("HTTP server closed the connection"s);
+        }
+        buffer_.append(chunk, static_cast<size_t>(received));
+    }
+    response.body = buffer_.substr(header_end + 4, total_size - header_end - 4);
+    buffer_.erase(0, total_size);
+    return response;
+}
+
+string EncodeQueryComponent(string_view text) {
+    static constexpr char HEX[] = "0123456789ABCDEF";
+    string result;
+    result.reserve(text.size());
+    for (const char c : text) {
+        const unsigned char byte = static_cast<unsigned char>(c);
+        if (isalnum(byte) || c == '-' || c == '_' || c == '.' || c == '~') {
+            result.push_back(c);
+        }
+        else if (c == ' ') {
+            result.push_back('+');
+        }
+        else {
+            result.push_back('%');
+            result.push_back(HEX[byte >> 4]);
+            result.push_back(HEX[byte & 0xF]);
+        }
+    }
+    return result;
+}
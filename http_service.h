@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "search_server.h"
+
+// HTTP/JSON-фронтенд SearchServer: один поток, epoll, keep-alive.
+//
+//   GET    /search?query=fluffy+cat[&status=ACTUAL][&page_size=5][&offset=0][&after=<next>]
+//                  [&max_postings=100000][&timeout_ms=20]
+//          {"documents":[{"id":2,"relevance":0.65,"rating":5}],"total":12,"next":"0.65,5,2"}
+//          next есть, пока выдача не кончилась; after=<next> возвращает следующую страницу.
+//          max_postings и timeout_ms - бюджет запроса (FindTopDocumentsWithBudget), срок отсчитывается
+//          от разбора запроса; с бюджетом в ответе есть "truncated":true|false
+//   GET    /match?id=2&query=fluffy+cat
+//          {"words":["cat","fluffy"],"status":"ACTUAL"}
+//   POST   /documents?id=2[&status=ACTUAL][&ratings=7,2,7]   тело запроса - текст документа
+//   PATCH  /documents?id=2[&status=BANNED][&ratings=1,2]    текст меняется, если есть тело запроса
+//   DELETE /documents?id=2
+//   GET    /stats
+//          {"document_count":3}
+//
+// Некорректный запрос - 400 и {"error":"..."}, неизвестный путь или документ для PATCH - 404.
+// Все запросы к SearchServer выполняются в потоке Run(), поэтому изменения индекса
+// и поиск не пересекаются. Из сокета читается не больше одного недочитанного запроса
+// (заголовок до 64 КБ плюс тело по Content-Length, до 16 МБ), а пока клиент не забирает
+// ответы, чтение приостанавливается.
+//
+//   SearchServer server(stop_words);
+//   HttpSearchService service(server, 8080);
+//   service.Run(); //до Stop() из другого потока или обработчика сигнала
+
+struct HttpRequest {
+    // ссылаются на входной буфер соединения и живут до конца обработки запроса
+    std::string_view method;
+    std::string_view path;
+    std::string_view query_string;
+    std::string_view body;
+    bool keep_alive = true;
+};
+
+// разбирает запрос в начале data. Возвращает длину запроса в байтах или 0, если он пришёл
+// не полностью; на синтаксической ошибке бросает invalid_argument
+size_t ParseHttpRequest(std::string_view data, HttpRequest& request);
+
+// значение параметра из строки запроса с раскодированием %XX и '+'; в found - был ли параметр
+std::string GetQueryParameter(std::string_view query_string, std::string_view name, bool* found = nullptr);
+
+// кодирование значения для строки запроса: пробел -> '+', прочие спецсимволы -> %XX
+std::string EncodeQueryComponent(std::string_view text);
+
+// дописывает в response полный HTTP-ответ на запрос
+void HandleHttpRequest(SearchServer& server, const HttpRequest& request, std::string& response);
+
+class HttpSearchService {
+public:
+    // port 0 - выбрать свободный, узнать его можно через GetPort()
+    HttpSearchService(SearchServer& server, uint16_t port, std::string_view address = "127.0.0.1");
+    ~HttpSearchService();
+
+    HttpSearchService(const HttpSearchService&) = delete;
+    HttpSearchService& operator=(const HttpSearchService&) = delete;
+
+    uint16_t GetPort() const {
+        return port_;
+    }
+
+    // цикл обработки событий; возвращается после Stop()
+    void Run();
+    // можно вызывать из любого потока и из обработчика сигнала
+    void Stop();
+
+private:
+    struct Connection {
+        std::string input;
+        // сколько байт может занять input: до конца первого необработанного запроса
+        size_t input_limit = 0;
+        std::string output;
+        size_t output_offset = 0;
+        bool close_after_write = false;
+        bool waiting_writable = false;
+    };
+
+    SearchServer& server_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int stop_fd_ = -1;
+    uint16_t port_ = 0;
+    std::unordered_map<int, Connection> connections_;
+
+    void Accept();
+    // false - соединение надо закрыть
+    bool OnReadable(int fd, Connection& connection);
+    // отвечает на все полные запросы из input и обновляет input_limit
+    void ProcessInput(Connection& connection);
+    bool Flush(int fd, Connection& connection);
+    void CloseConnection(int fd);
+};
+
+// блокирующий клиент с одним keep-alive соединением - для тестов и генератора нагрузки
+class HttpClient {
+public:
+    struct Response {
+        int status = 0;
+        std::string body;
+    };
+
+    HttpClient(std::string_view address, uint16_t port);
+    ~HttpClient();
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    Response Request(std::string_view method, std::string_view target, std::string_view body = {});
+
+private:
+    int socket_fd_ = -1;
+    std::string buffer_;
+};
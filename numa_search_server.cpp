@@ -0,0 +1,284 @@
+#include "numa_search_server.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sched.h>
+#include <stdexcept>
+
+#if defined(SEARCH_SERVER_HAS_LIBNUMA)
+#include <numa.h>
+#endif
+
+using namespace std;
+
+vector<int> ParseCpuList(string_view text) {
+    vector<int> cpus;
+    while (!text.empty()) {
+        const size_t range_end = min(text.find(','), text.size());
+        const string_view range = text.substr(0, range_end);
+        text.remove_prefix(min(range_end + 1, text.size()));
+        int first = 0;
+        int last = 0;
+        const auto [first_end, first_error] = from_chars(range.data(), range.data() + range.size(), first);
+        if (first_error != errc{}) {
+            continue; //перевод строки в конце файла и пустые части
+        }
+        last = first;
+        if (first_end != range.data() + range.size() && *first_end == '-') {
+            from_chars(first_end + 1, range.data() + range.size(), last);
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+//процессоры, на которых процессу разрешено работать (taskset, cgroups)
+static vector<int> GetAllowedCpus() {
+    vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        for (int cpu = 0; cpu < static_cast<int>(max(1u, thread::hardware_concurrency())); ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+vector<NumaNode> GetNumaNodes() {
+    const vector<int> allowed = GetAllowedCpus();
+    vector<NumaNode> nodes;
+    error_code error;
+    for (const filesystem::directory_entry& entry : filesystem::directory_iterator("/sys/devices/system/node"s, error)) {
+        const string name = entry.path().filename().string();
+        NumaNode node;
+        if (name.rfind("node"s, 0) != 0 || from_chars(name.data() + 4, name.data() + name.size(), node.id).ec != errc{}) {
+            continue;
+        }
+        ifstream cpulist(entry.path() / "cpulist"s);
+        const string text((istreambuf_iterator<char>(cpulist)), istreambuf_iterator<char>());
+        for (const int cpu : ParseCpuList(text)) {
+            if (binary_search(allowed.begin(), allowed.end(), cpu)) {
+                node.cpus.push_back(cpu);
+            }
+        }
+        //узлы только с памятью и узлы вне маски процесса потоков не получают
+        if (!node.cpus.empty()) {
+            nodes.push_back(move(node));
+        }
+    }
+    if (nodes.empty()) {
+        nodes.push_back({ 0, allowed });
+    }
+    sort(nodes.begin(), nodes.end(), [](const NumaNode& lhs, const NumaNode& rhs) { return lhs.id < rhs.id; });
+    return nodes;
+}
+
+bool PinCurrentThread(const vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return !cpus.empty() && sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+bool SetPreferredMemoryNode(int node) {
+#if defined(SEARCH_SERVER_HAS_LIBNUMA)
+    if (numa_available() < 0) {
+        return false;
+    }
+    numa_set_preferred(node);
+    return true;
+#else
+    return false;
+#endif
+}
+
+struct NumaSearchServer::Node {
+    NumaNode topology;
+    unique_ptr<SearchServer> replica;
+    vector<thread> workers;
+    //доля узла в текущем пакете - запросы [next, end)
+    atomic<size_t> next = 0;
+    size_t end = 0;
+};
+
+NumaSearchServer::NumaSearchServer(const string& stop_words, const Builder& build)
+    : NumaSearchServer(stop_words, build, Options{})
+{}
+
+NumaSearchServer::NumaSearchServer(const string& stop_words, const Builder& build, Options options)
+    : options_(options)
+{
+    vector<NumaNode> topology = GetNumaNodes();
+    if (options_.max_nodes > 0 && topology.size() > options_.max_nodes) {
+        topology.resize(options_.max_nodes);
+    }
+    for (NumaNode& node_topology : topology) {
+        nodes_.push_back(make_unique<Node>());
+        nodes_.back()->topology = move(node_topology);
+    }
+
+    //копии строятся одновременно, каждая потоком своего узла - её страницы выделяются там же
+    vector<exception_ptr> failures(nodes_.size());
+    vector<char> has_policy(nodes_.size());
+    vector<thread> builders;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        builders.emplace_back([&, i] {
+            Node& node = *nodes_[i];
+            PinCurrentThread(node.topology.cpus);
+            has_policy[i] = SetPreferredMemoryNode(node.topology.id);
+            try {
+                node.replica = make_unique<SearchServer>(stop_words);
+                build(*node.replica);
+            }
+            catch (...) {
+                failures[i] = current_exception();
+            }
+        });
+    }
+    for (thread& builder : builders) {
+        builder.join();
+    }
+    for (const exception_ptr& failure : failures) {
+        if (failure) {
+            rethrow_exception(failure);
+        }
+    }
+    has_memory_policy_ = all_of(has_policy.begin(), has_policy.end(), [](char value) { return value != 0; });
+
+    for (const unique_ptr<Node>& node : nodes_) {
+        const vector<int>& cpus = node->topology.cpus;
+        const size_t worker_count = options_.workers_per_node > 0 ? options_.workers_per_node : cpus.size();
+        for (size_t i = 0; i < worker_count; ++i) {
+            node->workers.emplace_back([this, &node = *node, cpu = cpus[i % cpus.size()]] { WorkerLoop(node, cpu); });
+        }
+    }
+}
+
+NumaSearchServer::~NumaSearchServer() {
+    lock_guard batch(batch_mutex_);
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    has_work_.notify_all();
+    for (const unique_ptr<Node>& node : nodes_) {
+        for (thread& worker : node->workers) {
+            worker.join();
+        }
+    }
+}
+
+const NumaNode& NumaSearchServer::GetNode(size_t index) const {
+    return nodes_.at(index)->topology;
+}
+
+const SearchServer& NumaSearchServer::GetReplica(size_t index) const {
+    return *nodes_.at(index)->replica;
+}
+
+size_t NumaSearchServer::GetWorkerCount() const {
+    size_t count = 0;
+    for (const unique_ptr<Node>& node : nodes_) {
+        count += node->workers.size();
+    }
+    return count;
+}
+
+vector<vector<Document>> NumaSearchServer::ProcessQueries(const vector<string>& queries) {
+    vector<vector<Document>> results(queries.size());
+    if (queries.empty()) {
+        return results;
+    }
+    lock_guard batch(batch_mutex_);
+    //доли узлов пропорциональны числу их потоков
+    const size_t worker_count = GetWorkerCount();
+    size_t begin = 0;
+    size_t workers_before = 0;
+    for (const unique_ptr<Node>& node : nodes_) {
+        workers_before += node->workers.size();
+        node->next.store(begin, memory_order_relaxed);
+        node->end = queries.size() * workers_before / worker_count;
+        begin = node->end;
+    }
+    {
+        lock_guard guard(mutex_);
+        queries_ = &queries;
+        results_ = &results;
+        budget_ = options_.limits.MakeBudget(chrono::steady_clock::now());
+        failure_ = nullptr;
+        active_workers_ = worker_count;
+        ++generation_;
+    }
+    has_work_.notify_all();
+    unique_lock lock(mutex_);
+    done_.wait(lock, [this] { return active_workers_ == 0; });
+    if (failure_) {
+        rethrow_exception(failure_);
+    }
+    return results;
+}
+
+void NumaSearchServer::RunQueries(Node& from, const SearchServer& replica) {
+    for (size_t index = from.next.fetch_add(1, memory_order_relaxed); index < from.end;
+        index = from.next.fetch_add(1, memory_order_relaxed))
+    {
+        (*results_)[index] = budget_.IsUnlimited()
+            ? replica.FindTopDocuments((*queries_)[index])
+            : replica.FindTopDocumentsWithBudget((*queries_)[index], DocumentStatus::ACTUAL, budget_).documents;
+    }
+}
+
+void NumaSearchServer::WorkerLoop(Node& node, int cpu) {
+    if (options_.pin_workers) {
+        PinCurrentThread({ cpu });
+    }
+    //арена запросов потока тоже выделяется на его узле
+    SetPreferredMemoryNode(node.topology.id);
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            unique_lock lock(mutex_);
+            has_work_.wait(lock, [&] { return stopping_ || generation_ != seen_generation; });
+            if (stopping_) {
+                return;
+            }
+            seen_generation = generation_;
+        }
+        try {
+            //сначала своя доля, потом чужие - по копии своего узла
+            const size_t own = static_cast<size_t>(find_if(nodes_.begin(), nodes_.end(),
+                [&node](const unique_ptr<Node>& other) { return other.get() == &node; }) - nodes_.begin());
+            for (size_t i = 0; i < nodes_.size(); ++i) {
+                RunQueries(*nodes_[(own + i) % nodes_.size()], *node.replica);
+            }
+        }
+        catch (...) {
+            lock_guard guard(mutex_);
+            if (!failure_) {
+                failure_ = current_exception();
+            }
+        }
+        lock_guard guard(mutex_);
+        if (--active_workers_ == 0) {
+            done_.notify_all();
+        }
+    }
+}
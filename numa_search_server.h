@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Пакетный поиск на многосокетной машине без обращений к памяти чужого узла NUMA.
+//
+// У каждого узла своя копия индекса и свои рабочие потоки, каждый закреплён за ядром узла.
+// Копию строит поток, закреплённый на узле: страница достаётся памяти узла, где её впервые
+// коснулись, а с libnuma память потока ещё и явно предпочитает его узел. Пакет запросов делится
+// между узлами по числу их потоков; закончив свою долю, поток берёт запросы других узлов, но
+// выполняет их по копии своего узла - копии одинаковые.
+// На машине без NUMA (или с max_nodes = 1) остаётся одна копия и пул закреплённых потоков.
+// С limits запросы выполняются с бюджетом (FindTopDocumentsWithBudget), срок отсчитывается от
+// вызова ProcessQueries - это задержка пакета, которую видит вызывающий.
+//
+//   NumaSearchServer numa_server("and in on"s, [&documents](SearchServer& replica) { Fill(replica, documents); });
+//   std::vector<std::vector<Document>> results = numa_server.ProcessQueries(queries);
+
+// узел NUMA и процессоры на нём, доступные процессу
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus;
+};
+
+// список процессоров в формате sysfs: "0-3,8,10-11"
+std::vector<int> ParseCpuList(std::string_view text);
+
+// узлы из /sys/devices/system/node с процессорами из sched_getaffinity; без NUMA - один узел
+std::vector<NumaNode> GetNumaNodes();
+
+// закрепляет вызывающий поток за процессорами; false - не удалось
+bool PinCurrentThread(const std::vector<int>& cpus);
+
+// память вызывающего потока выделяется на узле node; false - без libnuma, остаётся первое касание
+bool SetPreferredMemoryNode(int node);
+
+class NumaSearchServer {
+public:
+    struct Options {
+        size_t max_nodes = 0;           // 0 - все узлы; 1 - одна копия индекса
+        size_t workers_per_node = 0;    // 0 - по потоку на процессор узла
+        bool pin_workers = true;
+        QueryLimits limits;             // по умолчанию без ограничений
+    };
+    using Builder = std::function<void(SearchServer&)>;
+
+    // build заполняет копию и вызывается в потоке её узла, для всех узлов одновременно;
+    // копии должны получиться одинаковыми
+    NumaSearchServer(const std::string& stop_words, const Builder& build);
+    NumaSearchServer(const std::string& stop_words, const Builder& build, Options options);
+    // ждёт выполняемый пакет
+    ~NumaSearchServer();
+
+    NumaSearchServer(const NumaSearchServer&) = delete;
+    NumaSearchServer& operator=(const NumaSearchServer&) = delete;
+
+    // то же, что ProcessQueries из process_queries.h; пакеты из разных потоков выполняются по очереди
+    std::vector<std::vector<Document>> ProcessQueries(const std::vector<std::string>& queries);
+
+    size_t GetNodeCount() const {
+        return nodes_.size();
+    }
+    const NumaNode& GetNode(size_t index) const;
+    const SearchServer& GetReplica(size_t index) const;
+    size_t GetWorkerCount() const;
+    // память копий размещена политикой libnuma, а не только первым касанием
+    bool HasMemoryPolicy() const {
+        return has_memory_policy_;
+    }
+
+private:
+    struct Node;
+
+    const Options options_;
+    std::vector<std::unique_ptr<Node>> nodes_;
+    bool has_memory_policy_ = true;
+
+    std::mutex batch_mutex_;            // один пакет за раз
+    std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0;           // номер текущего пакета
+    size_t active_workers_ = 0;
+    const std::vector<std::string>* queries_ = nullptr;
+    QueryBudget budget_;                // бюджет запросов текущего пакета
+    std::vector<std::vector<Document>>* results_ = nullptr;
+    std::exception_ptr failure_;
+    bool stopping_ = false;
+
+    void WorkerLoop(Node& node, int cpu);
+    // выполняет по копии replica запросы из доли узла from, пока они не кончатся
+    void RunQueries(Node& from, const SearchServer& replica);
+};
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
+#include <iterator>
+#include <stdexcept>
 
 template <typename Iterator>
 class IteratorRange {
@@ -33,29 +37,80 @@ std::ostream& operator<<(std::ostream& out, const IteratorRange<Iterator>& range
     return out;
 }
 
+//страницы не хранятся: итератор строит IteratorRange очередной страницы на лету,
+//поэтому ни создание Paginator, ни переход к далёкой странице не проходят по всем предыдущим
 template <typename Iterator>
 class Paginator {
 public:
-    Paginator(Iterator begin, Iterator end, size_t page_size) {
-        for (size_t left = std::distance(begin, end); left > 0;) {
-            const size_t current_page_size = std::min(page_size, left);
-            const Iterator current_page_end = std::next(begin, current_page_size);
-            pages_.push_back({begin, current_page_end});
-            left -= current_page_size;
-            begin = current_page_end;
+    class PageIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = IteratorRange<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        PageIterator(Iterator page_begin, size_t left, size_t page_size)
+            : page_begin_(page_begin)
+            , left_(left)
+            , page_size_(page_size) {
+        }
+        value_type operator*() const {
+            return { page_begin_, std::next(page_begin_, std::min(page_size_, left_)) };
+        }
+        PageIterator& operator++() {
+            const size_t step = std::min(page_size_, left_);
+            std::advance(page_begin_, step);
+            left_ -= step;
+            return *this;
+        }
+        PageIterator operator++(int) {
+            PageIterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        bool operator==(const PageIterator& other) const {
+            return left_ == other.left_;
+        }
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
+    private:
+        Iterator page_begin_;
+        size_t left_;
+        size_t page_size_;
+    };
+
+    Paginator(Iterator begin, Iterator end, size_t page_size)
+        : begin_(begin)
+        , end_(end)
+        , page_size_(page_size)
+        , item_count_(std::distance(begin, end)) {
+        if (page_size == 0) {
+            throw std::invalid_argument("Page size must be positive");
         }
     }
-    auto begin() const {
-        return pages_.begin();
+    PageIterator begin() const {
+        return { begin_, item_count_, page_size_ };
     }
-    auto end() const {
-        return pages_.end();
+    PageIterator end() const {
+        return { end_, 0, page_size_ };
     }
     size_t size() const {
-        return pages_.size();
+        return (item_count_ + page_size_ - 1) / page_size_;
+    }
+    //страница с номером index от нуля; для итераторов произвольного доступа - за O(1)
+    IteratorRange<Iterator> Page(size_t index) const {
+        if (index >= size()) {
+            throw std::out_of_range("Page index is out of range");
+        }
+        return *PageIterator(std::next(begin_, index * page_size_), item_count_ - index * page_size_, page_size_);
     }
 private:
-    std::vector<IteratorRange<Iterator>> pages_;
+    Iterator begin_;
+    Iterator end_;
+    size_t page_size_;
+    size_t item_count_;
 };
 
 template <typename Container>
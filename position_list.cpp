@@ -0,0 +1,102 @@
+#include "position_list.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+EncodedPositions EncodePositions(const PositionList& positions) {
+    EncodedPositions encoded;
+    encoded.reserve(positions.size());
+    uint32_t previous = 0;
+    for (const uint32_t position : positions) {
+        uint32_t delta = position - previous;
+        previous = position;
+        while (delta >= 0x80) {
+            encoded.push_back(static_cast<uint8_t>(delta | 0x80));
+            delta >>= 7;
+        }
+        encoded.push_back(static_cast<uint8_t>(delta));
+    }
+    encoded.shrink_to_fit();
+    return encoded;
+}
+
+PositionList DecodePositions(const EncodedPositions& encoded) {
+    PositionList positions;
+    positions.reserve(encoded.size());
+    uint32_t position = 0;
+    uint32_t delta = 0;
+    int shift = 0;
+    for (const uint8_t byte : encoded) {
+        delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte & 0x80) {
+            shift += 7;
+            continue;
+        }
+        position += delta;
+        positions.push_back(position);
+        delta = 0;
+        shift = 0;
+    }
+    return positions;
+}
+
+bool ContainsPhrase(const vector<PositionList>& word_positions) {
+    if (word_positions.empty()) {
+        return false;
+    }
+    //по одному курсору на слово; все списки отсортированы, поэтому курсоры только растут
+    vector<size_t> cursors(word_positions.size(), 0);
+    for (const uint32_t start : word_positions[0]) {
+        bool matched = true;
+        for (size_t i = 1; i < word_positions.size(); ++i) {
+            const PositionList& positions = word_positions[i];
+            const uint32_t expected = start + static_cast<uint32_t>(i);
+            size_t& cursor = cursors[i];
+            while (cursor < positions.size() && positions[cursor] < expected) {
+                ++cursor;
+            }
+            if (cursor == positions.size()) {
+                return false;
+            }
+            if (positions[cursor] != expected) {
+                matched = false;
+                break;
+            }
+        }
+        if (matched) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ContainsWithinWindow(const vector<PositionList>& word_positions, uint32_t slop) {
+    if (word_positions.empty()) {
+        return false;
+    }
+    const uint64_t max_span = word_positions.size() - 1 + static_cast<uint64_t>(slop);
+    //окно из текущих позиций всех слов; каждый шаг сдвигает самое левое слово
+    vector<size_t> cursors(word_positions.size(), 0);
+    while (true) {
+        uint32_t min_position = numeric_limits<uint32_t>::max();
+        uint32_t max_position = 0;
+        size_t min_word = 0;
+        for (size_t i = 0; i < word_positions.size(); ++i) {
+            if (cursors[i] == word_positions[i].size()) {
+                return false;
+            }
+            const uint32_t position = word_positions[i][cursors[i]];
+            if (position < min_position) {
+                min_position = position;
+                min_word = i;
+            }
+            max_position = max(max_position, position);
+        }
+        if (max_position - min_position <= max_span) {
+            return true;
+        }
+        ++cursors[min_word];
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Позиции слова в документе хранятся сжатыми: разности соседних позиций в формате varint
+// (7 бит на байт, старший бит - признак продолжения). Короткие расстояния занимают один байт.
+
+using PositionList = std::vector<uint32_t>;
+using EncodedPositions = std::vector<uint8_t>;
+
+EncodedPositions EncodePositions(const PositionList& positions);
+
+PositionList DecodePositions(const EncodedPositions& encoded);
+
+// есть ли позиция p такая, что слово i стоит на позиции p + i для всех i (точная фраза)
+bool ContainsPhrase(const std::vector<PositionList>& word_positions);
+
+// есть ли окно, в котором встречаются все слова в любом порядке и между крайними словами
+// не больше slop посторонних: max - min <= (число слов - 1) + slop
+bool ContainsWithinWindow(const std::vector<PositionList>& word_positions, uint32_t slop);
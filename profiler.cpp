@@ -0,0 +1,224 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+
+namespace profiling {
+
+size_t Histogram::GetBucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    int exponent = 63;
+    while ((value >> exponent) == 0) {
+        --exponent;
+    }
+    const int shift = exponent - SUB_BUCKET_BITS;
+    return static_cast<size_t>((shift + 1) * SUB_BUCKET_COUNT + ((value >> shift) - SUB_BUCKET_COUNT));
+}
+
+uint64_t Histogram::GetBucketLowerBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    const uint64_t shift = index / SUB_BUCKET_COUNT - 1;
+    return (SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT) << shift;
+}
+
+void Histogram::Record(uint64_t value) {
+    //писатель у гистограммы один, поэтому хватает обычных load/store без read-modify-write
+    auto& bucket = buckets_[GetBucketIndex(value)];
+    bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    count_.store(count_.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    total_.store(total_.load(memory_order_relaxed) + value, memory_order_relaxed);
+    if (value > max_.load(memory_order_relaxed)) {
+        max_.store(value, memory_order_relaxed);
+    }
+}
+
+uint64_t Histogram::GetCount() const {
+    return count_.load(memory_order_relaxed);
+}
+
+uint64_t Histogram::GetTotal() const {
+    return total_.load(memory_order_relaxed);
+}
+
+uint64_t Histogram::GetMax() const {
+    return max_.load(memory_order_relaxed);
+}
+
+uint64_t Histogram::GetValueAtQuantile(double quantile) const {
+    uint64_t count = 0;
+    for (const auto& bucket : buckets_) {
+        count += bucket.load(memory_order_relaxed);
+    }
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(quantile * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t index = 0; index < BUCKET_COUNT; ++index) {
+        seen += buckets_[index].load(memory_order_relaxed);
+        if (seen >= rank) {
+            return min(GetBucketLowerBound(index), GetMax());
+        }
+    }
+    return GetMax();
+}
+
+void Histogram::Merge(const Histogram& other) {
+    for (size_t index = 0; index < BUCKET_COUNT; ++index) {
+        buckets_[index].fetch_add(other.buckets_[index].load(memory_order_relaxed), memory_order_relaxed);
+    }
+    count_.fetch_add(other.GetCount(), memory_order_relaxed);
+    total_.fetch_add(other.GetTotal(), memory_order_relaxed);
+    max_.store(max(GetMax(), other.GetMax()), memory_order_relaxed);
+}
+
+ThreadMetrics::~ThreadMetrics() {
+    for (auto& stage : stages_) {
+        delete stage.load(memory_order_relaxed);
+    }
+}
+
+void ThreadMetrics::RecordDuration(size_t stage_id, uint64_t nanoseconds) {
+    Histogram* histogram = stages_[stage_id].load(memory_order_relaxed);
+    if (histogram == nullptr) {
+        histogram = new Histogram;
+        stages_[stage_id].store(histogram, memory_order_release);
+    }
+    histogram->Record(nanoseconds);
+}
+
+void ThreadMetrics::Merge(const ThreadMetrics& other) {
+    for (size_t stage_id = 0; stage_id < MAX_STAGES; ++stage_id) {
+        if (const Histogram* histogram = other.GetStageHistogram(stage_id)) {
+            Histogram* own = stages_[stage_id].load(memory_order_relaxed);
+            if (own == nullptr) {
+                own = new Histogram;
+                stages_[stage_id].store(own, memory_order_release);
+            }
+            own->Merge(*histogram);
+        }
+    }
+    for (size_t counter_id = 0; counter_id < MAX_COUNTERS; ++counter_id) {
+        counters_[counter_id].fetch_add(other.GetCounter(counter_id), memory_order_relaxed);
+    }
+}
+
+Registry& Registry::Instance() {
+    //не разрушается при выходе: потоки пула могут писать метрики до самого конца программы
+    static Registry* const instance = new Registry;
+    return *instance;
+}
+
+namespace {
+size_t RegisterName(vector<string>& names, string_view name, size_t limit) {
+    const auto it = find(names.begin(), names.end(), name);
+    if (it != names.end()) {
+        return static_cast<size_t>(it - names.begin());
+    }
+    if (names.size() == limit) {
+        throw length_error("Too many profiling names, cannot register "s + string(name));
+    }
+    names.emplace_back(name);
+    return names.size() - 1;
+}
+} // namespace
+
+size_t Registry::RegisterStage(string_view name) {
+    lock_guard guard(mutex_);
+    return RegisterName(stage_names_, name, MAX_STAGES);
+}
+
+size_t Registry::RegisterCounter(string_view name) {
+    lock_guard guard(mutex_);
+    return RegisterName(counter_names_, name, MAX_COUNTERS);
+}
+
+Registry::LocalMetrics::~LocalMetrics() {
+    if (metrics != nullptr) {
+        Registry::Instance().Retire(metrics);
+    }
+}
+
+ThreadMetrics& Registry::Local() {
+    thread_local LocalMetrics local;
+    if (local.metrics == nullptr) {
+        lock_guard guard(mutex_);
+        threads_.push_back(make_unique<ThreadMetrics>());
+        local.metrics = threads_.back().get();
+    }
+    return *local.metrics;
+}
+
+void Registry::Retire(const ThreadMetrics* metrics) {
+    lock_guard guard(mutex_);
+    retired_.Merge(*metrics);
+    const auto it = find_if(threads_.begin(), threads_.end(),
+        [metrics](const unique_ptr<ThreadMetrics>& thread) { return thread.get() == metrics; });
+    swap(*it, threads_.back());
+    threads_.pop_back();
+}
+
+size_t Registry::GetThreadCount() const {
+    lock_guard guard(mutex_);
+    return threads_.size();
+}
+
+Snapshot Registry::TakeSnapshot() const {
+    lock_guard guard(mutex_);
+    Snapshot snapshot;
+    for (size_t stage_id = 0; stage_id < stage_names_.size(); ++stage_id) {
+        Histogram merged;
+        if (const Histogram* histogram = retired_.GetStageHistogram(stage_id)) {
+            merged.Merge(*histogram);
+        }
+        for (const auto& thread : threads_) {
+            if (const Histogram* histogram = thread->GetStageHistogram(stage_id)) {
+                merged.Merge(*histogram);
+            }
+        }
+        StageStats stats;
+        stats.name = stage_names_[stage_id];
+        stats.count = merged.GetCount();
+        stats.total_ns = merged.GetTotal();
+        stats.max_ns = merged.GetMax();
+        stats.p50_ns = merged.GetValueAtQuantile(0.5);
+        stats.p99_ns = merged.GetValueAtQuantile(0.99);
+        stats.p999_ns = merged.GetValueAtQuantile(0.999);
+        snapshot.stages.push_back(move(stats));
+    }
+    sort(snapshot.stages.begin(), snapshot.stages.end(),
+        [](const StageStats& lhs, const StageStats& rhs) { return lhs.name < rhs.name; });
+
+    for (size_t counter_id = 0; counter_id < counter_names_.size(); ++counter_id) {
+        uint64_t total = retired_.GetCounter(counter_id);
+        for (const auto& thread : threads_) {
+            total += thread->GetCounter(counter_id);
+        }
+        snapshot.counters[counter_names_[counter_id]] = total;
+    }
+    return snapshot;
+}
+
+ostream& operator<<(ostream& out, const Snapshot& snapshot) {
+    for (const StageStats& stage : snapshot.stages) {
+        out << left << setw(40) << stage.name << right
+            << " count = "s << stage.count
+            << ", p50 = "s << stage.p50_ns << " ns"s
+            << ", p99 = "s << stage.p99_ns << " ns"s
+            << ", p999 = "s << stage.p999_ns << " ns"s
+            << ", max = "s << stage.max_ns << " ns"s << endl;
+    }
+    for (const auto& [name, value] : snapshot.counters) {
+        out << left << setw(40) << name << right << " "s << value << endl;
+    }
+    return out;
+}
+
+} // namespace profiling
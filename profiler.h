@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define PROFILER_CONCAT_INTERNAL(X, Y) X##Y
+#define PROFILER_CONCAT(X, Y) PROFILER_CONCAT_INTERNAL(X, Y)
+
+/**
+ * Инструментирование с наносекундным разрешением.
+ *
+ * Включается определением SEARCH_SERVER_PROFILING при сборке; без него макросы
+ * раскрываются в пустые выражения, и их аргументы даже не вычисляются.
+ *
+ * Пример использования:
+ *
+ *  std::vector<Document> FindTopDocuments(...) {
+ *      PROFILE_SCOPE("FindTopDocuments");         // время всего вызова
+ *      {
+ *          PROFILE_SCOPE("FindTopDocuments.parse"); // вложенная стадия
+ *          ...
+ *      }
+ *      PROFILE_COUNT("results_returned", result.size());
+ *  }
+ *
+ *  std::cout << profiling::Registry::Instance().TakeSnapshot();
+ *
+ * Имена стадий через точку задают иерархию: в снимке стадии отсортированы по имени.
+ */
+#ifdef SEARCH_SERVER_PROFILING
+#define PROFILE_SCOPE(name)                                                                                   \
+    static const size_t PROFILER_CONCAT(profileStage, __LINE__) = profiling::Registry::Instance().RegisterStage(name); \
+    profiling::ScopedTimer PROFILER_CONCAT(profileTimer, __LINE__)(PROFILER_CONCAT(profileStage, __LINE__))
+
+#define PROFILE_COUNT(name, value)                                                                            \
+    do {                                                                                                      \
+        static const size_t profile_counter_id = profiling::Registry::Instance().RegisterCounter(name);       \
+        profiling::Registry::Instance().Local().AddToCounter(profile_counter_id, (value));                    \
+    } while (false)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNT(name, value) ((void)0)
+#endif
+
+namespace profiling {
+
+// Лог-линейная гистограмма в духе HDR: 2^SUB_BUCKET_BITS корзин на каждую степень двойки,
+// относительная погрешность значения - не больше 1 / 2^SUB_BUCKET_BITS.
+// Писать может только один поток (владелец), читать - любой: счётчики атомарные, без блокировок.
+class Histogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKET_COUNT = uint64_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    void Record(uint64_t value);
+
+    uint64_t GetCount() const;
+    uint64_t GetTotal() const;
+    uint64_t GetMax() const;
+
+    // значение, не меньше которого quantile-доля записей (quantile от 0 до 1)
+    uint64_t GetValueAtQuantile(double quantile) const;
+
+    // складывает в себя значения другой гистограммы (для сбора снимка по потокам)
+    void Merge(const Histogram& other);
+
+    static size_t GetBucketIndex(uint64_t value);
+    static uint64_t GetBucketLowerBound(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> count_{ 0 };
+    std::atomic<uint64_t> total_{ 0 };
+    std::atomic<uint64_t> max_{ 0 };
+};
+
+const size_t MAX_STAGES = 64;
+const size_t MAX_COUNTERS = 64;
+
+// Метрики одного потока. Гистограммы стадий создаются при первой записи,
+// чтобы поток, не заходивший в стадию, не платил за неё памятью.
+class ThreadMetrics {
+public:
+    ThreadMetrics() = default;
+    ThreadMetrics(const ThreadMetrics&) = delete;
+    ThreadMetrics& operator=(const ThreadMetrics&) = delete;
+    ~ThreadMetrics();
+
+    void RecordDuration(size_t stage_id, uint64_t nanoseconds);
+    void AddToCounter(size_t counter_id, uint64_t value) {
+        counters_[counter_id].store(counters_[counter_id].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    // складывает в себя метрики другого потока (для итога вышедших потоков)
+    void Merge(const ThreadMetrics& other);
+
+    const Histogram* GetStageHistogram(size_t stage_id) const {
+        return stages_[stage_id].load(std::memory_order_acquire);
+    }
+    uint64_t GetCounter(size_t counter_id) const {
+        return counters_[counter_id].load(std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<Histogram*>, MAX_STAGES> stages_{};
+    std::array<std::atomic<uint64_t>, MAX_COUNTERS> counters_{};
+};
+
+struct StageStats {
+    std::string name;
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t p999_ns = 0;
+};
+
+struct Snapshot {
+    std::vector<StageStats> stages;            // отсортированы по имени
+    std::map<std::string, uint64_t> counters;
+};
+
+std::ostream& operator<<(std::ostream& out, const Snapshot& snapshot);
+
+class Registry {
+public:
+    static Registry& Instance();
+
+    size_t RegisterStage(std::string_view name);
+    size_t RegisterCounter(std::string_view name);
+
+    // метрики текущего потока. При выходе потока они добавляются к общему итогу вышедших потоков
+    // и освобождаются, так что память не растёт с числом когда-либо созданных потоков
+    ThreadMetrics& Local();
+
+    // сколько живых потоков сейчас держат свои метрики
+    size_t GetThreadCount() const;
+
+    Snapshot TakeSnapshot() const;
+
+private:
+    // владелец метрик потока в thread_local; разрушается при выходе потока
+    struct LocalMetrics {
+        ThreadMetrics* metrics = nullptr;
+        ~LocalMetrics();
+    };
+
+    Registry() = default;
+
+    void Retire(const ThreadMetrics* metrics);
+
+    mutable std::mutex mutex_;
+    std::vector<std::string> stage_names_;
+    std::vector<std::string> counter_names_;
+    std::vector<std::unique_ptr<ThreadMetrics>> threads_;
+    ThreadMetrics retired_;     // сумма метрик вышедших потоков; пишется только под mutex_
+};
+
+class ScopedTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ScopedTimer(size_t stage_id)
+        : stage_id_(stage_id) {
+    }
+
+    ~ScopedTimer() {
+        const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_);
+        Registry::Instance().Local().RecordDuration(stage_id_, static_cast<uint64_t>(duration.count()));
+    }
+
+private:
+    const size_t stage_id_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+} // namespace profiling
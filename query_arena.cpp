@@ -0,0 +1,108 @@
+#include "query_arena.h"
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+// выделения сверх буфера арены: считаются, чтобы при сбросе увеличить буфер
+class OverflowResource : public pmr::memory_resource {
+public:
+    size_t TakeAllocated() {
+        return exchange(allocated_, 0);
+    }
+
+private:
+    size_t allocated_ = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        allocated_ += bytes;
+        return pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override {
+        pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+    }
+
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+class QueryArena {
+public:
+    QueryArena() {
+        Allocate(QUERY_ARENA_INITIAL_SIZE);
+        if (!resource_) {
+            throw bad_alloc();
+        }
+    }
+
+    pmr::memory_resource* GetResource() {
+        return &*resource_;
+    }
+
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+    void Reset() {
+        resource_->release();
+        const size_t overflow = overflow_.TakeAllocated();
+        if (overflow > 0 && capacity_ < QUERY_ARENA_MAX_SIZE) {
+            Allocate(min(QUERY_ARENA_MAX_SIZE, bit_ceil(capacity_ + overflow)));
+        }
+    }
+
+    size_t depth = 0;
+
+private:
+    unique_ptr<byte[]> buffer_;
+    size_t capacity_ = 0;
+    OverflowResource overflow_;
+    optional<pmr::monotonic_buffer_resource> resource_;
+
+    // вызывается из деструктора QueryArenaScope, поэтому без исключений: не хватило памяти - остаётся прежний буфер
+    void Allocate(size_t capacity) {
+        unique_ptr<byte[]> buffer(new (nothrow) byte[capacity]);
+        if (!buffer) {
+            return;
+        }
+        resource_.reset();
+        buffer_ = move(buffer);
+        capacity_ = capacity;
+        resource_.emplace(buffer_.get(), capacity_, &overflow_);
+    }
+};
+
+QueryArena& GetThreadArena() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+} // namespace
+
+QueryArenaScope::QueryArenaScope() {
+    ++GetThreadArena().depth;
+}
+
+QueryArenaScope::~QueryArenaScope() {
+    QueryArena& arena = GetThreadArena();
+    if (--arena.depth == 0) {
+        arena.Reset();
+    }
+}
+
+pmr::memory_resource* QueryArenaScope::GetResource() const {
+    return GetThreadArena().GetResource();
+}
+
+size_t QueryArenaScope::GetCapacity() {
+    return GetThreadArena().GetCapacity();
+}
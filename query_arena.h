@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+// Память для временных данных одного запроса: разобранного запроса, накопителей релевантности.
+// У каждого потока своя арена. Выделение - сдвиг указателя в буфере, по одному ничего не
+// освобождается: вся память возвращается разом, когда завершается внешний QueryArenaScope потока.
+// Если запрос не уместился, при сбросе буфер увеличивается, так что после разогрева повторяющиеся
+// запросы не обращаются к malloc вовсе.
+//
+//   QueryArenaScope arena;
+//   std::pmr::map<int, double> relevance(arena.GetResource());
+//
+// Вложенные области пользуются той же ареной, сброс - по выходу из самой внешней. Результаты,
+// которые переживают запрос, из арены выделять нельзя.
+
+// начальный и наибольший размер буфера арены одного потока
+constexpr size_t QUERY_ARENA_INITIAL_SIZE = 64 * 1024;
+constexpr size_t QUERY_ARENA_MAX_SIZE = 16 * 1024 * 1024;
+
+class QueryArenaScope {
+public:
+    QueryArenaScope();
+    ~QueryArenaScope();
+
+    QueryArenaScope(const QueryArenaScope&) = delete;
+    QueryArenaScope& operator=(const QueryArenaScope&) = delete;
+
+    std::pmr::memory_resource* GetResource() const;
+
+    // текущий размер буфера арены этого потока
+    static size_t GetCapacity();
+};
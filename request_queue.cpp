@@ -2,15 +2,11 @@
 #include <vector>
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    const auto result = search_server_.FindTopDocuments(raw_query, status);
-    AddRequest(result.size());
-    return result;
+    return TimedRequest([&]() { return search_server_.FindTopDocuments(raw_query, status); });
 }
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
-    const auto result = search_server_.FindTopDocuments(raw_query);
-    AddRequest(result.size());
-    return result;
+    return TimedRequest([&]() { return search_server_.FindTopDocuments(raw_query); });
 }
 int RequestQueue::GetNoResultRequests() const {
-    return no_results_requests_;
+    return no_results_requests_.load(std::memory_order_relaxed);
 }
@@ -1,48 +1,60 @@
 #pragma once
 #include "search_server.h"
-#include <deque>
+#include "request_statistics.h"
+#include <array>
+#include <atomic>
+#include <chrono>
 
+// Очередь запросов к поисковому серверу. Все методы можно вызывать из нескольких потоков сразу:
+// учёт ведётся на атомарных счётчиках, без блокировок.
 class RequestQueue {
 public:
     explicit RequestQueue(const SearchServer& search_server)
         : search_server_(search_server)
-        , no_results_requests_(0)
-        , current_time_(0) 
     {}
 
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-        const auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
-        AddRequest(result.size());
-        return result;
+        return TimedRequest([&]() { return search_server_.FindTopDocuments(raw_query, document_predicate); });
     }
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
     std::vector<Document> AddFindRequest(const std::string& raw_query);
+
+    // число запросов без результатов среди последних min_in_day_ запросов
     int GetNoResultRequests() const;
+
+    // доля пустых ответов, QPS и задержки за последнюю минуту, час и сутки реального времени
+    const RequestStatistics& GetStatistics() const {
+        return statistics_;
+    }
+
 private:
-    struct QueryResult {
-        uint64_t timestamp;
-        int results;
-    };
-    std::deque<QueryResult> requests_;
     const SearchServer& search_server_;
-    int no_results_requests_;
-    uint64_t current_time_;
     const static int min_in_day_ = 1440;
 
-    void AddRequest(int results_num) {
-        // новый запрос - новая секунда
-        ++current_time_;
-        // удаляем все результаты поиска, которые устарели
-        while (!requests_.empty() && min_in_day_ <= current_time_ - requests_.front().timestamp) {
-            if (0 == requests_.front().results) {
-                --no_results_requests_;
-            }
-            requests_.pop_front();
-        }
-        requests_.push_back({ current_time_, results_num });
-        if (0 == results_num) {
-            ++no_results_requests_;
+    // кольцо из последних min_in_day_ запросов: 1 - запрос был без результатов
+    std::array<std::atomic<uint8_t>, min_in_day_> no_result_flags_{};
+    std::atomic<uint64_t> current_time_{ 0 };
+    std::atomic<int> no_results_requests_{ 0 };
+    RequestStatistics statistics_;
+
+    template <typename Search>
+    std::vector<Document> TimedRequest(Search search) {
+        const auto start_time = RequestStatistics::Clock::now();
+        std::vector<Document> result = search();
+        const auto end_time = RequestStatistics::Clock::now();
+        statistics_.Record(end_time - start_time, result.size(), end_time);
+        AddRequest(result.size());
+        return result;
+    }
+
+    void AddRequest(size_t results_num) {
+        // новый запрос - новая минута; его флаг вытесняет запрос, сделанный min_in_day_ запросов назад
+        const uint64_t request_time = current_time_.fetch_add(1, std::memory_order_relaxed);
+        const uint8_t is_empty = results_num == 0 ? 1 : 0;
+        const uint8_t was_empty = no_result_flags_[request_time % min_in_day_].exchange(is_empty, std::memory_order_relaxed);
+        if (is_empty != was_empty) {
+            no_results_requests_.fetch_add(is_empty - was_empty, std::memory_order_relaxed);
         }
     }
 };
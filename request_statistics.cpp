@@ -0,0 +1,169 @@
+#include "request_statistics.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+//номер корзины ещё не назначен или корзина как раз обнуляется
+const int64_t EMPTY_EPOCH = -1;
+const int64_t RESETTING_EPOCH = -2;
+} // namespace
+
+class RequestStatistics::SlidingWindow {
+public:
+    SlidingWindow(nanoseconds bucket_width, size_t bucket_count)
+        : bucket_width_(bucket_width)
+        , buckets_(bucket_count) {
+    }
+
+    void Record(nanoseconds since_start, uint64_t latency_ns, bool is_empty) {
+        const int64_t epoch = since_start / bucket_width_;
+        Bucket& bucket = buckets_[static_cast<size_t>(epoch) % buckets_.size()];
+        if (!AcquireBucket(bucket, epoch)) {
+            return; //запись запоздала настолько, что её корзина уже занята более новым интервалом
+        }
+        bucket.requests.fetch_add(1, memory_order_relaxed);
+        if (is_empty) {
+            bucket.empty_results.fetch_add(1, memory_order_relaxed);
+        }
+        bucket.latency[GetLatencyBucket(latency_ns)].fetch_add(1, memory_order_relaxed);
+        uint64_t max_latency = bucket.latency_max.load(memory_order_relaxed);
+        while (latency_ns > max_latency
+            && !bucket.latency_max.compare_exchange_weak(max_latency, latency_ns, memory_order_relaxed)) {
+        }
+    }
+
+    WindowStats GetStats(nanoseconds since_start) const {
+        const int64_t current_epoch = since_start / bucket_width_;
+        const int64_t oldest_epoch = current_epoch - static_cast<int64_t>(buckets_.size()) + 1;
+        WindowStats stats;
+        array<uint64_t, LATENCY_BUCKET_COUNT> latency{};
+        for (const Bucket& bucket : buckets_) {
+            const int64_t epoch = bucket.epoch.load(memory_order_acquire);
+            if (epoch < oldest_epoch || epoch > current_epoch) {
+                continue;
+            }
+            stats.requests += bucket.requests.load(memory_order_relaxed);
+            stats.empty_results += bucket.empty_results.load(memory_order_relaxed);
+            stats.latency_max_ns = max(stats.latency_max_ns, bucket.latency_max.load(memory_order_relaxed));
+            for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+                latency[i] += bucket.latency[i].load(memory_order_relaxed);
+            }
+        }
+        if (stats.requests == 0) {
+            return stats;
+        }
+        stats.empty_rate = static_cast<double>(stats.empty_results) / stats.requests;
+        //пока сервер работает меньше окна, делим на фактически прошедшее время
+        const nanoseconds covered = min(bucket_width_ * static_cast<int64_t>(buckets_.size()),
+            max(since_start, nanoseconds(bucket_width_)));
+        stats.queries_per_second = stats.requests / duration<double>(covered).count();
+        stats.latency_p50_ns = min(GetQuantile(latency, stats.requests, 0.5), stats.latency_max_ns);
+        stats.latency_p99_ns = min(GetQuantile(latency, stats.requests, 0.99), stats.latency_max_ns);
+        return stats;
+    }
+
+private:
+    struct Bucket {
+        atomic<int64_t> epoch{ EMPTY_EPOCH };
+        atomic<uint64_t> requests{ 0 };
+        atomic<uint64_t> empty_results{ 0 };
+        atomic<uint64_t> latency_max{ 0 };
+        array<atomic<uint64_t>, LATENCY_BUCKET_COUNT> latency{};
+    };
+
+    // Переводит корзину на интервал epoch. Обнуляет её тот поток, который первым
+    // захватил устаревшую корзину; остальные ждут несколько сохранений, а не мьютекс.
+    static bool AcquireBucket(Bucket& bucket, int64_t epoch) {
+        int64_t current = bucket.epoch.load(memory_order_acquire);
+        while (current != epoch) {
+            if (current > epoch) {
+                return false;
+            }
+            if (current == RESETTING_EPOCH) {
+                this_thread::yield();
+                current = bucket.epoch.load(memory_order_acquire);
+                continue;
+            }
+            if (bucket.epoch.compare_exchange_weak(current, RESETTING_EPOCH, memory_order_acq_rel)) {
+                bucket.requests.store(0, memory_order_relaxed);
+                bucket.empty_results.store(0, memory_order_relaxed);
+                bucket.latency_max.store(0, memory_order_relaxed);
+                for (auto& counter : bucket.latency) {
+                    counter.store(0, memory_order_relaxed);
+                }
+                bucket.epoch.store(epoch, memory_order_release);
+                return true;
+            }
+        }
+        return true;
+    }
+
+    static uint64_t GetQuantile(const array<uint64_t, LATENCY_BUCKET_COUNT>& latency, uint64_t count, double quantile) {
+        const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(quantile * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+            seen += latency[i];
+            if (seen >= rank) {
+                return GetLatencyBucketUpperBound(i);
+            }
+        }
+        return GetLatencyBucketUpperBound(LATENCY_BUCKET_COUNT - 1);
+    }
+
+    const nanoseconds bucket_width_;
+    vector<Bucket> buckets_;
+};
+
+size_t RequestStatistics::GetLatencyBucket(uint64_t nanoseconds) {
+    const uint64_t sub_bucket_count = uint64_t(1) << LATENCY_SUB_BUCKET_BITS;
+    if (nanoseconds < sub_bucket_count) {
+        return static_cast<size_t>(nanoseconds);
+    }
+    int exponent = 63;
+    while ((nanoseconds >> exponent) == 0) {
+        --exponent;
+    }
+    if (exponent > LATENCY_MAX_EXPONENT) {
+        return LATENCY_BUCKET_COUNT - 1;
+    }
+    const int shift = exponent - LATENCY_SUB_BUCKET_BITS;
+    return static_cast<size_t>((shift + 1) * sub_bucket_count + ((nanoseconds >> shift) - sub_bucket_count));
+}
+
+uint64_t RequestStatistics::GetLatencyBucketUpperBound(size_t index) {
+    const uint64_t sub_bucket_count = uint64_t(1) << LATENCY_SUB_BUCKET_BITS;
+    if (index < sub_bucket_count) {
+        return index;
+    }
+    const uint64_t shift = index / sub_bucket_count - 1;
+    return ((sub_bucket_count + index % sub_bucket_count + 1) << shift) - 1;
+}
+
+RequestStatistics::RequestStatistics()
+    : start_time_(Clock::now())
+    , windows_{
+        make_unique<SlidingWindow>(seconds(1), 60),     //минута по секундам
+        make_unique<SlidingWindow>(minutes(1), 60),     //час по минутам
+        make_unique<SlidingWindow>(minutes(15), 96),    //сутки по четверть часа
+    } {
+}
+
+RequestStatistics::~RequestStatistics() = default;
+
+void RequestStatistics::Record(nanoseconds latency, size_t result_count, Clock::time_point now) {
+    const nanoseconds since_start = max(nanoseconds(0), duration_cast<nanoseconds>(now - start_time_));
+    const uint64_t latency_ns = static_cast<uint64_t>(max(nanoseconds(0), latency).count());
+    for (const auto& window : windows_) {
+        window->Record(since_start, latency_ns, result_count == 0);
+    }
+}
+
+RequestStatistics::WindowStats RequestStatistics::GetStats(Window window, Clock::time_point now) const {
+    const nanoseconds since_start = max(nanoseconds(0), duration_cast<nanoseconds>(now - start_time_));
+    return windows_[static_cast<size_t>(window)]->GetStats(since_start);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// Статистика запросов в скользящих окнах по реальному времени: минута, час, сутки.
+// Каждое окно - кольцо корзин фиксированной ширины; память не зависит от потока запросов.
+// Record и GetStats можно вызывать из любых потоков одновременно, блокировок нет.
+class RequestStatistics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Window {
+        MINUTE,
+        HOUR,
+        DAY,
+    };
+
+    struct WindowStats {
+        uint64_t requests = 0;
+        uint64_t empty_results = 0;
+        double empty_rate = 0.0;      // доля запросов без результатов
+        double queries_per_second = 0.0;
+        uint64_t latency_p50_ns = 0;  // верхние границы корзин гистограммы, погрешность до 25%
+        uint64_t latency_p99_ns = 0;
+        uint64_t latency_max_ns = 0;
+    };
+
+    RequestStatistics();
+    ~RequestStatistics();
+
+    void Record(std::chrono::nanoseconds latency, size_t result_count, Clock::time_point now = Clock::now());
+
+    WindowStats GetStats(Window window, Clock::time_point now = Clock::now()) const;
+
+    // корзины гистограммы задержек: 4 на каждую степень двойки наносекунд, до ~68 секунд
+    static constexpr int LATENCY_SUB_BUCKET_BITS = 2;
+    static constexpr int LATENCY_MAX_EXPONENT = 36;
+    static constexpr size_t LATENCY_BUCKET_COUNT = (LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 2) << LATENCY_SUB_BUCKET_BITS;
+
+    static size_t GetLatencyBucket(uint64_t nanoseconds);
+    static uint64_t GetLatencyBucketUpperBound(size_t index);
+
+private:
+    class SlidingWindow;
+
+    const Clock::time_point start_time_;
+    std::array<std::unique_ptr<SlidingWindow>, 3> windows_;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Функции ранжирования для SearchServer::FindTopDocuments. Скорер передаётся параметром шаблона,
+// поэтому вызовы встраиваются и путь по умолчанию (TF-IDF) не платит за выбор формулы.
+//
+// Скорер - любой тип с двумя методами:
+//   double ComputeIdf(std::string_view word, size_t document_count, size_t document_freq) const;
+//   double ComputeScore(double term_freq, double idf, size_t document_length, double average_document_length) const;
+// term_freq - доля слова в документе (число вхождений / document_length),
+// document_length - число слов документа без стоп-слов.
+
+// исходная формула сервера: tf * log(N / df)
+struct TfIdfScorer {
+    double ComputeIdf(std::string_view /*word*/, size_t document_count, size_t document_freq) const {
+        return std::log(document_count * 1.0 / document_freq);
+    }
+
+    double ComputeScore(double term_freq, double idf, size_t /*document_length*/, double /*average_document_length*/) const {
+        return term_freq * idf;
+    }
+};
+
+// Okapi BM25: насыщение по числу вхождений (k1) и нормировка по длине документа (b)
+struct Bm25Scorer {
+    double k1 = 1.2;
+    double b = 0.75;
+
+    double ComputeIdf(std::string_view /*word*/, size_t document_count, size_t document_freq) const {
+        return std::log(1.0 + (document_count - document_freq + 0.5) / (document_freq + 0.5));
+    }
+
+    double ComputeScore(double term_freq, double idf, size_t document_length, double average_document_length) const {
+        const double count = term_freq * document_length;
+        const double length_norm = k1 * (1.0 - b + b * document_length / average_document_length);
+        return idf * count * (k1 + 1.0) / (count + length_norm);
+    }
+};
+
+// Статистика коллекции по словам запроса. Шарды считают её каждый для себя, а суммарная
+// даёт всем шардам одинаковые IDF и среднюю длину - как если бы индекс был один
+struct CollectionStatistics {
+    // шаблон (comp*) или слово нечёткого поиска -> слова словаря с весом подстановки
+    using Expansions = std::map<std::string, std::vector<std::pair<std::string, double>>, std::less<>>;
+
+    size_t document_count = 0;
+    size_t total_document_length = 0;
+    std::map<std::string, size_t, std::less<>> document_freqs;
+    // от шарда - все его кандидаты в подстановки (их частоты - в document_freqs); шардам - выбранные
+    // по общим частотам, которые они используют вместо своих
+    Expansions expansions;
+
+    CollectionStatistics& operator+=(const CollectionStatistics& other) {
+        document_count += other.document_count;
+        total_document_length += other.total_document_length;
+        for (const auto& [word, document_freq] : other.document_freqs) {
+            document_freqs[word] += document_freq;
+        }
+        for (const auto& [word, terms] : other.expansions) {
+            auto& merged = expansions[word];
+            merged.insert(merged.end(), terms.begin(), terms.end());
+            std::sort(merged.begin(), merged.end());
+            merged.erase(std::unique(merged.begin(), merged.end(),
+                [](const auto& lhs, const auto& rhs) { return lhs.first == rhs.first; }), merged.end());
+        }
+        return *this;
+    }
+
+    double GetAverageDocumentLength() const {
+        return document_count == 0 ? 0.0 : total_document_length * 1.0 / document_count;
+    }
+};
+
+// скорер, подставляющий вместо статистики своего индекса общую статистику коллекции
+template <typename Scorer>
+class GlobalStatisticsScorer {
+public:
+    GlobalStatisticsScorer(const Scorer& scorer, const CollectionStatistics& statistics)
+        : scorer_(scorer)
+        , statistics_(statistics)
+        , average_document_length_(statistics.GetAverageDocumentLength())
+    {}
+
+    double ComputeIdf(std::string_view word, size_t document_count, size_t document_freq) const {
+        const auto it = statistics_.document_freqs.find(word);
+        if (it == statistics_.document_freqs.end()) {
+            return scorer_.ComputeIdf(word, document_count, document_freq);
+        }
+        return scorer_.ComputeIdf(word, statistics_.document_count, it->second);
+    }
+
+    double ComputeScore(double term_freq, double idf, size_t document_length, double /*average_document_length*/) const {
+        return scorer_.ComputeScore(term_freq, idf, document_length, average_document_length_);
+    }
+
+    const CollectionStatistics& GetStatistics() const {
+        return statistics_;
+    }
+
+private:
+    Scorer scorer_;
+    const CollectionStatistics& statistics_;
+    double average_document_length_;
+};
@@ -0,0 +1,251 @@
+// Генератор нагрузки для search_service: QPS и перцентили задержки.
+//
+//   ./search_load_generator --port 8080 --connections 8 --duration 10
+//   ./search_load_generator --port 8080 --connections 8 --duration 10 --rate 20000
+//
+// Без --rate работает замкнутый цикл: каждое соединение шлёт следующий запрос сразу после
+// ответа на предыдущий, и QPS показывает пропускную способность. С --rate - открытый цикл:
+// запросы идут по расписанию с заданной суммарной частотой, а задержка отсчитывается от
+// запланированного момента отправки. Так очередь перед перегруженным сервером попадает в
+// перцентили, а не прячется за паузой клиента.
+//
+// Запросы берутся из файла --queries (по одному на строку) или генерируются по распределению
+// Ципфа. --populate N перед замером добавляет в сервис N документов из того же словаря.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "generators.h"
+#include "http_service.h"
+
+using namespace std;
+
+namespace {
+
+struct Options {
+    string address = "127.0.0.1"s;
+    int port = 8080;
+    size_t connections = 4;
+    double duration = 10.0;        // секунды
+    double rate = 0.0;             // запросов в секунду на все соединения; 0 - замкнутый цикл
+    string queries_path;
+    string status = "ACTUAL"s;
+    int populate = 0;
+};
+
+struct WorkerResult {
+    vector<double> latencies_us;
+    size_t errors = 0;
+    exception_ptr failure;     // соединение оборвалось
+};
+
+[[noreturn]] void PrintUsage() {
+    cerr << "Usage: search_load_generator [--address 127.0.0.1] [--port 8080] [--connections 4] [--duration 10]\n"
+            "                             [--rate 0] [--queries file] [--status ACTUAL] [--populate 0]"s << endl;
+    exit(2);
+}
+
+// значение опции целиком как число, иначе PrintUsage
+template <typename Number>
+Number ParseNumber(string_view value) {
+    Number number{};
+    const auto [end, error] = from_chars(value.data(), value.data() + value.size(), number);
+    if (error != errc() || end != value.data() + value.size()) {
+        PrintUsage();
+    }
+    return number;
+}
+
+Options ParseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const string_view option = argv[i];
+        if (i + 1 == argc) {
+            PrintUsage();
+        }
+        const string value = argv[++i];
+        if (option == "--address"sv) {
+            options.address = value;
+        }
+        else if (option == "--port"sv) {
+            options.port = ParseNumber<int>(value);
+        }
+        else if (option == "--connections"sv) {
+            options.connections = ParseNumber<size_t>(value);
+        }
+        else if (option == "--duration"sv) {
+            options.duration = ParseNumber<double>(value);
+        }
+        else if (option == "--rate"sv) {
+            options.rate = ParseNumber<double>(value);
+        }
+        else if (option == "--queries"sv) {
+            options.queries_path = value;
+        }
+        else if (option == "--status"sv) {
+            options.status = value;
+        }
+        else if (option == "--populate"sv) {
+            options.populate = ParseNumber<int>(value);
+        }
+        else {
+            PrintUsage();
+        }
+    }
+    if (options.connections == 0 || options.duration <= 0 || options.rate < 0 || options.port < 0 || options.port > 65535) {
+        PrintUsage();
+    }
+    return options;
+}
+
+vector<string> LoadQueries(const Options& options, mt19937& generator, const vector<string>& dictionary) {
+    vector<string> queries;
+    if (!options.queries_path.empty()) {
+        ifstream input(options.queries_path);
+        if (!input) {
+            throw runtime_error("Cannot open "s + options.queries_path);
+        }
+        for (string line; getline(input, line);) {
+            if (!line.empty()) {
+                queries.push_back(move(line));
+            }
+        }
+    }
+    else {
+        queries = GenerateZipfQueries(generator, dictionary, 1.0, 1000, 3);
+    }
+    if (queries.empty()) {
+        throw runtime_error("No queries"s);
+    }
+    //запрос сразу превращается в путь, чтобы не кодировать его на каждой отправке
+    const string status = "&status="s + EncodeQueryComponent(options.status);
+    for (string& query : queries) {
+        query = "/search?query="s + EncodeQueryComponent(query) + status;
+    }
+    return queries;
+}
+
+void Populate(const Options& options, mt19937& generator, const vector<string>& dictionary) {
+    HttpClient client(options.address, static_cast<uint16_t>(options.port));
+    const ZipfDistribution distribution(dictionary.size(), 1.0);
+    for (int id = 0; id < options.populate; ++id) {
+        const string text = GenerateZipfQuery(generator, dictionary, distribution, 70);
+        const string target = "/documents?id="s + to_string(id) + "&ratings="s + to_string(id % 10);
+        const HttpClient::Response response = client.Request("POST"sv, target, text);
+        if (response.status != 200) {
+            throw runtime_error("Populate failed: "s + response.body);
+        }
+    }
+}
+
+void RunWorker(const Options& options, const vector<string>& targets, size_t worker_index, WorkerResult& result) {
+    using Clock = chrono::steady_clock;
+    HttpClient client(options.address, static_cast<uint16_t>(options.port));
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point finish = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(options.duration));
+    const bool open_loop = options.rate > 0;
+    const auto interval = open_loop
+        ? chrono::duration_cast<Clock::duration>(chrono::duration<double>(options.connections / options.rate))
+        : Clock::duration::zero();
+    //соединения сдвинуты по фазе, чтобы не стрелять одновременно
+    Clock::time_point scheduled = start + interval * worker_index / options.connections;
+    for (size_t i = worker_index; ; i += options.connections) {
+        if (open_loop) {
+            if (scheduled >= finish) {
+                break;
+            }
+            this_thread::sleep_until(scheduled);
+        }
+        const Clock::time_point sent = open_loop ? scheduled : Clock::now();
+        if (!open_loop && sent >= finish) {
+            break;
+        }
+        const HttpClient::Response response = client.Request("GET"sv, targets[i % targets.size()]);
+        const Clock::time_point received = Clock::now();
+        if (response.status != 200) {
+            ++result.errors;
+        }
+        result.latencies_us.push_back(chrono::duration<double, micro>(received - sent).count());
+        scheduled += interval;
+    }
+}
+
+double Percentile(const vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t index = min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    return sorted[index];
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const Options options = ParseOptions(argc, argv);
+    try {
+        mt19937 generator(42);
+        const vector<string> dictionary = GenerateDictionary(generator, 10000, 10);
+        if (options.populate > 0) {
+            Populate(options, generator, dictionary);
+            cout << "Populated "s << options.populate << " documents"s << endl;
+        }
+        const vector<string> targets = LoadQueries(options, generator, dictionary);
+
+        vector<WorkerResult> results(options.connections);
+        vector<thread> workers;
+        const auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < options.connections; ++i) {
+            workers.emplace_back([&, i] {
+                try {
+                    RunWorker(options, targets, i, results[i]);
+                }
+                catch (...) {
+                    results[i].failure = current_exception();
+                }
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        const double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        vector<double> latencies;
+        size_t errors = 0;
+        for (const WorkerResult& result : results) {
+            if (result.failure) {
+                rethrow_exception(result.failure);
+            }
+            latencies.insert(latencies.end(), result.latencies_us.begin(), result.latencies_us.end());
+            errors += result.errors;
+        }
+        sort(latencies.begin(), latencies.end());
+
+        cout << fixed << setprecision(1);
+        cout << (options.rate > 0 ? "open loop, target "s + to_string(static_cast<long long>(options.rate)) + " req/s"s : "closed loop"s)
+             << ", "s << options.connections << " connections, "s << elapsed << " s"s << endl;
+        cout << "requests: "s << latencies.size() << ", errors: "s << errors
+             << ", QPS: "s << latencies.size() / elapsed << endl;
+        cout << "latency us: p50 "s << Percentile(latencies, 0.50)
+             << ", p90 "s << Percentile(latencies, 0.90)
+             << ", p99 "s << Percentile(latencies, 0.99)
+             << ", p99.9 "s << Percentile(latencies, 0.999)
+             << ", max "s << (latencies.empty() ? 0.0 : latencies.back()) << endl;
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
@@ -4,7 +4,10 @@
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
+#include <cmath>
 #include <execution>
+#include <iterator>
+#include <span>
 
 using namespace std;
 
@@ -13,8 +16,17 @@ bool SearchServer::IsValidWord(const std::string_view& word) {
     return none_of(word.begin(), word.end(), [](char c) {  return c >= '\0' && c < ' ';  });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view& text) const {
+std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view& text_sv, std::string& buffer) const {
     std::vector<std::string_view> words;
+    std::string_view text = text_sv;
+    if (analyzer_) {
+        buffer.clear();
+        analyzer_->Normalize(text, buffer);
+        if (buffer.empty()) {
+            return words;
+        }
+        text = buffer;
+    }
     for (const std::string_view& word : SplitIntoWords(text)) {
         if (!IsValidWord(word)) {
             std::string s = ("Word "s + std::string(word) + " is invalid"s);
@@ -28,6 +40,9 @@ std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::stri
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
+    if (ratings.empty()) {
+        return 0;
+    }
     int rating_sum = 0;
     for (const int rating : ratings) {
         rating_sum += rating;
@@ -45,51 +60,1018 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view& tex
         is_minus = true;
         word.remove_prefix(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    //анализатор сам разбивает слово по управляющим символам
+    if (word.empty() || word[0] == '-' || (!analyzer_ && !IsValidWord(word))) {
         throw std::invalid_argument(("Query word "s + std::string(text_sv) + " is invalid"s));
     }
     return { word, is_minus, IsStopWord(word) };
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view& raw_query, bool is_parallel) const {
-    Query result;
+const SearchServer::FieldIndex* SearchServer::ParseFieldWord(QueryWord& query_word) const {
+    const size_t colon = query_word.data.find(':');
+    if (fields_.empty() || colon == query_word.data.npos || colon == 0) {
+        return nullptr;
+    }
+    const auto it = fields_.find(query_word.data.substr(0, colon));
+    if (it == fields_.end()) {
+        return nullptr;
+    }
+    const std::string_view word = query_word.data.substr(colon + 1);
+    if (word.empty() || word[0] == '-') {
+        throw std::invalid_argument("Query word "s + std::string(query_word.data) + " is invalid"s);
+    }
+    if (IsWildcardPattern(word)) {
+        throw std::invalid_argument("Patterns are not supported in field words: "s + std::string(query_word.data));
+    }
+    query_word.data = word;
+    query_word.is_stop = IsStopWord(word);
+    return &it->second;
+}
 
-    for (const std::string_view& word : SplitIntoWords(raw_query)) {
-        const QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
+static bool IsBooleanOperator(const std::string_view& word) {
+    return word == "AND"sv || word == "OR"sv || word == "NOT"sv;
+}
+
+static bool IsBooleanQuery(const std::string_view& text) {
+    if (text.find_first_of("()"sv) != text.npos) {
+        return true;
+    }
+    for (size_t position = text.find_first_of("AON"sv); position != text.npos; position = text.find_first_of("AON"sv, position + 1)) {
+        const size_t end = std::min(text.find(' ', position), text.size());
+        if ((position == 0 || text[position - 1] == ' ') && IsBooleanOperator(text.substr(position, end - position))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SearchServer::Query SearchServer::ParseQuery(const std::string_view& raw_query, std::pmr::memory_resource* memory,
+    const ExpansionSource& expansions) const
+{
+    Query result(memory);
+    if (IsBooleanQuery(raw_query)) {
+        ParseBooleanQuery(raw_query, result, expansions);
+        std::sort(result.plus_words.begin(), result.plus_words.end());
+        result.plus_words.erase(std::unique(result.plus_words.begin(), result.plus_words.end()), result.plus_words.end());
+        std::sort(result.field_plus_words.begin(), result.field_plus_words.end());
+        result.field_plus_words.erase(std::unique(result.field_plus_words.begin(), result.field_plus_words.end()), result.field_plus_words.end());
+        return result;
+    }
+    const auto add_word = [this, &result, &expansions](const std::string_view& word) {
+        QueryWord query_word = ParseQueryWord(word);
+        const FieldIndex* field = ParseFieldWord(query_word);
+        ForEachQueryTerm(query_word.data, result, [this, &result, &query_word, field, &expansions](const std::string_view& term) {
+            if (IsStopWord(term)) {
+                return;
+            }
+            if (field) {
+                (query_word.is_minus ? result.field_minus_words : result.field_plus_words).push_back({ field, term });
+                return;
+            }
+            std::pmr::vector<std::string_view>& words = query_word.is_minus ? result.minus_words : result.plus_words;
+            if (IsWildcardPattern(term)) {
+                ExpandPattern(term, words, expansions);
             }
             else {
-                result.plus_words.push_back(query_word.data);
+                words.push_back(term);
+                if (!query_word.is_minus && fuzzy_max_edits_ > 0) {
+                    ExpandFuzzy(term, result.fuzzy_words, expansions);
+                }
+            }
+        });
+    };
+
+    if (raw_query.find('"') == raw_query.npos) {
+        for (const std::string_view& word : SplitIntoWords(raw_query, memory)) {
+            add_word(word);
+        }
+    }
+    else {
+        //в запросе есть фразы: "слова подряд" или "слова рядом"~N
+        std::string_view rest = raw_query;
+        while (!rest.empty()) {
+            if (rest[0] == ' ') {
+                rest.remove_prefix(1);
+                continue;
+            }
+            const size_t token_end = std::min(rest.find(' '), rest.size());
+            if (rest[0] != '"') {
+                const std::string_view word = rest.substr(0, token_end);
+                if (word.find('"') != word.npos) {
+                    throw std::invalid_argument("Query word "s + std::string(word) + " is invalid"s);
+                }
+                add_word(word);
+                rest.remove_prefix(token_end);
+                continue;
+            }
+            const size_t closing = rest.find('"', 1);
+            if (closing == rest.npos) {
+                throw std::invalid_argument("Phrase "s + std::string(rest) + " is not closed"s);
             }
+            const size_t suffix_end = std::min(rest.find(' ', closing), rest.size());
+            ParseQueryPhrase(rest.substr(1, closing - 1), rest.substr(closing + 1, suffix_end - closing - 1), result);
+            rest.remove_prefix(suffix_end);
         }
     }
 
-    if (!is_parallel)//параллельная версия без сортировки!!!
-    {
-        std::sort(result.minus_words.begin(), result.minus_words.end());
-        result.minus_words.erase(std::unique(result.minus_words.begin(), result.minus_words.end()), result.minus_words.end());
-        std::sort(result.plus_words.begin(), result.plus_words.end());
-        result.plus_words.erase(std::unique(result.plus_words.begin(), result.plus_words.end()), result.plus_words.end());
+    //отсортированные слова без повторов нужны и для поиска, и для слияния с прямым индексом в MatchDocument
+    std::sort(result.minus_words.begin(), result.minus_words.end());
+    result.minus_words.erase(std::unique(result.minus_words.begin(), result.minus_words.end()), result.minus_words.end());
+    std::sort(result.plus_words.begin(), result.plus_words.end());
+    result.plus_words.erase(std::unique(result.plus_words.begin(), result.plus_words.end()), result.plus_words.end());
+    for (std::pmr::vector<FieldWord>* field_words : { &result.field_plus_words, &result.field_minus_words }) {
+        std::sort(field_words->begin(), field_words->end());
+        field_words->erase(std::unique(field_words->begin(), field_words->end()), field_words->end());
+    }
+
+    if (!result.fuzzy_words.empty()) {
+        //одно слово словаря может быть близко к нескольким словам запроса - остаётся больший вес;
+        //слова, которые и так есть в запросе, второй раз не учитываются
+        std::sort(result.fuzzy_words.begin(), result.fuzzy_words.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first || (lhs.first == rhs.first && lhs.second > rhs.second); });
+        result.fuzzy_words.erase(std::unique(result.fuzzy_words.begin(), result.fuzzy_words.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.first == rhs.first; }), result.fuzzy_words.end());
+        result.fuzzy_words.erase(std::remove_if(result.fuzzy_words.begin(), result.fuzzy_words.end(),
+            [&result](const auto& word) { return std::binary_search(result.plus_words.begin(), result.plus_words.end(), word.first); }),
+            result.fuzzy_words.end());
+    }
+    if (term_tiers_ && term_tiers_->stop_max_idf) {
+        RemoveDynamicStopWords(result);
     }
 
     return result;
 }
 
+void SearchServer::ParseBooleanQuery(const std::string_view& text, Query& result, const ExpansionSource& expansions) const {
+    if (text.find('"') != text.npos) {
+        throw std::invalid_argument("Phrases are not supported in boolean queries"s);
+    }
+    //скобки - отдельные лексемы, даже если прилегают к словам
+    std::pmr::vector<std::string_view> tokens(result.GetMemory());
+    size_t word_begin = 0;
+    for (size_t position = 0; position <= text.size(); ++position) {
+        if (position == text.size() || text[position] == ' ' || text[position] == '(' || text[position] == ')') {
+            if (word_begin < position) {
+                tokens.push_back(text.substr(word_begin, position - word_begin));
+            }
+            if (position < text.size() && text[position] != ' ') {
+                tokens.push_back(text.substr(position, 1));
+            }
+            word_begin = position + 1;
+        }
+    }
+
+    //грамматика, от слабого связывания к сильному:
+    //  or       := and ("OR" and)*
+    //  and      := sequence ("AND" sequence)*
+    //  sequence := unary unary*      хотя бы одно плюс-слово и ни одного отрицания
+    //  unary    := "NOT" unary | "(" or ")" | слово | -слово
+    //Стоп-слова узлов не дают; negated - узел под нечётным числом NOT, его слова не ранжируются
+    struct Parser {
+        const SearchServer& server;
+        const std::pmr::vector<std::string_view>& tokens;
+        Query& query;
+        const ExpansionSource& expansions;
+        size_t position = 0;
+
+        bool Peek(std::string_view token) const {
+            return position < tokens.size() && tokens[position] == token;
+        }
+
+        [[noreturn]] void Fail(const std::string& message) const {
+            throw std::invalid_argument("Boolean query: "s + message);
+        }
+
+        uint32_t AddNode(BooleanOperator op, const std::pmr::vector<uint32_t>& children) {
+            //из одного ребёнка AND и OR вырождаются в него самого
+            if (op != BooleanOperator::NOT && children.size() == 1) {
+                return children[0];
+            }
+            query.boolean_nodes.push_back({ op, nullptr, static_cast<uint32_t>(query.boolean_children.size()),
+                static_cast<uint32_t>(children.size()) });
+            query.boolean_children.insert(query.boolean_children.end(), children.begin(), children.end());
+            return static_cast<uint32_t>(query.boolean_nodes.size() - 1);
+        }
+
+        uint32_t AddTerm(std::string_view word, bool negated) {
+            const auto it = server.word_to_document_freqs_.find(word);
+            query.boolean_nodes.push_back({ BooleanOperator::TERM, it == server.word_to_document_freqs_.end() ? nullptr : &it->second, 0, 0,
+                server.FindDenseBitmap(word) });
+            if (!negated) {
+                query.plus_words.push_back(word);
+            }
+            return static_cast<uint32_t>(query.boolean_nodes.size() - 1);
+        }
+
+        uint32_t AddFieldTerm(const FieldWord& field_word, bool negated) {
+            query.boolean_nodes.push_back({ BooleanOperator::TERM, FindFieldPostings(field_word) });
+            if (!negated) {
+                query.field_plus_words.push_back(field_word);
+            }
+            return static_cast<uint32_t>(query.boolean_nodes.size() - 1);
+        }
+
+        uint32_t ParseOr(bool negated) {
+            std::pmr::vector<uint32_t> children(query.GetMemory());
+            do {
+                const uint32_t child = ParseAnd(negated);
+                if (child != NO_BOOLEAN_NODE) {
+                    children.push_back(child);
+                }
+            } while (Peek("OR"sv) && ++position);
+            return children.empty() ? NO_BOOLEAN_NODE : AddNode(BooleanOperator::OR, children);
+        }
+
+        uint32_t ParseAnd(bool negated) {
+            std::pmr::vector<uint32_t> children(query.GetMemory());
+            do {
+                const uint32_t child = ParseSequence(negated);
+                if (child != NO_BOOLEAN_NODE) {
+                    children.push_back(child);
+                }
+            } while (Peek("AND"sv) && ++position);
+            return children.empty() ? NO_BOOLEAN_NODE : AddNode(BooleanOperator::AND, children);
+        }
+
+        uint32_t ParseSequence(bool negated) {
+            std::pmr::vector<uint32_t> positives(query.GetMemory());
+            std::pmr::vector<uint32_t> negatives(query.GetMemory());
+            size_t operands = 0;
+            while (position < tokens.size() && !Peek(")"sv) && !Peek("AND"sv) && !Peek("OR"sv)) {
+                bool is_negative = false;
+                const uint32_t child = ParseUnary(negated, is_negative);
+                ++operands;
+                if (child != NO_BOOLEAN_NODE) {
+                    (is_negative ? negatives : positives).push_back(child);
+                }
+            }
+            if (operands == 0) {
+                Fail(position < tokens.size() ? "missing operand before "s + std::string(tokens[position]) : "missing operand at the end"s);
+            }
+            if (positives.empty() && negatives.empty()) {
+                return NO_BOOLEAN_NODE;
+            }
+            if (!positives.empty()) {
+                negatives.insert(negatives.begin(), AddNode(BooleanOperator::OR, positives));
+            }
+            return AddNode(BooleanOperator::AND, negatives);
+        }
+
+        uint32_t ParseUnary(bool negated, bool& is_negative) {
+            const std::string_view token = tokens[position++];
+            if (token == "NOT"sv) {
+                if (position == tokens.size()) {
+                    Fail("missing operand after NOT"s);
+                }
+                bool inner_negative = false;
+                const uint32_t child = ParseUnary(!negated, inner_negative);
+                is_negative = true;
+                return child == NO_BOOLEAN_NODE ? NO_BOOLEAN_NODE : AddNode(BooleanOperator::NOT, { { child }, query.GetMemory() });
+            }
+            if (token == "("sv) {
+                const uint32_t child = ParseOr(negated);
+                if (!Peek(")"sv)) {
+                    Fail("unbalanced parentheses"s);
+                }
+                ++position;
+                return child;
+            }
+            if (token == ")"sv || IsBooleanOperator(token)) {
+                Fail("unexpected "s + std::string(token));
+            }
+            QueryWord query_word = server.ParseQueryWord(token);
+            const FieldIndex* field = server.ParseFieldWord(query_word);
+            is_negative = query_word.is_minus;
+            const bool word_negated = negated != query_word.is_minus;
+            //анализатор может разбить слово на несколько - они объединяются через OR, как слова подряд
+            std::pmr::vector<uint32_t> children(query.GetMemory());
+            server.ForEachQueryTerm(query_word.data, query, [&](const std::string_view& term) {
+                if (server.IsStopWord(term)) {
+                    return;
+                }
+                if (field) {
+                    children.push_back(AddFieldTerm({ field, term }, word_negated));
+                }
+                else if (IsWildcardPattern(term)) {
+                    std::pmr::vector<std::string_view> terms(query.GetMemory());
+                    server.ExpandPattern(term, terms, expansions);
+                    std::pmr::vector<uint32_t> expansion_nodes(query.GetMemory());
+                    for (const std::string_view& expansion : terms) {
+                        expansion_nodes.push_back(AddTerm(expansion, word_negated));
+                    }
+                    //шаблону ничего не подошло - OR без детей, под него не попадает ни один документ
+                    children.push_back(AddNode(BooleanOperator::OR, expansion_nodes));
+                }
+                else {
+                    children.push_back(AddTerm(term, word_negated));
+                }
+            });
+            if (children.empty()) {
+                return NO_BOOLEAN_NODE;
+            }
+            const uint32_t node = AddNode(BooleanOperator::OR, children);
+            return query_word.is_minus ? AddNode(BooleanOperator::NOT, { { node }, query.GetMemory() }) : node;
+        }
+    };
+
+    Parser parser{ *this, tokens, result, expansions };
+    result.is_boolean = true;
+    result.boolean_root = parser.ParseOr(false);
+    if (parser.position != tokens.size()) {
+        parser.Fail("unbalanced parentheses"s);
+    }
+}
+
+//первый элемент [first, last) не меньше value: шаги удваиваются, пока не перескочат value,
+//затем двоичный поиск в последнем шаге. Дёшево, когда искомое близко
+template <typename Iterator>
+static Iterator GallopTo(Iterator first, Iterator last, int value) {
+    size_t step = 1;
+    while (first != last && *first < value) {
+        if (static_cast<size_t>(last - first) <= step) {
+            return std::lower_bound(first, last, value);
+        }
+        if (first[step] >= value) {
+            return std::lower_bound(first + 1, first + step + 1, value);
+        }
+        first += step;
+        step *= 2;
+    }
+    return first;
+}
+
+//пересечение отсортированных списков: идём по короткому, скачками ищем в длинном
+static void IntersectGalloping(const std::pmr::vector<int>& shorter, const std::pmr::vector<int>& longer, std::pmr::vector<int>& result) {
+    result.clear();
+    auto it = longer.begin();
+    for (const int document_id : shorter) {
+        it = GallopTo(it, longer.end(), document_id);
+        if (it == longer.end()) {
+            break;
+        }
+        if (*it == document_id) {
+            result.push_back(document_id);
+        }
+    }
+}
+
+size_t SearchServer::EstimateBooleanNode(const Query& query, uint32_t node_index) const {
+    const BooleanNode& node = query.boolean_nodes[node_index];
+    const auto children = std::span(query.boolean_children).subspan(node.first_child, node.child_count);
+    switch (node.op) {
+    case BooleanOperator::TERM:
+        return node.postings ? node.postings->size() : 0;
+    case BooleanOperator::OR: {
+        size_t estimate = 0;
+        for (const uint32_t child : children) {
+            estimate += EstimateBooleanNode(query, child);
+        }
+        return std::min(estimate, documents_.size());
+    }
+    case BooleanOperator::AND: {
+        size_t estimate = documents_.size();
+        for (const uint32_t child : children) {
+            if (query.boolean_nodes[child].op != BooleanOperator::NOT) {
+                estimate = std::min(estimate, EstimateBooleanNode(query, child));
+            }
+        }
+        return estimate;
+    }
+    case BooleanOperator::NOT:
+        break;
+    }
+    return documents_.size();
+}
+
+std::pmr::vector<int> SearchServer::EvaluateBooleanNode(const Query& query, uint32_t node_index) const {
+    const BooleanNode& node = query.boolean_nodes[node_index];
+    std::pmr::memory_resource* memory = query.GetMemory();
+    const auto children = std::span(query.boolean_children).subspan(node.first_child, node.child_count);
+    std::pmr::vector<int> result(memory);
+    const auto all_documents = [this, memory] {
+        std::pmr::vector<int> document_ids(memory);
+        document_ids.reserve(documents_.size());
+        for (const auto& [document_id, _] : documents_) {
+            document_ids.push_back(document_id);
+        }
+        return document_ids;
+    };
+
+    switch (node.op) {
+    case BooleanOperator::TERM:
+        if (node.postings) {
+            result.reserve(node.postings->size());
+            for (const auto& [document_id, _] : *node.postings) {
+                result.push_back(document_id);
+            }
+        }
+        return result;
+
+    case BooleanOperator::NOT: {
+        const std::pmr::vector<int> excluded = EvaluateBooleanNode(query, children[0]);
+        const std::pmr::vector<int> universe = all_documents();
+        std::set_difference(universe.begin(), universe.end(), excluded.begin(), excluded.end(), std::back_inserter(result));
+        return result;
+    }
+
+    case BooleanOperator::OR: {
+        std::pmr::vector<int> merged(memory);
+        for (const uint32_t child : children) {
+            const std::pmr::vector<int> documents = EvaluateBooleanNode(query, child);
+            merged.clear();
+            std::set_union(result.begin(), result.end(), documents.begin(), documents.end(), std::back_inserter(merged));
+            result.swap(merged);
+        }
+        return result;
+    }
+
+    case BooleanOperator::AND:
+        break;
+    }
+
+    //сначала самые короткие списки, отрицания - в конце: их проще проверить на готовых кандидатах
+    std::pmr::vector<std::pair<size_t, uint32_t>> order(memory);
+    for (const uint32_t child : children) {
+        const bool is_not = query.boolean_nodes[child].op == BooleanOperator::NOT;
+        order.emplace_back(is_not ? SIZE_MAX : EstimateBooleanNode(query, child), child);
+    }
+    std::sort(order.begin(), order.end());
+    if (order.front().first == 0) {
+        return result;
+    }
+    //одни отрицания - вычитаем их из всех документов
+    const bool has_positive = order.front().first != SIZE_MAX;
+    result = has_positive ? EvaluateBooleanNode(query, order.front().second) : all_documents();
+    std::pmr::vector<int> intersection(memory);
+    for (size_t i = has_positive ? 1 : 0; i < order.size() && !result.empty(); ++i) {
+        const BooleanNode& child = query.boolean_nodes[order[i].second];
+        if (child.op == BooleanOperator::NOT) {
+            const uint32_t excluded = query.boolean_children[child.first_child];
+            result.erase(std::remove_if(result.begin(), result.end(),
+                [this, &query, excluded](int document_id) { return MatchesBooleanNode(query, excluded, document_id); }),
+                result.end());
+        }
+        else if (child.op == BooleanOperator::TERM) {
+            if (!child.postings) {
+                result.clear();
+            }
+            else if (child.postings->size() < result.size()) {
+                //слово реже кандидатов: идём по его постингам, кандидатов пропускаем скачками
+                intersection.clear();
+                auto it = result.begin();
+                for (const auto& [document_id, _] : *child.postings) {
+                    it = GallopTo(it, result.end(), document_id);
+                    if (it == result.end()) {
+                        break;
+                    }
+                    if (*it == document_id) {
+                        intersection.push_back(document_id);
+                    }
+                }
+                result.swap(intersection);
+            }
+            else if (child.bitmap) {
+                result.erase(std::remove_if(result.begin(), result.end(),
+                    [&child](int document_id) { return !child.bitmap->Contains(document_id); }),
+                    result.end());
+            }
+            else {
+                result.erase(std::remove_if(result.begin(), result.end(),
+                    [&child](int document_id) { return child.postings->count(document_id) == 0; }),
+                    result.end());
+            }
+        }
+        else {
+            const std::pmr::vector<int> documents = EvaluateBooleanNode(query, order[i].second);
+            if (documents.size() < result.size()) {
+                IntersectGalloping(documents, result, intersection);
+            }
+            else {
+                IntersectGalloping(result, documents, intersection);
+            }
+            result.swap(intersection);
+        }
+    }
+    return result;
+}
+
+bool SearchServer::MatchesBooleanNode(const Query& query, uint32_t node_index, int document_id) const {
+    const BooleanNode& node = query.boolean_nodes[node_index];
+    const auto children = std::span(query.boolean_children).subspan(node.first_child, node.child_count);
+    const auto matches = [this, &query, document_id](uint32_t child) { return MatchesBooleanNode(query, child, document_id); };
+    switch (node.op) {
+    case BooleanOperator::TERM:
+        if (node.bitmap) {
+            return node.bitmap->Contains(document_id);
+        }
+        return node.postings && node.postings->count(document_id) > 0;
+    case BooleanOperator::AND:
+        return std::all_of(children.begin(), children.end(), matches);
+    case BooleanOperator::OR:
+        return std::any_of(children.begin(), children.end(), matches);
+    case BooleanOperator::NOT:
+        return !matches(children[0]);
+    }
+    return false;
+}
+
+std::vector<std::string_view> SearchServer::MatchBooleanQuery(const Query& query, int document_id) const {
+    std::vector<std::string_view> matched_words;
+    if (query.boolean_root == NO_BOOLEAN_NODE || !MatchesBooleanNode(query, query.boolean_root, document_id)) {
+        return matched_words;
+    }
+    const WordFreqs& document_words = GetDocumentWords(document_id);
+    for (const std::string_view& word : query.plus_words) {
+        const auto it = document_words.find(word);
+        if (it != document_words.end()) {
+            matched_words.push_back(it->first);
+        }
+    }
+    if (!query.field_plus_words.empty()) {
+        MatchFieldWords(query, document_id, matched_words);
+        std::sort(matched_words.begin(), matched_words.end());
+        matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
+    }
+    return matched_words;
+}
+
+void SearchServer::ParseQueryPhrase(const std::string_view& text, const std::string_view& suffix, Query& result) const {
+    Phrase phrase;
+    if (!suffix.empty()) {
+        if (suffix[0] != '~' || suffix.size() == 1 || suffix.size() > 10
+            || !std::all_of(suffix.begin() + 1, suffix.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            throw std::invalid_argument("Phrase suffix "s + std::string(suffix) + " is invalid"s);
+        }
+        phrase.is_exact = false;
+        phrase.slop = static_cast<uint32_t>(std::stoul(std::string(suffix.substr(1))));
+    }
+    for (const std::string_view& word : SplitIntoWords(text, result.GetMemory())) {
+        if (word.empty()) {
+            continue;
+        }
+        const QueryWord query_word = ParseQueryWord(word);
+        if (query_word.is_minus) {
+            throw std::invalid_argument("Minus word "s + std::string(word) + " inside phrase"s);
+        }
+        if (IsWildcardPattern(query_word.data)) {
+            throw std::invalid_argument("Pattern "s + std::string(word) + " inside phrase"s);
+        }
+        ForEachQueryTerm(query_word.data, result, [this, &phrase](const std::string_view& term) {
+            if (!IsStopWord(term)) {
+                phrase.words.push_back(term);
+            }
+        });
+    }
+    if (!phrase.is_exact) {
+        //для окна порядок не важен, повторы ничего не меняют
+        std::sort(phrase.words.begin(), phrase.words.end());
+        phrase.words.erase(std::unique(phrase.words.begin(), phrase.words.end()), phrase.words.end());
+    }
+    if (phrase.words.size() == 1) {
+        result.plus_words.push_back(phrase.words[0]);
+        return;
+    }
+    if (phrase.words.empty()) {
+        return;
+    }
+    if (!has_positional_index_) {
+        throw std::invalid_argument("Phrase queries require the positional index"s);
+    }
+    result.phrases.push_back(std::move(phrase));
+}
+
+void SearchServer::ExpandPattern(const std::string_view& pattern, std::pmr::vector<std::string_view>& terms,
+    const ExpansionSource& expansions) const
+{
+    if (expansions.given) {
+        const auto it = expansions.given->find(pattern);
+        if (it != expansions.given->end()) {
+            for (const auto& [term, _] : it->second) {
+                terms.push_back(term);
+            }
+            return;
+        }
+    }
+    const std::string_view prefix = pattern.substr(0, pattern.find_first_of("*?"sv));
+    if (prefix.empty()) {
+        throw std::invalid_argument("Pattern "s + std::string(pattern) + " must start with a literal prefix"s);
+    }
+    const std::string_view rest = pattern.substr(prefix.size());
+    size_t expansion_count = 0;
+    size_t scanned = 0;
+    for (auto it = word_to_document_freqs_.lower_bound(prefix);
+        it != word_to_document_freqs_.end() && it->first.substr(0, prefix.size()) == prefix
+            && scanned < MAX_PATTERN_SCANNED_TERMS;
+        ++it, ++scanned)
+    {
+        if (it->second.empty() || !MatchesWildcard(it->first.substr(prefix.size()), rest)) {
+            continue;
+        }
+        terms.push_back(it->first);
+        if (expansions.collect) {
+            (*expansions.collect)[std::string(pattern)].emplace_back(it->first, 1.0);
+        }
+        if (++expansion_count == MAX_PATTERN_EXPANSIONS) {
+            break;
+        }
+    }
+}
+
+void SearchServer::SetFuzzyMaxEdits(int max_edits) {
+    if (max_edits < 0 || max_edits > 2) {
+        throw std::invalid_argument("Fuzzy edit distance must be from 0 to 2"s);
+    }
+    if (max_edits == 0) {
+        fuzzy_terms_.Clear();
+    }
+    else if (fuzzy_max_edits_ == 0) {
+        for (const auto& [term, _] : word_to_document_freqs_) {
+            fuzzy_terms_.Insert(term);
+        }
+    }
+    fuzzy_max_edits_ = max_edits;
+}
+
+void SearchServer::ExpandFuzzy(const std::string_view& word, std::pmr::vector<std::pair<std::string_view, double>>& terms,
+    const ExpansionSource& expansions) const
+{
+    if (expansions.given) {
+        const auto it = expansions.given->find(word);
+        if (it != expansions.given->end()) {
+            terms.insert(terms.end(), it->second.begin(), it->second.end());
+            return;
+        }
+    }
+    const std::vector<char32_t> chars = DecodeUtf8(word);
+    const int max_edits = std::min(fuzzy_max_edits_, chars.size() <= 2 ? 0 : chars.size() <= 5 ? 1 : 2);
+    if (max_edits == 0) {
+        return;
+    }
+
+    struct Candidate {
+        std::string_view term;
+        int distance;
+        size_t document_freq;
+    };
+    std::vector<Candidate> candidates;
+    for (const auto& [term, distance] : fuzzy_terms_.FindWithinDistance(chars, max_edits)) {
+        //в боре остаются и слова удалённых документов
+        const size_t document_freq = word_to_document_freqs_.at(term).size();
+        if (distance > 0 && document_freq > 0) {
+            candidates.push_back({ term, distance, document_freq });
+        }
+    }
+
+    //для выбора по всем шардам нужны все кандидаты: лучшие по общим частотам могут не быть лучшими здесь
+    if (expansions.collect) {
+        auto& collected = (*expansions.collect)[std::string(word)];
+        for (const Candidate& candidate : candidates) {
+            terms.emplace_back(candidate.term, std::pow(FUZZY_EDIT_WEIGHT, candidate.distance));
+            collected.emplace_back(candidate.term, terms.back().second);
+        }
+        return;
+    }
+    //сначала ближайшие, среди равных - более частые
+    const size_t count = std::min(candidates.size(), MAX_FUZZY_EXPANSIONS);
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+        [](const Candidate& lhs, const Candidate& rhs) {
+            return lhs.distance < rhs.distance || (lhs.distance == rhs.distance && lhs.document_freq > rhs.document_freq);
+        });
+    for (size_t i = 0; i < count; ++i) {
+        terms.emplace_back(candidates[i].term, std::pow(FUZZY_EDIT_WEIGHT, candidates[i].distance));
+    }
+}
+
+std::vector<std::string_view> SearchServer::GetTermsByPrefix(const std::string_view& raw_prefix, size_t limit) const {
+    std::vector<std::string_view> terms;
+    //начало слова нормализуется как шаблон - без стемминга; дополняется последнее слово
+    std::string normalized;
+    std::string_view prefix = raw_prefix;
+    if (analyzer_) {
+        analyzer_->Normalize(raw_prefix, normalized, true);
+        prefix = normalized;
+        prefix.remove_prefix(std::min(prefix.rfind(' ') + 1, prefix.size()));
+        if (prefix.empty()) {
+            return terms;
+        }
+    }
+    for (auto it = word_to_document_freqs_.lower_bound(prefix);
+        it != word_to_document_freqs_.end() && terms.size() < limit && it->first.substr(0, prefix.size()) == prefix; ++it)
+    {
+        if (!it->second.empty()) {
+            terms.push_back(it->first);
+        }
+    }
+    return terms;
+}
+
+std::vector<const SearchServer::PositionPostings*> SearchServer::ResolvePhrase(const Phrase& phrase) const {
+    std::vector<const PositionPostings*> postings;
+    postings.reserve(phrase.words.size());
+    for (const std::string_view& word : phrase.words) {
+        const auto it = word_to_document_positions_.find(word);
+        if (it == word_to_document_positions_.end() || it->second.empty()) {
+            return {};
+        }
+        postings.push_back(&it->second);
+    }
+    return postings;
+}
+
+bool SearchServer::DocumentMatchesPhrase(const Phrase& phrase, const std::vector<const PositionPostings*>& postings, int document_id) const {
+    std::vector<PositionList> word_positions;
+    word_positions.reserve(postings.size());
+    for (const PositionPostings* word_postings : postings) {
+        const auto it = word_postings->find(document_id);
+        if (it == word_postings->end()) {
+            return false;
+        }
+        word_positions.push_back(DecodePositions(it->second));
+    }
+    return phrase.is_exact ? ContainsPhrase(word_positions) : ContainsWithinWindow(word_positions, phrase.slop);
+}
+
+void SearchServer::EnablePositionalIndex() {
+    if (!documents_.empty()) {
+        throw std::logic_error("Positional index must be enabled before adding documents"s);
+    }
+    has_positional_index_ = true;
+}
+
+std::string_view SearchServer::InternWord(const std::string_view& word) {
+    const auto it = word_to_document_freqs_.find(word);
+    if (it != word_to_document_freqs_.end()) {
+        return it->first;
+    }
+    const std::string& stored = doc_string_storage_.emplace_back(word);
+    //короткие строки лежат в самом объекте, длинные - в отдельном буфере с завершающим нулём
+    static const size_t local_capacity = std::string().capacity();
+    const bool is_local = stored.capacity() <= local_capacity;
+    term_bytes_ += sizeof(std::string) + (is_local ? 0 : stored.capacity() + 1);
+    if (fuzzy_max_edits_ > 0) {
+        fuzzy_terms_.Insert(doc_string_storage_.back());
+    }
+    return doc_string_storage_.back();
+}
+
+void SearchServer::SetTextAnalyzer(const AnalyzerOptions& options) {
+    if (!documents_.empty()) {
+        throw std::logic_error("Text analyzer must be set before adding documents"s);
+    }
+    analyzer_.emplace(options);
+    analyzed_stop_words_.clear();
+    for (const std::string& stop_word : stop_words_) {
+        //SplitIntoWords возвращает string_view - нормализованная строка должна пережить цикл
+        const std::string normalized = analyzer_->Normalize(stop_word);
+        for (const std::string_view& word : SplitIntoWords(normalized)) {
+            if (!word.empty()) {
+                analyzed_stop_words_.emplace(word);
+            }
+        }
+    }
+}
+
 void SearchServer::AddDocument(int document_id, const std::string_view& document, DocumentStatus status, const std::vector<int>& ratings) {
     if ((document_id < 0) || (documents_.count(document_id) > 0)) {
         throw std::invalid_argument("Invalid document_id"s);
     }
-    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
+    std::string normalized;
+    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document, normalized);
     const double inv_word_count = 1.0 / words.size();
-    for (const std::string_view& word : words) {
-        doc_string_storage_.push_back(std::string(word));
-        word_to_document_freqs_[std::string_view(doc_string_storage_.back())][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][std::string_view(doc_string_storage_.back())] += inv_word_count;
+    WordFreqs& word_freqs = document_to_word_freqs_[document_id];
+    std::map<std::string_view, PositionList> word_positions;
+    for (uint32_t position = 0; position < words.size(); ++position) {
+        const std::string_view term = InternWord(words[position]);
+        Postings& postings = word_to_document_freqs_[term];
+        live_term_count_ += postings.empty();
+        postings[document_id] += inv_word_count;
+        word_freqs[term] += inv_word_count;
+        if (has_positional_index_) {
+            word_positions[term].push_back(position);
+        }
+    }
+    for (const auto& [term, positions] : word_positions) {
+        StorePositions(term, document_id, positions);
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
+    posting_count_ += word_freqs.size();
+    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, words.size() });
+    total_document_length_ += words.size();
     document_ids_.push_back(document_id);
+    if (term_tiers_) {
+        for (const auto& [term, _] : word_freqs) {
+            UpdateTermTier(term, document_id, true);
+        }
+        UpdateTermTiers();
+    }
+}
+
+static void CheckFieldName(const std::string_view& name) {
+    if (name.empty() || name[0] == '-' || name.find_first_of(" :"sv) != name.npos
+        || any_of(name.begin(), name.end(), [](char c) { return c >= '\0' && c < ' '; })) {
+        throw std::invalid_argument("Field name "s + std::string(name) + " is invalid"s);
+    }
+}
+
+SearchServer::FieldIndex& SearchServer::GetOrAddField(const std::string_view& name) {
+    const auto it = fields_.find(name);
+    if (it != fields_.end()) {
+        return it->second;
+    }
+    CheckFieldName(name);
+    return fields_.try_emplace(std::string(name), &index_memory_->pool).first->second;
+}
+
+//общий текст полей; имена полей проверяются до изменения индекса
+static std::string JoinDocumentFields(const std::vector<DocumentField>& fields) {
+    std::string text;
+    for (const DocumentField& field : fields) {
+        if (!field.name.empty()) {
+            CheckFieldName(field.name);
+        }
+        if (!text.empty()) {
+            text += ' ';
+        }
+        text += field.text;
+    }
+    return text;
+}
+
+void SearchServer::AddDocument(int document_id, const std::vector<DocumentField>& fields, DocumentStatus status,
+    const std::vector<int>& ratings)
+{
+    AddDocument(document_id, JoinDocumentFields(fields), status, ratings);
+    AddDocumentFields(document_id, fields);
+}
+
+void SearchServer::AddDocumentFields(int document_id, const std::vector<DocumentField>& fields) {
+    //частота в поле нормируется длиной всего документа, как в основном индексе
+    const double inv_word_count = 1.0 / documents_.at(document_id).length;
+    std::string normalized;
+    for (const DocumentField& field : fields) {
+        if (field.name.empty()) {
+            continue;
+        }
+        FieldIndex& field_index = GetOrAddField(field.name);
+        for (const std::string_view& word : SplitIntoWordsNoStop(field.text, normalized)) {
+            //пустое слово даёт пробел в конце текста поля; в общем тексте его нет
+            if (word.empty()) {
+                continue;
+            }
+            const std::string_view term = word_to_document_freqs_.find(word)->first;
+            const auto [it, inserted] = field_index.word_to_document_freqs[term].try_emplace(document_id, 0.0);
+            it->second += inv_word_count;
+            field_posting_count_ += inserted;
+        }
+    }
+}
+
+void SearchServer::SetFieldWeight(const std::string_view& field, double weight) {
+    if (!(weight >= 0.0) || std::isinf(weight)) {
+        throw std::invalid_argument("Field weight must be finite and non-negative"s);
+    }
+    GetOrAddField(field).weight = weight;
+    has_field_weights_ = any_of(fields_.begin(), fields_.end(),
+        [](const auto& name_field) { return name_field.second.weight != 1.0; });
+}
+
+double SearchServer::GetFieldWeight(const std::string_view& field) const {
+    const auto it = fields_.find(field);
+    return it == fields_.end() ? 1.0 : it->second.weight;
+}
+
+SearchServer::FieldBoosts SearchServer::GetFieldBoosts(const std::string_view& word) const {
+    FieldBoosts boosts;
+    if (!has_field_weights_) {
+        return boosts;
+    }
+    for (const auto& [_, field] : fields_) {
+        if (field.weight == 1.0) {
+            continue;
+        }
+        const auto it = field.word_to_document_freqs.find(word);
+        if (it != field.word_to_document_freqs.end() && !it->second.empty()) {
+            boosts.emplace_back(&it->second, field.weight - 1.0);
+        }
+    }
+    return boosts;
+}
+
+bool SearchServer::MatchFieldWords(const Query& query, int document_id, std::vector<std::string_view>& matched_words) const {
+    for (const FieldWord& field_word : query.field_minus_words) {
+        const Postings* postings = FindFieldPostings(field_word);
+        if (postings && postings->count(document_id)) {
+            return false;
+        }
+    }
+    for (const FieldWord& field_word : query.field_plus_words) {
+        const auto it = field_word.field->word_to_document_freqs.find(field_word.word);
+        if (it != field_word.field->word_to_document_freqs.end() && it->second.count(document_id)) {
+            matched_words.push_back(it->first);
+        }
+    }
+    return true;
+}
+
+SearchServer::DocumentData& SearchServer::GetDocumentData(int document_id) {
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        throw std::out_of_range("Unknown document_id "s + std::to_string(document_id));
+    }
+    return it->second;
+}
+
+void SearchServer::UpdateDocument(int document_id, const std::string_view& document) {
+    GetDocumentData(document_id);
+    if (HasDocumentFields(document_id)) {
+        throw std::invalid_argument("Document "s + std::to_string(document_id) + " has fields: update it with fields"s);
+    }
+    ReplaceDocumentText(document_id, document);
+}
+
+void SearchServer::UpdateDocument(int document_id, const std::vector<DocumentField>& fields) {
+    GetDocumentData(document_id);
+    ReplaceDocumentText(document_id, JoinDocumentFields(fields));
+    AddDocumentFields(document_id, fields);
+}
+
+void SearchServer::ReplaceDocumentText(int document_id, const std::string_view& document) {
+    DocumentData& document_data = GetDocumentData(document_id);
+    std::string normalized;
+    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document, normalized);
+    RemoveDocumentFields(document_id);
+    //слова с позициями, сгруппированные по слову, - чтобы пройти их одним слиянием с прямым индексом
+    std::vector<std::pair<std::string_view, uint32_t>> sorted_words(words.size());
+    for (uint32_t position = 0; position < words.size(); ++position) {
+        sorted_words[position] = { words[position], position };
+    }
+    std::sort(sorted_words.begin(), sorted_words.end());
+    const double inv_word_count = 1.0 / words.size();
+
+    WordFreqs& word_freqs = document_to_word_freqs_[document_id];
+    posting_count_ -= word_freqs.size();
+    const auto remove_word = [this, document_id, &word_freqs](WordFreqs::iterator it) {
+        Postings& postings = word_to_document_freqs_.at(it->first);
+        postings.erase(document_id);
+        live_term_count_ -= postings.empty();
+        if (has_positional_index_) {
+            ErasePositions(it->first, document_id);
+        }
+        if (term_tiers_) {
+            UpdateTermTier(it->first, document_id, false);
+        }
+        return word_freqs.erase(it);
+    };
+    auto old_it = word_freqs.begin();
+    PositionList positions;
+    for (size_t begin = 0; begin < sorted_words.size();) {
+        const std::string_view word = sorted_words[begin].first;
+        //частота набирается так же, как в AddDocument, чтобы совпасть с ней до последнего бита
+        double term_freq = 0.0;
+        positions.clear();
+        for (; begin < sorted_words.size() && sorted_words[begin].first == word; ++begin) {
+            term_freq += inv_word_count;
+            positions.push_back(sorted_words[begin].second);
+        }
+        while (old_it != word_freqs.end() && old_it->first < word) {
+            old_it = remove_word(old_it);
+        }
+        std::string_view term;
+        if (old_it != word_freqs.end() && old_it->first == word) {
+            term = old_it->first;
+            if (old_it->second != term_freq) {
+                old_it->second = term_freq;
+                word_to_document_freqs_.at(term).at(document_id) = term_freq;
+            }
+            ++old_it;
+        }
+        else {
+            term = InternWord(word);
+            word_freqs.emplace_hint(old_it, term, term_freq);
+            Postings& postings = word_to_document_freqs_[term];
+            live_term_count_ += postings.empty();
+            postings[document_id] = term_freq;
+            if (term_tiers_) {
+                UpdateTermTier(term, document_id, true);
+            }
+        }
+        if (has_positional_index_) {
+            StorePositions(term, document_id, positions);
+        }
+    }
+    while (old_it != word_freqs.end()) {
+        old_it = remove_word(old_it);
+    }
+    posting_count_ += word_freqs.size();
+    total_document_length_ = total_document_length_ - document_data.length + words.size();
+    document_data.length = words.size();
+}
+
+void SearchServer::SetStatus(int document_id, DocumentStatus status) {
+    GetDocumentData(document_id).status = status;
+}
+
+void SearchServer::SetRatings(int document_id, const std::vector<int>& ratings) {
+    GetDocumentData(document_id).rating = ComputeAverageRating(ratings);
 }
 
 vector<Document> SearchServer::FindTopDocuments(const string_view& raw_query, DocumentStatus status) const {
@@ -103,37 +1085,288 @@ vector<Document> SearchServer::FindTopDocuments(const string_view& raw_query, Do
 vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query) const 
 { return SearchServer::FindTopDocuments(raw_query, DocumentStatus::ACTUAL); }
 
+BudgetedSearchResult SearchServer::FindTopDocumentsWithBudget(const string_view& raw_query, DocumentStatus status,
+    const QueryBudget& budget) const
+{
+    return FindTopDocumentsWithBudget(raw_query,
+        [status](int document_id, DocumentStatus document_status, int rating) { return document_status == status; },
+        TfIdfScorer{}, budget);
+}
+
+SearchPage SearchServer::FindPage(const string_view& raw_query, DocumentStatus status, const PageRequest& page) const {
+    return FindPage(execution::seq, raw_query,
+        [status](int document_id, DocumentStatus document_status, int rating) { return document_status == status; },
+        TfIdfScorer{}, page);
+}
+
 int SearchServer::GetDocumentCount() const {
     return documents_.size();
 }
 
+bool SearchServer::HasDocument(int document_id) const {
+    return documents_.count(document_id) > 0;
+}
+
+//узел дерева std::map в libstdc++: цвет и три указателя, за ними значение
+template <typename Map>
+static constexpr size_t MapNodeBytes() {
+    return 4 * sizeof(void*) + sizeof(typename Map::value_type);
+}
+
+IndexMemoryStats SearchServer::GetMemoryStats(size_t top_n) const {
+    IndexMemoryStats stats;
+    stats.document_count = documents_.size();
+    stats.term_count = word_to_document_freqs_.size();
+    stats.posting_count = posting_count_;
+    stats.field_posting_count = field_posting_count_;
+    stats.dense_term_count = dense_postings_.size();
+    for (const auto& [_, bitmap] : dense_postings_) {
+        stats.dense_posting_count += bitmap.GetCount();
+        stats.dense_bitmap_bytes += MapNodeBytes<decltype(dense_postings_)>() + bitmap.GetMemoryUsage();
+    }
+    const bool has_stop_words = term_tiers_ && term_tiers_->stop_max_idf;
+
+    //самые длинные постинги - куча из top_n лучших, наверху худший из них
+    const auto is_longer = [](const pair<string_view, size_t>& lhs, const pair<string_view, size_t>& rhs) {
+        return lhs.second != rhs.second ? lhs.second > rhs.second : lhs.first < rhs.first;
+    };
+    if (top_n > 0) {
+        stats.longest_postings.reserve(top_n);
+        for (const auto& [term, postings] : word_to_document_freqs_) {
+            const size_t length = postings.size();
+            if (length == 0) {
+                continue;
+            }
+            stats.dynamic_stop_word_count += has_stop_words && IsDynamicStopWord(postings);
+            stats.max_posting_length = max(stats.max_posting_length, length);
+            if (stats.longest_postings.size() < top_n) {
+                stats.longest_postings.emplace_back(term, length);
+                push_heap(stats.longest_postings.begin(), stats.longest_postings.end(), is_longer);
+            }
+            else if (is_longer({ term, length }, stats.longest_postings.front())) {
+                pop_heap(stats.longest_postings.begin(), stats.longest_postings.end(), is_longer);
+                stats.longest_postings.back() = { term, length };
+                push_heap(stats.longest_postings.begin(), stats.longest_postings.end(), is_longer);
+            }
+        }
+        sort_heap(stats.longest_postings.begin(), stats.longest_postings.end(), is_longer);
+    }
+    stats.live_term_count = live_term_count_;
+    if (stats.live_term_count > 0) {
+        stats.average_posting_length = static_cast<double>(posting_count_) / stats.live_term_count;
+    }
+
+    stats.term_bytes = term_bytes_;
+    stats.inverted_index_bytes = word_to_document_freqs_.size() * MapNodeBytes<decltype(word_to_document_freqs_)>()
+        + posting_count_ * MapNodeBytes<Postings>();
+    stats.forward_index_bytes = document_to_word_freqs_.size() * MapNodeBytes<decltype(document_to_word_freqs_)>()
+        + posting_count_ * MapNodeBytes<WordFreqs>();
+    stats.document_bytes = documents_.size() * MapNodeBytes<decltype(documents_)>() + document_ids_.capacity() * sizeof(int);
+    if (has_positional_index_) {
+        stats.position_bytes = word_to_document_positions_.size() * MapNodeBytes<decltype(word_to_document_positions_)>()
+            + posting_count_ * MapNodeBytes<PositionPostings>() + position_bytes_;
+    }
+    for (const auto& [_, field] : fields_) {
+        stats.field_bytes += MapNodeBytes<decltype(fields_)>()
+            + field.word_to_document_freqs.size() * MapNodeBytes<decltype(field.word_to_document_freqs)>();
+    }
+    stats.field_bytes += field_posting_count_ * MapNodeBytes<Postings>();
+    stats.fuzzy_trie_bytes = fuzzy_terms_.GetMemoryUsage();
+    stats.total_bytes = stats.term_bytes + stats.inverted_index_bytes + stats.forward_index_bytes + stats.document_bytes
+        + stats.position_bytes + stats.field_bytes + stats.fuzzy_trie_bytes + stats.dense_bitmap_bytes;
+    stats.index_pool_bytes = index_memory_->upstream.GetAllocatedBytes();
+    return stats;
+}
+
+void SearchServer::SetTermTiers(const TermTierOptions& options) {
+    if (!(options.dense_max_idf >= 0.0) || (options.stop_max_idf && !(*options.stop_max_idf >= 0.0))) {
+        throw std::invalid_argument("Term tier IDF thresholds must be non-negative"s);
+    }
+    term_tiers_ = options;
+    ClassifyTerms();
+}
+
+bool SearchServer::IsDenseTerm(size_t document_freq, size_t bitmap_bytes, bool is_dense) const {
+    if (document_freq == 0) {
+        return false;
+    }
+    //IDF не выше порога: document_freq >= N * e^-порог
+    const double min_document_freq = documents_.size() * std::exp(-term_tiers_->dense_max_idf);
+    //при редких больших id карта вышла бы больше самих постингов
+    const size_t max_bitmap_bytes = document_freq * MapNodeBytes<Postings>();
+    if (is_dense) {
+        return document_freq >= min_document_freq / 2 && bitmap_bytes <= 2 * max_bitmap_bytes;
+    }
+    return document_freq >= min_document_freq && bitmap_bytes <= max_bitmap_bytes;
+}
+
+template <typename Postings>
+static DocumentBitmap MakeDocumentBitmap(const Postings& postings) {
+    DocumentBitmap bitmap;
+    for (auto it = postings.rbegin(); it != postings.rend(); ++it) {
+        bitmap.Insert(it->first);  //с наибольшего id - карта выделяется один раз
+    }
+    return bitmap;
+}
+
+void SearchServer::ClassifyTerms() {
+    dense_postings_.clear();
+    tiered_document_count_ = documents_.size();
+    for (const auto& [word, postings] : word_to_document_freqs_) {
+        //карта слова доходит до его наибольшего id, а не до наибольшего id индекса
+        if (!postings.empty()
+            && IsDenseTerm(postings.size(), DocumentBitmap::GetMemoryUsage(postings.rbegin()->first), false)) {
+            dense_postings_.emplace(word, MakeDocumentBitmap(postings));
+        }
+    }
+}
+
+void SearchServer::UpdateTermTier(const std::string_view& word, int document_id, bool is_added) {
+    const Postings& postings = word_to_document_freqs_.at(word);
+    const auto it = dense_postings_.find(word);
+    if (it == dense_postings_.end()) {
+        if (is_added && IsDenseTerm(postings.size(), DocumentBitmap::GetMemoryUsage(postings.rbegin()->first), false)) {
+            dense_postings_.emplace(word, MakeDocumentBitmap(postings));
+        }
+        return;
+    }
+    //карта растёт до нового id, поэтому её размер проверяется до вставки
+    const size_t bitmap_bytes = is_added
+        ? std::max(it->second.GetMemoryUsage(), DocumentBitmap::GetMemoryUsage(document_id))
+        : it->second.GetMemoryUsage();
+    if (!IsDenseTerm(postings.size(), bitmap_bytes, true)) {
+        dense_postings_.erase(it);
+    }
+    else if (is_added) {
+        it->second.Insert(document_id);
+    }
+    else {
+        it->second.Erase(document_id);
+    }
+}
+
+void SearchServer::UpdateTermTiers() {
+    if (documents_.size() >= 2 * tiered_document_count_ || 2 * documents_.size() <= tiered_document_count_) {
+        ClassifyTerms();
+    }
+}
+
+bool SearchServer::IsDynamicStopWord(const Postings& postings) const {
+    return !postings.empty() && std::log(documents_.size() * 1.0 / postings.size()) <= *term_tiers_->stop_max_idf;
+}
+
+void SearchServer::RemoveDynamicStopWords(Query& query) const {
+    const auto is_stop_word = [this](const std::string_view& word) {
+        const auto it = word_to_document_freqs_.find(word);
+        return it != word_to_document_freqs_.end() && IsDynamicStopWord(it->second);
+    };
+    const bool has_rare_words = !query.phrases.empty() || !query.field_plus_words.empty()
+        || !std::all_of(query.plus_words.begin(), query.plus_words.end(), is_stop_word)
+        || std::any_of(query.fuzzy_words.begin(), query.fuzzy_words.end(), [&is_stop_word](const auto& word) { return !is_stop_word(word.first); });
+    if (!has_rare_words) {
+        return;
+    }
+    std::erase_if(query.plus_words, is_stop_word);
+    std::erase_if(query.fuzzy_words, [&is_stop_word](const auto& word) { return is_stop_word(word.first); });
+}
+
+CollectionStatistics SearchServer::GetQueryStatistics(const std::string_view& raw_query) const {
+    const QueryArenaScope arena;
+    CollectionStatistics statistics;
+    const Query query = ParseQuery(raw_query, arena.GetResource(), { nullptr, &statistics.expansions });
+    statistics.document_count = documents_.size();
+    statistics.total_document_length = total_document_length_;
+    const auto add_word = [this, &statistics](const std::string_view& word) {
+        const auto it = word_to_document_freqs_.find(word);
+        if (it != word_to_document_freqs_.end() && !it->second.empty()) {
+            statistics.document_freqs.emplace(std::string(word), it->second.size());
+        }
+    };
+    for (const std::string_view& word : query.plus_words) {
+        add_word(word);
+    }
+    for (const auto& [word, _] : query.fuzzy_words) {
+        add_word(word);
+    }
+    for (const Phrase& phrase : query.phrases) {
+        for (const std::string_view& word : phrase.words) {
+            add_word(word);
+        }
+    }
+    return statistics;
+}
+
 using MatchedWords_Status = std::tuple<std::vector<std::string_view>, DocumentStatus>;
+const SearchServer::WordFreqs& SearchServer::GetDocumentWords(int document_id) const {
+    static const WordFreqs empty_words;
+    const auto it = document_to_word_freqs_.find(document_id);
+    return it == document_to_word_freqs_.end() ? empty_words : it->second;
+}
+
 MatchedWords_Status SearchServer::MatchDocument(const std::string_view& raw_query_sv,
     int document_id) const //последовательная версия
 {
-    Query query = ParseQuery(raw_query_sv);
+    documents_.at(document_id); //неизвестный документ - out_of_range раньше ошибок разбора запроса
+    const QueryArenaScope arena;
+    return MatchParsedQuery(ParseQuery(raw_query_sv, arena.GetResource()), document_id);
+}
 
-    std::vector<std::string_view> matched_words;
+MatchedWords_Status SearchServer::MatchParsedQuery(const Query& query, int document_id) const {
+    const DocumentStatus status = documents_.at(document_id).status;
+    if (query.is_boolean) {
+        return { MatchBooleanQuery(query, document_id), status };
+    }
+    const WordFreqs& document_words = GetDocumentWords(document_id);
 
+    std::vector<std::string_view> matched_words;
     for (const string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.clear();
-            return { matched_words, documents_.at(document_id).status };
+        if (document_words.count(word)) {
+            return { matched_words, status };
         }
     }
+    std::vector<std::string_view> field_words;
+    if (!MatchFieldWords(query, document_id, field_words)) {
+        return { matched_words, status };
+    }
 
-    for (const string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    matched_words.reserve(std::min(query.plus_words.size(), document_words.size()));
+    if (query.plus_words.size() * MATCH_MERGE_RATIO < document_words.size()) {
+        //короткий запрос: поиск каждого слова в прямом индексе документа
+        for (const string_view& word : query.plus_words) {
+            const auto it = document_words.find(word);
+            if (it != document_words.end()) {
+                matched_words.push_back(it->first);
+            }
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+    }
+    else {
+        //слова запроса отсортированы, слова документа тоже - достаточно одного слияния
+        auto query_it = query.plus_words.begin();
+        auto document_it = document_words.begin();
+        while (query_it != query.plus_words.end() && document_it != document_words.end()) {
+            if (*query_it < document_it->first) {
+                ++query_it;
+            }
+            else if (document_it->first < *query_it) {
+                ++document_it;
+            }
+            else {
+                matched_words.push_back(document_it->first);
+                ++query_it;
+                ++document_it;
+            }
         }
     }
-    return { matched_words, documents_.at(document_id).status };
+    AddMatchedFuzzyWords(query, document_words, matched_words);
+    if (!query.phrases.empty()) {
+        AddMatchedPhraseWords(ResolveQuery(query), document_id, matched_words);
+    }
+    if (!field_words.empty()) {
+        matched_words.insert(matched_words.end(), field_words.begin(), field_words.end());
+        std::sort(matched_words.begin(), matched_words.end());
+        matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
+    }
+    return { matched_words, status };
 }
 
 MatchedWords_Status SearchServer::MatchDocument(const std::execution::sequenced_policy&,
@@ -147,44 +1380,171 @@ MatchedWords_Status SearchServer::MatchDocument(const std::execution::parallel_p
     const std::string_view& raw_query_sv, //параллельная версия
     int document_id) const
 {
-    Query query = ParseQuery(raw_query_sv, true);
-    vector<string_view> matched_words(query.plus_words.size());
-
-    if (std::any_of(policy,
-                    query.minus_words.begin(), 
-                    query.minus_words.end(), 
-                    [&](const string_view& word) 
-                        {
-                            if (word_to_document_freqs_.count(word) > 0 && word_to_document_freqs_.at(word).count(document_id)) {
-                                matched_words.clear();
-                                return true;
-                            }
-                            return false;
-                        }
-                   )
-        ) 
-    {return { matched_words, documents_.at(document_id).status };}
-
-    auto end = std::copy_if(policy,
-                            query.plus_words.begin(), 
-                            query.plus_words.end(), 
-                            matched_words.begin(), 
-                            [&](const std::string_view& word){
-                                                                if (word_to_document_freqs_.count(word) == 0) {
-                                                                    return false;
-                                                                }
-                                                                if (word_to_document_freqs_.at(word).count(document_id)) {
-                                                                    return true;
-                                                                }
-                                                                return false;
-                                                             }
-    );
-
-    //сортировка и повторы
-    std::sort(policy, matched_words.begin(), end);
-    matched_words.erase(std::unique(policy, matched_words.begin(), end), matched_words.end());
-
-    return { matched_words, documents_.at(document_id).status };
+    const DocumentStatus status = documents_.at(document_id).status;
+    const QueryArenaScope arena;
+    const Query query = ParseQuery(raw_query_sv, arena.GetResource());
+    //на коротких запросах накладные расходы на потоки больше выигрыша
+    if (query.is_boolean || !query.field_plus_words.empty() || !query.field_minus_words.empty()
+        || query.plus_words.size() + query.minus_words.size() < PARALLEL_MATCH_MIN_QUERY_WORDS) {
+        return MatchParsedQuery(query, document_id);
+    }
+    const WordFreqs& document_words = GetDocumentWords(document_id);
+    std::vector<std::string_view> matched_words;
+
+    if (std::any_of(policy, query.minus_words.begin(), query.minus_words.end(),
+            [&document_words](const string_view& word) { return document_words.count(word) > 0; })) {
+        return { matched_words, status };
+    }
+
+    //больше слов, чем есть в документе, совпасть не может
+    matched_words.resize(std::min(query.plus_words.size(), document_words.size()));
+    //copy_if сохраняет порядок, а слова запроса уже отсортированы и уникальны
+    const auto end = std::copy_if(policy, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(),
+        [&document_words](const string_view& word) { return document_words.count(word) > 0; });
+    matched_words.erase(end, matched_words.end());
+    AddMatchedFuzzyWords(query, document_words, matched_words);
+    if (!query.phrases.empty()) {
+        AddMatchedPhraseWords(ResolveQuery(query), document_id, matched_words);
+    }
+
+    return { matched_words, status };
+}
+
+SearchServer::ResolvedQuery SearchServer::ResolveQuery(const Query& query) const {
+    ResolvedQuery result;
+    result.plus_words.reserve(query.plus_words.size());
+    for (const string_view& word : query.plus_words) {
+        const auto it = word_to_document_freqs_.find(word);
+        if (it != word_to_document_freqs_.end()) {
+            result.plus_words.emplace_back(it->first, &it->second);
+        }
+    }
+    for (const auto& [word, _] : query.fuzzy_words) {
+        result.plus_words.emplace_back(word, &word_to_document_freqs_.at(word));
+    }
+    //слово поля - те же постинги поля под тем же словом; совпавшее слово в выдаче одно
+    for (const FieldWord& field_word : query.field_plus_words) {
+        const auto it = field_word.field->word_to_document_freqs.find(field_word.word);
+        if (it != field_word.field->word_to_document_freqs.end()) {
+            result.plus_words.emplace_back(it->first, &it->second);
+        }
+    }
+    if (!query.fuzzy_words.empty() || !query.field_plus_words.empty()) {
+        std::sort(result.plus_words.begin(), result.plus_words.end());
+    }
+    for (const string_view& word : query.minus_words) {
+        const auto it = word_to_document_freqs_.find(word);
+        if (it != word_to_document_freqs_.end()) {
+            result.minus_words.push_back(&it->second);
+        }
+    }
+    for (const FieldWord& field_word : query.field_minus_words) {
+        if (const Postings* postings = FindFieldPostings(field_word)) {
+            result.minus_words.push_back(postings);
+        }
+    }
+    for (const Phrase& phrase : query.phrases) {
+        std::vector<const PositionPostings*> postings = ResolvePhrase(phrase);
+        if (!postings.empty()) {
+            result.phrases.emplace_back(phrase, std::move(postings));
+        }
+    }
+    return result;
+}
+
+void SearchServer::AddMatchedFuzzyWords(const Query& query, const WordFreqs& document_words,
+    std::vector<std::string_view>& matched_words)
+{
+    const size_t plus_matched = matched_words.size();
+    for (const auto& [word, _] : query.fuzzy_words) {
+        const auto it = document_words.find(word);
+        if (it != document_words.end()) {
+            matched_words.push_back(it->first);
+        }
+    }
+    //оба списка отсортированы и не пересекаются
+    std::inplace_merge(matched_words.begin(), matched_words.begin() + plus_matched, matched_words.end());
+}
+
+void SearchServer::AddMatchedPhraseWords(const ResolvedQuery& query, int document_id, std::vector<std::string_view>& matched_words) const {
+    const WordFreqs& document_words = GetDocumentWords(document_id);
+    bool added = false;
+    for (const auto& [phrase, postings] : query.phrases) {
+        if (DocumentMatchesPhrase(phrase, postings, document_id)) {
+            for (const std::string_view& word : phrase.words) {
+                matched_words.push_back(document_words.find(word)->first);
+            }
+            added = true;
+        }
+    }
+    if (added) {
+        std::sort(matched_words.begin(), matched_words.end());
+        matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
+    }
+}
+
+MatchedWords_Status SearchServer::MatchResolvedQuery(const ResolvedQuery& query, int document_id) const {
+    const DocumentStatus status = documents_.at(document_id).status;
+    std::vector<std::string_view> matched_words;
+    for (const auto* word_freqs : query.minus_words) {
+        if (word_freqs->count(document_id)) {
+            return { matched_words, status };
+        }
+    }
+    for (const auto& [word, word_freqs] : query.plus_words) {
+        if ((matched_words.empty() || matched_words.back() != word) && word_freqs->count(document_id)) {
+            matched_words.push_back(word);
+        }
+    }
+    AddMatchedPhraseWords(query, document_id, matched_words);
+    return { matched_words, status };
+}
+
+std::vector<MatchedWords_Status> SearchServer::MatchDocuments(const std::string_view& raw_query_sv,
+    const std::vector<int>& document_ids) const
+{
+    const QueryArenaScope arena;
+    const Query parsed_query = ParseQuery(raw_query_sv, arena.GetResource());
+    std::vector<MatchedWords_Status> result;
+    result.reserve(document_ids.size());
+    if (parsed_query.is_boolean) {
+        for (const int document_id : document_ids) {
+            result.emplace_back(MatchBooleanQuery(parsed_query, document_id), documents_.at(document_id).status);
+        }
+        return result;
+    }
+    const ResolvedQuery query = ResolveQuery(parsed_query);
+    for (const int document_id : document_ids) {
+        result.push_back(MatchResolvedQuery(query, document_id));
+    }
+    return result;
+}
+
+std::vector<MatchedWords_Status> SearchServer::MatchDocuments(const std::execution::sequenced_policy&,
+    const std::string_view& raw_query_sv,
+    const std::vector<int>& document_ids) const
+{
+    return MatchDocuments(raw_query_sv, document_ids);
+}
+
+std::vector<MatchedWords_Status> SearchServer::MatchDocuments(const std::execution::parallel_policy& policy,
+    const std::string_view& raw_query_sv,
+    const std::vector<int>& document_ids) const
+{
+    const QueryArenaScope arena;
+    const Query parsed_query = ParseQuery(raw_query_sv, arena.GetResource());
+    std::vector<MatchedWords_Status> result(document_ids.size());
+    if (parsed_query.is_boolean) {
+        std::transform(policy, document_ids.begin(), document_ids.end(), result.begin(),
+            [this, &parsed_query](int document_id) {
+                return MatchedWords_Status{ MatchBooleanQuery(parsed_query, document_id), documents_.at(document_id).status };
+            });
+        return result;
+    }
+    const ResolvedQuery query = ResolveQuery(parsed_query);
+    std::transform(policy, document_ids.begin(), document_ids.end(), result.begin(),
+        [this, &query](int document_id) { return MatchResolvedQuery(query, document_id); });
+    return result;
 }
 
 std::vector<int>::const_iterator SearchServer::begin() const
@@ -203,27 +1563,84 @@ const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int d
     if (documents_.count(document_id) == 0) {
         return word_freqs;
     }
-    word_freqs = document_to_word_freqs_.at(document_id);
+    const WordFreqs& document_words = document_to_word_freqs_.at(document_id);
+    word_freqs.clear();
+    word_freqs.insert(document_words.begin(), document_words.end());
 
     return word_freqs;
 }
 
+void SearchServer::RemoveDocumentPositions(int document_id) {
+    if (!has_positional_index_) {
+        return;
+    }
+    for (const auto& [word, _] : GetDocumentWords(document_id)) {
+        ErasePositions(word, document_id);
+    }
+}
+
+void SearchServer::StorePositions(const std::string_view& word, int document_id, const PositionList& positions) {
+    EncodedPositions& stored = word_to_document_positions_[word][document_id];
+    position_bytes_ -= stored.capacity();
+    stored = EncodePositions(positions);
+    position_bytes_ += stored.capacity();
+}
+
+void SearchServer::ErasePositions(const std::string_view& word, int document_id) {
+    PositionPostings& postings = word_to_document_positions_.at(word);
+    const auto it = postings.find(document_id);
+    if (it != postings.end()) {
+        position_bytes_ -= it->second.capacity();
+        postings.erase(it);
+    }
+}
+
+bool SearchServer::HasDocumentFields(int document_id) const {
+    for (const auto& [_, field] : fields_) {
+        for (const auto& [word, _] : GetDocumentWords(document_id)) {
+            const auto it = field.word_to_document_freqs.find(word);
+            if (it != field.word_to_document_freqs.end() && it->second.count(document_id)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void SearchServer::RemoveDocumentFields(int document_id) {
+    for (auto& [_, field] : fields_) {
+        for (const auto& [word, _] : GetDocumentWords(document_id)) {
+            const auto it = field.word_to_document_freqs.find(word);
+            if (it != field.word_to_document_freqs.end()) {
+                field_posting_count_ -= it->second.erase(document_id);
+            }
+        }
+    }
+}
+
 void SearchServer::RemoveDocument(int document_id) 
 {
     if (!documents_.count(document_id)) { return; }
+    //только постинги слов самого документа, а не весь словарь
+    for (const auto& [word, _] : GetDocumentWords(document_id)) {
+        Postings& postings = word_to_document_freqs_.at(word);
+        postings.erase(document_id);
+        live_term_count_ -= postings.empty();
+        if (term_tiers_) {
+            UpdateTermTier(word, document_id, false);
+        }
+    }
+    RemoveDocumentPositions(document_id);
+    RemoveDocumentFields(document_id);
+    posting_count_ -= GetDocumentWords(document_id).size();
     document_to_word_freqs_.erase(document_id);
+    total_document_length_ -= documents_.at(document_id).length;
     documents_.erase(document_id);
+    if (term_tiers_) {
+        UpdateTermTiers();
+    }
     auto it0 = std::remove(document_ids_.begin(), document_ids_.end(), document_id);
     document_ids_.erase(it0, document_ids_.end());
-
-    for (auto& element : word_to_document_freqs_)
-    {
-        auto it = element.second.find(document_id);
-        if (it != element.second.end())
-        {
-            element.second.erase(it);
-        }
-    }
 }
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy& policy, int document_id)
@@ -235,9 +1652,24 @@ void SearchServer::RemoveDocument(const std::execution::parallel_policy& policy,
     std::for_each(policy, word_ptrs.begin(), word_ptrs.end(),
         [this, document_id](auto word)
         { word_to_document_freqs_.at(word).erase(document_id); });
+    //слова документа различны, так что опустевшие постинги считаются по одному разу
+    live_term_count_ -= std::count_if(word_ptrs.begin(), word_ptrs.end(),
+        [this](std::string_view word) { return word_to_document_freqs_.at(word).empty(); });
+    if (term_tiers_) {
+        for (const std::string_view& word : word_ptrs) {
+            UpdateTermTier(word, document_id, false);
+        }
+    }
+    RemoveDocumentPositions(document_id);
+    RemoveDocumentFields(document_id);
 
+    posting_count_ -= word_ptrs.size();
     document_to_word_freqs_.erase(document_id);
+    total_document_length_ -= documents_.at(document_id).length;
     documents_.erase(document_id);
+    if (term_tiers_) {
+        UpdateTermTiers();
+    }
     document_ids_.erase(std::remove(document_ids_.begin(), document_ids_.end(), document_id), document_ids_.end());
 }
 
@@ -292,11 +1724,11 @@ int SearchServer::GetDocumentId(int index) const {
 void MatchDocuments(const SearchServer& search_server, const std::string& query) {
     try {
         std::cout << "Matching for request: "s << query << std::endl;
-        const int document_count = search_server.GetDocumentCount();
-        for (int index = 0; index < document_count; ++index) {
-            const int document_id = search_server.GetDocumentId(index);
-            const auto [words, status] = search_server.MatchDocument(query, document_id);
-            PrintMatchDocumentResult(document_id, words, status);
+        const std::vector<int> document_ids(search_server.begin(), search_server.end());
+        const auto matches = search_server.MatchDocuments(query, document_ids);
+        for (size_t index = 0; index < document_ids.size(); ++index) {
+            const auto& [words, status] = matches[index];
+            PrintMatchDocumentResult(document_ids[index], words, status);
         }
     }
     catch (const std::exception& e) {
@@ -1,22 +1,162 @@
 #pragma once
 #include "document.h"
+#include "document_bitmap.h"
 #include "string_processing.h"
-#include "log_duration.h"
+#include "profiler.h"
 #include "concurrent_map.h"
+#include "position_list.h"
+#include "query_arena.h"
+#include "scoring.h"
+#include "term_trie.h"
+#include "text_analyzer.h"
 
 #include <execution>
 #include <map>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <atomic>
 #include <cmath>
 #include <deque>
+#include <forward_list>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <tuple>
 #include <type_traits>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+//с какой длины запроса параллельная версия MatchDocument действительно распараллеливает работу
+const size_t PARALLEL_MATCH_MIN_QUERY_WORDS = 256;
+//во сколько раз документ должен быть длиннее запроса, чтобы искать слова поштучно, а не сливать списки
+const size_t MATCH_MERGE_RATIO = 8;
+//поиск со сроком: как часто длинный цикл по постингам сверяется с часами
+const size_t DEADLINE_CHECK_POSTINGS = 1024;
+
+//сколько слов словаря может подставить один шаблон запроса (comp*, c?t) и сколько слов
+//с его буквальным началом можно перебрать. Шаблон без буквального начала (*ny, ?at) отвергается:
+//он перебирал бы весь словарь
+const size_t MAX_PATTERN_EXPANSIONS = 256;
+const size_t MAX_PATTERN_SCANNED_TERMS = 1 << 16;
+
+//нечёткий поиск: сколько слов словаря может заменить одно слово запроса и во сколько раз
+//уменьшается вес замены за каждую правку
+const size_t MAX_FUZZY_EXPANSIONS = 16;
+constexpr double FUZZY_EDIT_WEIGHT = 0.5;
+
+//самый крупный блок, который выделяется из пула индекса; узлы постингов и прямого индекса
+//занимают 48-104 байта, всё крупнее идёт мимо пула
+const size_t INDEX_POOL_MAX_BLOCK = 128;
+
 //чувствительность поиска по рейтингу
 constexpr double COMPARISON_TOLERANCE = 1e-6;
 
+//релевантность, округлённая до COMPARISON_TOLERANCE: равные ключи - равная релевантность.
+//Сравнение разности с допуском не транзитивно (a~b, b~c, но a<c) и ломает sort и курсор страниц
+inline double GetRelevanceKey(double relevance) {
+    return std::round(relevance / COMPARISON_TOLERANCE);
+}
+
+//порядок выдачи: ключ релевантности, затем рейтинг, затем id. Это строгий слабый порядок,
+//а с id - полный, поэтому последний документ страницы однозначно задаёт место следующей
+inline bool IsRankedBefore(const Document& lhs, const Document& rhs) {
+    const double lhs_key = GetRelevanceKey(lhs.relevance);
+    const double rhs_key = GetRelevanceKey(rhs.relevance);
+    if (lhs_key != rhs_key) {
+        return lhs_key > rhs_key;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+//сколько работы можно потратить на один запрос
+struct QueryBudget {
+    size_t max_postings = 0;                //постингов плюс-слов, фраз и булева запроса; 0 - без ограничения
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+
+    bool IsUnlimited() const {
+        return max_postings == 0 && !deadline;
+    }
+};
+
+//бюджет, который сервис даёт каждому запросу: срок отсчитывается от прихода запроса
+struct QueryLimits {
+    size_t max_postings = 0;                    //0 - без ограничения
+    std::chrono::microseconds timeout{ 0 };     //0 - без срока
+
+    bool IsUnlimited() const {
+        return max_postings == 0 && timeout.count() == 0;
+    }
+    QueryBudget MakeBudget(std::chrono::steady_clock::time_point start) const {
+        QueryBudget budget;
+        budget.max_postings = max_postings;
+        if (timeout.count() > 0) {
+            budget.deadline = start + timeout;
+        }
+        return budget;
+    }
+};
+
+struct BudgetedSearchResult {
+    std::vector<Document> documents;
+    bool is_truncated = false;              //часть слов запроса не учтена - выдача приблизительная
+    size_t postings_scanned = 0;            //постинги, учтённые в бюджете
+};
+
+//какую страницу выдачи вернуть: page_size документов, пропустив offset лучших.
+//search_after - последний документ предыдущей страницы: выдача продолжается сразу после него,
+//и offset отсчитывается уже от этого места
+struct PageRequest {
+    size_t page_size = MAX_RESULT_DOCUMENT_COUNT;
+    size_t offset = 0;
+    std::optional<Document> search_after;
+    QueryBudget budget;                     //с ограничением поиск последовательный, см. FindTopDocumentsWithBudget
+};
+
+struct SearchPage {
+    std::vector<Document> documents;
+    size_t total_count = 0;                 //сколько всего документов подходит под запрос
+    std::optional<Document> next_cursor;    //search_after для следующей страницы; нет - страница последняя
+    bool is_truncated = false;              //бюджет запроса кончился - выдача приблизительная
+};
+
+//сколько памяти занимают части индекса - для планирования ёмкости и проверки оптимизаций памяти.
+//Байты структур на деревьях - оценка: число узлов на размер узла без округления аллокатора;
+//index_pool_bytes - точно, сколько пул индекса взял у системы, вместе со свободными в нём блоками
+struct IndexMemoryStats {
+    size_t term_bytes = 0;              //строки словаря, по одной копии каждого слова
+    size_t inverted_index_bytes = 0;    //слово -> документы с частотами
+    size_t forward_index_bytes = 0;     //документ -> слова с частотами
+    size_t document_bytes = 0;          //рейтинг, статус, длина и список id документов
+    size_t position_bytes = 0;          //позиционный индекс вместе со сжатыми позициями
+    size_t field_bytes = 0;             //постинги полей с именем
+    size_t fuzzy_trie_bytes = 0;        //бор нечёткого поиска
+    size_t dense_bitmap_bytes = 0;      //битовые карты горячих слов
+    size_t total_bytes = 0;             //сумма оценок выше
+    size_t index_pool_bytes = 0;        //пул индекса: постинги, прямой индекс, поля
+
+    size_t document_count = 0;
+    size_t term_count = 0;              //слов в словаре; слово остаётся в нём и после удаления всех его документов
+    size_t live_term_count = 0;         //слов, у которых есть документы
+    size_t posting_count = 0;           //пар (слово, документ)
+    size_t field_posting_count = 0;
+    size_t dense_term_count = 0;        //горячих слов, с битовой картой (SetTermTiers)
+    size_t dense_posting_count = 0;     //постингов у горячих слов; остальные - у холодных
+    size_t dynamic_stop_word_count = 0; //слов, которые запрос сейчас отбросил бы как слишком частые (при top_n > 0)
+    double average_posting_length = 0.0;    //по живым словам
+    size_t max_posting_length = 0;
+    std::vector<std::pair<std::string_view, size_t>> longest_postings;  //слова с самыми длинными постингами, по убыванию
+};
+
+//деление слов словаря по частоте в документах, через IDF = ln(N / df)
+struct TermTierOptions {
+    double dense_max_idf = 2.0;             //горячие слова: есть хотя бы в каждом ~7-м документе
+    std::optional<double> stop_max_idf;     //динамические стоп-слова; нет значения - не отбрасываются
+};
+
 using namespace std::string_literals;
 class SearchServer {
 public://========================================================================
@@ -28,10 +168,65 @@ public://=======================================================================
     explicit SearchServer(const std::string_view& stop_words_sv)
         : SearchServer(SplitIntoWords(stop_words_sv))
     {}
+    //только перемещение: индексы ссылаются string_view на слова своего хранилища и выделяют узлы из
+    //своего пула, так что поэлементная копия ссылалась бы на чужие данные. Присваивания нет из-за
+    //const stop_words_. Перемещение сохраняет и строки deque, и пул - он лежит в куче
+    SearchServer(const SearchServer&) = delete;
+    SearchServer(SearchServer&&) = default;
 
     void AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
         const std::vector<int>& ratings);
 
+    //документ из полей. Все поля вместе ищутся как один текст, а слова полей с именем попадают ещё и
+    //в постинги своего поля - для запросов title:cat и весов полей. Пока полей с именем не было,
+    //индекс не отличается от индекса без полей. Имя поля - слово без ':'
+    void AddDocument(int document_id, const std::vector<DocumentField>& fields, DocumentStatus status,
+        const std::vector<int>& ratings);
+    //вес поля при ранжировании: слово в поле с весом w считается за w вхождений (по умолчанию 1).
+    //Применяется при поиске, переиндексации не требует; менять одновременно с поиском нельзя
+    void SetFieldWeight(const std::string_view& field, double weight);
+    double GetFieldWeight(const std::string_view& field) const;
+
+    //замена текста документа на месте: постинги меняются только у слов, которые появились, пропали
+    //или сменили частоту. Поиск после неё тот же, что после RemoveDocument и AddDocument с новым текстом.
+    //Неизвестный document_id - out_of_range; документ с полями так обновить нельзя - invalid_argument,
+    //иначе его поля молча пропали бы
+    void UpdateDocument(int document_id, const std::string_view& document);
+    //то же для документа из полей: текст и поля заменяются целиком
+    void UpdateDocument(int document_id, const std::vector<DocumentField>& fields);
+    //статус и рейтинг хранятся отдельно от постингов, их смена индекс слов не трогает
+    void SetStatus(int document_id, DocumentStatus status);
+    void SetRatings(int document_id, const std::vector<int>& ratings);
+
+    //нечёткий поиск: плюс-слова запроса дополняются словами словаря на расстоянии Левенштейна до max_edits
+    //(0 - выключен, не больше 2). Слова до 2 символов не дополняются, до 5 символов - только с одной правкой.
+    //Менять одновременно с поиском нельзя
+    void SetFuzzyMaxEdits(int max_edits);
+    int GetFuzzyMaxEdits() const { return fuzzy_max_edits_; }
+
+    //нормализация текста документов и запросов (text_analyzer.h): разбор UTF-8, регистр, пунктуация,
+    //стемминг. Включается до добавления документов; стоп-слова нормализуются тем же анализатором
+    void SetTextAnalyzer(const AnalyzerOptions& options);
+    bool HasTextAnalyzer() const { return analyzer_.has_value(); }
+
+    //горячие и холодные слова. У горячих (IDF не выше dense_max_idf) к постингам добавляется битовая
+    //карта документов: AND и NOT булевых запросов и минус-слова проверяют документ по ней за O(1).
+    //С stop_max_idf плюс-слова обычного запроса с IDF не выше порога отбрасываются как стоп-слова:
+    //постинги у них самые длинные, а вклад в релевантность близок к нулю. Запрос из одних таких слов
+    //ищется как есть; минус-слова, фразы и булевы запросы не затрагиваются. Уровни слов пересчитываются
+    //при изменениях индекса. Можно вызывать в любой момент, но не одновременно с поиском
+    void SetTermTiers(const TermTierOptions& options);
+
+    //позиции слов для запросов-фраз: "white cat" - подряд, "white cat"~2 - не дальше двух слов друг от друга.
+    //Включается до добавления документов; без него позиции не хранятся и фразы в запросах запрещены
+    void EnablePositionalIndex();
+    bool HasPositionalIndex() const { return has_positional_index_; }
+
+    //булевы запросы: cat AND (dog OR fox) NOT bird. Запрос булев, если в нём есть скобки или слова
+    //AND, OR, NOT (заглавными). AND связывает сильнее OR, слова подряд без оператора - как обычный запрос:
+    //хотя бы одно из плюс-слов и ни одного из -слов и NOT-слов. Шаблоны работают, фразы запрещены,
+    //нечёткий поиск не применяется. Релевантность - сумма по словам не под NOT, как у обычного запроса
+
     //обычная версия
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const std::string_view& raw_query_sv, DocumentPredicate document_predicate) const;
@@ -44,14 +239,56 @@ public://=======================================================================
     std::vector<Document> FindTopDocuments(const ExecPolicy& policy, const std::string_view& raw_query, DocumentStatus status) const;
     template <typename ExecPolicy>
     std::vector<Document> FindTopDocuments(const ExecPolicy& policy, const std::string_view& raw_query) const;
+    //с выбором функции ранжирования (TfIdfScorer, Bm25Scorer из scoring.h)
+    template <typename ExecPolicy, typename DocumentPredicate, typename Scorer>
+    std::vector<Document> FindTopDocuments(const ExecPolicy& policy, const std::string_view& raw_query_sv, DocumentPredicate document_predicate,
+        const Scorer& scorer) const;
+
+    //постраничная выдача в том же порядке, что FindTopDocuments, без ограничения MAX_RESULT_DOCUMENT_COUNT.
+    //Упорядочиваются только документы до конца запрошенной страницы, остальные лишь отделяются от них
+    template <typename ExecPolicy, typename DocumentPredicate, typename Scorer>
+    SearchPage FindPage(const ExecPolicy& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+        const Scorer& scorer, const PageRequest& page) const;
+    SearchPage FindPage(const std::string_view& raw_query, DocumentStatus status, const PageRequest& page) const;
+
+    //поиск с ограниченной работой. Плюс-слова обрабатываются от редких к частым, то есть по убыванию IDF
+    //и вклада на каждый просмотренный постинг. Слово, постинги которого уже не помещаются в max_postings,
+    //или слово после deadline не учитывается вместе со всеми более частыми, и выдача помечается
+    //is_truncated: лучшие документы по самым весомым словам. Фраза стоит постингов всех своих слов.
+    //По числу постингов обрезка детерминирована; срок проверяется и внутри длинных списков постингов.
+    //Булев запрос без части слов изменил бы смысл: он выполняется целиком, если его постинги помещаются
+    //в бюджет, иначе выдача пуста. Минус-слова применяются всегда, по кандидатам, а не по своим постингам
+    template <typename DocumentPredicate, typename Scorer>
+    BudgetedSearchResult FindTopDocumentsWithBudget(const std::string_view& raw_query, DocumentPredicate document_predicate,
+        const Scorer& scorer, const QueryBudget& budget) const;
+    BudgetedSearchResult FindTopDocumentsWithBudget(const std::string_view& raw_query, DocumentStatus status,
+        const QueryBudget& budget) const;
 
     int GetDocumentCount() const;
+    bool HasDocument(int document_id) const;
+
+    //память индекса по частям. Счётчики ведутся при изменениях индекса; словарь проходится один раз
+    //только при top_n > 0 - для самых длинных постингов, max_posting_length и dynamic_stop_word_count.
+    //С top_n = 0 эти три поля пусты, и вызов не зависит от размера словаря
+    IndexMemoryStats GetMemoryStats(size_t top_n = 10) const;
+
+    //число документов, их суммарная длина и частоты слов запроса (после подстановки шаблонов и
+    //нечётких замен); суммируется по шардам, чтобы все они ранжировали по одной статистике
+    CollectionStatistics GetQueryStatistics(const std::string_view& raw_query) const;
+
+    //слова словаря с данным началом в алфавитном порядке, не больше limit - для автодополнения
+    std::vector<std::string_view> GetTermsByPrefix(const std::string_view& prefix, size_t limit) const;
 
     using MatchedWords_Status = std::tuple<std::vector<std::string_view>, DocumentStatus>;
     MatchedWords_Status MatchDocument(const std::string_view& raw_query_sv, int document_id) const;
     MatchedWords_Status MatchDocument(const std::execution::parallel_policy&, const std::string_view& raw_query_sv, int document_id) const;
     MatchedWords_Status MatchDocument(const std::execution::sequenced_policy&, const std::string_view& raw_query_sv, int document_id) const;
 
+    //пакетная версия: запрос разбирается один раз на все документы
+    std::vector<MatchedWords_Status> MatchDocuments(const std::string_view& raw_query_sv, const std::vector<int>& document_ids) const;
+    std::vector<MatchedWords_Status> MatchDocuments(const std::execution::parallel_policy&, const std::string_view& raw_query_sv, const std::vector<int>& document_ids) const;
+    std::vector<MatchedWords_Status> MatchDocuments(const std::execution::sequenced_policy&, const std::string_view& raw_query_sv, const std::vector<int>& document_ids) const;
+
     std::vector<int>::const_iterator begin() const;
 
     std::vector<int>::const_iterator end() const;
@@ -70,19 +307,82 @@ private://======================================================================
     struct DocumentData {
         int rating;
         DocumentStatus status;
+        size_t length; //число слов без стоп-слов, для нормировки BM25
     };
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
+    //узлы постингов и прямого индекса - из пула блоков одного размера: узлы удалённых документов
+    //возвращаются в списки свободных блоков и достаются следующим, а не дробят общую кучу.
+    //Пул синхронизированный - параллельный RemoveDocument освобождает узлы из нескольких потоков
+    //Над new/delete стоит счётчик байт, взятых пулом у системы
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        size_t GetAllocatedBytes() const { return allocated_bytes_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<size_t> allocated_bytes_ = 0;
+
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            void* const result = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            allocated_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+            return result;
+        }
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+            allocated_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+    struct IndexMemory {
+        CountingResource upstream;
+        std::pmr::synchronized_pool_resource pool{ std::pmr::pool_options{ 0, INDEX_POOL_MAX_BLOCK }, &upstream };
+    };
+    std::unique_ptr<IndexMemory> index_memory_;
+    using Postings = std::pmr::map<int, double>;
+    using WordFreqs = std::pmr::map<std::string_view, double>;
+    std::pmr::map<std::string_view, Postings> word_to_document_freqs_;
+    std::pmr::map<int, WordFreqs> document_to_word_freqs_;
     std::map<int, DocumentData> documents_;
     std::vector<int> document_ids_;
-    std::deque<std::string> doc_string_storage_;
+    size_t total_document_length_ = 0;
+    std::deque<std::string> doc_string_storage_; //по одной копии каждого слова, на неё ссылаются оба индекса
+    //счётчики для GetMemoryStats
+    size_t posting_count_ = 0;          //пар (слово, документ): столько же узлов в прямом индексе
+    size_t field_posting_count_ = 0;
+    size_t term_bytes_ = 0;             //doc_string_storage_ вместе с буферами длинных строк
+    size_t live_term_count_ = 0;        //слов с непустыми постингами
+    size_t position_bytes_ = 0;         //буферы сжатых позиций
+    using PositionPostings = std::map<int, EncodedPositions>;
+    bool has_positional_index_ = false;
+    int fuzzy_max_edits_ = 0;
+    TermTrie fuzzy_terms_; //бор слов словаря, строится только при включённом нечётком поиске
+    std::map<std::string_view, PositionPostings> word_to_document_positions_; //пуст, пока индекс не включён
+    std::optional<TextAnalyzer> analyzer_;
+    std::set<std::string, std::less<>> analyzed_stop_words_; //стоп-слова после анализатора
 
-    bool IsStopWord(const std::string_view& word) const {  return stop_words_.count(word) > 0;  }
+    //постинги поля с именем: частота слова в поле, делённая на длину всего документа, так что
+    //по всем полям она складывается в частоту основного индекса. Слова - те же string_view
+    struct FieldIndex {
+        explicit FieldIndex(std::pmr::memory_resource* memory)
+            : word_to_document_freqs(memory)
+        {}
+        double weight = 1.0;
+        std::pmr::map<std::string_view, Postings> word_to_document_freqs;
+    };
+    std::map<std::string, FieldIndex, std::less<>> fields_;
+    bool has_field_weights_ = false; //у какого-то поля вес не 1
+
+    std::optional<TermTierOptions> term_tiers_;
+    std::map<std::string_view, DocumentBitmap> dense_postings_;    //битовые карты горячих слов
+    size_t tiered_document_count_ = 0;  //число документов при последней полной классификации слов
+
+    bool IsStopWord(const std::string_view& word) const {  return (analyzer_ ? analyzed_stop_words_ : stop_words_).count(word) > 0;  }
 
     static bool IsValidWord(const std::string_view& word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view& text) const;
+    //с анализатором слова нормализуются в buffer и ссылаются на него
+    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view& text, std::string& buffer) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
@@ -94,29 +394,301 @@ private://======================================================================
 
     QueryWord ParseQueryWord(const std::string_view& text) const;
 
+    //слово запроса вида поле:слово; поле ищется среди известных. Для других слов - nullptr
+    const FieldIndex* ParseFieldWord(QueryWord& query_word) const;
+
+    FieldIndex& GetOrAddField(const std::string_view& name);
+
+    //слово запроса, ограниченное полем: title:cat
+    struct FieldWord {
+        const FieldIndex* field;
+        std::string_view word;
+        bool operator<(const FieldWord& other) const {
+            return std::tie(word, field) < std::tie(other.word, other.field);
+        }
+        bool operator==(const FieldWord& other) const {
+            return field == other.field && word == other.word;
+        }
+    };
+
+    //фраза из двух и более слов: точная (слова подряд) или с окном близости slop
+    struct Phrase {
+        std::vector<std::string_view> words;
+        bool is_exact = true;
+        uint32_t slop = 0;
+    };
+
+    //узел дерева булева запроса; дети узла лежат подряд в Query::boolean_children
+    enum class BooleanOperator : uint8_t { TERM, AND, OR, NOT };
+    static constexpr uint32_t NO_BOOLEAN_NODE = UINT32_MAX;
+    struct BooleanNode {
+        BooleanOperator op;
+        const Postings* postings = nullptr; //TERM: постинги слова, nullptr - слова нет в словаре
+        uint32_t first_child = 0;
+        uint32_t child_count = 0;
+        const DocumentBitmap* bitmap = nullptr; //TERM: карта документов горячего слова
+    };
+
+    //векторы запроса и всё временное при его выполнении берутся из memory - обычно арены запроса
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        explicit Query(std::pmr::memory_resource* memory)
+            : plus_words(memory), minus_words(memory), phrases(memory), fuzzy_words(memory)
+            , field_plus_words(memory), field_minus_words(memory)
+            , boolean_nodes(memory), boolean_children(memory), analyzed_words(memory)
+        {}
+
+        std::pmr::memory_resource* GetMemory() const { return plus_words.get_allocator().resource(); }
+
+        std::pmr::vector<std::string_view> plus_words;  //у булева запроса - слова не под NOT, для ранжирования
+        std::pmr::vector<std::string_view> minus_words;
+        std::pmr::vector<Phrase> phrases;
+        std::pmr::vector<std::pair<std::string_view, double>> fuzzy_words; //близкие слова словаря с весом, без plus_words
+        std::pmr::vector<FieldWord> field_plus_words;
+        std::pmr::vector<FieldWord> field_minus_words;
+
+        bool is_boolean = false;
+        uint32_t boolean_root = NO_BOOLEAN_NODE;        //NO_BOOLEAN_NODE - в запросе одни стоп-слова
+        std::pmr::vector<BooleanNode> boolean_nodes;
+        std::pmr::vector<uint32_t> boolean_children;
+
+        std::pmr::forward_list<std::pmr::string> analyzed_words;    //нормализованный текст, на него ссылаются слова выше
+    };
+
+    //откуда берутся подстановки шаблонов и нечётких слов. {} - из своего словаря; given - готовые
+    //(для слов, которые в нём есть), collect - сюда записываются все кандидаты, а не только лучшие
+    struct ExpansionSource {
+        const CollectionStatistics::Expansions* given;
+        CollectionStatistics::Expansions* collect;
     };
+    //GlobalStatisticsScorer несёт подстановки, выбранные по всем шардам
+    template <typename Scorer>
+    static ExpansionSource GetExpansionSource(const Scorer& scorer) {
+        if constexpr (requires { scorer.GetStatistics().expansions; }) {
+            return { &scorer.GetStatistics().expansions, nullptr };
+        }
+        else {
+            return {};
+        }
+    }
+
+    Query ParseQuery(const std::string_view& text, std::pmr::memory_resource* memory, const ExpansionSource& expansions = {}) const;
 
-    Query ParseQuery(const std::string_view& text, bool is_parallel = false) const;
+    //вызывает callback(term) для слов, которые анализатор получает из слова запроса; без анализатора -
+    //для самого слова. Нормализованный текст хранится в query
+    template <typename Callback>
+    void ForEachQueryTerm(const std::string_view& word, Query& query, Callback callback) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view& word) const {
-        return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+    //разбор булева запроса рекурсивным спуском в result.boolean_nodes
+    void ParseBooleanQuery(const std::string_view& text, Query& result, const ExpansionSource& expansions) const;
+
+    //оценка сверху числа документов под узлом - для порядка пересечения
+    size_t EstimateBooleanNode(const Query& query, uint32_t node) const;
+    //отсортированные id документов под узлом. В AND пересечение начинается с самого короткого ребёнка,
+    //остальные проверяются по возрастанию длины, и на пустом промежуточном результате обход прекращается
+    std::pmr::vector<int> EvaluateBooleanNode(const Query& query, uint32_t node) const;
+    bool MatchesBooleanNode(const Query& query, uint32_t node, int document_id) const;
+    //слова запроса не под NOT, если документ подходит под запрос
+    std::vector<std::string_view> MatchBooleanQuery(const Query& query, int document_id) const;
+
+    class BudgetTracker;
+    //tracker - поиск с бюджетом
+    template <typename DocumentPredicate, typename Scorer>
+    std::vector<Document> FindBooleanDocuments(const Query& query, DocumentPredicate document_predicate, const Scorer& scorer,
+        BudgetTracker* tracker) const;
+
+    //подставляет вместо шаблона слова словаря (не больше MAX_PATTERN_EXPANSIONS), обходя
+    //только диапазон упорядоченного словаря с буквальным началом шаблона (не больше
+    //MAX_PATTERN_SCANNED_TERMS слов). Шаблон без буквального начала - invalid_argument
+    void ExpandPattern(const std::string_view& pattern, std::pmr::vector<std::string_view>& terms,
+        const ExpansionSource& expansions) const;
+
+    //слова словаря на расстоянии Левенштейна от 1 до fuzzy_max_edits_ (лучшие MAX_FUZZY_EXPANSIONS)
+    void ExpandFuzzy(const std::string_view& word, std::pmr::vector<std::pair<std::string_view, double>>& terms,
+        const ExpansionSource& expansions) const;
+
+    //разбирает содержимое кавычек и суффикс ~N; фраза из одного слова становится обычным плюс-словом
+    void ParseQueryPhrase(const std::string_view& text, const std::string_view& suffix, Query& result) const;
+
+    //позиционные постинги слов фразы; пустой вектор, если какого-то слова нет ни в одном документе
+    std::vector<const PositionPostings*> ResolvePhrase(const Phrase& phrase) const;
+
+    bool DocumentMatchesPhrase(const Phrase& phrase, const std::vector<const PositionPostings*>& postings, int document_id) const;
+
+    //вызывает callback(document_id, relevance) для документов, содержащих фразу;
+    //релевантность фразы - сумма tf-idf её слов
+    template <typename DocumentPredicate, typename Scorer, typename Callback>
+    void ForEachPhraseMatch(const Phrase& phrase, DocumentPredicate document_predicate, const Scorer& scorer, Callback callback) const;
+
+    void RemoveDocumentPositions(int document_id);
+    void RemoveDocumentFields(int document_id);
+    bool HasDocumentFields(int document_id) const; //есть ли у документа постинги полей с именем
+    //постинги полей документа, общий текст которого уже в индексе
+    void AddDocumentFields(int document_id, const std::vector<DocumentField>& fields);
+    //общая часть UpdateDocument: новый текст без полей
+    void ReplaceDocumentText(int document_id, const std::string_view& document);
+    //сжатые позиции слова в документе, с учётом их буферов в position_bytes_
+    void StorePositions(const std::string_view& word, int document_id, const PositionList& positions);
+    void ErasePositions(const std::string_view& word, int document_id);
+
+    //постинги слова в полях с весом не 1 и прибавка к частоте на единицу частоты в поле (вес - 1)
+    using FieldBoosts = std::vector<std::pair<const Postings*, double>>;
+    FieldBoosts GetFieldBoosts(const std::string_view& word) const;
+
+    //горячее ли слово с document_freq документами и картой в bitmap_bytes байт; is_dense - уже горячее:
+    //назад в холодные оно переходит при вдвое меньшей частоте или вдвое большей карте,
+    //чтобы не перестраивать карту на каждом документе
+    bool IsDenseTerm(size_t document_freq, size_t bitmap_bytes, bool is_dense) const;
+    //полная классификация - при включении и когда число документов изменилось вдвое:
+    //с ним меняется порог частоты и для слов, которых изменения не касались
+    void ClassifyTerms();
+    //после добавления или удаления постинга слова для документа
+    void UpdateTermTier(const std::string_view& word, int document_id, bool is_added);
+    void UpdateTermTiers(); //после изменения числа документов
+    const DocumentBitmap* FindDenseBitmap(const std::string_view& word) const {
+        const auto it = dense_postings_.find(word);
+        return it == dense_postings_.end() ? nullptr : &it->second;
+    }
+    bool IsDynamicStopWord(const Postings& postings) const;
+    void RemoveDynamicStopWords(Query& query) const;
+    static double ApplyFieldBoosts(const FieldBoosts& boosts, int document_id, double term_freq) {
+        for (const auto& [postings, boost] : boosts) {
+            const auto it = postings->find(document_id);
+            if (it != postings->end()) {
+                term_freq += boost * it->second;
+            }
+        }
+        return term_freq;
     }
 
-    template <typename DocumentPredicate>
+    //постинги слова в поле; nullptr, если слова в поле нет
+    static const Postings* FindFieldPostings(const FieldWord& field_word) {
+        const auto it = field_word.field->word_to_document_freqs.find(field_word.word);
+        return it == field_word.field->word_to_document_freqs.end() ? nullptr : &it->second;
+    }
+
+    //вызывает callback(document_id, relevance) для документов со словом в поле; IDF - по всему документу,
+    //как у слова без поля, поэтому статистика коллекции для шардов остаётся общей
+    template <typename DocumentPredicate, typename Scorer, typename Callback>
+    void ForEachFieldMatch(const FieldWord& field_word, DocumentPredicate document_predicate, const Scorer& scorer, Callback callback) const;
+
+    //false - документ исключён минус-словом поля; иначе в matched_words добавляются совпавшие слова полей
+    bool MatchFieldWords(const Query& query, int document_id, std::vector<std::string_view>& matched_words) const;
+
+    //данные документа для изменения; неизвестный document_id - out_of_range
+    DocumentData& GetDocumentData(int document_id);
+
+    //возвращает постоянный string_view на слово, при необходимости сохраняя его в doc_string_storage_
+    std::string_view InternWord(const std::string_view& word);
+
+    //прямой индекс документа; для документа из одних стоп-слов - пустой
+    const WordFreqs& GetDocumentWords(int document_id) const;
+
+    //слова запроса вместе с найденными для них постинг-листами
+    struct ResolvedQuery {
+        std::vector<std::pair<std::string_view, const Postings*>> plus_words;
+        std::vector<const Postings*> minus_words;
+        std::vector<std::pair<Phrase, std::vector<const PositionPostings*>>> phrases;
+    };
+
+    ResolvedQuery ResolveQuery(const Query& query) const;
+
+    MatchedWords_Status MatchResolvedQuery(const ResolvedQuery& query, int document_id) const;
+
+    //последовательный MatchDocument по уже разобранному запросу
+    MatchedWords_Status MatchParsedQuery(const Query& query, int document_id) const;
+
+    //добавляет к совпавшим словам близкие слова из нечёткого поиска, сохраняя порядок
+    static void AddMatchedFuzzyWords(const Query& query, const WordFreqs& document_words,
+        std::vector<std::string_view>& matched_words);
+
+    //добавляет к словам документа слова совпавших фраз, сохраняя порядок и уникальность
+    void AddMatchedPhraseWords(const ResolvedQuery& query, int document_id, std::vector<std::string_view>& matched_words) const;
+
+    double GetAverageDocumentLength() const {
+        return documents_.empty() ? 0.0 : total_document_length_ * 1.0 / documents_.size();
+    }
+
+    //расход бюджета одного запроса; счётчики пишутся прямо в результат
+    class BudgetTracker {
+    public:
+        BudgetTracker(const QueryBudget& budget, BudgetedSearchResult& result)
+            : budget_(budget)
+            , result_(result)
+        {}
+
+        //false - на ещё postings постингов бюджета не хватает, запрос обрезается; иначе они учтены
+        bool Charge(size_t postings) {
+            if (!result_.is_truncated
+                && ((budget_.max_postings > 0 && result_.postings_scanned + postings > budget_.max_postings)
+                    || (budget_.deadline && std::chrono::steady_clock::now() >= *budget_.deadline)))
+            {
+                result_.is_truncated = true;
+            }
+            if (!result_.is_truncated) {
+                result_.postings_scanned += postings;
+            }
+            return !result_.is_truncated;
+        }
+
+        //вызывается на каждом шаге длинного цикла; часы читаются раз в DEADLINE_CHECK_POSTINGS шагов
+        bool IsExpired() {
+            if (!budget_.deadline || --until_deadline_check_ > 0) {
+                return false;
+            }
+            until_deadline_check_ = DEADLINE_CHECK_POSTINGS;
+            if (std::chrono::steady_clock::now() >= *budget_.deadline) {
+                result_.is_truncated = true;
+            }
+            return result_.is_truncated;
+        }
+
+    private:
+        const QueryBudget& budget_;
+        BudgetedSearchResult& result_;
+        size_t until_deadline_check_ = DEADLINE_CHECK_POSTINGS;
+    };
+
+    //оценка слов запроса в пределах бюджета: фразы и слова полей (они избирательны), затем обычные и
+    //нечёткие слова по возрастанию длины постингов. score_word(word, weight), score_phrase(phrase),
+    //score_field_word(field_word) добавляют вклад в релевантность
+    template <typename ScoreWord, typename ScorePhrase, typename ScoreFieldWord>
+    void ScoreWithinBudget(const Query& query, BudgetTracker& tracker,
+        ScoreWord score_word, ScorePhrase score_phrase, ScoreFieldWord score_field_word) const;
+
+    //убирает из кандидатов документы минус-слова. С бюджетом кандидатов обычно намного меньше постингов
+    //частого минус-слова, и тогда они проверяются поштучно: работа не выходит за бюджет плюс-слов
+    template <typename Candidates>
+    static void RemoveMinusPostings(const Postings& postings, Candidates& candidates, bool is_budgeted) {
+        if (is_budgeted && candidates.size() * MATCH_MERGE_RATIO < postings.size()) {
+            std::erase_if(candidates, [&postings](const auto& document) { return postings.count(document.first) > 0; });
+            return;
+        }
+        for (const auto& [document_id, _] : postings) {
+            candidates.erase(document_id);
+        }
+    }
+
+    //tracker - поиск с бюджетом
+    template <typename DocumentPredicate, typename Scorer>
     std::vector<Document> FindAllDocuments( //sequenced
         const Query& query, 
-        DocumentPredicate document_predicate
+        DocumentPredicate document_predicate,
+        const Scorer& scorer,
+        BudgetTracker* tracker = nullptr
     ) const;
 
-    template <typename ExecPolicy, typename DocumentPredicate>
+    template <typename ExecPolicy, typename DocumentPredicate, typename Scorer>
     std::vector<Document> FindAllDocuments( //ExecPolicy
         const ExecPolicy& policy,
         const Query& query, 
-        DocumentPredicate document_predicate
+        DocumentPredicate document_predicate,
+        const Scorer& scorer
     ) const;
+
+    //оставляет в documents места [offset, offset + count) порядка IsRankedBefore, упорядоченные.
+    //Лучшие offset + count отделяются за линейное время, сортируется только сама страница
+    template <typename ExecPolicy>
+    static void SelectPage(const ExecPolicy& policy, std::vector<Document>& documents, size_t offset, size_t count);
 };
 
 ///////////////////////////////////////////////////////////////////////////////////
@@ -124,54 +696,138 @@ private://======================================================================
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words)
     : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+    , index_memory_(std::make_unique<IndexMemory>())
+    , word_to_document_freqs_(&index_memory_->pool)
+    , document_to_word_freqs_(&index_memory_->pool)
 {
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
         throw std::invalid_argument("Some of stop words are invalid"s);
     }
 }
 
+template <typename Callback>
+void SearchServer::ForEachQueryTerm(const std::string_view& word, Query& query, Callback callback) const {
+    if (!analyzer_) {
+        callback(word);
+        return;
+    }
+    std::pmr::string& text = query.analyzed_words.emplace_front();
+    analyzer_->Normalize(word, text, IsWildcardPattern(word));
+    const std::string_view terms = text;
+    for (size_t begin = 0; begin < terms.size();) {
+        const size_t end = std::min(terms.find(' ', begin), terms.size());
+        callback(terms.substr(begin, end - begin));
+        begin = end + 1;
+    }
+}
+
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query_sv,
     DocumentPredicate document_predicate) const
 {
-    const Query query = ParseQuery(raw_query_sv);
+    return FindTopDocuments(std::execution::seq, raw_query_sv, document_predicate, TfIdfScorer{});
+}
 
-    std::vector<Document> matched_documents = FindAllDocuments(query, document_predicate);
+template <typename ExecPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecPolicy& policy, const std::string_view& raw_query_sv,
+    DocumentPredicate document_predicate) const
+{
+    return FindTopDocuments(policy, raw_query_sv, document_predicate, TfIdfScorer{});
+}
 
-    sort(matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            return lhs.relevance > rhs.relevance
-                || (std::abs(lhs.relevance - rhs.relevance) < COMPARISON_TOLERANCE && lhs.rating > rhs.rating);
-        });
+template <typename ExecPolicy, typename DocumentPredicate, typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(const ExecPolicy& policy, const std::string_view& raw_query_sv,
+    DocumentPredicate document_predicate, const Scorer& scorer) const
+{
+    PROFILE_SCOPE("FindTopDocuments");
+    const QueryArenaScope arena;
+    const Query query = [&] {
+        PROFILE_SCOPE("FindTopDocuments.parse");
+        return ParseQuery(raw_query_sv, arena.GetResource(), GetExpansionSource(scorer));
+    }();
+    std::vector<Document> matched_documents = FindAllDocuments(policy, query, document_predicate, scorer);
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    {
+        PROFILE_SCOPE("FindTopDocuments.sort");
+        SelectPage(policy, matched_documents, 0, MAX_RESULT_DOCUMENT_COUNT);
     }
+    PROFILE_COUNT("results_returned", matched_documents.size());
     return matched_documents;
 }
 
-template <typename ExecPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const ExecPolicy& policy, const std::string_view& raw_query_sv,
-    DocumentPredicate document_predicate) const
+template <typename DocumentPredicate, typename Scorer>
+BudgetedSearchResult SearchServer::FindTopDocumentsWithBudget(const std::string_view& raw_query, DocumentPredicate document_predicate,
+    const Scorer& scorer, const QueryBudget& budget) const
 {
-    if constexpr (std::is_same_v<ExecPolicy, std::execution::sequenced_policy>) {
-        return FindTopDocuments(raw_query_sv, document_predicate);
-    }
+    PROFILE_SCOPE("FindTopDocuments");
+    const QueryArenaScope arena;
+    const Query query = ParseQuery(raw_query, arena.GetResource(), GetExpansionSource(scorer));
+    BudgetedSearchResult result;
+    BudgetTracker tracker(budget, result);
+    result.documents = FindAllDocuments(query, document_predicate, scorer, &tracker);
+    SelectPage(std::execution::seq, result.documents, 0, MAX_RESULT_DOCUMENT_COUNT);
+    return result;
+}
 
-    const Query query = ParseQuery(raw_query_sv);
-    std::vector<Document> matched_documents = FindAllDocuments(policy, query, document_predicate);
+template <typename ExecPolicy, typename DocumentPredicate, typename Scorer>
+SearchPage SearchServer::FindPage(const ExecPolicy& policy, const std::string_view& raw_query,
+    DocumentPredicate document_predicate, const Scorer& scorer, const PageRequest& page) const
+{
+    PROFILE_SCOPE("FindPage");
+    const QueryArenaScope arena;
+    const Query query = ParseQuery(raw_query, arena.GetResource(), GetExpansionSource(scorer));
+    SearchPage result;
+    std::vector<Document> matched_documents;
+    if (page.budget.IsUnlimited()) {
+        matched_documents = FindAllDocuments(policy, query, document_predicate, scorer);
+    }
+    else {
+        BudgetedSearchResult budget_result;
+        BudgetTracker tracker(page.budget, budget_result);
+        matched_documents = FindAllDocuments(query, document_predicate, scorer, &tracker);
+        result.is_truncated = budget_result.is_truncated;
+    }
 
-    sort(policy,
-        matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            return lhs.relevance > rhs.relevance
-                || (std::abs(lhs.relevance - rhs.relevance) < COMPARISON_TOLERANCE && lhs.rating > rhs.rating);
-        });
+    result.total_count = matched_documents.size();
+    if (page.search_after) {
+        const Document& cursor = *page.search_after;
+        matched_documents.erase(
+            remove_if(matched_documents.begin(), matched_documents.end(),
+                [&cursor](const Document& document) { return !IsRankedBefore(cursor, document); }),
+            matched_documents.end());
+    }
+    const size_t remaining = matched_documents.size();
+    {
+        PROFILE_SCOPE("FindPage.select");
+        SelectPage(policy, matched_documents, page.offset, page.page_size);
+    }
+    if (!matched_documents.empty() && page.offset + matched_documents.size() < remaining) {
+        result.next_cursor = matched_documents.back();
+    }
+    result.documents = std::move(matched_documents);
+    return result;
+}
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename ExecPolicy>
+void SearchServer::SelectPage(const ExecPolicy& policy, std::vector<Document>& documents, size_t offset, size_t count) {
+    if (offset >= documents.size()) {
+        documents.clear();
+        return;
     }
-    return matched_documents;
+    const auto begin = documents.begin() + offset;
+    const auto end = documents.size() - offset > count ? begin + count : documents.end();
+    if (offset == 0) {
+        partial_sort(policy, documents.begin(), end, documents.end(), IsRankedBefore);
+    }
+    else {
+        if (end != documents.end()) {
+            nth_element(policy, documents.begin(), end, documents.end(), IsRankedBefore);
+        }
+        nth_element(policy, documents.begin(), begin, end, IsRankedBefore);
+        sort(policy, begin, end, IsRankedBefore);
+    }
+    documents.erase(end, documents.end());
+    documents.erase(documents.begin(), begin);
 }
 
 template <typename ExecPolicy>
@@ -195,90 +851,378 @@ std::vector<Document> SearchServer::FindTopDocuments(const ExecPolicy& policy, c
     return SearchServer::FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
-    DocumentPredicate document_predicate) const 
+template <typename DocumentPredicate, typename Scorer, typename Callback>
+void SearchServer::ForEachPhraseMatch(const Phrase& phrase, DocumentPredicate document_predicate, const Scorer& scorer,
+    Callback callback) const
+{
+    const std::vector<const PositionPostings*> postings = ResolvePhrase(phrase);
+    if (postings.empty()) {
+        return;
+    }
+    std::vector<std::pair<const Postings*, double>> word_freqs;
+    word_freqs.reserve(phrase.words.size());
+    for (const std::string_view& word : phrase.words) {
+        const Postings& freqs = word_to_document_freqs_.at(word);
+        word_freqs.emplace_back(&freqs, scorer.ComputeIdf(word, documents_.size(), freqs.size()));
+    }
+    //кандидаты - документы самого редкого слова, остальные списки только проверяются
+    const PositionPostings& rarest = **std::min_element(postings.begin(), postings.end(),
+        [](const PositionPostings* lhs, const PositionPostings* rhs) { return lhs->size() < rhs->size(); });
+    PROFILE_COUNT("postings_scanned", rarest.size());
+    const double average_document_length = GetAverageDocumentLength();
+    for (const auto& [document_id, _] : rarest) {
+        const DocumentData& document_data = documents_.at(document_id);
+        if (!document_predicate(document_id, document_data.status, document_data.rating)
+            || !DocumentMatchesPhrase(phrase, postings, document_id)) {
+            continue;
+        }
+        double relevance = 0.0;
+        for (const auto& [freqs, inverse_document_freq] : word_freqs) {
+            relevance += scorer.ComputeScore(freqs->at(document_id), inverse_document_freq, document_data.length, average_document_length);
+        }
+        callback(document_id, relevance);
+    }
+}
+
+template <typename DocumentPredicate, typename Scorer, typename Callback>
+void SearchServer::ForEachFieldMatch(const FieldWord& field_word, DocumentPredicate document_predicate, const Scorer& scorer,
+    Callback callback) const
 {
-    std::map<int, double> document_to_relevance;
+    const Postings* postings = FindFieldPostings(field_word);
+    if (!postings || postings->empty()) {
+        return;
+    }
+    const Postings& document_freqs = word_to_document_freqs_.at(field_word.word);
+    const double inverse_document_freq = scorer.ComputeIdf(field_word.word, documents_.size(), document_freqs.size());
+    const double average_document_length = GetAverageDocumentLength();
+    PROFILE_COUNT("postings_scanned", postings->size());
+    for (const auto& [document_id, term_freq] : *postings) {
+        const DocumentData& document_data = documents_.at(document_id);
+        if (document_predicate(document_id, document_data.status, document_data.rating)) {
+            callback(document_id, scorer.ComputeScore(field_word.field->weight * term_freq, inverse_document_freq,
+                document_data.length, average_document_length));
+        }
+    }
+}
+
+template <typename DocumentPredicate, typename Scorer>
+std::vector<Document> SearchServer::FindBooleanDocuments(const Query& query, DocumentPredicate document_predicate,
+    const Scorer& scorer, BudgetTracker* tracker) const
+{
+    if (query.boolean_root == NO_BOOLEAN_NODE) {
+        return {};
+    }
+    if (tracker) {
+        //пересечение и объединение читают не больше постингов всех слов запроса
+        size_t postings = 0;
+        for (const BooleanNode& node : query.boolean_nodes) {
+            postings += node.op == BooleanOperator::TERM && node.postings ? node.postings->size() : 0;
+        }
+        if (!tracker->Charge(postings)) {
+            return {};
+        }
+    }
+    const std::pmr::vector<int> candidates = [&] {
+        PROFILE_SCOPE("FindTopDocuments.boolean");
+        return EvaluateBooleanNode(query, query.boolean_root);
+    }();
+    PROFILE_COUNT("documents_scored", candidates.size());
+    //постинги, IDF и множитель частоты: у слов без поля - поправки весов полей, у слов поля - его вес
+    struct ScoredWord {
+        const Postings* postings;
+        double inverse_document_freq;
+        FieldBoosts boosts;
+        double weight = 1.0;
+    };
+    std::vector<ScoredWord> word_freqs;
+    word_freqs.reserve(query.plus_words.size() + query.field_plus_words.size());
     for (const std::string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        const auto it = word_to_document_freqs_.find(word);
+        if (it != word_to_document_freqs_.end() && !it->second.empty()) {
+            word_freqs.push_back({ &it->second, scorer.ComputeIdf(it->first, documents_.size(), it->second.size()), GetFieldBoosts(it->first) });
+        }
+    }
+    for (const FieldWord& field_word : query.field_plus_words) {
+        const Postings* postings = FindFieldPostings(field_word);
+        if (postings && !postings->empty()) {
+            const Postings& document_freqs = word_to_document_freqs_.at(field_word.word);
+            word_freqs.push_back({ postings, scorer.ComputeIdf(field_word.word, documents_.size(), document_freqs.size()), {},
+                field_word.field->weight });
+        }
+    }
+    const double average_document_length = GetAverageDocumentLength();
+    std::vector<Document> matched_documents;
+    matched_documents.reserve(candidates.size());
+    for (const int document_id : candidates) {
+        if (tracker && tracker->IsExpired()) {
+            break;
+        }
+        const DocumentData& document_data = documents_.at(document_id);
+        if (!document_predicate(document_id, document_data.status, document_data.rating)) {
             continue;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        double relevance = 0.0;
+        for (const ScoredWord& word : word_freqs) {
+            const auto it = word.postings->find(document_id);
+            if (it != word.postings->end()) {
+                const double term_freq = word.weight * ApplyFieldBoosts(word.boosts, document_id, it->second);
+                relevance += scorer.ComputeScore(term_freq, word.inverse_document_freq, document_data.length, average_document_length);
             }
         }
+        matched_documents.push_back({ document_id, relevance, document_data.rating });
     }
-    for (const std::string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    return matched_documents;
+}
+
+template <typename ScoreWord, typename ScorePhrase, typename ScoreFieldWord>
+void SearchServer::ScoreWithinBudget(const Query& query, BudgetTracker& tracker,
+    ScoreWord score_word, ScorePhrase score_phrase, ScoreFieldWord score_field_word) const
+{
+    for (const Phrase& phrase : query.phrases) {
+        //кандидаты берутся из самого редкого слова, но проверяются по спискам всех слов фразы
+        size_t postings = 0;
+        for (const std::string_view& word : phrase.words) {
+            const auto it = word_to_document_freqs_.find(word);
+            postings += it == word_to_document_freqs_.end() ? 0 : it->second.size();
+        }
+        if (!tracker.Charge(postings)) {
+            return;
+        }
+        score_phrase(phrase);
+    }
+    for (const FieldWord& field_word : query.field_plus_words) {
+        const Postings* postings = FindFieldPostings(field_word);
+        if (!tracker.Charge(postings ? postings->size() : 0)) {
+            return;
+        }
+        score_field_word(field_word);
+    }
+
+    //чем короче постинги, тем больше IDF и вклад каждого из них
+    struct WeightedWord {
+        size_t postings_size;
+        std::string_view word;
+        double weight;
+    };
+    std::pmr::vector<WeightedWord> words(query.GetMemory());
+    words.reserve(query.plus_words.size() + query.fuzzy_words.size());
+    const auto add_word = [this, &words](const std::string_view& word, double weight) {
+        const auto it = word_to_document_freqs_.find(word);
+        if (it != word_to_document_freqs_.end() && !it->second.empty()) {
+            words.push_back({ it->second.size(), it->first, weight });
         }
-        for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+    };
+    for (const std::string_view& word : query.plus_words) {
+        add_word(word, 1.0);
+    }
+    for (const auto& [word, weight] : query.fuzzy_words) {
+        add_word(word, weight);
+    }
+    std::sort(words.begin(), words.end(), [](const WeightedWord& lhs, const WeightedWord& rhs) {
+        return std::tie(lhs.postings_size, lhs.word) < std::tie(rhs.postings_size, rhs.word);
+    });
+    for (const WeightedWord& word : words) {
+        if (!tracker.Charge(word.postings_size)) {
+            return;
         }
+        score_word(word.word, word.weight);
     }
+}
+
+template <typename DocumentPredicate, typename Scorer>
+std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
+    DocumentPredicate document_predicate, const Scorer& scorer, BudgetTracker* tracker) const 
+{
+    if (query.is_boolean) {
+        return FindBooleanDocuments(query, document_predicate, scorer, tracker);
+    }
+    std::pmr::map<int, double> document_to_relevance(query.GetMemory());
+    {
+        PROFILE_SCOPE("FindTopDocuments.score");
+        const double average_document_length = GetAverageDocumentLength();
+        const auto score_word = [&](const std::string_view& word, double weight) {
+            const auto word_it = word_to_document_freqs_.find(word);
+            if (word_it == word_to_document_freqs_.end()) {
+                return;
+            }
+            const double inverse_document_freq = scorer.ComputeIdf(word_it->first, documents_.size(), word_it->second.size());
+            const FieldBoosts boosts = GetFieldBoosts(word_it->first);
+            PROFILE_COUNT("postings_scanned", word_it->second.size());
+            for (const auto& [document_id, term_freq] : word_it->second) {
+                //срок вышел посреди частого слова - его вклад остаётся частичным
+                if (tracker && tracker->IsExpired()) {
+                    break;
+                }
+                const auto& document_data = documents_.at(document_id);
+                if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                    document_to_relevance[document_id] += weight * scorer.ComputeScore(
+                        ApplyFieldBoosts(boosts, document_id, term_freq), inverse_document_freq, document_data.length, average_document_length);
+                }
+            }
+        };
+        if (tracker) {
+            ScoreWithinBudget(query, *tracker, score_word,
+                [&](const Phrase& phrase) {
+                    ForEachPhraseMatch(phrase, document_predicate, scorer, [&document_to_relevance](int document_id, double relevance) {
+                        document_to_relevance[document_id] += relevance;
+                    });
+                },
+                [&](const FieldWord& field_word) {
+                    ForEachFieldMatch(field_word, document_predicate, scorer, [&document_to_relevance](int document_id, double relevance) {
+                        document_to_relevance[document_id] += relevance;
+                    });
+                });
+        }
+        else {
+            for (const std::string_view& word : query.plus_words) {
+                score_word(word, 1.0);
+            }
+            for (const auto& [word, weight] : query.fuzzy_words) {
+                score_word(word, weight);
+            }
+            for (const Phrase& phrase : query.phrases) {
+                ForEachPhraseMatch(phrase, document_predicate, scorer, [&document_to_relevance](int document_id, double relevance) {
+                    document_to_relevance[document_id] += relevance;
+                });
+            }
+            for (const FieldWord& field_word : query.field_plus_words) {
+                ForEachFieldMatch(field_word, document_predicate, scorer, [&document_to_relevance](int document_id, double relevance) {
+                    document_to_relevance[document_id] += relevance;
+                });
+            }
+        }
+    }
+    {
+        PROFILE_SCOPE("FindTopDocuments.minus-filter");
+        for (const std::string_view& word : query.minus_words) {
+            const auto word_it = word_to_document_freqs_.find(word);
+            if (word_it == word_to_document_freqs_.end()) {
+                continue;
+            }
+            //у горячего слова постинги длиннее списка кандидатов - кандидаты проверяются по его карте
+            const DocumentBitmap* bitmap = FindDenseBitmap(word);
+            if (bitmap && document_to_relevance.size() < word_it->second.size()) {
+                std::erase_if(document_to_relevance, [bitmap](const auto& document) { return bitmap->Contains(document.first); });
+                continue;
+            }
+            RemoveMinusPostings(word_it->second, document_to_relevance, tracker != nullptr);
+        }
+        for (const FieldWord& field_word : query.field_minus_words) {
+            if (const Postings* postings = FindFieldPostings(field_word)) {
+                RemoveMinusPostings(*postings, document_to_relevance, tracker != nullptr);
+            }
+        }
+    }
+    PROFILE_COUNT("documents_scored", document_to_relevance.size());
 
     std::vector<Document> matched_documents;
+    matched_documents.reserve(document_to_relevance.size());
     for (const auto& [document_id, relevance] : document_to_relevance) {
         matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
     }
     return matched_documents;
 }
 
-template <typename ExecPolicy, typename DocumentPredicate>
+template <typename ExecPolicy, typename DocumentPredicate, typename Scorer>
 std::vector<Document> SearchServer::FindAllDocuments(
     const ExecPolicy& policy,
     const Query& query,
-    DocumentPredicate document_predicate) const
+    DocumentPredicate document_predicate,
+    const Scorer& scorer) const
 {
-    //LOG_DURATION_STREAM("FindAllDocuments"s, std::cout);
-    if constexpr (std::is_same_v<ExecPolicy, std::execution::sequenced_policy >) {
-        return FindAllDocuments(query, document_predicate);
+    //булев запрос - последовательное пересечение, его стоимость определяет самый короткий список
+    if (std::is_same_v<ExecPolicy, std::execution::sequenced_policy> || query.is_boolean) {
+        return FindAllDocuments(query, document_predicate, scorer);
     }
 
     ConcurrentMap<int, double> document_to_relevance(8);
-    for_each(
-        policy,
-        query.plus_words.begin(),
-        query.plus_words.end(),
-        [this, &document_to_relevance, document_predicate](const std::string_view& word) {
-            if (word_to_document_freqs_.count(word)) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
+    {
+        PROFILE_SCOPE("FindTopDocuments.score");
+        const double average_document_length = GetAverageDocumentLength();
+        const auto score_word = [this, &document_to_relevance, document_predicate, &scorer, average_document_length](
+            const std::string_view& word, double weight)
+        {
+            const auto word_it = word_to_document_freqs_.find(word);
+            if (word_it != word_to_document_freqs_.end()) {
+                const double inverse_document_freq = scorer.ComputeIdf(word_it->first, documents_.size(), word_it->second.size());
+                const FieldBoosts boosts = GetFieldBoosts(word_it->first);
+                PROFILE_COUNT("postings_scanned", word_it->second.size());
+                for (const auto& [document_id, term_freq] : word_it->second) {
                     const DocumentData& document_data = documents_.at(document_id);
                     if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+                        document_to_relevance[document_id].ref_to_value += weight * scorer.ComputeScore(
+                            ApplyFieldBoosts(boosts, document_id, term_freq), inverse_document_freq, document_data.length, average_document_length);
                     }
                 }
             }
-        }
-    );
+        };
+        for_each(
+            policy,
+            query.plus_words.begin(),
+            query.plus_words.end(),
+            [&score_word](const std::string_view& word) { score_word(word, 1.0); }
+        );
+        for_each(
+            policy,
+            query.fuzzy_words.begin(),
+            query.fuzzy_words.end(),
+            [&score_word](const std::pair<std::string_view, double>& word) { score_word(word.first, word.second); }
+        );
+        for_each(
+            policy,
+            query.phrases.begin(),
+            query.phrases.end(),
+            [this, &document_to_relevance, document_predicate, &scorer](const Phrase& phrase) {
+                ForEachPhraseMatch(phrase, document_predicate, scorer, [&document_to_relevance](int document_id, double relevance) {
+                    document_to_relevance[document_id].ref_to_value += relevance;
+                });
+            }
+        );
+        for_each(
+            policy,
+            query.field_plus_words.begin(),
+            query.field_plus_words.end(),
+            [this, &document_to_relevance, document_predicate, &scorer](const FieldWord& field_word) {
+                ForEachFieldMatch(field_word, document_predicate, scorer, [&document_to_relevance](int document_id, double relevance) {
+                    document_to_relevance[document_id].ref_to_value += relevance;
+                });
+            }
+        );
+    }
 
-    for_each( 
-        policy,
-        query.minus_words.begin(),
-        query.minus_words.end(),
-        [this, &document_to_relevance](const std::string_view& word) {
-            if (word_to_document_freqs_.count(word)) {
-                for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
+    {
+        PROFILE_SCOPE("FindTopDocuments.minus-filter");
+        for_each(
+            policy,
+            query.minus_words.begin(),
+            query.minus_words.end(),
+            [this, &document_to_relevance](const std::string_view& word) {
+                if (word_to_document_freqs_.count(word)) {
+                    for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
+                        document_to_relevance.erase(document_id);
+                    }
+                }
+            }
+        );
+        for (const FieldWord& field_word : query.field_minus_words) {
+            if (const Postings* postings = FindFieldPostings(field_word)) {
+                for (const auto& [document_id, _] : *postings) {
                     document_to_relevance.erase(document_id);
                 }
             }
         }
-    );
+    }
 
-    std::vector<Document> matched_documents;
     std::map<int, double> document_to_relevance_map = document_to_relevance.BuildOrdinaryMap();
-    matched_documents.reserve(document_to_relevance_map.size());
-
-    for_each(
+    PROFILE_COUNT("documents_scored", document_to_relevance_map.size());
+    //каждый поток пишет в своё место заранее выделенного вектора
+    std::vector<Document> matched_documents(document_to_relevance_map.size());
+    transform(
         policy,
         document_to_relevance_map.begin(), document_to_relevance_map.end(),
-        [this, &matched_documents](const std::pair<int, double>& id_relevance) {
-            matched_documents.push_back({ id_relevance.first, id_relevance.second, documents_.at(id_relevance.first).rating });
+        matched_documents.begin(),
+        [this](const std::pair<const int, double>& id_relevance) {
+            return Document{ id_relevance.first, id_relevance.second, documents_.at(id_relevance.first).rating };
         }
     );
 
@@ -0,0 +1,784 @@
+// Тесты производительности на Google Benchmark.
+//
+// Машиночитаемый отчёт для отслеживания регрессий:
+//   ./search_server_benchmark --benchmark_format=json --benchmark_out=bench.json
+// Выбор отдельных тестов:
+//   ./search_server_benchmark --benchmark_filter=FindTopDocuments
+
+#include <benchmark/benchmark.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "document_loader.h"
+#include "generators.h"
+#include "numa_search_server.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "string_processing.h"
+#include "text_analyzer.h"
+#include "write_ahead_log.h"
+
+using namespace std;
+
+//счётчик выделений памяти через глобальные operator new всех видов - для отчёта о выделениях на запрос
+static atomic<uint64_t> allocation_count{ 0 };
+
+static void* CountedAllocate(size_t size, size_t alignment) noexcept {
+    allocation_count.fetch_add(1, memory_order_relaxed);
+    size = max<size_t>(size, 1);
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        return malloc(size);
+    }
+    //aligned_alloc требует размер, кратный выравниванию
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void* CountedAllocateOrThrow(size_t size, size_t alignment) {
+    if (void* pointer = CountedAllocate(size, alignment)) {
+        return pointer;
+    }
+    throw bad_alloc();
+}
+
+//GCC считает free после замещённого operator new несовпадающей парой (-Wmismatched-new-delete),
+//хотя здесь обе стороны - malloc/free
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) { return CountedAllocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return CountedAllocateOrThrow(size, 0); }
+void* operator new(size_t size, align_val_t alignment) { return CountedAllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, align_val_t alignment) { return CountedAllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, const nothrow_t&) noexcept { return CountedAllocate(size, 0); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return CountedAllocate(size, 0); }
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, align_val_t) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t, align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t, align_val_t) noexcept { free(pointer); }
+void operator delete(void* pointer, const nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, const nothrow_t&) noexcept { free(pointer); }
+void operator delete(void* pointer, align_val_t, const nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, align_val_t, const nothrow_t&) noexcept { free(pointer); }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+//показатель Ципфа, близкий к естественным текстам
+const double ZIPF_EXPONENT = 1.0;
+const int DOCUMENT_WORD_COUNT = 70;
+const int QUERY_COUNT = 64;
+
+struct Corpus {
+    vector<string> dictionary;
+    vector<string> documents;
+};
+
+//корпуса дорого генерировать, поэтому они создаются один раз на пару (число документов, размер словаря)
+const Corpus& GetCorpus(int document_count, int dictionary_size) {
+    static map<pair<int, int>, Corpus> corpora;
+    auto [it, inserted] = corpora.try_emplace({ document_count, dictionary_size });
+    if (inserted) {
+        mt19937 generator(document_count ^ dictionary_size);
+        it->second.dictionary = GenerateDictionary(generator, dictionary_size, 10);
+        it->second.documents = GenerateZipfQueries(generator, it->second.dictionary, ZIPF_EXPONENT,
+            document_count, DOCUMENT_WORD_COUNT);
+    }
+    return it->second;
+}
+
+void FillServer(SearchServer& server, const Corpus& corpus) {
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        server.AddDocument(static_cast<int>(i), corpus.documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+}
+
+//первое слово словаря - самое частое по Ципфу, его и делаем стоп-словом
+const SearchServer& GetServer(int document_count, int dictionary_size) {
+    static map<pair<int, int>, unique_ptr<SearchServer>> servers;
+    auto& server = servers[{ document_count, dictionary_size }];
+    if (!server) {
+        const Corpus& corpus = GetCorpus(document_count, dictionary_size);
+        server = make_unique<SearchServer>(corpus.dictionary[0]);
+        FillServer(*server, corpus);
+    }
+    return *server;
+}
+
+vector<string> MakeQueries(const Corpus& corpus, int word_count, double minus_prob = 0.1) {
+    mt19937 generator(word_count);
+    return GenerateZipfQueries(generator, corpus.dictionary, ZIPF_EXPONENT, QUERY_COUNT, word_count, minus_prob);
+}
+
+//document_count, dictionary_size, query_words
+void QueryArguments(benchmark::internal::Benchmark* benchmark) {
+    for (int document_count : { 1'000, 10'000 }) {
+        for (int dictionary_size : { 1'000, 20'000 }) {
+            for (int query_words : { 5, 70, 500 }) {
+                benchmark->Args({ document_count, dictionary_size, query_words });
+            }
+        }
+    }
+}
+
+void CorpusArguments(benchmark::internal::Benchmark* benchmark) {
+    for (int document_count : { 1'000, 10'000 }) {
+        for (int dictionary_size : { 1'000, 20'000 }) {
+            benchmark->Args({ document_count, dictionary_size });
+        }
+    }
+}
+
+//выделения памяти за замер в пересчёте на одну итерацию
+class AllocationCounter {
+public:
+    explicit AllocationCounter(benchmark::State& state)
+        : state_(state)
+        , start_(allocation_count.load(memory_order_relaxed))
+    {}
+
+    ~AllocationCounter() {
+        const uint64_t allocations = allocation_count.load(memory_order_relaxed) - start_;
+        state_.counters["allocations_per_query"s] = static_cast<double>(allocations) / max<benchmark::IterationCount>(state_.iterations(), 1);
+    }
+
+private:
+    benchmark::State& state_;
+    const uint64_t start_;
+};
+
+//сколько памяти malloc взял у системы и сколько из неё сейчас свободно внутри кучи
+struct HeapUsage {
+    double heap_mb = 0.0;
+    double free_mb = 0.0;
+};
+
+HeapUsage GetHeapUsage() {
+    HeapUsage usage;
+#if defined(__GLIBC__)
+    malloc_trim(0);
+    const struct mallinfo2 info = mallinfo2();
+    usage.heap_mb = (info.arena + info.hblkhd) / 1048576.0;
+    usage.free_mb = info.fordblks / 1048576.0;
+#endif
+    return usage;
+}
+
+//RemoveDuplicates печатает каждый найденный дубликат, а stdout занят отчётом бенчмарка
+class SilenceStdout {
+public:
+    SilenceStdout()
+        : buffer_(cout.rdbuf(nullptr)) {
+    }
+    ~SilenceStdout() {
+        cout.rdbuf(buffer_);
+        cout.clear();
+    }
+
+private:
+    streambuf* const buffer_;
+};
+
+} // namespace
+
+static void BM_AddDocument(benchmark::State& state) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    for (auto _ : state) {
+        SearchServer server(corpus.dictionary[0]);
+        FillServer(server, corpus);
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+    state.counters["docs_per_second"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * corpus.documents.size()), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_AddDocument)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+
+//GetMemoryStats на заполненном индексе: время обхода словаря и оценка памяти рядом с измеренной по malloc
+static void BM_GetMemoryStats(benchmark::State& state) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    const HeapUsage empty = GetHeapUsage();
+    SearchServer server(corpus.dictionary[0]);
+    FillServer(server, corpus);
+    const HeapUsage filled = GetHeapUsage();
+    IndexMemoryStats stats;
+    for (auto _ : state) {
+        stats = server.GetMemoryStats(10);
+        benchmark::DoNotOptimize(stats.longest_postings.data());
+    }
+    state.counters["heap_mb"s] = (filled.heap_mb - filled.free_mb) - (empty.heap_mb - empty.free_mb);
+    state.counters["estimated_mb"s] = stats.total_bytes / 1048576.0;
+    state.counters["pool_mb"s] = stats.index_pool_bytes / 1048576.0;
+    state.counters["terms"s] = static_cast<double>(stats.live_term_count);
+    state.counters["avg_posting"s] = stats.average_posting_length;
+}
+BENCHMARK(BM_GetMemoryStats)->Apply(CorpusArguments)->Unit(benchmark::kMicrosecond);
+
+//тот же корпус кириллицей, с заглавными буквами и пунктуацией - как тексты, на которые рассчитан анализатор
+const vector<string>& GetCyrillicDocuments(int document_count, int dictionary_size) {
+    static map<pair<int, int>, vector<string>> corpora;
+    auto [it, inserted] = corpora.try_emplace({ document_count, dictionary_size });
+    if (inserted) {
+        for (const string& document : GetCorpus(document_count, dictionary_size).documents) {
+            string text;
+            size_t word_index = 0;
+            bool word_start = true;
+            for (const char c : document) {
+                if (c == ' ') {
+                    text += ++word_index % 5 == 0 ? ", "s : " "s;
+                    word_start = true;
+                    continue;
+                }
+                //a..z -> а..щ, первая буква каждого седьмого слова заглавная
+                const bool upper = word_start && word_index % 7 == 0;
+                const char32_t letter = (upper ? U'А' : U'а') + static_cast<char32_t>((c - 'a') % 26);
+                text += static_cast<char>(0xC0 | (letter >> 6));
+                text += static_cast<char>(0x80 | (letter & 0x3F));
+                word_start = false;
+            }
+            it->second.push_back(text + '.');
+        }
+    }
+    return it->second;
+}
+
+enum class AnalyzerMode { NONE, FOLD, STEM };
+
+//индексация кириллического корпуса без анализатора и с ним: цена нормализации на вводе
+static void BM_AnalyzedAddDocument(benchmark::State& state, AnalyzerMode mode) {
+    const vector<string>& documents = GetCyrillicDocuments(state.range(0), state.range(1));
+    size_t bytes = 0;
+    for (const string& document : documents) {
+        bytes += document.size();
+    }
+    for (auto _ : state) {
+        SearchServer server(""s);
+        if (mode != AnalyzerMode::NONE) {
+            server.SetTextAnalyzer({ .stem = mode == AnalyzerMode::STEM });
+        }
+        for (size_t i = 0; i < documents.size(); ++i) {
+            server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1 });
+        }
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+    state.counters["docs_per_second"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * documents.size()), benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+BENCHMARK_CAPTURE(BM_AnalyzedAddDocument, none, AnalyzerMode::NONE)->Args({ 10'000, 20'000 })->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_AnalyzedAddDocument, fold, AnalyzerMode::FOLD)->Args({ 10'000, 20'000 })->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_AnalyzedAddDocument, stem, AnalyzerMode::STEM)->Args({ 10'000, 20'000 })->Unit(benchmark::kMillisecond);
+
+//скорость самой нормализации: ASCII идёт по таблицам, кириллица - через декодирование UTF-8
+static void BM_NormalizeText(benchmark::State& state, bool cyrillic) {
+    const vector<string>& documents = cyrillic ? GetCyrillicDocuments(10'000, 20'000) : GetCorpus(10'000, 20'000).documents;
+    const TextAnalyzer analyzer;
+    string normalized;
+    size_t bytes = 0;
+    size_t index = 0;
+    for (auto _ : state) {
+        const string& document = documents[index++ % documents.size()];
+        normalized.clear();
+        analyzer.Normalize(document, normalized);
+        benchmark::DoNotOptimize(normalized.data());
+        bytes += document.size();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK_CAPTURE(BM_NormalizeText, ascii, false)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_NormalizeText, cyrillic, true)->Unit(benchmark::kMicrosecond);
+
+static void BM_LoadDocuments(benchmark::State& state) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    const string path = "bench_load_documents.tsv"s;
+    {
+        ofstream out(path);
+        for (size_t i = 0; i < corpus.documents.size(); ++i) {
+            out << i << "\tACTUAL\t1 2 3\t"s << corpus.documents[i] << '\n';
+        }
+    }
+    LoadStats total;
+    for (auto _ : state) {
+        SearchServer server(corpus.dictionary[0]);
+        const LoadStats stats = LoadDocuments(server, path);
+        total.documents += stats.documents;
+        total.bytes += stats.bytes;
+    }
+    remove(path.c_str());
+    state.counters["docs_per_second"] = benchmark::Counter(static_cast<double>(total.documents), benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(static_cast<int64_t>(total.bytes));
+}
+BENCHMARK(BM_LoadDocuments)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+
+//восстановление из журнала: все документы корпуса и удаление каждого десятого.
+//decode - только чтение и проверка записей, apply - с построением индекса
+static void BM_WalReplay(benchmark::State& state, bool apply) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    const string path = "bench_wal_replay.log"s;
+    remove(path.c_str());
+    {
+        WriteAheadLog::Options options;
+        options.sync = false;
+        WriteAheadLog log(path, options);
+        LogRecord record;
+        record.ratings = { 1, 2, 3 };
+        for (size_t i = 0; i < corpus.documents.size(); ++i) {
+            record.document_id = static_cast<int>(i);
+            record.text = corpus.documents[i];
+            log.Append(record);
+        }
+        record.type = LogRecordType::REMOVE_DOCUMENT;
+        for (size_t i = 0; i < corpus.documents.size(); i += 10) {
+            record.document_id = static_cast<int>(i);
+            log.Append(record);
+        }
+    }
+    size_t records = 0;
+    for (auto _ : state) {
+        SearchServer server(corpus.dictionary[0]);
+        WriteAheadLog log(path, WriteAheadLog::Options{}, [&](const LogRecord& record) {
+            ++records;
+            if (apply) {
+                ApplyLogRecord(server, record);
+            }
+        });
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+    remove(path.c_str());
+    state.counters["records_per_second"] = benchmark::Counter(static_cast<double>(records), benchmark::Counter::kIsRate);
+}
+BENCHMARK_CAPTURE(BM_WalReplay, decode, false)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_WalReplay, apply, true)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+
+template <typename ExecutionPolicy>
+static void BM_RemoveDocument(benchmark::State& state, ExecutionPolicy policy) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    //удаляется каждый десятый документ, построение индекса в замер не входит
+    for (auto _ : state) {
+        state.PauseTiming();
+        SearchServer server(corpus.dictionary[0]);
+        FillServer(server, corpus);
+        state.ResumeTiming();
+        for (size_t id = 0; id < corpus.documents.size(); id += 10) {
+            server.RemoveDocument(policy, static_cast<int>(id));
+        }
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+}
+BENCHMARK_CAPTURE(BM_RemoveDocument, seq, execution::seq)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_RemoveDocument, par, execution::par)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+
+enum class DocumentChange { REPLACE, UPDATE, SET_STATUS };
+
+static void BM_ChangeDocument(benchmark::State& state, DocumentChange change) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    //правится каждый десятый документ: последнее слово заменяется другим словом словаря,
+    //на следующей итерации текст возвращается обратно - индекс не приходится строить заново
+    vector<pair<int, string>> edits;
+    for (size_t id = 0; id < corpus.documents.size(); id += 10) {
+        const string& text = corpus.documents[id];
+        edits.emplace_back(static_cast<int>(id), text.substr(0, text.rfind(' ') + 1) + corpus.dictionary[id % corpus.dictionary.size()]);
+    }
+    SearchServer server(corpus.dictionary[0]);
+    FillServer(server, corpus);
+    bool edited = false;
+    for (auto _ : state) {
+        edited = !edited;
+        for (const auto& [id, edited_text] : edits) {
+            const string& text = edited ? edited_text : corpus.documents[id];
+            switch (change) {
+            case DocumentChange::REPLACE:
+                server.RemoveDocument(id);
+                server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1, 2, 3 });
+                break;
+            case DocumentChange::UPDATE:
+                server.UpdateDocument(id, text);
+                break;
+            case DocumentChange::SET_STATUS:
+                server.SetStatus(id, edited ? DocumentStatus::BANNED : DocumentStatus::ACTUAL);
+                break;
+            }
+        }
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+    state.SetItemsProcessed(state.iterations() * edits.size());
+}
+BENCHMARK_CAPTURE(BM_ChangeDocument, remove_add, DocumentChange::REPLACE)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ChangeDocument, update, DocumentChange::UPDATE)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ChangeDocument, set_status, DocumentChange::SET_STATUS)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+
+//долгая смена документов: каждый раунд удаляет случайную десятую часть и добавляет столько же новых.
+//Куча после смены сравнивается с кучей сразу после заполнения при том же числе документов
+static void BM_IndexChurn(benchmark::State& state) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    const int rounds = 20;
+    const size_t churn = corpus.documents.size() / 10;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto server = make_unique<SearchServer>(corpus.dictionary[0]);
+        FillServer(*server, corpus);
+        const HeapUsage filled = GetHeapUsage();
+        mt19937 generator(42);
+        vector<int> live_ids(server->begin(), server->end());
+        int next_id = static_cast<int>(corpus.documents.size());
+        const uint64_t allocations_before = allocation_count.load(memory_order_relaxed);
+        state.ResumeTiming();
+        for (int round = 0; round < rounds; ++round) {
+            shuffle(live_ids.begin(), live_ids.end(), generator);
+            for (size_t i = 0; i < churn; ++i) {
+                server->RemoveDocument(live_ids[i]);
+                live_ids[i] = next_id++;
+                server->AddDocument(live_ids[i], corpus.documents[generator() % corpus.documents.size()], DocumentStatus::ACTUAL, { 1 });
+            }
+        }
+        state.PauseTiming();
+        const double allocations = static_cast<double>(allocation_count.load(memory_order_relaxed) - allocations_before);
+        const HeapUsage churned = GetHeapUsage();
+        state.counters["allocations_per_document"s] = allocations / (rounds * churn);
+        state.counters["heap_filled_mb"s] = filled.heap_mb;
+        state.counters["heap_churned_mb"s] = churned.heap_mb;
+        state.counters["heap_free_mb"s] = churned.free_mb;
+        server.reset();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_IndexChurn)->Args({ 10'000, 20'000 })->Iterations(1)->Unit(benchmark::kMillisecond);
+
+template <typename ExecutionPolicy>
+static void BM_FindTopDocuments(benchmark::State& state, ExecutionPolicy policy) {
+    const SearchServer& server = GetServer(state.range(0), state.range(1));
+    const vector<string> queries = MakeQueries(GetCorpus(state.range(0), state.range(1)), state.range(2));
+    size_t index = 0;
+    const AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.FindTopDocuments(policy, queries[index++ % queries.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FindTopDocuments, seq, execution::seq)->Apply(QueryArguments)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FindTopDocuments, par, execution::par)->Apply(QueryArguments)->Unit(benchmark::kMicrosecond);
+
+//три слова запроса через separator: " " - обычный запрос (объединение списков),
+//" AND " - пересечение, начиная с самого короткого списка
+static void BM_BooleanQuery(benchmark::State& state, string_view separator) {
+    const SearchServer& server = GetServer(state.range(0), state.range(1));
+    vector<string> queries = MakeQueries(GetCorpus(state.range(0), state.range(1)), 3, 0.0);
+    for (string& query : queries) {
+        string joined;
+        for (const string_view word : SplitIntoWords(query)) {
+            joined += (joined.empty() ? ""s : string(separator)) + string(word);
+        }
+        query = move(joined);
+    }
+    size_t index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.FindTopDocuments(queries[index++ % queries.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_BooleanQuery, plain, " "sv)->Apply(CorpusArguments)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_BooleanQuery, and, " AND "sv)->Apply(CorpusArguments)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_BooleanQuery, and_not, " AND NOT "sv)->Apply(CorpusArguments)->Unit(benchmark::kMicrosecond);
+
+//горячие и холодные слова на корпусе Ципфа: самые частые слова есть почти во всех документах.
+//DENSE - битовые карты горячих слов, STOP - ещё и частые плюс-слова отбрасываются как стоп-слова.
+//Запросы - пять слов с минус-словами или три слова через AND
+enum class TierMode { PLAIN, DENSE, STOP };
+
+static void BM_TermTiers(benchmark::State& state, TierMode mode, string_view separator) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    SearchServer server(""s);
+    FillServer(server, corpus);
+    if (mode != TierMode::PLAIN) {
+        TermTierOptions options;
+        if (mode == TierMode::STOP) {
+            options.stop_max_idf = 1.0;
+        }
+        server.SetTermTiers(options);
+    }
+    vector<string> queries = MakeQueries(corpus, separator == " "sv ? 5 : 3, separator == " "sv ? 0.2 : 0.0);
+    for (string& query : queries) {
+        string joined;
+        for (const string_view word : SplitIntoWords(query)) {
+            joined += (joined.empty() ? ""s : string(separator)) + string(word);
+        }
+        query = move(joined);
+    }
+    size_t index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.FindTopDocuments(queries[index++ % queries.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+    const IndexMemoryStats stats = server.GetMemoryStats(0);
+    state.counters["dense_terms"s] = static_cast<double>(stats.dense_term_count);
+    state.counters["dense_postings"s] = static_cast<double>(stats.dense_posting_count);
+    state.counters["bitmap_kb"s] = stats.dense_bitmap_bytes / 1024.0;
+    state.counters["stop_words"s] = static_cast<double>(stats.dynamic_stop_word_count);
+}
+BENCHMARK_CAPTURE(BM_TermTiers, plain, TierMode::PLAIN, " "sv)->Args({ 10'000, 20'000 })->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_TermTiers, dense, TierMode::DENSE, " "sv)->Args({ 10'000, 20'000 })->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_TermTiers, stop, TierMode::STOP, " "sv)->Args({ 10'000, 20'000 })->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_TermTiers, and_plain, TierMode::PLAIN, " AND "sv)->Args({ 10'000, 20'000 })->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_TermTiers, and_dense, TierMode::DENSE, " AND "sv)->Args({ 10'000, 20'000 })->Unit(benchmark::kMicrosecond);
+
+//патологические запросы из сотен слов с бюджетом постингов (0 - без ограничения).
+//recall - доля документов полной выдачи, оставшихся в приблизительной
+static void BM_QueryBudget(benchmark::State& state) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    SearchServer server(""s);
+    FillServer(server, corpus);
+    const vector<string> queries = MakeQueries(corpus, 200, 0.0);
+    const QueryBudget budget{ .max_postings = static_cast<size_t>(state.range(2)), .deadline = nullopt };
+    size_t index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.FindTopDocumentsWithBudget(queries[index++ % queries.size()], DocumentStatus::ACTUAL, budget));
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    size_t scanned = 0;
+    size_t truncated = 0;
+    size_t found = 0;
+    size_t expected = 0;
+    for (const string& query : queries) {
+        const BudgetedSearchResult result = server.FindTopDocumentsWithBudget(query, DocumentStatus::ACTUAL, budget);
+        const vector<Document> full = server.FindTopDocuments(query);
+        scanned += result.postings_scanned;
+        truncated += result.is_truncated;
+        expected += full.size();
+        for (const Document& document : full) {
+            found += any_of(result.documents.begin(), result.documents.end(),
+                [&document](const Document& other) { return other.id == document.id; });
+        }
+    }
+    state.counters["postings"s] = static_cast<double>(scanned) / queries.size();
+    state.counters["truncated"s] = static_cast<double>(truncated) / queries.size();
+    state.counters["recall"s] = expected ? static_cast<double>(found) / expected : 1.0;
+}
+BENCHMARK(BM_QueryBudget)->ArgsProduct({ { 10'000 }, { 20'000 }, { 0, 50'000, 10'000, 2'000 } })
+    ->ArgNames({ "docs", "dict", "max_postings" })->Unit(benchmark::kMicrosecond);
+
+//документы из заголовка (первые 8 слов) и текста: сколько стоят поля на запросе и в памяти индекса.
+//PLAIN - тот же текст одним полем, TITLE_ONLY - все слова запроса с title:
+enum class FieldMode { PLAIN, FIELDS, WEIGHTED, TITLE_ONLY };
+
+static void BM_FieldSearch(benchmark::State& state, FieldMode mode) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    const HeapUsage empty = GetHeapUsage();
+    SearchServer server(corpus.dictionary[0]);
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        const string_view text = corpus.documents[i];
+        size_t title_end = 0;
+        for (int words = 0; words < 8 && title_end != text.npos; ++words) {
+            title_end = text.find(' ', title_end + 1);
+        }
+        title_end = min(title_end, text.size());
+        if (mode == FieldMode::PLAIN) {
+            server.AddDocument(static_cast<int>(i), text, DocumentStatus::ACTUAL, { 1 });
+        }
+        else {
+            server.AddDocument(static_cast<int>(i), { { "title"sv, text.substr(0, title_end) }, { ""sv, text.substr(title_end) } },
+                DocumentStatus::ACTUAL, { 1 });
+        }
+    }
+    const HeapUsage filled = GetHeapUsage();
+    state.counters["index_mb"s] = (filled.heap_mb - filled.free_mb) - (empty.heap_mb - empty.free_mb);
+    if (mode == FieldMode::WEIGHTED || mode == FieldMode::TITLE_ONLY) {
+        server.SetFieldWeight("title"sv, 3.0);
+    }
+    vector<string> queries = MakeQueries(corpus, 3, 0.0);
+    if (mode == FieldMode::TITLE_ONLY) {
+        for (string& query : queries) {
+            string fielded;
+            for (const string_view word : SplitIntoWords(query)) {
+                fielded += (fielded.empty() ? "title:"s : " title:"s) + string(word);
+            }
+            query = move(fielded);
+        }
+    }
+    size_t index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.FindTopDocuments(queries[index++ % queries.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_FieldSearch, plain, FieldMode::PLAIN)->Args({ 10'000, 20'000 })->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FieldSearch, fields, FieldMode::FIELDS)->Args({ 10'000, 20'000 })->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FieldSearch, weighted, FieldMode::WEIGHTED)->Args({ 10'000, 20'000 })->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FieldSearch, title_only, FieldMode::TITLE_ONLY)->Args({ 10'000, 20'000 })->Unit(benchmark::kMicrosecond);
+
+//та же выборка с BM25 вместо TF-IDF по умолчанию
+static void BM_FindTopDocumentsBm25(benchmark::State& state) {
+    const SearchServer& server = GetServer(state.range(0), state.range(1));
+    const vector<string> queries = MakeQueries(GetCorpus(state.range(0), state.range(1)), state.range(2));
+    const auto is_actual = [](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; };
+    size_t index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.FindTopDocuments(execution::seq, queries[index++ % queries.size()], is_actual, Bm25Scorer{}));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FindTopDocumentsBm25)->Apply(QueryArguments)->Unit(benchmark::kMicrosecond);
+
+//страница из 10 документов с глубины offset: отбор лучших offset + 10 вместо полной сортировки
+static void BM_FindPage(benchmark::State& state) {
+    const SearchServer& server = GetServer(10000, 20000);
+    const vector<string> queries = MakeQueries(GetCorpus(10000, 20000), 3);
+    PageRequest page;
+    page.page_size = 10;
+    page.offset = static_cast<size_t>(state.range(0));
+    size_t index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.FindPage(queries[index++ % queries.size()], DocumentStatus::ACTUAL, page));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FindPage)->Arg(0)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+//стоимость нечёткого расширения одного слова с опечаткой на большом словаре:
+//каждое слово словаря встречается в одном документе из 100 слов
+static void BM_FuzzyExpansion(benchmark::State& state) {
+    static map<int, unique_ptr<SearchServer>> servers;
+    static map<int, vector<string>> dictionaries;
+    const int dictionary_size = state.range(0);
+    auto& server = servers[dictionary_size];
+    vector<string>& dictionary = dictionaries[dictionary_size];
+    if (!server) {
+        mt19937 generator(dictionary_size);
+        dictionary = GenerateDictionary(generator, dictionary_size, 10);
+        server = make_unique<SearchServer>(""s);
+        string document;
+        for (int i = 0; i < dictionary_size; ++i) {
+            document += dictionary[i] + ' ';
+            if (i % 100 == 99 || i + 1 == dictionary_size) {
+                document.pop_back();
+                server->AddDocument(i / 100, document, DocumentStatus::ACTUAL, { 1 });
+                document.clear();
+            }
+        }
+    }
+    server->SetFuzzyMaxEdits(static_cast<int>(state.range(1)));
+
+    mt19937 generator(42);
+    vector<string> queries;
+    for (int i = 0; i < QUERY_COUNT; ++i) {
+        string word = dictionary[generator() % dictionary.size()];
+        word[generator() % word.size()] = static_cast<char>('a' + generator() % 26);
+        queries.push_back(word);
+    }
+    size_t index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server->FindTopDocuments(queries[index++ % queries.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FuzzyExpansion)->ArgsProduct({ { 100'000, 1'000'000 }, { 0, 1, 2 } })->Unit(benchmark::kMicrosecond);
+
+template <typename ExecutionPolicy>
+static void BM_MatchDocument(benchmark::State& state, ExecutionPolicy policy) {
+    const SearchServer& server = GetServer(state.range(0), state.range(1));
+    const vector<string> queries = MakeQueries(GetCorpus(state.range(0), state.range(1)), state.range(2));
+    const int document_count = server.GetDocumentCount();
+    size_t index = 0;
+    const AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.MatchDocument(policy, queries[index % queries.size()],
+            server.GetDocumentId(static_cast<int>(index % document_count))));
+        ++index;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_MatchDocument, seq, execution::seq)->Apply(QueryArguments)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MatchDocument, par, execution::par)->Apply(QueryArguments)->Unit(benchmark::kMicrosecond);
+
+static void BM_MatchDocumentsBatch(benchmark::State& state) {
+    const SearchServer& server = GetServer(state.range(0), state.range(1));
+    const vector<string> queries = MakeQueries(GetCorpus(state.range(0), state.range(1)), state.range(2));
+    const vector<int> document_ids(server.begin(), server.end());
+    size_t index = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.MatchDocuments(execution::par, queries[index++ % queries.size()], document_ids));
+    }
+    state.SetItemsProcessed(state.iterations() * document_ids.size());
+}
+BENCHMARK(BM_MatchDocumentsBatch)->Apply(QueryArguments)->Unit(benchmark::kMillisecond);
+
+static void BM_ProcessQueries(benchmark::State& state) {
+    const SearchServer& server = GetServer(state.range(0), state.range(1));
+    const vector<string> queries = MakeQueries(GetCorpus(state.range(0), state.range(1)), state.range(2));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ProcessQueries(server, queries));
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+BENCHMARK(BM_ProcessQueries)->Apply(QueryArguments)->Unit(benchmark::kMillisecond);
+
+//пакет запросов по копиям индекса на узлах NUMA: range(0) - сколько узлов занять. Узлов больше,
+//чем у машины, не бывает, поэтому на одноузловой машине все варианты - один пул закреплённых потоков.
+//pinned = 0 - потоки не закреплены, для сравнения
+static void BM_NumaProcessQueries(benchmark::State& state) {
+    const Corpus& corpus = GetCorpus(10'000, 20'000);
+    const NumaSearchServer::Options options{ .max_nodes = static_cast<size_t>(state.range(0)), .workers_per_node = 0,
+        .pin_workers = state.range(1) != 0, .limits = {} };
+    NumaSearchServer server(corpus.dictionary[0], [&corpus](SearchServer& replica) { FillServer(replica, corpus); }, options);
+    const vector<string> queries = MakeQueries(corpus, 5);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.ProcessQueries(queries));
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+    state.counters["nodes"s] = static_cast<double>(server.GetNodeCount());
+    state.counters["workers"s] = static_cast<double>(server.GetWorkerCount());
+    state.counters["memory_policy"s] = server.HasMemoryPolicy() ? 1.0 : 0.0;
+}
+BENCHMARK(BM_NumaProcessQueries)->ArgsProduct({ { 1, 2, 4 }, { 0, 1 } })->ArgNames({ "nodes", "pinned" })->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static void BM_RemoveDuplicates(benchmark::State& state) {
+    const Corpus& corpus = GetCorpus(state.range(0), state.range(1));
+    for (auto _ : state) {
+        state.PauseTiming();
+        SearchServer server(corpus.dictionary[0]);
+        FillServer(server, corpus);
+        //каждый десятый документ - копия предыдущего
+        for (size_t i = 0; i < corpus.documents.size(); i += 10) {
+            server.AddDocument(static_cast<int>(corpus.documents.size() + i), corpus.documents[i], DocumentStatus::ACTUAL, { 1 });
+        }
+        state.ResumeTiming();
+        SilenceStdout silence;
+        RemoveDuplicates(server);
+        benchmark::DoNotOptimize(server.GetDocumentCount());
+    }
+}
+BENCHMARK(BM_RemoveDuplicates)->Apply(CorpusArguments)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
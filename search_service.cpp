@@ -0,0 +1,105 @@
+// HTTP-сервис поиска (протокол - в http_service.h).
+//
+//   ./search_service --port 8080 --stop-words "and in on" --load documents.tsv
+//
+// --load принимает дамп document_loader.h: .jsonl разбирается как JSONL, остальное как TSV.
+// Остановка - SIGINT или SIGTERM.
+
+#include <charconv>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "document_loader.h"
+#include "http_service.h"
+#include "search_server.h"
+
+using namespace std;
+
+namespace {
+
+HttpSearchService* running_service = nullptr;
+
+void StopService(int) {
+    if (running_service) {
+        running_service->Stop();
+    }
+}
+
+[[noreturn]] void PrintUsage() {
+    cerr << "Usage: search_service [--address 127.0.0.1] [--port 8080] [--stop-words \"a b\"] [--load dump.tsv|dump.jsonl]"s << endl;
+    exit(2);
+}
+
+// значение опции целиком как число, иначе PrintUsage
+template <typename Number>
+Number ParseNumber(string_view value) {
+    Number number{};
+    const auto [end, error] = from_chars(value.data(), value.data() + value.size(), number);
+    if (error != errc() || end != value.data() + value.size()) {
+        PrintUsage();
+    }
+    return number;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    string address = "127.0.0.1"s;
+    int port = 8080;
+    string stop_words;
+    string dump_path;
+    for (int i = 1; i < argc; ++i) {
+        const string_view option = argv[i];
+        if (i + 1 == argc) {
+            PrintUsage();
+        }
+        const string value = argv[++i];
+        if (option == "--address"sv) {
+            address = value;
+        }
+        else if (option == "--port"sv) {
+            port = ParseNumber<int>(value);
+        }
+        else if (option == "--stop-words"sv) {
+            stop_words = value;
+        }
+        else if (option == "--load"sv) {
+            dump_path = value;
+        }
+        else {
+            PrintUsage();
+        }
+    }
+    if (port < 0 || port > 65535) {
+        PrintUsage();
+    }
+
+    try {
+        SearchServer server(stop_words);
+        if (!dump_path.empty()) {
+            LoadOptions options;
+            const string_view suffix = ".jsonl"sv;
+            if (dump_path.size() >= suffix.size() && dump_path.compare(dump_path.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                options.format = DumpFormat::JSONL;
+            }
+            const LoadStats stats = LoadDocuments(server, dump_path, options);
+            cerr << "Loaded "s << stats.documents << " documents in "s << stats.seconds << " s"s << endl;
+        }
+
+        HttpSearchService service(server, static_cast<uint16_t>(port), address);
+        running_service = &service;
+        signal(SIGINT, StopService);
+        signal(SIGTERM, StopService);
+        cerr << "Listening on "s << address << ':' << service.GetPort() << endl;
+        service.Run();
+        running_service = nullptr;
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
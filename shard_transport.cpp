@@ -0,0 +1,529 @@
+#include "shard_transport.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+using namespace std;
+
+namespace {
+
+enum class Operation : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT,
+    GET_DOCUMENT_COUNT,
+    GET_QUERY_STATISTICS,
+    FIND_TOP_DOCUMENTS,
+};
+
+// самый длинный кадр: документ или статистика запроса с подстановками
+constexpr uint32_t MAX_FRAME_SIZE = 256u << 20;
+
+enum class ResponseStatus : uint8_t {
+    OK = 0,
+    INVALID_ARGUMENT,
+    ERROR,
+};
+
+class Writer {
+public:
+    template <typename T>
+    Writer& Put(T value) {
+        static_assert(is_trivially_copyable_v<T>);
+        data_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        return *this;
+    }
+
+    Writer& PutString(string_view text) {
+        Put(static_cast<uint32_t>(text.size()));
+        data_.append(text);
+        return *this;
+    }
+
+    string Take() { return move(data_); }
+
+private:
+    string data_;
+};
+
+class Reader {
+public:
+    explicit Reader(string_view data)
+        : data_(data)
+    {}
+
+    template <typename T>
+    T Get() {
+        static_assert(is_trivially_copyable_v<T>);
+        Require(sizeof(T));
+        T value;
+        memcpy(&value, data_.data(), sizeof(T));
+        data_.remove_prefix(sizeof(T));
+        return value;
+    }
+
+    string_view GetString() {
+        const uint32_t size = Get<uint32_t>();
+        Require(size);
+        const string_view text = data_.substr(0, size);
+        data_.remove_prefix(size);
+        return text;
+    }
+
+private:
+    string_view data_;
+
+    void Require(size_t size) const {
+        if (data_.size() < size) {
+            throw runtime_error("Truncated shard message"s);
+        }
+    }
+};
+
+void WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "Shard socket write"s);
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+// false - соединение закрыто до начала данных
+bool ReadAll(int fd, char* data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t received = ::recv(fd, data + done, size - done, 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, generic_category(), "Shard socket read"s);
+        }
+        if (received == 0) {
+            if (done == 0) {
+                return false;
+            }
+            throw runtime_error("Shard connection closed in the middle of a message"s);
+        }
+        done += static_cast<size_t>(received);
+    }
+    return true;
+}
+
+void SendFrame(int fd, const string& body) {
+    const uint32_t size = static_cast<uint32_t>(body.size());
+    WriteAll(fd, reinterpret_cast<const char*>(&size), sizeof(size));
+    WriteAll(fd, body.data(), body.size());
+}
+
+bool ReceiveFrame(int fd, string& body) {
+    uint32_t size = 0;
+    if (!ReadAll(fd, reinterpret_cast<char*>(&size), sizeof(size))) {
+        return false;
+    }
+    //длина из чужого или испорченного потока не должна заставлять выделять гигабайты
+    if (size > MAX_FRAME_SIZE) {
+        throw runtime_error("Shard message of "s + to_string(size) + " bytes is too large"s);
+    }
+    body.resize(size);
+    if (size > 0 && !ReadAll(fd, body.data(), size)) {
+        throw runtime_error("Shard connection closed in the middle of a message"s);
+    }
+    return true;
+}
+
+void PutStatistics(Writer& writer, const CollectionStatistics& statistics) {
+    writer.Put(static_cast<uint64_t>(statistics.document_count))
+        .Put(static_cast<uint64_t>(statistics.total_document_length))
+        .Put(static_cast<uint32_t>(statistics.document_freqs.size()));
+    for (const auto& [word, document_freq] : statistics.document_freqs) {
+        writer.PutString(word).Put(static_cast<uint64_t>(document_freq));
+    }
+    writer.Put(static_cast<uint32_t>(statistics.expansions.size()));
+    for (const auto& [word, terms] : statistics.expansions) {
+        writer.PutString(word).Put(static_cast<uint32_t>(terms.size()));
+        for (const auto& [term, weight] : terms) {
+            writer.PutString(term).Put(weight);
+        }
+    }
+}
+
+CollectionStatistics GetStatistics(Reader& reader) {
+    CollectionStatistics statistics;
+    statistics.document_count = reader.Get<uint64_t>();
+    statistics.total_document_length = reader.Get<uint64_t>();
+    const uint32_t word_count = reader.Get<uint32_t>();
+    for (uint32_t i = 0; i < word_count; ++i) {
+        const string_view word = reader.GetString();
+        statistics.document_freqs.emplace(string(word), reader.Get<uint64_t>());
+    }
+    const uint32_t expansion_count = reader.Get<uint32_t>();
+    for (uint32_t i = 0; i < expansion_count; ++i) {
+        auto& terms = statistics.expansions[string(reader.GetString())];
+        terms.resize(reader.Get<uint32_t>());
+        for (auto& [term, weight] : terms) {
+            term = reader.GetString();
+            weight = reader.Get<double>();
+        }
+    }
+    return statistics;
+}
+
+string HandleRequest(SearchServer& server, shared_mutex& index_mutex, const string& request) {
+    Reader reader(request);
+    Writer response;
+    response.Put(ResponseStatus::OK);
+    const Operation operation = reader.Get<Operation>();
+    //поиск с разных соединений идёт параллельно, изменения индекса - по одному и без поиска
+    const bool is_mutation = operation == Operation::ADD_DOCUMENT || operation == Operation::REMOVE_DOCUMENT;
+    unique_lock<shared_mutex> write_lock(index_mutex, defer_lock);
+    shared_lock<shared_mutex> read_lock(index_mutex, defer_lock);
+    if (is_mutation) {
+        write_lock.lock();
+    }
+    else {
+        read_lock.lock();
+    }
+    switch (operation) {
+    case Operation::ADD_DOCUMENT: {
+        const int document_id = reader.Get<int32_t>();
+        const DocumentStatus status = reader.Get<DocumentStatus>();
+        vector<int> ratings(reader.Get<uint32_t>());
+        for (int& rating : ratings) {
+            rating = reader.Get<int32_t>();
+        }
+        server.AddDocument(document_id, reader.GetString(), status, ratings);
+        break;
+    }
+    case Operation::REMOVE_DOCUMENT:
+        server.RemoveDocument(reader.Get<int32_t>());
+        break;
+    case Operation::GET_DOCUMENT_COUNT:
+        response.Put(static_cast<int32_t>(server.GetDocumentCount()));
+        break;
+    case Operation::GET_QUERY_STATISTICS:
+        PutStatistics(response, server.GetQueryStatistics(reader.GetString()));
+        break;
+    case Operation::FIND_TOP_DOCUMENTS: {
+        const string_view raw_query = reader.GetString();
+        const DocumentStatus status = reader.Get<DocumentStatus>();
+        const CollectionStatistics statistics = GetStatistics(reader);
+        const bool has_bm25 = reader.Get<uint8_t>() != 0;
+        Bm25Scorer bm25;
+        if (has_bm25) {
+            bm25.k1 = reader.Get<double>();
+            bm25.b = reader.Get<double>();
+        }
+        QueryLimits limits;
+        limits.max_postings = reader.Get<uint64_t>();
+        limits.timeout = chrono::microseconds(reader.Get<int64_t>());
+        const BudgetedSearchResult result = FindShardTopDocuments(server, raw_query, status, statistics,
+            has_bm25 ? &bm25 : nullptr, limits);
+        const vector<Document>& documents = result.documents;
+        response.Put(static_cast<uint8_t>(result.is_truncated)).Put(static_cast<uint64_t>(result.postings_scanned));
+        response.Put(static_cast<uint32_t>(documents.size()));
+        for (const Document& document : documents) {
+            response.Put(static_cast<int32_t>(document.id)).Put(document.relevance).Put(static_cast<int32_t>(document.rating));
+        }
+        break;
+    }
+    default:
+        throw runtime_error("Unknown shard operation"s);
+    }
+    return response.Take();
+}
+
+string ErrorResponse(ResponseStatus status, const char* message) {
+    return Writer().Put(status).PutString(message).Take();
+}
+
+} // namespace
+
+RemoteShard::RemoteShard(int socket_fd)
+    : socket_fd_(socket_fd)
+{}
+
+RemoteShard::RemoteShard(const string& socket_path) {
+    sockaddr_un address{};
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw invalid_argument("Shard socket path is too long"s);
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    socket_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_fd_ < 0) {
+        throw system_error(errno, generic_category(), "Shard socket"s);
+    }
+    if (::connect(socket_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const int error = errno;
+        ::close(socket_fd_);
+        throw system_error(error, generic_category(), "Connect to shard "s + socket_path);
+    }
+}
+
+RemoteShard::~RemoteShard() {
+    ::close(socket_fd_);
+}
+
+string RemoteShard::Call(const string& request) const {
+    string response;
+    {
+        lock_guard guard(mutex_);
+        SendFrame(socket_fd_, request);
+        if (!ReceiveFrame(socket_fd_, response)) {
+            throw runtime_error("Shard closed the connection"s);
+        }
+    }
+    Reader reader(response);
+    const ResponseStatus status = reader.Get<ResponseStatus>();
+    if (status == ResponseStatus::OK) {
+        return response.substr(sizeof(ResponseStatus));
+    }
+    const string message(reader.GetString());
+    if (status == ResponseStatus::INVALID_ARGUMENT) {
+        throw invalid_argument(message);
+    }
+    throw runtime_error(message);
+}
+
+void RemoteShard::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    Writer request;
+    request.Put(Operation::ADD_DOCUMENT).Put(static_cast<int32_t>(document_id)).Put(status)
+        .Put(static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        request.Put(static_cast<int32_t>(rating));
+    }
+    request.PutString(document);
+    Call(request.Take());
+}
+
+void RemoteShard::RemoveDocument(int document_id) {
+    Call(Writer().Put(Operation::REMOVE_DOCUMENT).Put(static_cast<int32_t>(document_id)).Take());
+}
+
+int RemoteShard::GetDocumentCount() const {
+    const string response = Call(Writer().Put(Operation::GET_DOCUMENT_COUNT).Take());
+    Reader reader(response);
+    return reader.Get<int32_t>();
+}
+
+CollectionStatistics RemoteShard::GetQueryStatistics(string_view raw_query) const {
+    const string response = Call(Writer().Put(Operation::GET_QUERY_STATISTICS).PutString(raw_query).Take());
+    Reader reader(response);
+    return GetStatistics(reader);
+}
+
+BudgetedSearchResult RemoteShard::FindTopDocuments(string_view raw_query, DocumentStatus status,
+    const CollectionStatistics& statistics, const Bm25Scorer* bm25, const QueryLimits& limits) const
+{
+    Writer request;
+    request.Put(Operation::FIND_TOP_DOCUMENTS).PutString(raw_query).Put(status);
+    PutStatistics(request, statistics);
+    request.Put(static_cast<uint8_t>(bm25 != nullptr));
+    if (bm25) {
+        request.Put(bm25->k1).Put(bm25->b);
+    }
+    request.Put(static_cast<uint64_t>(limits.max_postings)).Put(static_cast<int64_t>(limits.timeout.count()));
+    const string response = Call(request.Take());
+    Reader reader(response);
+    BudgetedSearchResult result;
+    result.is_truncated = reader.Get<uint8_t>() != 0;
+    result.postings_scanned = reader.Get<uint64_t>();
+    result.documents.resize(reader.Get<uint32_t>());
+    for (Document& document : result.documents) {
+        document.id = reader.Get<int32_t>();
+        document.relevance = reader.Get<double>();
+        document.rating = reader.Get<int32_t>();
+    }
+    return result;
+}
+
+void ServeShard(SearchServer& server, int socket_fd) {
+    shared_mutex index_mutex;
+    ServeShard(server, socket_fd, index_mutex);
+}
+
+void ServeShard(SearchServer& server, int socket_fd, shared_mutex& index_mutex) {
+    string request;
+    while (ReceiveFrame(socket_fd, request)) {
+        string response;
+        try {
+            response = HandleRequest(server, index_mutex, request);
+        }
+        catch (const invalid_argument& e) {
+            response = ErrorResponse(ResponseStatus::INVALID_ARGUMENT, e.what());
+        }
+        catch (const exception& e) {
+            response = ErrorResponse(ResponseStatus::ERROR, e.what());
+        }
+        SendFrame(socket_fd, response);
+    }
+}
+
+namespace {
+
+// сколько соединений шард обслуживает одновременно; следующие ждут в очереди, а когда и она
+// полна - в очереди listen ядра
+constexpr size_t SHARD_CONNECTION_WORKERS = 16;
+// пауза перед новым accept, когда кончились дескрипторы или память
+constexpr auto ACCEPT_RETRY_DELAY = chrono::milliseconds(100);
+
+// постоянные потоки, по соединению на поток. Разрушение закрывает ожидающие соединения,
+// обрывает обслуживаемые и дожидается потоков - ни один не переживает server и замок
+class ConnectionWorkers {
+public:
+    ConnectionWorkers(SearchServer& server, size_t worker_count)
+        : server_(server)
+    {
+        workers_.reserve(worker_count);
+        try {
+            for (size_t i = 0; i < worker_count; ++i) {
+                workers_.emplace_back([this] { Run(); });
+            }
+        }
+        catch (...) {
+            Stop();
+            throw;
+        }
+    }
+
+    ~ConnectionWorkers() {
+        Stop();
+    }
+
+    // ждёт места в очереди и передаёт соединение потокам; дескриптор закрывают они
+    void Push(int connection_fd) {
+        unique_lock lock(mutex_);
+        changed_.wait(lock, [this] { return pending_.size() < workers_.size(); });
+        pending_.push_back(connection_fd);
+        changed_.notify_all();
+    }
+
+private:
+    SearchServer& server_;
+    shared_mutex index_mutex_;
+    mutex mutex_;
+    condition_variable changed_;
+    deque<int> pending_;
+    set<int> active_;
+    bool stopped_ = false;
+    vector<thread> workers_;
+
+    void Run() {
+        while (true) {
+            int connection_fd = -1;
+            {
+                unique_lock lock(mutex_);
+                changed_.wait(lock, [this] { return stopped_ || !pending_.empty(); });
+                if (stopped_) {
+                    return;
+                }
+                connection_fd = pending_.front();
+                pending_.pop_front();
+                active_.insert(connection_fd);
+                changed_.notify_all();
+            }
+            try {
+                ServeShard(server_, connection_fd, index_mutex_);
+            }
+            catch (const exception&) {
+                //оборванное соединение не останавливает шард
+            }
+            {
+                //пока дескриптор в active_, Stop может вызвать для него shutdown
+                lock_guard lock(mutex_);
+                active_.erase(connection_fd);
+            }
+            ::close(connection_fd);
+        }
+    }
+
+    void Stop() {
+        {
+            lock_guard lock(mutex_);
+            stopped_ = true;
+            for (const int connection_fd : pending_) {
+                ::close(connection_fd);
+            }
+            pending_.clear();
+            //чтение в ServeShard вернёт конец потока
+            for (const int connection_fd : active_) {
+                ::shutdown(connection_fd, SHUT_RDWR);
+            }
+        }
+        changed_.notify_all();
+        for (thread& worker : workers_) {
+            worker.join();
+        }
+        workers_.clear();
+    }
+};
+
+// ошибки accept, после которых стоит подождать и попробовать снова
+bool IsTemporaryAcceptError(int error) {
+    return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+}
+
+} // namespace
+
+void RunShardServer(SearchServer& server, const string& socket_path) {
+    sockaddr_un address{};
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw invalid_argument("Shard socket path is too long"s);
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    const int listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        throw system_error(errno, generic_category(), "Shard socket"s);
+    }
+    try {
+        ::unlink(socket_path.c_str());
+        if (::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listen_fd, 16) != 0) {
+            const int error = errno;
+            throw system_error(error, generic_category(), "Listen on "s + socket_path);
+        }
+        ConnectionWorkers workers(server, SHARD_CONNECTION_WORKERS);
+        while (true) {
+            const int connection_fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            const int error = errno;
+            if (connection_fd >= 0) {
+                try {
+                    workers.Push(connection_fd);
+                }
+                catch (...) {
+                    ::close(connection_fd);
+                    throw;
+                }
+            }
+            else if (IsTemporaryAcceptError(error)) {
+                this_thread::sleep_for(ACCEPT_RETRY_DELAY);
+            }
+            else if (error != EINTR && error != ECONNABORTED) {
+                throw system_error(error, generic_category(), "Accept on "s + socket_path);
+            }
+        }
+    }
+    catch (...) {
+        ::close(listen_fd);
+        throw;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sharded_search_server.h"
+
+// Шард в отдельном процессе: запросы SearchShard передаются через потоковый сокет
+// (Unix-сокет или socketpair). Кадр - длина (uint32, не больше 256 МБ) и тело; числа в порядке
+// байт машины, поэтому обе стороны должны работать на одной архитектуре.
+//
+// Процесс шарда:
+//   SearchServer server(stop_words);
+//   RunShardServer(server, "/tmp/shard0.sock");
+// Координатор:
+//   shards.push_back(std::make_unique<RemoteShard>("/tmp/shard0.sock"));
+
+class RemoteShard : public SearchShard {
+public:
+    explicit RemoteShard(const std::string& socket_path);
+    // владеет уже подключённым сокетом
+    explicit RemoteShard(int socket_fd);
+    ~RemoteShard() override;
+
+    RemoteShard(const RemoteShard&) = delete;
+    RemoteShard& operator=(const RemoteShard&) = delete;
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) override;
+    void RemoveDocument(int document_id) override;
+    int GetDocumentCount() const override;
+    CollectionStatistics GetQueryStatistics(std::string_view raw_query) const override;
+    BudgetedSearchResult FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        const CollectionStatistics& statistics, const Bm25Scorer* bm25, const QueryLimits& limits) const override;
+
+private:
+    int socket_fd_;
+    mutable std::mutex mutex_; //на соединении одновременно один запрос
+
+    std::string Call(const std::string& request) const;
+};
+
+// обслуживает запросы с подключённого сокета до его закрытия
+void ServeShard(SearchServer& server, int socket_fd);
+// то же для одного из нескольких соединений с общим server: поиск идёт под общим замком
+// index_mutex, изменения индекса - под исключительным
+void ServeShard(SearchServer& server, int socket_fd, std::shared_mutex& index_mutex);
+
+// слушает Unix-сокет и обслуживает до 16 подключений параллельно, остальные ждут очереди.
+// Возвращается только исключением - после того как все потоки подключений завершены
+void RunShardServer(SearchServer& server, const std::string& socket_path);
@@ -0,0 +1,213 @@
+#include "sharded_search_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <execution>
+#include <exception>
+#include <numeric>
+#include <stdexcept>
+
+using namespace std;
+
+void LocalShard::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    server_.AddDocument(document_id, document, status, ratings);
+}
+
+void LocalShard::RemoveDocument(int document_id) {
+    server_.RemoveDocument(document_id);
+}
+
+int LocalShard::GetDocumentCount() const {
+    return server_.GetDocumentCount();
+}
+
+CollectionStatistics LocalShard::GetQueryStatistics(string_view raw_query) const {
+    return server_.GetQueryStatistics(raw_query);
+}
+
+BudgetedSearchResult LocalShard::FindTopDocuments(string_view raw_query, DocumentStatus status,
+    const CollectionStatistics& statistics, const Bm25Scorer* bm25, const QueryLimits& limits) const
+{
+    return FindShardTopDocuments(server_, raw_query, status, statistics, bm25, limits);
+}
+
+template <typename Scorer>
+static BudgetedSearchResult FindShardTopDocuments(const SearchServer& server, string_view raw_query, DocumentStatus status,
+    const Scorer& scorer, const QueryLimits& limits)
+{
+    const auto has_status = [status](int, DocumentStatus document_status, int) { return document_status == status; };
+    if (limits.IsUnlimited()) {
+        BudgetedSearchResult result;
+        result.documents = server.FindTopDocuments(execution::seq, raw_query, has_status, scorer);
+        return result;
+    }
+    return server.FindTopDocumentsWithBudget(raw_query, has_status, scorer, limits.MakeBudget(chrono::steady_clock::now()));
+}
+
+BudgetedSearchResult FindShardTopDocuments(const SearchServer& server, string_view raw_query, DocumentStatus status,
+    const CollectionStatistics& statistics, const Bm25Scorer* bm25, const QueryLimits& limits)
+{
+    if (bm25) {
+        return FindShardTopDocuments(server, raw_query, status, GlobalStatisticsScorer<Bm25Scorer>(*bm25, statistics), limits);
+    }
+    return FindShardTopDocuments(server, raw_query, status, GlobalStatisticsScorer<TfIdfScorer>(TfIdfScorer{}, statistics), limits);
+}
+
+ShardedSearchServer::ShardedSearchServer(vector<unique_ptr<SearchShard>> shards)
+    : shards_(move(shards))
+{
+    if (shards_.empty() || any_of(shards_.begin(), shards_.end(), [](const auto& shard) { return !shard; })) {
+        throw invalid_argument("Sharded server needs at least one shard"s);
+    }
+}
+
+static vector<unique_ptr<SearchShard>> MakeLocalShards(size_t shard_count, const string& stop_words) {
+    vector<unique_ptr<SearchShard>> shards;
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.push_back(make_unique<LocalShard>(stop_words));
+    }
+    return shards;
+}
+
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, const string& stop_words)
+    : ShardedSearchServer(MakeLocalShards(shard_count, stop_words))
+{}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    //перемешивание битов: идущие подряд id не должны попадать в соседние шарды по кругу
+    uint64_t hash = static_cast<uint32_t>(document_id);
+    hash *= 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>((hash >> 32) % shards_.size());
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    if (document_id < 0) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    shards_[GetShardIndex(document_id)]->AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    if (document_id < 0) {
+        return;
+    }
+    shards_[GetShardIndex(document_id)]->RemoveDocument(document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    return accumulate(shards_.begin(), shards_.end(), 0,
+        [](int count, const auto& shard) { return count + shard->GetDocumentCount(); });
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(raw_query, status, nullptr, {}).documents;
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, const Bm25Scorer& scorer) const {
+    return FindTopDocuments(raw_query, status, &scorer, {}).documents;
+}
+
+BudgetedSearchResult ShardedSearchServer::FindTopDocumentsWithBudget(string_view raw_query, DocumentStatus status,
+    const QueryBudget& budget) const
+{
+    return FindTopDocuments(raw_query, status, nullptr, budget);
+}
+
+BudgetedSearchResult ShardedSearchServer::FindTopDocumentsWithBudget(string_view raw_query, DocumentStatus status,
+    const Bm25Scorer& scorer, const QueryBudget& budget) const
+{
+    return FindTopDocuments(raw_query, status, &scorer, budget);
+}
+
+//вызывает function(shard, index) для всех шардов параллельно. Исключение внутри параллельного
+//алгоритма завершило бы программу, поэтому они собираются и первое пробрасывается после обхода
+template <typename Function>
+static void ForEachShard(const vector<unique_ptr<SearchShard>>& shards, Function function) {
+    vector<exception_ptr> errors(shards.size());
+    vector<size_t> indexes(shards.size());
+    iota(indexes.begin(), indexes.end(), 0);
+    for_each(execution::par, indexes.begin(), indexes.end(), [&](size_t index) {
+        try {
+            function(*shards[index], index);
+        }
+        catch (...) {
+            errors[index] = current_exception();
+        }
+    });
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+}
+
+//оставляет подстановки, которые выбрал бы один SearchServer над всей коллекцией: шаблону - первые
+//MAX_PATTERN_EXPANSIONS слов по алфавиту, нечёткому слову - MAX_FUZZY_EXPANSIONS ближайших, среди
+//равных - более частых во всей коллекции. Каждый шард сам по своим частотам выбрал бы другие
+static void SelectExpansions(CollectionStatistics& statistics) {
+    const auto document_freq = [&statistics](const string& term) {
+        const auto it = statistics.document_freqs.find(term);
+        return it == statistics.document_freqs.end() ? size_t{ 0 } : it->second;
+    };
+    for (auto& [word, terms] : statistics.expansions) {
+        //после сложения статистик слова отсортированы
+        if (IsWildcardPattern(word)) {
+            terms.resize(min(terms.size(), MAX_PATTERN_EXPANSIONS));
+            continue;
+        }
+        const size_t count = min(terms.size(), MAX_FUZZY_EXPANSIONS);
+        partial_sort(terms.begin(), terms.begin() + count, terms.end(), [&document_freq](const auto& lhs, const auto& rhs) {
+            if (lhs.second != rhs.second) {
+                return lhs.second > rhs.second;
+            }
+            return document_freq(lhs.first) > document_freq(rhs.first);
+        });
+        terms.resize(count);
+    }
+}
+
+BudgetedSearchResult ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, const Bm25Scorer* bm25,
+    const QueryBudget& budget) const
+{
+    PROFILE_SCOPE("ShardedFindTopDocuments");
+    vector<CollectionStatistics> shard_statistics(shards_.size());
+    ForEachShard(shards_, [raw_query, &shard_statistics](const SearchShard& shard, size_t index) {
+        shard_statistics[index] = shard.GetQueryStatistics(raw_query);
+    });
+    CollectionStatistics statistics;
+    for (const CollectionStatistics& part : shard_statistics) {
+        statistics += part;
+    }
+    SelectExpansions(statistics);
+
+    //шардам передаётся остаток срока: у процессов шардов свои часы
+    QueryLimits limits;
+    limits.max_postings = budget.max_postings;
+    if (budget.deadline) {
+        const auto remaining = *budget.deadline - chrono::steady_clock::now();
+        if (remaining <= chrono::steady_clock::duration::zero()) {
+            BudgetedSearchResult result;
+            result.is_truncated = true;
+            return result;
+        }
+        limits.timeout = max(chrono::microseconds(1), chrono::duration_cast<chrono::microseconds>(remaining));
+    }
+
+    vector<BudgetedSearchResult> shard_results(shards_.size());
+    ForEachShard(shards_, [raw_query, status, &statistics, bm25, &limits, &shard_results](const SearchShard& shard, size_t index) {
+        shard_results[index] = shard.FindTopDocuments(raw_query, status, statistics, bm25, limits);
+    });
+
+    //каждый шард вернул свой топ, общий топ - лучшие из их объединения
+    BudgetedSearchResult result;
+    for (const BudgetedSearchResult& part : shard_results) {
+        result.documents.insert(result.documents.end(), part.documents.begin(), part.documents.end());
+        result.is_truncated = result.is_truncated || part.is_truncated;
+        result.postings_scanned += part.postings_scanned;
+    }
+    vector<Document>& documents = result.documents;
+    const size_t count = min(documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    partial_sort(documents.begin(), documents.begin() + count, documents.end(), IsRankedBefore);
+    documents.resize(count);
+    return result;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "scoring.h"
+#include "search_server.h"
+
+// Шард - часть индекса за интерфейсом, который можно передать по сети: условия отбора
+// сводятся к статусу документа, ранжирование - к TF-IDF или BM25 с параметрами.
+class SearchShard {
+public:
+    virtual ~SearchShard() = default;
+
+    virtual void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) = 0;
+    virtual void RemoveDocument(int document_id) = 0;
+    virtual int GetDocumentCount() const = 0;
+
+    virtual CollectionStatistics GetQueryStatistics(std::string_view raw_query) const = 0;
+
+    // лучшие MAX_RESULT_DOCUMENT_COUNT документов шарда по общей статистике коллекции;
+    // bm25 == nullptr - TF-IDF. С limits - как FindTopDocumentsWithBudget, срок от прихода запроса в шард
+    virtual BudgetedSearchResult FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        const CollectionStatistics& statistics, const Bm25Scorer* bm25, const QueryLimits& limits) const = 0;
+};
+
+// поиск шарда по серверу его части индекса - общий для LocalShard и процесса шарда
+BudgetedSearchResult FindShardTopDocuments(const SearchServer& server, std::string_view raw_query, DocumentStatus status,
+    const CollectionStatistics& statistics, const Bm25Scorer* bm25, const QueryLimits& limits);
+
+// шард в том же процессе
+class LocalShard : public SearchShard {
+public:
+    explicit LocalShard(const std::string& stop_words)
+        : server_(stop_words)
+    {}
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) override;
+    void RemoveDocument(int document_id) override;
+    int GetDocumentCount() const override;
+    CollectionStatistics GetQueryStatistics(std::string_view raw_query) const override;
+    BudgetedSearchResult FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        const CollectionStatistics& statistics, const Bm25Scorer* bm25, const QueryLimits& limits) const override;
+
+    SearchServer& GetServer() { return server_; }
+
+private:
+    SearchServer server_;
+};
+
+// Документы распределяются по шардам по хешу id. Поиск идёт в два прохода по всем шардам
+// параллельно: сбор статистики слов запроса, затем поиск с общей статистикой и слияние
+// частичных топов. Подстановки шаблонов и нечётких слов выбираются между проходами по общим
+// частотам и передаются шардам вместе со статистикой. Поэтому ранжирование совпадает с одним
+// общим SearchServer.
+// С бюджетом каждый шард тратит до max_postings постингов - шарды работают параллельно, и задержку
+// определяет самый загруженный; оставшийся после сбора статистики срок передаётся шардам.
+// Изменять индекс одновременно с поиском нельзя, как и у SearchServer.
+class ShardedSearchServer {
+public:
+    explicit ShardedSearchServer(std::vector<std::unique_ptr<SearchShard>> shards);
+    // shard_count локальных шардов
+    ShardedSearchServer(size_t shard_count, const std::string& stop_words);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+    int GetDocumentCount() const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, const Bm25Scorer& scorer) const;
+    BudgetedSearchResult FindTopDocumentsWithBudget(std::string_view raw_query, DocumentStatus status, const QueryBudget& budget) const;
+    BudgetedSearchResult FindTopDocumentsWithBudget(std::string_view raw_query, DocumentStatus status, const Bm25Scorer& scorer,
+        const QueryBudget& budget) const;
+
+    size_t GetShardCount() const { return shards_.size(); }
+    size_t GetShardIndex(int document_id) const;
+
+private:
+    std::vector<std::unique_ptr<SearchShard>> shards_;
+
+    BudgetedSearchResult FindTopDocuments(std::string_view raw_query, DocumentStatus status, const Bm25Scorer* bm25,
+        const QueryBudget& budget) const;
+};
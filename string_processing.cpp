@@ -2,9 +2,9 @@
 
 using namespace std;
 
-std::vector<std::string_view> SplitIntoWords(const std::string_view& text_sv) {
-    std::vector<std::string_view> words;
-    std::string_view word;
+//words - пустой вектор нужного вида
+template <typename Words>
+static Words SplitIntoWordsTo(const std::string_view& text_sv, Words words) {
 
     //////////////// C++20 !!!!!!!!!!!!!!!!!!!!!!!
     //std::string_view::const_iterator it1 = text_sv.begin();
@@ -41,4 +41,79 @@ std::vector<std::string_view> SplitIntoWords(const std::string_view& text_sv) {
     words.push_back(text_sv.substr(begin, end));
 
     return words;
-}
\ No newline at end of file
+}
+
+std::vector<std::string_view> SplitIntoWords(const std::string_view& text_sv) {
+    return SplitIntoWordsTo(text_sv, std::vector<std::string_view>{});
+}
+
+std::pmr::vector<std::string_view> SplitIntoWords(const std::string_view& text_sv, std::pmr::memory_resource* memory) {
+    return SplitIntoWordsTo(text_sv, std::pmr::vector<std::string_view>(memory));
+}
+
+bool IsWildcardPattern(const std::string_view& word) {
+    return word.find_first_of("*?"sv) != word.npos;
+}
+
+//длина символа UTF-8 по первому байту; некорректные байты считаются отдельными символами
+static size_t Utf8CharLength(const std::string_view& text, size_t pos) {
+    size_t length = 1;
+    while (pos + length < text.size() && (static_cast<unsigned char>(text[pos + length]) & 0xC0) == 0x80) {
+        ++length;
+    }
+    return length;
+}
+
+bool MatchesWildcard(const std::string_view& word, const std::string_view& pattern) {
+    //жадный разбор с возвратом к последней '*': линейно для шаблонов с одной звёздочкой
+    size_t word_pos = 0;
+    size_t pattern_pos = 0;
+    size_t star_pos = pattern.npos;
+    size_t star_word_pos = 0;
+    while (word_pos < word.size()) {
+        if (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+            star_pos = pattern_pos++;
+            star_word_pos = word_pos;
+        }
+        else if (pattern_pos < pattern.size() && pattern[pattern_pos] == '?') {
+            ++pattern_pos;
+            word_pos += Utf8CharLength(word, word_pos);
+        }
+        else if (pattern_pos < pattern.size() && pattern[pattern_pos] == word[word_pos]) {
+            ++pattern_pos;
+            ++word_pos;
+        }
+        else if (star_pos != pattern.npos) {
+            pattern_pos = star_pos + 1;
+            star_word_pos += Utf8CharLength(word, star_word_pos);
+            word_pos = star_word_pos;
+        }
+        else {
+            return false;
+        }
+    }
+    while (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+        ++pattern_pos;
+    }
+    return pattern_pos == pattern.size();
+}
+
+std::vector<char32_t> DecodeUtf8(const std::string_view& text) {
+    std::vector<char32_t> chars;
+    chars.reserve(text.size());
+    size_t pos = 0;
+    while (pos < text.size()) {
+        const unsigned char lead = static_cast<unsigned char>(text[pos]);
+        size_t length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+        if (pos + length > text.size()) {
+            length = 1;
+        }
+        char32_t c = length == 1 ? lead : lead & (0xFF >> (length + 1));
+        for (size_t i = 1; i < length; ++i) {
+            c = (c << 6) | (static_cast<unsigned char>(text[pos + i]) & 0x3F);
+        }
+        chars.push_back(c);
+        pos += length;
+    }
+    return chars;
+}
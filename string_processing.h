@@ -1,10 +1,20 @@
 #pragma once
+#include <memory_resource>
 #include <set>
 #include <string>
 #include <vector>
 
 
 std::vector<std::string_view> SplitIntoWords(const std::string_view& text_sv);
+//то же в памяти из memory - для временных разборов внутри запроса
+std::pmr::vector<std::string_view> SplitIntoWords(const std::string_view& text_sv, std::pmr::memory_resource* memory);
+
+//шаблоны слов в запросе: '*' - любая последовательность символов, '?' - ровно один символ UTF-8
+bool IsWildcardPattern(const std::string_view& word);
+bool MatchesWildcard(const std::string_view& word, const std::string_view& pattern);
+
+//кодовые точки UTF-8; байты некорректных последовательностей возвращаются как отдельные символы
+std::vector<char32_t> DecodeUtf8(const std::string_view& text);
 
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
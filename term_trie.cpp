@@ -0,0 +1,111 @@
+#include "term_trie.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "string_processing.h"
+
+using namespace std;
+
+TermTrie::TermTrie() {
+    Clear();
+}
+
+void TermTrie::Clear() {
+    nodes_.assign(1, Node{ 0 });
+    nodes_.shrink_to_fit();
+    terms_.clear();
+    terms_.shrink_to_fit();
+    compacted_size_ = 1;
+}
+
+void TermTrie::Compact() {
+    vector<Node> compacted;
+    compacted.reserve(nodes_.size());
+    compacted.push_back(nodes_[0]);
+    //compacted[i] пока хранит старые ссылки; дети узла i дописываются в конец подряд
+    for (size_t i = 0; i < compacted.size(); ++i) {
+        uint32_t child = compacted[i].first_child;
+        compacted[i].first_child = child == NO_NODE ? NO_NODE : static_cast<uint32_t>(compacted.size());
+        while (child != NO_NODE) {
+            compacted.push_back(nodes_[child]);
+            child = nodes_[child].next_sibling;
+            compacted.back().next_sibling = child == NO_NODE ? NO_NODE : static_cast<uint32_t>(compacted.size());
+        }
+    }
+    nodes_ = move(compacted);
+    compacted_size_ = nodes_.size();
+}
+
+void TermTrie::Insert(string_view term) {
+    uint32_t node = 0;
+    for (const char32_t symbol : DecodeUtf8(term)) {
+        uint32_t child = nodes_[node].first_child;
+        while (child != NO_NODE && nodes_[child].symbol != symbol) {
+            child = nodes_[child].next_sibling;
+        }
+        if (child == NO_NODE) {
+            child = static_cast<uint32_t>(nodes_.size());
+            nodes_.push_back(Node{ symbol, NO_NODE, nodes_[node].first_child });
+            nodes_[node].first_child = child;
+        }
+        node = child;
+    }
+    if (nodes_[node].term == NO_NODE) {
+        nodes_[node].term = static_cast<uint32_t>(terms_.size());
+        terms_.push_back(term);
+    }
+    if (nodes_.size() >= 2 * compacted_size_) {
+        Compact();
+    }
+}
+
+vector<pair<string_view, int>> TermTrie::FindWithinDistance(const vector<char32_t>& word, int max_edits) const {
+    vector<pair<string_view, int>> result;
+    const size_t width = word.size() + 1;
+    //строка глубины depth - расстояния от начала слова бора длины depth до первых j символов word;
+    //глубже word.size() + max_edits живых веток не бывает
+    vector<int> rows((word.size() + max_edits + 2) * width);
+    iota(rows.begin(), rows.begin() + width, 0);
+
+    //обход в глубину: (узел, глубина узла)
+    vector<pair<uint32_t, size_t>> stack;
+    for (uint32_t child = nodes_[0].first_child; child != NO_NODE; child = nodes_[child].next_sibling) {
+        stack.emplace_back(child, 1);
+    }
+    while (!stack.empty()) {
+        const auto [node_index, depth] = stack.back();
+        stack.pop_back();
+        const Node& node = nodes_[node_index];
+
+        //считается только полоса |j - depth| <= max_edits: вне её расстояние заведомо больше,
+        //там хранится max_edits + 1, чтобы соседние клетки следующей строки читали верное значение
+        const int* above = &rows[(depth - 1) * width];
+        int* row = &rows[depth * width];
+        const size_t low = depth > static_cast<size_t>(max_edits) ? depth - max_edits : 1;
+        const size_t high = min(word.size(), depth + max_edits);
+        row[0] = static_cast<int>(depth);
+        int row_min = row[0];
+        if (low > 1) {
+            row[low - 1] = max_edits + 1;
+        }
+        for (size_t j = low; j <= high; ++j) {
+            const int substitution = above[j - 1] + (word[j - 1] == node.symbol ? 0 : 1);
+            row[j] = min({ above[j] + 1, row[j - 1] + 1, substitution });
+            row_min = min(row_min, row[j]);
+        }
+        if (high + 1 < width) {
+            row[high + 1] = max_edits + 1;
+        }
+        if (row_min > max_edits) {
+            continue;
+        }
+        if (node.term != NO_NODE && high == word.size() && low <= word.size() && row[width - 1] <= max_edits) {
+            result.emplace_back(terms_[node.term], row[width - 1]);
+        }
+        for (uint32_t child = node.first_child; child != NO_NODE; child = nodes_[child].next_sibling) {
+            stack.emplace_back(child, depth + 1);
+        }
+    }
+    return result;
+}
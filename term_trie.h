@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Бор по символам (кодовым точкам UTF-8) слов словаря для нечёткого поиска.
+// Поиск слов на расстоянии Левенштейна - обход бора с одной строкой динамики на уровень:
+// строка узла считается из строки родителя, поэтому общие начала слов обрабатываются один раз,
+// а ветка, где минимум строки уже больше допустимого, не обходится вовсе.
+class TermTrie {
+public:
+    TermTrie();
+
+    // term должен жить дольше бора; повторная вставка ничего не меняет
+    void Insert(std::string_view term);
+
+    // слова на расстоянии не больше max_edits вместе с расстоянием
+    std::vector<std::pair<std::string_view, int>> FindWithinDistance(const std::vector<char32_t>& word, int max_edits) const;
+
+    void Clear();
+
+    size_t GetTermCount() const { return terms_.size(); }
+    size_t GetNodeCount() const { return nodes_.size(); }
+    // байт в массивах узлов и слов
+    size_t GetMemoryUsage() const { return nodes_.capacity() * sizeof(Node) + terms_.capacity() * sizeof(std::string_view); }
+
+private:
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    // дети узла - односвязный список: символов в алфавите немного, а узел остаётся 16 байт
+    struct Node {
+        char32_t symbol;
+        uint32_t first_child = NO_NODE;
+        uint32_t next_sibling = NO_NODE;
+        uint32_t term = NO_NODE; // индекс в terms_, если здесь кончается слово
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<std::string_view> terms_;
+    size_t compacted_size_ = 1;
+
+    // перенумерация в порядке обхода в ширину: братья лежат подряд, и поиск, перебирающий
+    // всех детей живого узла, читает память последовательно. Вызывается, когда бор вырос вдвое
+    void Compact();
+};
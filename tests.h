@@ -6,13 +6,52 @@
 #include <cassert>
 #include <iostream>
 #include "remove_duplicates.h"
+#include "request_queue.h"
+#include "document_loader.h"
+#include "http_service.h"
+#include "paginator.h"
+#include "async_search_server.h"
+#include "shard_transport.h"
+#include "sharded_search_server.h"
+#include "write_ahead_log.h"
+#include "query_arena.h"
+#include "text_analyzer.h"
+#include "numa_search_server.h"
+#include "process_queries.h"
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <random>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <sys/socket.h>
+#include <unistd.h>
 
 using namespace std;
 
+//целые, которые принимает std::cmp_not_equal: без bool и символьных типов
+template <typename T>
+constexpr bool IS_COMPARABLE_INTEGER = std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>
+    && !std::is_same_v<T, wchar_t> && !std::is_same_v<T, char8_t> && !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>;
+
+template <typename T, typename U>
+bool IsNotEqual(const T& t, const U& u) {
+    //size() против литерала int сравнивается по значению, без -Wsign-compare
+    if constexpr (IS_COMPARABLE_INTEGER<T> && IS_COMPARABLE_INTEGER<U>) {
+        return std::cmp_not_equal(t, u);
+    }
+    else {
+        return t != u;
+    }
+}
+
 template <typename T, typename U>
 void AssertEqualImpl(const T& t, const U& u, const std::string& t_str, const std::string& u_str, const std::string& file,
     const std::string& func, unsigned line, const std::string& hint) {
-    if (t != u) {
+    if (IsNotEqual(t, u)) {
         cout << boolalpha;
         cout << file << "("s << line << "): "s << func << ": "s;
         cout << "ASSERT_EQUAL("s << t_str << ", "s << u_str << ") failed: "s;
@@ -237,6 +276,2019 @@ void TestDublicates() {
 }
 
 
+//=========================================================================================
+void TestMatchDocumentsBatch() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and stylish collar"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::BANNED, { 2 });
+    server.AddDocument(3, "fine dog big eyes"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "cat and collar"s, DocumentStatus::ACTUAL, { 4 });
+
+    const std::string query = "fluffy cat dog -collar"s;
+    const std::vector<int> ids = { 1, 2, 3, 4 };
+    const auto batch = server.MatchDocuments(query, ids);
+    const auto batch_par = server.MatchDocuments(std::execution::par, query, ids);
+    ASSERT_EQUAL(batch.size(), ids.size());
+    ASSERT_EQUAL(batch_par.size(), ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        const auto [words, status] = server.MatchDocument(query, ids[i]);
+        assert(get<1>(batch[i]) == status);
+        assert(get<1>(batch_par[i]) == status);
+        assert(get<0>(batch[i]) == words);
+        assert(get<0>(batch_par[i]) == words);
+    }
+    ASSERT_EQUAL(get<0>(batch[0]).size(), 0); //минус-слово collar
+    ASSERT_EQUAL(get<0>(batch[1]).size(), 2); //cat fluffy
+}
+
+//=========================================================================================
+void TestMatchDocumentLongQuery() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "w1 w7 w300 and w299"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "and"s, DocumentStatus::ACTUAL, { 1 });
+
+    //запрос длиннее PARALLEL_MATCH_MIN_QUERY_WORDS, с повторами
+    std::string query;
+    for (int i = 0; i < 300; ++i) {
+        const std::string number = std::to_string(i);
+        query.append("w"s).append(number).append(" w"s).append(number).append(" "s);
+    }
+    query += "w0"s;
+    const auto [words_seq, status_seq] = server.MatchDocument(query, 1);
+    const auto [words_par, status_par] = server.MatchDocument(std::execution::par, query, 1);
+    const std::vector<std::string_view> expected = { "w1"sv, "w299"sv, "w7"sv };
+    assert(words_seq == expected);
+    assert(words_par == expected);
+
+    //документ из одних стоп-слов
+    ASSERT_EQUAL(get<0>(server.MatchDocument(query, 2)).size(), 0);
+    ASSERT_EQUAL(get<0>(server.MatchDocument(std::execution::par, query, 2)).size(), 0);
+    ASSERT_EQUAL(get<0>(server.MatchDocument(std::execution::par, query + " -w7"s, 1)).size(), 0);
+}
+
+//=========================================================================================
+void TestProfilingHistogram() {
+    using profiling::Histogram;
+    //маленькие значения хранятся точно, большие - с относительной погрешностью не хуже 1/32
+    ASSERT_EQUAL(Histogram::GetBucketLowerBound(Histogram::GetBucketIndex(17)), 17u);
+    for (uint64_t value : { 100ull, 12345ull, 987654321ull, 1ull << 62 }) {
+        const uint64_t lower_bound = Histogram::GetBucketLowerBound(Histogram::GetBucketIndex(value));
+        assert(lower_bound <= value && value - lower_bound <= value / Histogram::SUB_BUCKET_COUNT);
+    }
+    assert(Histogram::GetBucketIndex(~0ull) < Histogram::BUCKET_COUNT);
+
+    Histogram histogram;
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.Record(value);
+    }
+    ASSERT_EQUAL(histogram.GetCount(), 1000u);
+    ASSERT_EQUAL(histogram.GetMax(), 1000u);
+    const uint64_t p50 = histogram.GetValueAtQuantile(0.5);
+    const uint64_t p999 = histogram.GetValueAtQuantile(0.999);
+    assert(p50 >= 480 && p50 <= 500);
+    assert(p999 >= 960 && p999 <= 1000);
+
+    auto& registry = profiling::Registry::Instance();
+    const size_t stage = registry.RegisterStage("tests.stage"sv);
+    ASSERT_EQUAL(registry.RegisterStage("tests.stage"sv), stage);
+    registry.Local().RecordDuration(stage, 1000);
+    registry.Local().AddToCounter(registry.RegisterCounter("tests.counter"sv), 3);
+    const profiling::Snapshot snapshot = registry.TakeSnapshot();
+    const auto it = find_if(snapshot.stages.begin(), snapshot.stages.end(),
+        [](const profiling::StageStats& stats) { return stats.name == "tests.stage"s; });
+    assert(it != snapshot.stages.end() && it->count == 1 && it->p50_ns <= 1000 && it->p50_ns >= 1000 - 1000 / 32);
+    ASSERT_EQUAL(snapshot.counters.at("tests.counter"s), 3u);
+
+    //метрики вышедших потоков остаются в снимке, а их память освобождается
+    const size_t thread_count = registry.GetThreadCount();
+    for (int i = 0; i < 20; ++i) {
+        std::thread([&registry, stage] {
+            registry.Local().RecordDuration(stage, 2000);
+            registry.Local().AddToCounter(registry.RegisterCounter("tests.counter"sv), 1);
+        }).join();
+    }
+    ASSERT_EQUAL(registry.GetThreadCount(), thread_count);
+    const profiling::Snapshot after_threads = registry.TakeSnapshot();
+    const auto stage_stats = find_if(after_threads.stages.begin(), after_threads.stages.end(),
+        [](const profiling::StageStats& stats) { return stats.name == "tests.stage"s; });
+    ASSERT_EQUAL(stage_stats->count, 21u);
+    assert(stage_stats->max_ns >= 2000);
+    ASSERT_EQUAL(after_threads.counters.at("tests.counter"s), 23u);
+}
+
+//=========================================================================================
+void TestRequestQueue() {
+    SearchServer search_server("and in at"s);
+    search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    search_server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+    search_server.AddDocument(3, "big cat fancy collar "s, DocumentStatus::ACTUAL, { 1, 2, 8 });
+    search_server.AddDocument(4, "big dog sparrow Eugene"s, DocumentStatus::ACTUAL, { 1, 3, 2 });
+    search_server.AddDocument(5, "big dog sparrow Vasiliy"s, DocumentStatus::ACTUAL, { 1, 1, 1 });
+
+    RequestQueue request_queue(search_server);
+    // 1439 запросов с нулевым результатом
+    const std::vector<int> empty_requests(1439);
+    std::for_each(std::execution::par, empty_requests.begin(), empty_requests.end(),
+        [&request_queue](int) { request_queue.AddFindRequest("empty request"s); });
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1439);
+    // все еще 1439 запросов с нулевым результатом
+    request_queue.AddFindRequest("curly dog"s);
+    // новые сутки, первый запрос удален, 1438 запросов с нулевым результатом
+    request_queue.AddFindRequest("big collar"s);
+    // первый запрос удален, 1437 запросов с нулевым результатом
+    request_queue.AddFindRequest("sparrow"s);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1437);
+
+    const auto stats = request_queue.GetStatistics().GetStats(RequestStatistics::Window::MINUTE);
+    ASSERT_EQUAL(stats.requests, 1442u);
+    ASSERT_EQUAL(stats.empty_results, 1439u);
+    assert(stats.queries_per_second > 0 && stats.latency_p99_ns >= stats.latency_p50_ns);
+}
+
+//=========================================================================================
+void TestRequestStatisticsWindows() {
+    using namespace std::chrono;
+    RequestStatistics statistics;
+    const auto start = RequestStatistics::Clock::now();
+    for (int second = 0; second < 120; ++second) {
+        //каждую секунду: один пустой ответ за 1 мс и три непустых за 100 мкс
+        const auto now = start + seconds(second);
+        statistics.Record(milliseconds(1), 0, now);
+        for (int i = 0; i < 3; ++i) {
+            statistics.Record(microseconds(100), 5, now);
+        }
+    }
+    const auto now = start + seconds(119);
+    const auto minute = statistics.GetStats(RequestStatistics::Window::MINUTE, now);
+    ASSERT_EQUAL(minute.requests, 240u); //только последние 60 секунд
+    ASSERT_EQUAL(minute.empty_results, 60u);
+    assert(std::abs(minute.empty_rate - 0.25) < 1e-9);
+    assert(std::abs(minute.queries_per_second - 4.0) < 1e-9);
+    assert(minute.latency_p50_ns >= 100'000 && minute.latency_p50_ns <= 125'000);
+    assert(minute.latency_p99_ns >= 1'000'000 && minute.latency_p99_ns <= 1'250'000);
+    ASSERT_EQUAL(minute.latency_max_ns, 1'000'000u);
+
+    const auto hour = statistics.GetStats(RequestStatistics::Window::HOUR, now);
+    ASSERT_EQUAL(hour.requests, 480u);
+    ASSERT_EQUAL(statistics.GetStats(RequestStatistics::Window::DAY, now).requests, 480u);
+
+    //через час минутное и часовое окна опустели
+    const auto later = start + hours(2);
+    ASSERT_EQUAL(statistics.GetStats(RequestStatistics::Window::MINUTE, later).requests, 0u);
+    ASSERT_EQUAL(statistics.GetStats(RequestStatistics::Window::HOUR, later).requests, 0u);
+    ASSERT_EQUAL(statistics.GetStats(RequestStatistics::Window::DAY, later).requests, 480u);
+
+    //корзина переиспользуется для нового интервала
+    statistics.Record(microseconds(10), 1, later);
+    ASSERT_EQUAL(statistics.GetStats(RequestStatistics::Window::MINUTE, later).requests, 1u);
+}
+
+//=========================================================================================
+void TestLoadDocuments() {
+    {
+        std::deque<std::string> storage;
+        const DocumentRecord record = ParseJsonRecord(
+            R"({"id": 7, "extra": {"a": [1, "}"]}, "status": "BANNED", "ratings": [1, -2, 4], "text": "say \"hi\" \u043a\u043e\u0442"})"sv, storage);
+        ASSERT_EQUAL(record.id, 7);
+        assert(record.status == DocumentStatus::BANNED);
+        assert(record.ratings == std::vector<int>({ 1, -2, 4 }));
+        ASSERT_EQUAL(record.text, "say \"hi\" \xD0\xBA\xD0\xBE\xD1\x82"sv); //"кот" в UTF-8
+        ASSERT_EQUAL(storage.size(), 1u);
+
+        const DocumentRecord plain = ParseJsonRecord(R"({"id": 8, "text": "plain"})"sv, storage);
+        ASSERT_EQUAL(storage.size(), 1u); //без escape-последовательностей текст не копируется
+        ASSERT_EQUAL(plain.ratings.size(), 0u);
+    }
+
+    //много маленьких кусков, чтобы конвейер действительно работал параллельно
+    LoadOptions options;
+    options.chunk_size = 64;
+    options.parser_threads = 3;
+    options.max_chunks_in_flight = 2;
+
+    std::string tsv;
+    for (int id = 0; id < 200; ++id) {
+        tsv += std::to_string(id) + "\t"s + (id % 2 ? "ACTUAL"s : "2"s) + "\t1 2 "s + std::to_string(id) + "\tcat number"s + std::to_string(id) + "\r\n"s;
+    }
+    {
+        SearchServer server("and"s);
+        const LoadStats stats = LoadDocumentsFromBuffer(server, tsv, options);
+        ASSERT_EQUAL(stats.documents, 200u);
+        ASSERT_EQUAL(server.GetDocumentCount(), 200);
+        ASSERT_EQUAL(server.GetDocumentId(0), 0); //порядок добавления совпадает с порядком в файле
+        ASSERT_EQUAL(server.GetDocumentId(199), 199);
+        const auto found = server.FindTopDocuments("number42"s, DocumentStatus::BANNED);
+        assert(found.size() == 1 && found[0].id == 42 && found[0].rating == (1 + 2 + 42) / 3);
+    }
+
+    const std::string path = "test_load_documents.jsonl"s;
+    {
+        std::ofstream out(path);
+        out << R"({"id": 1, "status": "ACTUAL", "ratings": [5], "text": "white cat"})" << "\n"s
+            << R"({"id": 2, "status": 1, "ratings": [], "text": "black dog"})" << "\n"s
+            << "\n"s
+            << R"({"id": "broken"})" << "\n"s
+            << R"({"id": 1, "text": "duplicate id"})" << "\n"s;
+    }
+    {
+        SearchServer server("and"s);
+        options.format = DumpFormat::JSONL;
+        bool thrown = false;
+        try {
+            LoadDocuments(server, path, options);
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    {
+        SearchServer server("and"s);
+        options.skip_invalid = true;
+        const LoadStats stats = LoadDocuments(server, path, options);
+        ASSERT_EQUAL(stats.documents, 2u);
+        ASSERT_EQUAL(stats.skipped, 2u);
+        ASSERT_EQUAL(server.FindTopDocuments("dog"s, DocumentStatus::IRRELEVANT).size(), 1u);
+    }
+    std::remove(path.c_str());
+}
+
+//=========================================================================================
+void TestPhraseQueries() {
+    {
+        const PositionList positions = { 0, 3, 130, 100000 };
+        assert(DecodePositions(EncodePositions(positions)) == positions);
+        assert(ContainsPhrase({ { 1, 5 }, { 2, 9 }, { 3 } }));
+        assert(!ContainsPhrase({ { 1, 5 }, { 3, 7 } }));
+        assert(ContainsWithinWindow({ { 10 }, { 7 } }, 2));
+        assert(!ContainsWithinWindow({ { 10 }, { 6 } }, 2));
+    }
+    {
+        SearchServer server("and in"s);
+        bool thrown = false;
+        try {
+            server.FindTopDocuments("\"white cat\""s);
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown); //без позиционного индекса фразы запрещены
+        //фраза из одного слова - обычное слово
+        server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_EQUAL(server.FindTopDocuments("\"cat\""s).size(), 1u);
+        thrown = false;
+        try {
+            server.EnablePositionalIndex();
+        }
+        catch (const std::logic_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    SearchServer server("and in"s);
+    server.EnablePositionalIndex();
+    server.AddDocument(1, "white cat and black dog"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cat white fluffy dog"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "white fluffy fluffy cat"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "white cat in city"s, DocumentStatus::BANNED, { 4 });
+
+    const auto ids = [](const std::vector<Document>& documents) {
+        std::vector<int> result;
+        for (const Document& document : documents) {
+            result.push_back(document.id);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+
+    assert(ids(server.FindTopDocuments("\"white cat\""s)) == std::vector<int>({ 1 }));
+    assert(ids(server.FindTopDocuments(std::execution::par, "\"white cat\""s)) == std::vector<int>({ 1 }));
+    //стоп-слова в позициях не участвуют
+    assert(ids(server.FindTopDocuments("\"cat and black\""s)) == std::vector<int>({ 1 }));
+    assert(ids(server.FindTopDocuments("\"white cat\"~1"s)) == std::vector<int>({ 1, 2 }));
+    assert(ids(server.FindTopDocuments("\"white cat\"~2"s)) == std::vector<int>({ 1, 2, 3 }));
+    assert(ids(server.FindTopDocuments("\"white cat\"~2 -dog"s)) == std::vector<int>({ 3 }));
+    assert(ids(server.FindTopDocuments("\"white cat\""s, DocumentStatus::BANNED)) == std::vector<int>({ 4 }));
+    assert(ids(server.FindTopDocuments("\"white dog\" fluffy"s)) == std::vector<int>({ 2, 3 }));
+
+    //фраза добавляет релевантность своих слов
+    const auto phrase_result = server.FindTopDocuments("\"white cat\""s);
+    const auto words_result = server.FindTopDocuments("white cat"s);
+    assert(std::abs(phrase_result[0].relevance - words_result[0].relevance) < COMPARISON_TOLERANCE);
+
+    {
+        const auto [words, status] = server.MatchDocument("\"black dog\" fluffy"s, 1);
+        assert(words == std::vector<std::string_view>({ "black"sv, "dog"sv }));
+        const auto [words_par, status_par] = server.MatchDocument(std::execution::par, "\"black dog\" fluffy"s, 1);
+        assert(words_par == words);
+        const auto batch = server.MatchDocuments("\"black dog\" fluffy"s, { 1, 2 });
+        assert(std::get<0>(batch[0]) == words);
+        assert(std::get<0>(batch[1]) == std::vector<std::string_view>({ "fluffy"sv }));
+    }
+
+    for (const std::string& invalid : { "\"white cat"s, "\"white -cat\""s, "\"white cat\"~"s, "\"white cat\"x"s, "wh\"ite"s }) {
+        bool thrown = false;
+        try {
+            server.FindTopDocuments(invalid);
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    server.RemoveDocument(1);
+    assert(server.FindTopDocuments("\"white cat\""s).empty());
+    server.RemoveDocument(std::execution::par, 2);
+    assert(ids(server.FindTopDocuments("\"white cat\"~5"s)) == std::vector<int>({ 3 }));
+}
+
+//=========================================================================================
+void TestBm25Ranking() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cat cat dog bird fish"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "dog"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "bird and fish"s, DocumentStatus::BANNED, { 4 });
+
+    const auto is_actual = [](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; };
+    //скорер по умолчанию совпадает с прежней формулой
+    const auto tf_idf = server.FindTopDocuments(std::execution::seq, "cat"s, is_actual, TfIdfScorer{});
+    const auto plain = server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(tf_idf.size(), plain.size());
+    for (size_t i = 0; i < plain.size(); ++i) {
+        ASSERT_EQUAL(tf_idf[i].id, plain[i].id);
+        assert(std::abs(tf_idf[i].relevance - plain[i].relevance) < COMPARISON_TOLERANCE);
+    }
+
+    //4 документа, средняя длина (1 + 5 + 1 + 2) / 4
+    const Bm25Scorer scorer{ 1.2, 0.75 };
+    const double average_length = 9.0 / 4;
+    const double idf = std::log(1.0 + (4 - 2 + 0.5) / (2 + 0.5));
+    const auto expected = [&](double count, double length) {
+        return idf * count * (scorer.k1 + 1) / (count + scorer.k1 * (1 - scorer.b + scorer.b * length / average_length));
+    };
+    for (const auto& found : { server.FindTopDocuments(std::execution::seq, "cat"s, is_actual, scorer),
+                               server.FindTopDocuments(std::execution::par, "cat"s, is_actual, scorer) }) {
+        ASSERT_EQUAL(found.size(), 2u);
+        //короткий документ с одним вхождением обходит длинный с двумя
+        ASSERT_EQUAL(found[0].id, 1);
+        assert(std::abs(found[0].relevance - expected(1, 1)) < COMPARISON_TOLERANCE);
+        assert(std::abs(found[1].relevance - expected(2, 5)) < COMPARISON_TOLERANCE);
+    }
+
+    //без нормировки по длине вес зависит только от числа вхождений
+    const auto flat = server.FindTopDocuments(std::execution::seq, "cat"s, is_actual, Bm25Scorer{ 1.2, 0.0 });
+    ASSERT_EQUAL(flat[0].id, 2);
+
+    //после удаления средняя длина пересчитывается
+    server.RemoveDocument(2);
+    const auto after_remove = server.FindTopDocuments(std::execution::seq, "cat"s, is_actual, scorer);
+    const double idf_after = std::log(1.0 + (3 - 1 + 0.5) / (1 + 0.5));
+    const double average_after = 4.0 / 3;
+    const double expected_after = idf_after * (scorer.k1 + 1) / (1 + scorer.k1 * (1 - scorer.b + scorer.b / average_after));
+    assert(std::abs(after_remove[0].relevance - expected_after) < COMPARISON_TOLERANCE);
+}
+
+//=========================================================================================
+void TestWildcardQueries() {
+    assert(MatchesWildcard("computer"sv, "comp*"sv));
+    assert(MatchesWildcard("computer"sv, "c*t?r"sv));
+    assert(!MatchesWildcard("computer"sv, "c*t?"sv));
+    assert(MatchesWildcard("\xD0\xBA\xD0\xBE\xD1\x82"sv, "?\xD0\xBE?"sv)); //"кот" по шаблону "?о?"
+    assert(!IsWildcardPattern("cat"sv));
+
+    SearchServer server("and"s);
+    server.AddDocument(1, "computer science"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "compiler design"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "company cat"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "cot and cut"s, DocumentStatus::ACTUAL, { 4 });
+    server.AddDocument(5, "compost"s, DocumentStatus::ACTUAL, { 5 });
+    server.RemoveDocument(5);
+
+    const auto ids = [](const std::vector<Document>& documents) {
+        std::vector<int> result;
+        for (const Document& document : documents) {
+            result.push_back(document.id);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    assert(ids(server.FindTopDocuments("comp*"s)) == std::vector<int>({ 1, 2, 3 }));
+    assert(ids(server.FindTopDocuments(std::execution::par, "comp*"s)) == std::vector<int>({ 1, 2, 3 }));
+    assert(ids(server.FindTopDocuments("comp* -co*ny"s)) == std::vector<int>({ 1, 2 }));
+    assert(ids(server.FindTopDocuments("c?t"s)) == std::vector<int>({ 3, 4 }));
+    assert(server.FindTopDocuments("zz*"s).empty());
+    //без буквального начала шаблон перебирал бы весь словарь
+    for (const std::string& query : { "*ny"s, "comp -*ny"s, "?at"s, "*"s, "cat OR *ny"s }) {
+        bool thrown = false;
+        try {
+            server.FindTopDocuments(query);
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    const auto [words, status] = server.MatchDocument("c?t design"s, 4);
+    assert(words == std::vector<std::string_view>({ "cot"sv, "cut"sv }));
+
+    //слова удалённых документов в подсказки не попадают
+    assert(server.GetTermsByPrefix("comp"sv, 10) == std::vector<std::string_view>({ "company"sv, "compiler"sv, "computer"sv }));
+    assert(server.GetTermsByPrefix("comp"sv, 2) == std::vector<std::string_view>({ "company"sv, "compiler"sv }));
+    assert(server.GetTermsByPrefix("x"sv, 10).empty());
+}
+
+//=========================================================================================
+void TestFuzzyQueries() {
+    {
+        TermTrie trie;
+        const std::vector<std::string> words = { "cat"s, "cats"s, "cut"s, "bat"s, "dog"s, "cart"s, "act"s, "cat"s };
+        for (const std::string& word : words) {
+            trie.Insert(word);
+        }
+        ASSERT_EQUAL(trie.GetTermCount(), 7u);
+        auto found = trie.FindWithinDistance(DecodeUtf8("cat"sv), 1);
+        std::sort(found.begin(), found.end());
+        assert(found == (std::vector<std::pair<std::string_view, int>>{ { "bat"sv, 1 }, { "cart"sv, 1 }, { "cat"sv, 0 }, { "cats"sv, 1 }, { "cut"sv, 1 } }));
+        ASSERT_EQUAL(trie.FindWithinDistance(DecodeUtf8("cat"sv), 2).size(), 6u); //+ act
+    }
+
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "grey parrot"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "\xD1\x81\xD0\xBE\xD0\xB1\xD0\xB0\xD0\xBA\xD0\xB0"s, DocumentStatus::ACTUAL, { 4 }); //"собака"
+    server.AddDocument(5, "parrots everywhere"s, DocumentStatus::ACTUAL, { 5 });
+
+    //по умолчанию опечатки не исправляются
+    assert(server.FindTopDocuments("whte"s).empty());
+    bool thrown = false;
+    try {
+        server.SetFuzzyMaxEdits(3);
+    }
+    catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    server.SetFuzzyMaxEdits(2);
+    const auto ids = [](const std::vector<Document>& documents) {
+        std::vector<int> result;
+        for (const Document& document : documents) {
+            result.push_back(document.id);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    assert(ids(server.FindTopDocuments("whte"s)) == std::vector<int>({ 1 }));
+    assert(ids(server.FindTopDocuments(std::execution::par, "whte"s)) == std::vector<int>({ 1 }));
+    //короткие слова не дополняются, слова до 5 символов - только с одной правкой
+    assert(server.FindTopDocuments("ct"s).empty());
+    assert(server.FindTopDocuments("wht"s).empty());
+    //расстояние считается по символам, а не по байтам: "сабака"
+    assert(ids(server.FindTopDocuments("\xD1\x81\xD0\xB0\xD0\xB1\xD0\xB0\xD0\xBA\xD0\xB0"s)) == std::vector<int>({ 4 }));
+    //минус-слова нечётко не расширяются
+    assert(ids(server.FindTopDocuments("parrot -everywher"s)) == std::vector<int>({ 3, 5 }));
+
+    //точное совпадение весит больше исправленного
+    const auto found = server.FindTopDocuments("parrot"s);
+    ASSERT_EQUAL(found.size(), 2u);
+    ASSERT_EQUAL(found[0].id, 3);
+
+    {
+        const auto [words, status] = server.MatchDocument("parrot whte"s, 1);
+        assert(words == std::vector<std::string_view>({ "white"sv }));
+        const auto [words_par, status_par] = server.MatchDocument(std::execution::par, "parrot whte"s, 5);
+        assert(words_par == std::vector<std::string_view>({ "parrots"sv }));
+        const auto batch = server.MatchDocuments("parrot whte"s, { 1, 3, 5 });
+        assert(std::get<0>(batch[0]) == std::vector<std::string_view>({ "white"sv }));
+        assert(std::get<0>(batch[1]) == std::vector<std::string_view>({ "parrot"sv }));
+        assert(std::get<0>(batch[2]) == std::vector<std::string_view>({ "parrots"sv }));
+    }
+
+    server.SetFuzzyMaxEdits(0);
+    assert(server.FindTopDocuments("whte"s).empty());
+}
+
+//=========================================================================================
+void TestShardedSearchServer() {
+    const std::vector<std::string> texts = {
+        "white cat fashionable collar"s, "fluffy cat fluffy tail"s, "groomed dog expressive eyes"s,
+        "groomed starling evgeny"s, "white dog black ears"s, "cat and dog friends"s, "big cat"s,
+        "small white mouse"s, "fluffy dog"s, "old cat sleeps all day"s, "dog walks in the park"s,
+    };
+    SearchServer single("and in the"s);
+    const auto check = [](const std::vector<Document>& expected, const std::vector<Document>& actual) {
+        ASSERT_EQUAL(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(expected[i].id, actual[i].id);
+            assert(std::abs(expected[i].relevance - actual[i].relevance) < COMPARISON_TOLERANCE);
+        }
+    };
+
+    //два шарда в процессе и один за сокетом, обслуживаемый отдельным потоком
+    int sockets[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    SearchServer remote_server("and in the"s);
+    std::thread remote_thread([&remote_server, fd = sockets[1]] { ServeShard(remote_server, fd); });
+    std::vector<std::unique_ptr<SearchShard>> shards;
+    shards.push_back(std::make_unique<LocalShard>("and in the"s));
+    shards.push_back(std::make_unique<LocalShard>("and in the"s));
+    shards.push_back(std::make_unique<RemoteShard>(sockets[0]));
+    {
+        ShardedSearchServer sharded(std::move(shards));
+        for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+            single.AddDocument(id, texts[id], id == 4 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id });
+            sharded.AddDocument(id, texts[id], id == 4 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id });
+        }
+        ASSERT_EQUAL(sharded.GetDocumentCount(), static_cast<int>(texts.size()));
+        ASSERT_EQUAL(remote_server.GetDocumentCount() > 0, true);
+
+        //общая статистика: результат тот же, что у одного индекса, вплоть до релевантности
+        const auto is_actual = [](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; };
+        for (const std::string& query : { "fluffy cat"s, "white dog -black"s, "groomed cat dog"s, "park"s }) {
+            check(single.FindTopDocuments(query), sharded.FindTopDocuments(query));
+            check(single.FindTopDocuments(std::execution::seq, query, is_actual, Bm25Scorer{}),
+                sharded.FindTopDocuments(query, DocumentStatus::ACTUAL, Bm25Scorer{}));
+        }
+        check(single.FindTopDocuments("white dog"s, DocumentStatus::BANNED), sharded.FindTopDocuments("white dog"s, DocumentStatus::BANNED));
+
+        //бюджет доходит до каждого шарда, в том числе удалённого
+        BudgetedSearchResult budgeted = sharded.FindTopDocumentsWithBudget("groomed cat dog"s, DocumentStatus::ACTUAL, {});
+        assert(!budgeted.is_truncated);
+        check(single.FindTopDocuments("groomed cat dog"s), budgeted.documents);
+        //cat - в пяти документах, значит, хотя бы в одном шарде их больше одного
+        budgeted = sharded.FindTopDocumentsWithBudget("cat"s, DocumentStatus::ACTUAL, Bm25Scorer{},
+            { .max_postings = 1, .deadline = std::nullopt });
+        assert(budgeted.is_truncated);
+        assert(budgeted.documents.size() < 5u);
+        budgeted = sharded.FindTopDocumentsWithBudget("cat"s, DocumentStatus::ACTUAL,
+            { .max_postings = 0, .deadline = std::chrono::steady_clock::now() });
+        assert(budgeted.is_truncated);
+        assert(budgeted.documents.empty());
+
+        //ошибки разбора запроса приходят и с удалённого шарда
+        bool thrown = false;
+        try {
+            sharded.FindTopDocuments("cat --dog"s);
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+        thrown = false;
+        try {
+            sharded.AddDocument(3, "duplicate"s, DocumentStatus::ACTUAL, {});
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+
+        for (int id = 0; id < 6; ++id) {
+            single.RemoveDocument(id);
+            sharded.RemoveDocument(id);
+        }
+        ASSERT_EQUAL(sharded.GetDocumentCount(), single.GetDocumentCount());
+        check(single.FindTopDocuments("cat dog"s), sharded.FindTopDocuments("cat dog"s));
+    }
+    //удаление RemoteShard закрывает сокет, и поток шарда завершается
+    remote_thread.join();
+    close(sockets[1]);
+
+    //у каждого шарда свои 16 самых частых слов рядом с mat и свои первые 256 слов шаблона pat*;
+    //подстановки выбираются по всей коллекции, и результат тот же, что у одного индекса
+    SearchServer expanded_single(""s);
+    expanded_single.SetFuzzyMaxEdits(1);
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    SearchServer expanded_remote_server(""s);
+    expanded_remote_server.SetFuzzyMaxEdits(1);
+    remote_thread = std::thread([&expanded_remote_server, fd = sockets[1]] { ServeShard(expanded_remote_server, fd); });
+    shards.clear();
+    for (int i = 0; i < 2; ++i) {
+        auto shard = std::make_unique<LocalShard>(""s);
+        shard->GetServer().SetFuzzyMaxEdits(1);
+        shards.push_back(std::move(shard));
+    }
+    shards.push_back(std::make_unique<RemoteShard>(sockets[0]));
+    {
+        ShardedSearchServer sharded(std::move(shards));
+        const auto add = [&](int id, const std::string& text) {
+            expanded_single.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+            sharded.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        };
+        //i-е слово на расстоянии 1 от mat встречается в i + 1 документах
+        const std::string first_letters = "bcdefghijklnopqrsuvw"s;
+        int id = 0;
+        for (size_t i = 0; i < first_letters.size(); ++i) {
+            for (size_t j = 0; j <= i; ++j) {
+                add(id++, first_letters[i] + "at"s);
+            }
+        }
+        for (int i = 0; i < 300; ++i) {
+            add(id++, "pat"s + std::to_string(1000 + i));
+        }
+        for (const std::string& query : { "mat"s, "pat*"s, "pat1?9*"s }) {
+            check(expanded_single.FindTopDocuments(query), sharded.FindTopDocuments(query));
+            check(expanded_single.FindTopDocuments(std::execution::seq, query,
+                [](int, DocumentStatus, int) { return true; }, Bm25Scorer{}),
+                sharded.FindTopDocuments(query, DocumentStatus::ACTUAL, Bm25Scorer{}));
+        }
+    }
+    remote_thread.join();
+    close(sockets[1]);
+}
+
+//=========================================================================================
+#if defined(__cpp_impl_coroutine)
+//простейшая корутина без результата: выполняется сразу и ни от кого не ждёт завершения
+struct DetachedCoroutine {
+    struct promise_type {
+        DetachedCoroutine get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+DetachedCoroutine AwaitSearch(AsyncSearchServer& async_server, std::string query, std::promise<std::vector<Document>>& done) {
+    done.set_value(co_await async_server.FindTopDocumentsAwaitable(query));
+}
+#endif
+
+void TestAsyncSearchServer() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+    server.AddDocument(4, "groomed starling"s, DocumentStatus::BANNED, { 9 });
+
+    const auto same = [](const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+            [](const Document& l, const Document& r) { return l.id == r.id && std::abs(l.relevance - r.relevance) < COMPARISON_TOLERANCE; });
+    };
+
+    AsyncSearchServer::Options options;
+    options.worker_threads = 1;
+    options.batch_window = std::chrono::milliseconds(50);
+    {
+        AsyncSearchServer async_server(server, options);
+        //пока окно пакета открыто, одинаковые запросы склеиваются
+        auto first = async_server.FindTopDocumentsAsync("fluffy groomed cat"s);
+        auto second = async_server.FindTopDocumentsAsync("fluffy groomed cat"s);
+        auto banned = async_server.FindTopDocumentsAsync("fluffy groomed cat"s, DocumentStatus::BANNED);
+        auto invalid = async_server.FindTopDocumentsAsync("cat --dog"s);
+        assert(same(first.get(), server.FindTopDocuments("fluffy groomed cat"s)));
+        assert(same(second.get(), first.get()));
+        assert(same(banned.get(), server.FindTopDocuments("fluffy groomed cat"s, DocumentStatus::BANNED)));
+        bool thrown = false;
+        try {
+            invalid.get();
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+
+        const AsyncSearchServer::Counters counters = async_server.GetCounters();
+        ASSERT_EQUAL(counters.submitted, 4u);
+        ASSERT_EQUAL(counters.deduplicated, 1u);
+        ASSERT_EQUAL(counters.executed, 3u);
+        ASSERT_EQUAL(counters.batches, 1u);
+
+        //после ответа запрос выполняется заново
+        async_server.FindTopDocumentsAsync("fluffy groomed cat"s).get();
+        ASSERT_EQUAL(async_server.GetCounters().executed, 4u);
+
+#if defined(__cpp_impl_coroutine)
+        std::promise<std::vector<Document>> done;
+        AwaitSearch(async_server, "groomed dog"s, done);
+        assert(same(done.get_future().get(), server.FindTopDocuments("groomed dog"s)));
+#endif
+    }
+
+    //пакет из одного окна выполняют все рабочие потоки
+    options.worker_threads = 3;
+    {
+        AsyncSearchServer async_server(server, options);
+        const std::vector<std::string> batch_queries = { "cat"s, "dog"s, "tail"s, "fluffy"s, "groomed"s, "eyes"s };
+        std::vector<std::shared_future<std::vector<Document>>> results;
+        for (const std::string& query : batch_queries) {
+            results.push_back(async_server.FindTopDocumentsAsync(query));
+        }
+        for (size_t i = 0; i < batch_queries.size(); ++i) {
+            assert(same(results[i].get(), server.FindTopDocuments(batch_queries[i])));
+        }
+        const AsyncSearchServer::Counters counters = async_server.GetCounters();
+        ASSERT_EQUAL(counters.executed, 6u);
+        ASSERT_EQUAL(counters.batches, 1u);
+    }
+
+    //много потоков-клиентов и несколько рабочих потоков
+    options.worker_threads = 3;
+    options.batch_window = std::chrono::microseconds(100);
+    options.max_batch_size = 4;
+    AsyncSearchServer async_server(server, options);
+    const std::vector<std::string> queries = { "cat"s, "dog"s, "fluffy tail"s, "groomed -dog"s };
+    std::vector<std::thread> clients;
+    std::atomic<int> mismatches = 0;
+    for (int client = 0; client < 4; ++client) {
+        clients.emplace_back([&, client] {
+            for (int i = 0; i < 50; ++i) {
+                const std::string& query = queries[(client + i) % queries.size()];
+                if (!same(async_server.FindTopDocumentsAsync(query).get(), server.FindTopDocuments(query))) {
+                    ++mismatches;
+                }
+            }
+        });
+    }
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    ASSERT_EQUAL(mismatches.load(), 0);
+    const AsyncSearchServer::Counters counters = async_server.GetCounters();
+    ASSERT_EQUAL(counters.submitted, 200u);
+    ASSERT_EQUAL(counters.executed + counters.deduplicated, 200u);
+}
+
+//=========================================================================================
+void TestHttpService() {
+    {
+        //запрос целиком, по частям и несколько подряд в одном буфере
+        const std::string data = "GET /search?query=fluffy+cat HTTP/1.1\r\nHost: x\r\n\r\n"s
+            "POST /documents?id=5 HTTP/1.0\r\ncontent-length: 9\r\n\r\nwhite cat"s;
+        HttpRequest request;
+        ASSERT_EQUAL(ParseHttpRequest(std::string_view(data).substr(0, 20), request), 0u);
+        const size_t first = ParseHttpRequest(data, request);
+        assert(first > 0);
+        ASSERT_EQUAL(request.method, "GET"sv);
+        ASSERT_EQUAL(request.path, "/search"sv);
+        ASSERT_EQUAL(GetQueryParameter(request.query_string, "query"sv), "fluffy cat"s);
+        assert(request.keep_alive);
+        ASSERT_EQUAL(ParseHttpRequest(std::string_view(data).substr(first, data.size() - first - 1), request), 0u);
+        ASSERT_EQUAL(ParseHttpRequest(std::string_view(data).substr(first), request), data.size() - first);
+        ASSERT_EQUAL(request.body, "white cat"sv);
+        assert(!request.keep_alive);
+
+        bool found = true;
+        ASSERT_EQUAL(GetQueryParameter("a=1&b=%D0%BA%D0%BE%D1%82+x%2By"sv, "b"sv), "кот x+y"s);
+        GetQueryParameter("a=1"sv, "b"sv, &found);
+        assert(!found);
+        ASSERT_EQUAL(GetQueryParameter("q="s + EncodeQueryComponent("cat -dog \"a&b\""s), "q"sv), "cat -dog \"a&b\""s);
+
+        bool thrown = false;
+        try {
+            ParseHttpRequest("GARBAGE\r\n\r\n"sv, request);
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::BANNED, { 5, -12, 2, 1 });
+
+    const auto handle = [&server](std::string_view text) {
+        HttpRequest request;
+        ParseHttpRequest(text, request);
+        std::string response;
+        HandleHttpRequest(server, request, response);
+        return response;
+    };
+    const auto body_of = [](const std::string& response) {
+        return response.substr(response.find("\r\n\r\n"s) + 4);
+    };
+    {
+        const std::string response = handle("GET /search?query=fluffy+cat HTTP/1.1\r\n\r\n"sv);
+        ASSERT_EQUAL(response.substr(0, 15), "HTTP/1.1 200 OK"s);
+        const std::string body = body_of(response);
+        assert(body.find("\"id\":2"s) < body.find("\"id\":1"s));
+        assert(body.find("\"rating\":5"s) != std::string::npos);
+        assert(body.find("\"id\":3"s) == std::string::npos);
+        assert(body_of(handle("GET /search?query=dog&status=BANNED HTTP/1.1\r\n\r\n"sv)).find("\"id\":3"s) != std::string::npos);
+
+        ASSERT_EQUAL(body_of(handle("GET /match?id=2&query=fluffy+cat+-collar HTTP/1.1\r\n\r\n"sv)),
+            "{\"words\":[\"cat\",\"fluffy\"],\"status\":\"ACTUAL\"}"s);
+
+        ASSERT_EQUAL(handle("GET /search?query=cat+--dog HTTP/1.1\r\n\r\n"sv).substr(9, 3), "400"s);
+        ASSERT_EQUAL(handle("GET /search HTTP/1.1\r\n\r\n"sv).substr(9, 3), "400"s);
+        ASSERT_EQUAL(handle("GET /match?id=42&query=cat HTTP/1.1\r\n\r\n"sv).substr(9, 3), "404"s);
+        ASSERT_EQUAL(handle("GET /nowhere HTTP/1.1\r\n\r\n"sv).substr(9, 3), "404"s);
+        ASSERT_EQUAL(handle("PUT /search?query=cat HTTP/1.1\r\n\r\n"sv).substr(9, 3), "405"s);
+        assert(handle("GET /stats HTTP/1.0\r\n\r\n"sv).find("Connection: close\r\n"s) != std::string::npos);
+
+        //PATCH меняет только переданное
+        ASSERT_EQUAL(handle("PATCH /documents?id=3&status=ACTUAL HTTP/1.1\r\n\r\n"sv).substr(9, 3), "200"s);
+        assert(body_of(handle("GET /search?query=dog HTTP/1.1\r\n\r\n"sv)).find("\"id\":3"s) != std::string::npos);
+        ASSERT_EQUAL(handle("PATCH /documents?id=3&status=BANNED&ratings=1,2 HTTP/1.1\r\nContent-Length: 12\r\n\r\ngroomed wolf"sv).substr(9, 3), "200"s);
+        const std::string wolf = body_of(handle("GET /search?query=wolf&status=BANNED HTTP/1.1\r\n\r\n"sv));
+        assert(wolf.find("\"id\":3"s) != std::string::npos && wolf.find("\"rating\":1}"s) != std::string::npos);
+        assert(body_of(handle("GET /search?query=dog&status=BANNED HTTP/1.1\r\n\r\n"sv)).find("\"id\":3"s) == std::string::npos);
+        ASSERT_EQUAL(handle("PATCH /documents?id=42&status=BANNED HTTP/1.1\r\n\r\n"sv).substr(9, 3), "404"s);
+        ASSERT_EQUAL(handle("PATCH /documents?id=3&status=GONE HTTP/1.1\r\n\r\n"sv).substr(9, 3), "400"s);
+    }
+
+    //живой сервис на свободном порту
+    HttpSearchService service(server, 0);
+    std::thread loop([&service] { service.Run(); });
+    {
+        HttpClient client("127.0.0.1"sv, service.GetPort());
+        HttpClient::Response response = client.Request("POST"sv, "/documents?id=4&ratings=9,3"sv, "fluffy starling"sv);
+        ASSERT_EQUAL(response.status, 200);
+        ASSERT_EQUAL(response.body, "{\"document_count\":4}"s);
+        response = client.Request("GET"sv, "/search?query="s + EncodeQueryComponent("fluffy starling"s));
+        ASSERT_EQUAL(response.status, 200);
+        assert(response.body.find("{\"documents\":[{\"id\":4,"s) == 0);
+        assert(response.body.find("\"rating\":6}"s) != std::string::npos);
+
+        //второе соединение, пока первое открыто
+        HttpClient other("127.0.0.1"sv, service.GetPort());
+        ASSERT_EQUAL(other.Request("DELETE"sv, "/documents?id=4"sv).body, "{\"document_count\":3}"s);
+        ASSERT_EQUAL(client.Request("POST"sv, "/documents?id=-1"sv, "cat"sv).status, 400);
+        ASSERT_EQUAL(client.Request("GET"sv, "/stats"sv).body, "{\"document_count\":3}"s);
+
+        //тело длиннее одного чтения из сокета дочитывается по Content-Length
+        std::string long_text;
+        for (int i = 0; i < 30000; ++i) {
+            long_text += "starling "s;
+        }
+        ASSERT_EQUAL(client.Request("POST"sv, "/documents?id=5"sv, long_text).status, 200);
+        ASSERT_EQUAL(client.Request("DELETE"sv, "/documents?id=5"sv).body, "{\"document_count\":3}"s);
+
+        //заголовок больше MAX_HEADER_SIZE - 400, не дожидаясь его конца
+        HttpClient oversized("127.0.0.1"sv, service.GetPort());
+        ASSERT_EQUAL(oversized.Request("GET"sv, "/search?query="s + std::string(100000, 'a')).status, 400);
+    }
+    service.Stop();
+    loop.join();
+}
+
+//=========================================================================================
+void TestPagination() {
+    SearchServer server("and"s);
+    //много документов с одинаковой релевантностью и рейтингом - порядок решает id
+    for (int id = 0; id < 40; ++id) {
+        const std::string text = id % 3 == 0 ? "fluffy cat"s : id % 3 == 1 ? "fluffy dog and cat"s : "cat"s;
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 4 });
+    }
+    server.AddDocument(100, "fluffy cat"s, DocumentStatus::BANNED, { 1 });
+
+    PageRequest all;
+    all.page_size = 1000;
+    const SearchPage full = server.FindPage("fluffy cat"s, DocumentStatus::ACTUAL, all);
+    ASSERT_EQUAL(full.documents.size(), 40u);
+    ASSERT_EQUAL(full.total_count, 40u);
+    assert(!full.next_cursor);
+    assert(std::is_sorted(full.documents.begin(), full.documents.end(), IsRankedBefore));
+    const auto ids = [](const std::vector<Document>& documents) {
+        std::vector<int> result;
+        for (const Document& document : documents) {
+            result.push_back(document.id);
+        }
+        return result;
+    };
+    {
+        //соседи ближе COMPARISON_TOLERANCE, крайние дальше: с допуском в сравнении получался цикл
+        //1 раньше 2 (рейтинг), 2 раньше 3 (рейтинг), 3 раньше 1 (релевантность)
+        const std::vector<Document> triple = { { 1, 0.1, 5 }, { 2, 0.1 + 0.6e-6, 3 }, { 3, 0.1 + 1.2e-6, 1 } };
+        for (const Document& x : triple) {
+            assert(!IsRankedBefore(x, x));
+            for (const Document& y : triple) {
+                for (const Document& z : triple) {
+                    assert(!(IsRankedBefore(x, y) && IsRankedBefore(y, z)) || IsRankedBefore(x, z));
+                }
+            }
+        }
+        std::vector<Document> sorted = triple;
+        std::sort(sorted.begin(), sorted.end(), IsRankedBefore);
+        assert(ids(sorted) == std::vector<int>({ 2, 3, 1 }));
+    }
+    const std::vector<int> expected = ids(full.documents);
+
+    //первая страница совпадает с FindTopDocuments
+    const std::vector<int> top = ids(server.FindTopDocuments("fluffy cat"s));
+    assert(top == std::vector<int>(expected.begin(), expected.begin() + MAX_RESULT_DOCUMENT_COUNT));
+
+    //страницы по номеру и по курсору дают ту же выдачу
+    std::vector<int> by_offset;
+    std::vector<int> by_cursor;
+    PageRequest cursor_page;
+    cursor_page.page_size = 7;
+    for (size_t page_index = 0; ; ++page_index) {
+        PageRequest page;
+        page.page_size = 7;
+        page.offset = page_index * 7;
+        const SearchPage result = server.FindPage(execution::par, "fluffy cat"s,
+            [](int, DocumentStatus status, int) { return status == DocumentStatus::ACTUAL; }, TfIdfScorer{}, page);
+        ASSERT_EQUAL(result.total_count, 40u);
+        if (result.documents.empty()) {
+            break;
+        }
+        const std::vector<int> page_ids = ids(result.documents);
+        by_offset.insert(by_offset.end(), page_ids.begin(), page_ids.end());
+
+        const SearchPage next = server.FindPage("fluffy cat"s, DocumentStatus::ACTUAL, cursor_page);
+        const std::vector<int> next_ids = ids(next.documents);
+        by_cursor.insert(by_cursor.end(), next_ids.begin(), next_ids.end());
+        ASSERT_EQUAL(next.next_cursor.has_value(), by_cursor.size() < 40u);
+        cursor_page.search_after = next.next_cursor;
+    }
+    assert(by_offset == expected);
+    assert(by_cursor == expected);
+
+    //offset после курсора и страница за концом выдачи
+    PageRequest page;
+    page.page_size = 3;
+    page.offset = 2;
+    page.search_after = full.documents[10];
+    assert(ids(server.FindPage("fluffy cat"s, DocumentStatus::ACTUAL, page).documents)
+        == std::vector<int>(expected.begin() + 13, expected.begin() + 16));
+    page.search_after = std::nullopt;
+    page.offset = 40;
+    const SearchPage beyond = server.FindPage("fluffy cat"s, DocumentStatus::ACTUAL, page);
+    assert(beyond.documents.empty() && !beyond.next_cursor);
+    ASSERT_EQUAL(beyond.total_count, 40u);
+
+    //Paginator не раскладывает контейнер на страницы заранее
+    const std::vector<int> items = { 1, 2, 3, 4, 5, 6, 7 };
+    const auto pages = Paginate(items, 3);
+    ASSERT_EQUAL(pages.size(), 3u);
+    std::vector<size_t> page_sizes;
+    for (const auto& range : pages) {
+        page_sizes.push_back(range.size());
+    }
+    assert((page_sizes == std::vector<size_t>{ 3, 3, 1 }));
+    ASSERT_EQUAL(*pages.Page(2).begin(), 7);
+    ASSERT_EQUAL(Paginate(std::vector<int>{}, 3).size(), 0u);
+    bool thrown = false;
+    try {
+        Paginate(items, 0);
+    }
+    catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    //то же через HTTP: курсор из ответа ведёт на следующую страницу
+    const auto search = [&server](std::string_view text) {
+        HttpRequest request;
+        ParseHttpRequest(text, request);
+        std::string response;
+        HandleHttpRequest(server, request, response);
+        return response.substr(response.find("\r\n\r\n"s) + 4);
+    };
+    const std::string first = search("GET /search?query=fluffy+cat&page_size=2 HTTP/1.1\r\n\r\n"sv);
+    const size_t next_begin = first.find("\"next\":\""s) + 8;
+    const std::string next = first.substr(next_begin, first.find('"', next_begin) - next_begin);
+    assert(first.find("\"total\":40"s) != std::string::npos);
+    const std::string second = search("GET /search?query=fluffy+cat&page_size=2&after="s + EncodeQueryComponent(next) + " HTTP/1.1\r\n\r\n"s);
+    assert(second.find("{\"documents\":[{\"id\":"s + std::to_string(expected[2]) + ","s) == 0);
+    assert(search("GET /search?query=cat&page_size=0 HTTP/1.1\r\n\r\n"sv).find("error"s) != std::string::npos);
+}
+
+//=========================================================================================
+void TestWriteAheadLog() {
+    ASSERT_EQUAL(Crc32c("123456789"sv), 0xE3069283u);
+    ASSERT_EQUAL(Crc32c("6789"sv, Crc32c("12345"sv)), 0xE3069283u);
+
+    const std::filesystem::path directory = std::filesystem::temp_directory_path()
+        / ("search_server_wal_test_"s + std::to_string(::getpid()));
+    std::filesystem::remove_all(directory);
+    const std::string log_path = (directory / "wal").string();
+    const auto same_results = [](const SearchServer& lhs, const SearchServer& rhs, const std::string& query) {
+        const std::vector<Document> left = lhs.FindTopDocuments(query);
+        const std::vector<Document> right = rhs.FindTopDocuments(query);
+        return left.size() == right.size() && std::equal(left.begin(), left.end(), right.begin(),
+            [](const Document& l, const Document& r) { return l.id == r.id && l.rating == r.rating; });
+    };
+
+    SearchServer reference("and in"s);
+    {
+        SearchServer server("and in"s);
+        DurableSearchServer durable(server, directory.string());
+        ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 0u);
+        durable.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+        durable.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        durable.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::BANNED, { 5, -12, 2, 1 });
+        durable.RemoveDocument(1);
+        durable.RemoveDocument(42); //нечего удалять - в журнал не попадает
+        bool thrown = false;
+        try {
+            durable.AddDocument(2, "duplicate"s, DocumentStatus::ACTUAL, {});
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+        //текст проверяет индекс уже после записи в журнал: документ не добавлен,
+        //а запись при восстановлении отвергается так же
+        thrown = false;
+        try {
+            durable.AddDocument(9, "bad c\x12t"s, DocumentStatus::ACTUAL, {});
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+        assert(!server.HasDocument(9));
+
+        //параллельные писатели делят fdatasync
+        std::vector<std::thread> writers;
+        for (int writer = 0; writer < 4; ++writer) {
+            writers.emplace_back([&durable, writer] {
+                for (int i = 0; i < 25; ++i) {
+                    durable.AddDocument(100 + writer * 25 + i, "fluffy starling number "s + std::to_string(i), DocumentStatus::ACTUAL, { i });
+                }
+            });
+        }
+        for (std::thread& writer : writers) {
+            writer.join();
+        }
+        const WriteAheadLog::Stats stats = durable.GetLogStats();
+        ASSERT_EQUAL(stats.records, 105u);
+        assert(stats.batches <= stats.records);
+        ASSERT_EQUAL(server.GetDocumentCount(), 102);
+
+        reference.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        reference.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::BANNED, { 5, -12, 2, 1 });
+        for (int writer = 0; writer < 4; ++writer) {
+            for (int i = 0; i < 25; ++i) {
+                reference.AddDocument(100 + writer * 25 + i, "fluffy starling number "s + std::to_string(i), DocumentStatus::ACTUAL, { i });
+            }
+        }
+    }
+    {
+        //восстановление из журнала
+        SearchServer server("and in"s);
+        DurableSearchServer durable(server, directory.string());
+        ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 104u);
+        ASSERT_EQUAL(durable.GetRecoveryStats().rejected_records, 1u);
+        ASSERT_EQUAL(server.GetDocumentCount(), 102);
+        assert(same_results(server, reference, "fluffy cat"s));
+        ASSERT_EQUAL(server.FindTopDocuments("groomed"s, DocumentStatus::BANNED).size(), 1u);
+        durable.RemoveDocument(2);
+        for (int id = 100; id < 200; ++id) {
+            durable.RemoveDocument(id);
+        }
+    }
+    const auto file_size = [&log_path] { return std::filesystem::file_size(log_path); };
+    {
+        //оборванная запись в конце журнала отбрасывается и отрезается
+        const auto valid_size = file_size();
+        std::ofstream(log_path, std::ios::binary | std::ios::app) << "\x20\x00\x00\x00garbage"s;
+        SearchServer server("and in"s);
+        DurableSearchServer durable(server, directory.string());
+        ASSERT_EQUAL(file_size(), valid_size);
+        ASSERT_EQUAL(server.GetDocumentCount(), 1);
+        durable.AddDocument(4, "fluffy dog"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    {
+        //у последней записи испорчено тело - она не применяется
+        std::fstream file(log_path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(-1, std::ios::end);
+        file.put('#');
+    }
+    {
+        SearchServer server("and in"s);
+        DurableSearchServer durable(server, directory.string());
+        ASSERT_EQUAL(server.GetDocumentCount(), 1);
+        assert(server.FindTopDocuments("dog"s).empty());
+
+        //снимок: журнал очищается, документы переходят в снимок
+        durable.AddDocument(5, "fluffy dog"s, DocumentStatus::ACTUAL, { 1 });
+        durable.AddDocument(6, "fluffy starling"s, DocumentStatus::ACTUAL, { 2 });
+        durable.RemoveDocument(6);
+        durable.Checkpoint();
+        ASSERT_EQUAL(file_size(), 16u);
+        durable.AddDocument(7, "white starling"s, DocumentStatus::ACTUAL, { 3 });
+    }
+    {
+        SearchServer server("and in"s);
+        DurableSearchServer durable(server, directory.string());
+        ASSERT_EQUAL(durable.GetRecoveryStats().snapshot_documents, 2u);
+        ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 1u);
+        ASSERT_EQUAL(server.GetDocumentCount(), 3);
+        ASSERT_EQUAL(server.FindTopDocuments("starling"s).size(), 1u);
+        ASSERT_EQUAL(server.FindTopDocuments("fluffy"s)[0].id, 5);
+    }
+    {
+        //журнал пропал после снимка: нумерация продолжается после снимка, записи не теряются
+        std::filesystem::remove(log_path);
+        {
+            SearchServer server("and in"s);
+            DurableSearchServer durable(server, directory.string());
+            ASSERT_EQUAL(server.GetDocumentCount(), 2);
+            durable.AddDocument(8, "groomed starling"s, DocumentStatus::ACTUAL, { 4 });
+        }
+        SearchServer server("and in"s);
+        DurableSearchServer durable(server, directory.string());
+        ASSERT_EQUAL(server.GetDocumentCount(), 3);
+    }
+    {
+        //запись длиннее куска, которым читается журнал, восстанавливается целиком
+        std::string long_text;
+        for (int i = 0; i < 150000; ++i) {
+            long_text += "starling "s;
+        }
+        {
+            SearchServer server("and in"s);
+            DurableSearchServer durable(server, directory.string());
+            durable.AddDocument(10, long_text, DocumentStatus::ACTUAL, { 1 });
+            durable.AddDocument(11, "white starling"s, DocumentStatus::ACTUAL, { 1 });
+        }
+        SearchServer server("and in"s);
+        DurableSearchServer durable(server, directory.string());
+        ASSERT_EQUAL(server.GetDocumentCount(), 5);
+        assert(server.HasDocument(10) && server.HasDocument(11));
+    }
+    std::filesystem::remove_all(directory);
+}
+
+//=========================================================================================
+void TestUpdateDocument() {
+    //после изменений на месте индекс должен быть тем же, что собранный заново из итоговых текстов
+    const auto build = [](bool updated) {
+        SearchServer server("and in"s);
+        server.EnablePositionalIndex();
+        server.SetFuzzyMaxEdits(1);
+        server.AddDocument(1, updated ? "black dog in fashionable collar collar"s : "white cat and fashionable collar"s,
+            updated ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, updated ? std::vector<int>{ 1, 2 } : std::vector<int>{ 8, -3 });
+        server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        server.AddDocument(3, updated ? "groomed cat"s : "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+        server.AddDocument(4, updated ? "and in"s : "well groomed starling"s, DocumentStatus::ACTUAL, { 4 });
+        return server;
+    };
+    const SearchServer reference = build(true);
+    SearchServer server = build(false);
+    server.UpdateDocument(1, "black dog in fashionable collar collar"s);
+    server.SetStatus(1, DocumentStatus::BANNED);
+    server.SetRatings(1, { 1, 2 });
+    server.UpdateDocument(3, "groomed cat"s);
+    server.UpdateDocument(4, "and in"s); //одни стоп-слова
+    server.UpdateDocument(2, "fluffy cat fluffy tail"s); //тот же текст ничего не меняет
+
+    const auto same_results = [&server, &reference](const std::string& query, DocumentStatus status) {
+        const std::vector<Document> left = server.FindTopDocuments(query, status);
+        const std::vector<Document> right = reference.FindTopDocuments(query, status);
+        ASSERT_EQUAL(left.size(), right.size());
+        for (size_t i = 0; i < left.size(); ++i) {
+            ASSERT_EQUAL(left[i].id, right[i].id);
+            ASSERT_EQUAL(left[i].relevance, right[i].relevance);
+            ASSERT_EQUAL(left[i].rating, right[i].rating);
+        }
+    };
+    for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+        same_results("fluffy groomed cat"s, status);
+        same_results("dog collar -white"s, status);
+        same_results("\"fashionable collar\" starling eyes"s, status);
+        same_results("gromed"s, status);
+    }
+    assert(server.FindTopDocuments("white"s, DocumentStatus::BANNED).empty());
+    assert(server.FindTopDocuments("starling"s).empty());
+    assert(server.GetTermsByPrefix("ex"s, 10).empty());
+    ASSERT_EQUAL(server.GetQueryStatistics("cat"s).total_document_length, reference.GetQueryStatistics("cat"s).total_document_length);
+    ASSERT_EQUAL(server.GetQueryStatistics("cat"s).document_freqs.at("cat"s), 2u);
+    for (int id = 1; id <= 4; ++id) {
+        //GetWordFrequencies отдаёт ссылку на одну статическую карту - результат нужно скопировать
+        const std::map<std::string_view, double> expected = reference.GetWordFrequencies(id);
+        assert(server.GetWordFrequencies(id) == expected);
+    }
+    const auto [words, status] = server.MatchDocument("\"dog in fashionable\" white"s, 1);
+    assert(words == std::vector<std::string_view>({ "dog"sv, "fashionable"sv }));
+    assert(status == DocumentStatus::BANNED);
+
+    //ошибка не меняет документ
+    bool thrown = false;
+    try {
+        server.UpdateDocument(2, "fluffy c\x12t"s);
+    }
+    catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+    same_results("fluffy cat"s, DocumentStatus::ACTUAL);
+    thrown = false;
+    try {
+        server.SetStatus(42, DocumentStatus::BANNED);
+    }
+    catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    //изменения в журнале: восстановление и свёртка в снимок
+    const std::filesystem::path directory = std::filesystem::temp_directory_path()
+        / ("search_server_update_test_"s + std::to_string(::getpid()));
+    std::filesystem::remove_all(directory);
+    {
+        SearchServer durable_server("and in"s);
+        DurableSearchServer durable(durable_server, directory.string());
+        durable.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+        durable.AddDocument(2, "fluffy dog"s, DocumentStatus::ACTUAL, { 2 });
+        durable.AddDocument(3, "groomed starling"s, DocumentStatus::ACTUAL, { 3 });
+        durable.SetStatus(1, DocumentStatus::BANNED);
+        durable.UpdateDocument(2, "fluffy cat"s);
+        durable.SetRatings(2, { 9, 7 });
+        //документы из полей: нетронутый и обновлённый полями
+        durable.AddDocument(4, { { "title"sv, "hamster"sv } }, DocumentStatus::ACTUAL, { 4 });
+        durable.AddDocument(5, { { "title"sv, "parrot"sv }, { ""sv, "green bird"sv } }, DocumentStatus::ACTUAL, { 5 });
+        durable.UpdateDocument(5, { { "title"sv, "macaw"sv }, { ""sv, "green bird"sv } });
+        thrown = false;
+        try {
+            durable.UpdateDocument(42, "cat"s);
+        }
+        catch (const std::out_of_range&) {
+            thrown = true;
+        }
+        assert(thrown);
+        ASSERT_EQUAL(durable.GetLogStats().records, 9u);
+    }
+    const auto check = [](const SearchServer& recovered) {
+        const std::vector<Document> cats = recovered.FindTopDocuments("cat"s);
+        ASSERT_EQUAL(cats.size(), 1u);
+        ASSERT_EQUAL(cats[0].id, 2);
+        ASSERT_EQUAL(cats[0].rating, 8);
+        ASSERT_EQUAL(recovered.FindTopDocuments("cat"s, DocumentStatus::BANNED)[0].id, 1);
+        assert(recovered.FindTopDocuments("dog"s).empty());
+        ASSERT_EQUAL(recovered.FindTopDocuments("starling"s).size(), 1u);
+        ASSERT_EQUAL(recovered.FindTopDocuments("title:hamster"s).size(), 1u);
+        assert(recovered.FindTopDocuments("title:parrot parrot"s).empty());
+        ASSERT_EQUAL(recovered.FindTopDocuments("title:macaw"s)[0].id, 5);
+        ASSERT_EQUAL(recovered.FindTopDocuments("bird"s)[0].id, 5);
+    };
+    {
+        SearchServer recovered("and in"s);
+        DurableSearchServer durable(recovered, directory.string());
+        ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 9u);
+        check(recovered);
+        durable.Checkpoint();
+    }
+    {
+        SearchServer recovered("and in"s);
+        DurableSearchServer durable(recovered, directory.string());
+        ASSERT_EQUAL(durable.GetRecoveryStats().snapshot_documents, 5u);
+        ASSERT_EQUAL(durable.GetRecoveryStats().replayed_records, 0u);
+        check(recovered);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+//=========================================================================================
+void TestQueryArena() {
+    {
+        QueryArenaScope outer;
+        std::pmr::vector<int> numbers(outer.GetResource());
+        {
+            //вложенная область пользуется той же ареной и не сбрасывает её
+            QueryArenaScope inner;
+            numbers.assign(100000, 7);
+        }
+        ASSERT_EQUAL(numbers.size(), 100000u);
+        ASSERT_EQUAL(numbers.back(), 7);
+    }
+    //не уместившийся запрос увеличивает буфер
+    assert(QueryArenaScope::GetCapacity() >= 100000 * sizeof(int));
+
+    //запрос больше буфера арены; результаты переживают её сброс
+    SearchServer server("and"s);
+    std::string long_query;
+    for (int i = 0; i < 20000; ++i) {
+        long_query += "word"s + std::to_string(i) + ' ';
+    }
+    long_query += "cat"s;
+    server.AddDocument(1, "white cat and collar"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "word7 cat word19999"s, DocumentStatus::ACTUAL, { 2 });
+    const std::vector<Document> documents = server.FindTopDocuments(long_query);
+    ASSERT_EQUAL(documents.size(), 2u);
+    ASSERT_EQUAL(documents[0].id, 2);
+    const auto [words, status] = server.MatchDocument(long_query, 2);
+    assert(words == std::vector<std::string_view>({ "cat"sv, "word19999"sv, "word7"sv }));
+    ASSERT_EQUAL(server.GetQueryStatistics("cat word7"s).document_freqs.at("cat"s), 2u);
+}
+
+//=========================================================================================
+void TestBooleanQueries() {
+    SearchServer server("and in the"s);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+    server.AddDocument(4, "groomed starling evgeny"s, DocumentStatus::BANNED, { 9 });
+    server.AddDocument(5, "cat with expressive eyes"s, DocumentStatus::ACTUAL, { 1 });
+
+    const auto ids = [&server](const std::string& query) {
+        std::vector<int> result;
+        for (const Document& document : server.FindTopDocuments(query, [](int, DocumentStatus, int) { return true; })) {
+            result.push_back(document.id);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    assert(ids("cat AND fluffy"s) == std::vector<int>({ 2 }));
+    assert(ids("cat OR dog"s) == std::vector<int>({ 1, 2, 3, 5 }));
+    assert(ids("cat AND NOT fluffy"s) == std::vector<int>({ 1, 5 }));
+    //подряд идущие слова - OR, и связывает сильнее AND, AND - сильнее OR
+    assert(ids("cat dog AND eyes"s) == std::vector<int>({ 3, 5 }));
+    assert(ids("groomed AND dog OR white"s) == std::vector<int>({ 1, 3 }));
+    assert(ids("groomed AND (dog OR white)"s) == std::vector<int>({ 3 }));
+    assert(ids("NOT cat"s) == std::vector<int>({ 3, 4 }));
+    assert(ids("NOT NOT cat"s) == ids("cat"s));
+    assert(ids("(cat)(dog)"s) == std::vector<int>({ 1, 2, 3, 5 }));
+    assert(ids("unknown AND cat"s).empty());
+    assert(ids("unknown OR cat"s) == ids("cat"s));
+    assert(ids("gro* AND NOT dog"s) == std::vector<int>({ 4 }));
+    //стоп-слова пропускаются, как и в обычном запросе
+    assert(ids("in AND cat AND the"s) == ids("cat"s));
+
+    //группа из слов и минус-слов ищет то же, что обычный запрос, и с той же релевантностью
+    const std::vector<Document> plain = server.FindTopDocuments("cat eyes -fluffy"s);
+    const std::vector<Document> grouped = server.FindTopDocuments("(cat eyes -fluffy)"s);
+    ASSERT_EQUAL(plain.size(), grouped.size());
+    for (size_t i = 0; i < plain.size(); ++i) {
+        ASSERT_EQUAL(plain[i].id, grouped[i].id);
+        ASSERT_EQUAL(plain[i].relevance, grouped[i].relevance);
+    }
+    //слова под NOT на релевантность не влияют
+    const std::vector<Document> with_not = server.FindTopDocuments("cat AND NOT (fluffy OR dog)"s);
+    const std::vector<Document> without_not = server.FindTopDocuments("cat -fluffy"s);
+    ASSERT_EQUAL(with_not.size(), without_not.size());
+    ASSERT_EQUAL(with_not[0].relevance, without_not[0].relevance);
+    ASSERT_EQUAL(server.FindTopDocuments(std::execution::par, "cat AND eyes"s).size(), 1u);
+
+    {
+        const auto [words, status] = server.MatchDocument("(cat OR dog) AND eyes AND NOT fluffy"s, 5);
+        assert(words == std::vector<std::string_view>({ "cat"sv, "eyes"sv }));
+        const auto [par_words, par_status] = server.MatchDocument(std::execution::par, "cat AND fluffy"s, 5);
+        assert(par_words.empty());
+        const auto matched = server.MatchDocuments("fluffy OR groomed"s, { 2, 4 });
+        assert(std::get<0>(matched[0]) == std::vector<std::string_view>({ "fluffy"sv }));
+        assert(std::get<0>(matched[1]) == std::vector<std::string_view>({ "groomed"sv }));
+        ASSERT_EQUAL(static_cast<int>(std::get<1>(matched[1])), static_cast<int>(DocumentStatus::BANNED));
+    }
+
+    for (const std::string& query : { "cat AND"s, "(cat"s, "cat)"s, "OR cat"s, "()"s, "cat AND -"s, "NOT"s, "\"white cat\" AND dog"s }) {
+        try {
+            server.FindTopDocuments(query);
+            assert(false);
+        }
+        catch (const std::invalid_argument&) {
+        }
+    }
+
+    //сверка со вычислением в лоб на случайных выражениях
+    std::mt19937 generator(7);
+    const std::vector<std::string> words = { "a1"s, "b2"s, "c3"s, "d4"s, "e5"s, "f6"s };
+    SearchServer random_server(""s);
+    std::vector<std::set<std::string>> documents;
+    for (int id = 0; id < 40; ++id) {
+        std::set<std::string> document_words;
+        std::string text;
+        for (int i = 0; i < 3; ++i) {
+            const std::string& word = words[generator() % (id < 20 ? 3 : words.size())];
+            document_words.insert(word);
+            text += word + ' ';
+        }
+        random_server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+        documents.push_back(document_words);
+    }
+    std::function<std::string(int, std::function<bool(const std::set<std::string>&)>&)> generate_expression =
+        [&](int depth, std::function<bool(const std::set<std::string>&)>& matches) -> std::string {
+        const unsigned kind = depth == 0 ? 0 : generator() % 4;
+        if (kind == 0) {
+            const std::string word = words[generator() % words.size()];
+            matches = [word](const std::set<std::string>& document) { return document.count(word) > 0; };
+            return word;
+        }
+        std::function<bool(const std::set<std::string>&)> left, right;
+        const std::string left_text = generate_expression(depth - 1, left);
+        if (kind == 1) {
+            matches = [left](const std::set<std::string>& document) { return !left(document); };
+            return "NOT ("s + left_text + ')';
+        }
+        const std::string right_text = generate_expression(depth - 1, right);
+        if (kind == 2) {
+            matches = [left, right](const std::set<std::string>& document) { return left(document) && right(document); };
+            return '(' + left_text + " AND "s + right_text + ')';
+        }
+        matches = [left, right](const std::set<std::string>& document) { return left(document) || right(document); };
+        return '(' + left_text + " OR "s + right_text + ')';
+    };
+    for (int i = 0; i < 200; ++i) {
+        std::function<bool(const std::set<std::string>&)> matches;
+        const std::string query = generate_expression(4, matches);
+        for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+            const bool found = !random_server.FindTopDocuments(query, [id](int document_id, DocumentStatus, int) { return document_id == id; }).empty();
+            ASSERT_EQUAL_HINT(found, matches(documents[id]), query);
+        }
+    }
+}
+
+//=========================================================================================
+void TestDocumentFields() {
+    SearchServer server("and the"s);
+    server.AddDocument(1, { { "title"sv, "fluffy cat"sv }, { ""sv, "the dog and the bird"sv } }, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, { { "title"sv, "dog"sv }, { ""sv, "cat with collar"sv }, { "tags"sv, "pets"sv } }, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "white cat"s, DocumentStatus::ACTUAL, { 3 });
+
+    const auto ids = [&server](const std::string& query) {
+        std::vector<int> result;
+        for (const Document& document : server.FindTopDocuments(query)) {
+            result.push_back(document.id);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    //без поля ищется весь документ
+    assert(ids("cat"s) == std::vector<int>({ 1, 2, 3 }));
+    assert(ids("title:cat"s) == std::vector<int>({ 1 }));
+    assert(ids("title:dog tags:pets"s) == std::vector<int>({ 2 }));
+    assert(ids("cat -title:cat"s) == std::vector<int>({ 2, 3 }));
+    assert(ids("title:cat OR title:dog"s) == std::vector<int>({ 1, 2 }));
+    assert(ids("cat AND NOT title:dog"s) == std::vector<int>({ 1, 3 }));
+    //стоп-слово в поле пропускается, неизвестное поле - часть обычного слова
+    assert(ids("title:the"s).empty());
+    assert(ids("author:cat"s).empty());
+
+    //с весами 1 релевантность та же, что у документа из одного текста
+    SearchServer plain_server("and the"s);
+    plain_server.AddDocument(1, "fluffy cat the dog and the bird"s, DocumentStatus::ACTUAL, { 1 });
+    plain_server.AddDocument(2, "dog cat with collar pets"s, DocumentStatus::ACTUAL, { 2 });
+    plain_server.AddDocument(3, "white cat"s, DocumentStatus::ACTUAL, { 3 });
+    const std::vector<Document> plain = plain_server.FindTopDocuments("fluffy dog"s);
+    const std::vector<Document> fielded = server.FindTopDocuments("fluffy dog"s);
+    ASSERT_EQUAL(plain.size(), fielded.size());
+    for (size_t i = 0; i < plain.size(); ++i) {
+        ASSERT_EQUAL(plain[i].id, fielded[i].id);
+        assert(std::abs(plain[i].relevance - fielded[i].relevance) < 1e-12);
+    }
+
+    //вес 3: слово заголовка считается за три вхождения
+    ASSERT_EQUAL(server.GetFieldWeight("title"sv), 1.0);
+    server.SetFieldWeight("title"sv, 3.0);
+    ASSERT_EQUAL(server.GetFieldWeight("title"sv), 3.0);
+    const std::vector<Document> boosted = server.FindTopDocuments("dog"s);
+    ASSERT_EQUAL(boosted.size(), 2u);
+    ASSERT_EQUAL(boosted[0].id, 2);
+    assert(std::abs(boosted[0].relevance - 3.0 / 5.0 * std::log(3.0 / 2.0)) < 1e-12);
+    assert(std::abs(boosted[1].relevance - 1.0 / 4.0 * std::log(3.0 / 2.0)) < 1e-12);
+    const std::vector<Document> in_title = server.FindTopDocuments("title:fluffy"s);
+    assert(std::abs(in_title[0].relevance - 3.0 / 4.0 * std::log(3.0)) < 1e-12);
+    const std::vector<Document> boolean = server.FindTopDocuments("dog AND collar"s);
+    assert(std::abs(boolean[0].relevance - 3.0 / 5.0 * std::log(3.0 / 2.0) - 1.0 / 5.0 * std::log(3.0)) < 1e-12);
+
+    {
+        const auto [words, status] = server.MatchDocument("title:cat bird"s, 1);
+        assert(words == std::vector<std::string_view>({ "bird"sv, "cat"sv }));
+        const auto [excluded, _] = server.MatchDocument("cat -title:cat"s, 1);
+        assert(excluded.empty());
+        const auto matched = server.MatchDocuments("title:cat cat"s, { 1, 2 });
+        assert(std::get<0>(matched[0]) == std::vector<std::string_view>({ "cat"sv }));
+        assert(std::get<0>(matched[1]) == std::vector<std::string_view>({ "cat"sv }));
+        const auto [par_words, par_status] = server.MatchDocument(std::execution::par, "title:dog"s, 1);
+        assert(par_words.empty());
+    }
+
+    //удаление убирает документ из постингов полей, а обновление полями заменяет их
+    server.RemoveDocument(1);
+    assert(ids("title:cat"s).empty());
+    try {
+        server.UpdateDocument(2, "dog cat"s);
+        assert(false);
+    }
+    catch (const std::invalid_argument&) {
+    }
+    assert(ids("title:dog"s) == std::vector<int>({ 2 }));
+    server.UpdateDocument(2, { { "title"sv, "bird"sv }, { ""sv, "dog cat"sv } });
+    assert(ids("title:dog"s).empty());
+    assert(ids("tags:pets"s).empty());
+    assert(ids("title:bird"s) == std::vector<int>({ 2 }));
+    assert(ids("dog"s) == std::vector<int>({ 2 }));
+    //без полей с именем документ снова обновляется текстом
+    server.UpdateDocument(2, { { ""sv, "dog cat"sv } });
+    server.UpdateDocument(2, "dog cat"s);
+    assert(ids("title:bird"s).empty());
+
+    for (const std::string_view name : { ""sv, "a b"sv, "a:b"sv, "-a"sv }) {
+        try {
+            server.SetFieldWeight(name, 2.0);
+            assert(false);
+        }
+        catch (const std::invalid_argument&) {
+        }
+    }
+    for (const std::string& query : { "title:"s, "title:ca*"s, "title:-cat"s }) {
+        try {
+            server.FindTopDocuments(query);
+            assert(false);
+        }
+        catch (const std::invalid_argument&) {
+        }
+    }
+    try {
+        server.SetFieldWeight("title"sv, -1.0);
+        assert(false);
+    }
+    catch (const std::invalid_argument&) {
+    }
+    try {
+        server.AddDocument(4, { { "bad name"sv, "cat"sv } }, DocumentStatus::ACTUAL, { 1 });
+        assert(false);
+    }
+    catch (const std::invalid_argument&) {
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+}
+
+//=========================================================================================
+void TestTextAnalyzer() {
+    {
+        const TextAnalyzer analyzer;
+        ASSERT_EQUAL(analyzer.Normalize("Hello, World!\tFOO--bar\n- 'quoted' don't"sv), "hello world foo--bar quoted don't"s);
+        ASSERT_EQUAL(analyzer.Normalize("«Пушистый» КОТ—и ЁЖИК… Straße ΣΟΦΊΑ"sv), "пушистый кот и ежик straße σοφία"s);
+        ASSERT_EQUAL(analyzer.Normalize("кто‐то don’t"sv), "кто-то don't"s);
+        //некорректный UTF-8 остаётся в слове как есть
+        ASSERT_EQUAL(analyzer.Normalize("AB\xFF" "C"sv), "ab\xFF" "c"s);
+        //в том числе байты старше F4, избыточно длинные формы, суррогаты и символы выше U+10FFFF:
+        //они не декодируются в другой символ и не разрывают слово
+        ASSERT_EQUAL(analyzer.Normalize("X\xF8\x81\x82" "Y"sv), "x\xF8\x81\x82" "y"s);
+        ASSERT_EQUAL(analyzer.Normalize("X\xE0\x80\x80" "Y X\xC0\x80" "Y"sv), "x\xE0\x80\x80" "y x\xC0\x80" "y"s);
+        ASSERT_EQUAL(analyzer.Normalize("X\xED\xA0\x80" "Y"sv), "x\xED\xA0\x80" "y"s);
+        ASSERT_EQUAL(analyzer.Normalize("X\xF0\x80\x80\x80" "Y X\xF4\x90\x80\x80" "Y"sv),
+            "x\xF0\x80\x80\x80" "y x\xF4\x90\x80\x80" "y"s);
+        ASSERT_EQUAL(analyzer.Normalize(" ,.!? "sv), ""s);
+        std::string pattern;
+        analyzer.Normalize("Кош*", pattern, true);
+        ASSERT_EQUAL(pattern, "кош*"s);
+        //дописывает через пробел
+        analyzer.Normalize("Кот", pattern);
+        ASSERT_EQUAL(pattern, "кош* кот"s);
+    }
+    {
+        const TextAnalyzer analyzer({ .fold_case = false, .strip_punctuation = false });
+        ASSERT_EQUAL(analyzer.Normalize("Hello,\tWorld!  Кот"sv), "Hello, World! Кот"s);
+    }
+    {
+        const TextAnalyzer analyzer({ .stem = true });
+        ASSERT_EQUAL(analyzer.Normalize("Пушистые кошки, пушистую кошку; котами"sv), "пушист кошк пушист кошк кот"s);
+        ASSERT_EQUAL(analyzer.Normalize("cats classes ponies jumped running bus is"sv), "cat class poni jump runn bus is"s);
+        //короткие слова не укорачиваются до одной буквы
+        ASSERT_EQUAL(analyzer.Normalize("он я ели"sv), "он я ел"s);
+    }
+
+    SearchServer server("и в"s);
+    server.EnablePositionalIndex();
+    server.SetTextAnalyzer({ .stem = true });
+    server.AddDocument(1, "Пушистый КОТ,\tи хвост."s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "Ухоженная собака в ошейнике!"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, { { "title"sv, "Кошки"sv }, { ""sv, "Ёжик в тумане"sv } }, DocumentStatus::ACTUAL, { 3 });
+
+    const auto ids = [&server](const std::string& query) {
+        std::vector<int> result;
+        for (const Document& document : server.FindTopDocuments(query)) {
+            result.push_back(document.id);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    assert(ids("кот"s) == std::vector<int>({ 1 }));
+    assert(ids("Коты!"s) == std::vector<int>({ 1 }));
+    assert(ids("пушистая -КОТА"s).empty());
+    assert(ids("собаки ежик"s) == std::vector<int>({ 2, 3 }));
+    assert(ids("ухож*"s) == std::vector<int>({ 2 }));
+    assert(ids("\"пушистые коты\""s) == std::vector<int>({ 1 }));
+    assert(ids("КОТ AND хвосты"s) == std::vector<int>({ 1 }));
+    assert(ids("title:кошка"s) == std::vector<int>({ 3 }));
+    //стоп-слова нормализуются так же; слово из одной пунктуации пропускается
+    assert(ids("И"s).empty());
+    assert(ids("кот ,"s) == std::vector<int>({ 1 }));
+    //анализатор разбивает слово запроса так же, как текст документа
+    assert(ids("кот,собака"s) == std::vector<int>({ 1, 2 }));
+
+    const auto [words, status] = server.MatchDocument("ПУШИСТЫЕ хвосты -собака"s, 1);
+    assert(words == std::vector<std::string_view>({ "пушист"sv, "хвост"sv }));
+    assert(server.GetTermsByPrefix("ПУ"sv, 10) == std::vector<std::string_view>({ "пушист"sv }));
+
+    try {
+        server.SetTextAnalyzer({});
+        assert(false);
+    }
+    catch (const std::logic_error&) {
+    }
+}
+
+//=========================================================================================
+void TestMemoryStats() {
+    SearchServer server("and"s);
+    server.EnablePositionalIndex();
+    server.AddDocument(1, "white cat and fancy collar"sv, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(2, "fluffy cat fluffy tail"sv, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(3, "groomed dog expressive eyes"sv, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+    server.AddDocument(4, { { "title"s, "cat dog"s }, { ""s, "tail"s } }, DocumentStatus::ACTUAL, { 1 });
+
+    IndexMemoryStats stats = server.GetMemoryStats(3);
+    ASSERT_EQUAL(stats.document_count, 4u);
+    //white cat fancy collar fluffy tail groomed dog expressive eyes
+    ASSERT_EQUAL(stats.term_count, 10u);
+    ASSERT_EQUAL(stats.live_term_count, 10u);
+    ASSERT_EQUAL(stats.posting_count, 4u + 3u + 4u + 3u);
+    ASSERT_EQUAL(stats.field_posting_count, 2u);
+    ASSERT_EQUAL(stats.max_posting_length, 3u);
+    ASSERT_EQUAL(stats.average_posting_length, 1.4);
+    const std::vector<std::pair<std::string_view, size_t>> longest = { { "cat"sv, 3 }, { "dog"sv, 2 }, { "tail"sv, 2 } };
+    assert(stats.longest_postings == longest);
+    ASSERT_EQUAL(server.GetMemoryStats(0).longest_postings.size(), 0u);
+    ASSERT_EQUAL(server.GetMemoryStats(100).longest_postings.size(), 10u);
+    assert(stats.term_bytes >= 10 * sizeof(std::string));
+    assert(stats.inverted_index_bytes > 0 && stats.forward_index_bytes > 0 && stats.document_bytes > 0);
+    assert(stats.position_bytes > 0 && stats.field_bytes > 0);
+    ASSERT_EQUAL(stats.total_bytes, stats.term_bytes + stats.inverted_index_bytes + stats.forward_index_bytes
+        + stats.document_bytes + stats.position_bytes + stats.field_bytes + stats.fuzzy_trie_bytes);
+    assert(stats.index_pool_bytes > 0);
+
+    //удаление уменьшает постинги, но слова остаются в словаре
+    server.RemoveDocument(4);
+    server.RemoveDocument(std::execution::par, 3);
+    stats = server.GetMemoryStats(1);
+    ASSERT_EQUAL(stats.document_count, 2u);
+    ASSERT_EQUAL(stats.term_count, 10u);
+    ASSERT_EQUAL(stats.live_term_count, 6u);
+    ASSERT_EQUAL(stats.posting_count, 7u);
+    ASSERT_EQUAL(stats.field_posting_count, 0u);
+    ASSERT_EQUAL(stats.longest_postings.size(), 1u);
+    ASSERT_EQUAL(stats.longest_postings[0].first, "cat"sv);
+    //без top_n словарь не проходится, а счётчики те же
+    stats = server.GetMemoryStats(0);
+    ASSERT_EQUAL(stats.live_term_count, 6u);
+    ASSERT_EQUAL(stats.max_posting_length, 0u);
+    ASSERT_EQUAL(stats.average_posting_length, 7.0 / 6.0);
+
+    //счётчики после UpdateDocument те же, что у индекса, построенного сразу с новым текстом
+    server.UpdateDocument(2, "fluffy dog with a long long tail"sv);
+    SearchServer rebuilt("and"s);
+    rebuilt.EnablePositionalIndex();
+    rebuilt.AddDocument(1, "white cat and fancy collar"sv, DocumentStatus::ACTUAL, { 8, -3 });
+    rebuilt.AddDocument(2, "fluffy dog with a long long tail"sv, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    const IndexMemoryStats updated = server.GetMemoryStats();
+    const IndexMemoryStats expected = rebuilt.GetMemoryStats();
+    ASSERT_EQUAL(updated.posting_count, expected.posting_count);
+    ASSERT_EQUAL(updated.live_term_count, expected.live_term_count);
+    ASSERT_EQUAL(updated.forward_index_bytes, expected.forward_index_bytes);
+    assert(updated.longest_postings == expected.longest_postings);
+
+    //бор нечёткого поиска растёт, когда он включён
+    const size_t empty_trie_bytes = updated.fuzzy_trie_bytes;
+    server.SetFuzzyMaxEdits(1);
+    assert(server.GetMemoryStats().fuzzy_trie_bytes > empty_trie_bytes);
+}
+
+//=========================================================================================
+void TestTermTiers() {
+    //cat - во всех документах, dog - в половине, остальные слова редкие
+    SearchServer server("and"s);
+    const std::vector<std::string> texts = {
+        "cat dog fluffy"s, "cat dog collar"s, "cat dog tail"s, "cat dog eyes"s,
+        "cat fluffy tail"s, "cat white collar"s, "cat groomed"s, "cat"s,
+    };
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id });
+    }
+    const std::vector<Document> plain_result = server.FindTopDocuments("cat fluffy"s);
+
+    //ln(8 / 4) < 1: горячие cat и dog
+    server.SetTermTiers({ .dense_max_idf = 1.0, .stop_max_idf = std::nullopt });
+    IndexMemoryStats stats = server.GetMemoryStats();
+    ASSERT_EQUAL(stats.dense_term_count, 2u);
+    ASSERT_EQUAL(stats.dense_posting_count, 12u);
+    assert(stats.dense_bitmap_bytes > 0);
+    ASSERT_EQUAL(stats.dynamic_stop_word_count, 0u);
+    ASSERT_EQUAL(server.FindTopDocuments("cat AND dog AND NOT tail"s).size(), 3u);
+    ASSERT_EQUAL(server.FindTopDocuments("fluffy collar -dog"s).size(), 2u);
+
+    //динамические стоп-слова: cat (IDF 0) отбрасывается, если в запросе есть другие слова
+    server.SetTermTiers({ .dense_max_idf = 1.0, .stop_max_idf = 0.5 });
+    ASSERT_EQUAL(server.GetMemoryStats().dynamic_stop_word_count, 1u);
+    std::vector<Document> result = server.FindTopDocuments("cat fluffy"s);
+    ASSERT_EQUAL(result.size(), 2u);
+    ASSERT_EQUAL(result.size(), server.FindTopDocuments("fluffy"s).size());
+    for (size_t i = 0; i < result.size(); ++i) {
+        ASSERT_EQUAL(result[i].id, plain_result[i].id);
+    }
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 5u);
+    ASSERT_EQUAL(server.FindTopDocuments("fluffy -cat"s).size(), 0u);
+    ASSERT_EQUAL(server.FindTopDocuments("cat AND groomed"s).size(), 1u);
+    const auto [matched_words, status] = server.MatchDocument("cat fluffy"s, 7);
+    ASSERT_EQUAL(matched_words.size(), 0u);
+    ASSERT_EQUAL(std::get<0>(server.MatchDocument("cat"s, 7)).size(), 1u);
+
+    //dog уходит в холодные, когда его документы удалены, - не сразу, а на половине порога
+    server.RemoveDocument(0);
+    server.RemoveDocument(std::execution::par, 1);
+    ASSERT_EQUAL(server.GetMemoryStats().dense_term_count, 2u);
+    server.UpdateDocument(2, "cat tail"sv);
+    stats = server.GetMemoryStats();
+    ASSERT_EQUAL(stats.dense_term_count, 1u);
+    ASSERT_EQUAL(stats.dense_posting_count, 6u);
+
+    try {
+        server.SetTermTiers({ .dense_max_idf = -1.0, .stop_max_idf = std::nullopt });
+        assert(false);
+    }
+    catch (const std::invalid_argument&) {
+    }
+
+    //документ с огромным id не раздувает карту горячего слова - слово уходит в холодные
+    const size_t bitmap_bytes = server.GetMemoryStats().dense_bitmap_bytes;
+    server.AddDocument(2'000'000'000, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    stats = server.GetMemoryStats();
+    assert(stats.dense_bitmap_bytes <= bitmap_bytes);
+    ASSERT_EQUAL(stats.dense_term_count, 0u);
+    ASSERT_EQUAL(server.FindTopDocuments("eyes tail -cat"s).size(), 0u);
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s, [](int id, DocumentStatus, int) { return id > 1000; }).size(), 1u);
+    server.RemoveDocument(2'000'000'000);
+
+    //огромный id другого слова не мешает переклассификации: карта cat доходит только до его id
+    SearchServer spread("and"s);
+    for (int id = 0; id < 4; ++id) {
+        spread.AddDocument(id, id == 0 ? "cat dog"s : "cat"s, DocumentStatus::ACTUAL, { id });
+    }
+    spread.SetTermTiers({ .dense_max_idf = 1.0, .stop_max_idf = std::nullopt });
+    ASSERT_EQUAL(spread.GetMemoryStats().dense_term_count, 1u);
+    spread.AddDocument(2'000'000'000, "mouse"s, DocumentStatus::ACTUAL, { 1 });
+    //восьмой документ удваивает число документов, и UpdateTermTiers классифицирует все слова заново
+    for (int id = 4; id < 7; ++id) {
+        spread.AddDocument(id, "cat"s, DocumentStatus::ACTUAL, { id });
+    }
+    stats = spread.GetMemoryStats();
+    ASSERT_EQUAL(stats.dense_term_count, 1u);
+    ASSERT_EQUAL(stats.dense_posting_count, 7u);
+    ASSERT_EQUAL(spread.FindTopDocuments("cat -dog"s, [](int id, DocumentStatus, int) { return id < 3; }).size(), 2u);
+
+    //карты горячих слов не меняют результатов: сверка с сервером без уровней при добавлениях,
+    //изменениях и удалениях
+    std::mt19937 generator(11);
+    const std::vector<std::string> words = { "a1"s, "b2"s, "c3"s, "d4"s, "e5"s, "f6"s, "g7"s, "h8"s };
+    SearchServer plain(""s);
+    SearchServer tiered(""s);
+    tiered.SetTermTiers({});
+    const auto make_text = [&generator, &words] {
+        std::string text;
+        for (int i = 0; i < 4; ++i) {
+            //первые слова намного частее остальных
+            text += words[std::min(generator() % words.size(), generator() % words.size())] + ' ';
+        }
+        text += "z"s;
+        return text;
+    };
+    const std::vector<std::string> queries = {
+        "a1 AND b2"s, "a1 AND NOT b2"s, "(a1 OR c3) AND b2 AND NOT d4"s, "NOT a1"s, "h8 AND a1"s,
+        "c3 d4 -a1"s, "h8 -b2"s, "g7 e5 -a1 -c3"s,
+    };
+    for (int step = 0; step < 300; ++step) {
+        const int id = static_cast<int>(generator() % 120);
+        const unsigned action = generator() % 4;
+        if (plain.GetDocumentCount() > 0 && action == 0 && std::find(plain.begin(), plain.end(), id) != plain.end()) {
+            plain.RemoveDocument(id);
+            tiered.RemoveDocument(id);
+        }
+        else if (action == 1 && std::find(plain.begin(), plain.end(), id) != plain.end()) {
+            const std::string text = make_text();
+            plain.UpdateDocument(id, text);
+            tiered.UpdateDocument(id, text);
+        }
+        else if (std::find(plain.begin(), plain.end(), id) == plain.end()) {
+            const std::string text = make_text();
+            plain.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+            tiered.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        }
+        if (step % 25 != 0) {
+            continue;
+        }
+        for (const std::string& query : queries) {
+            const auto all = [](int, DocumentStatus, int) { return true; };
+            const std::vector<Document> expected = plain.FindTopDocuments(query, all);
+            const std::vector<Document> actual = tiered.FindTopDocuments(query, all);
+            ASSERT_EQUAL_HINT(actual.size(), expected.size(), query);
+            for (size_t i = 0; i < actual.size(); ++i) {
+                ASSERT_EQUAL_HINT(actual[i].id, expected[i].id, query);
+            }
+        }
+    }
+    assert(tiered.GetMemoryStats().dense_term_count > 0);
+}
+
+//=========================================================================================
+void TestNumaSearchServer() {
+    assert((ParseCpuList("0-3,8,10-11\n"sv) == std::vector<int>{ 0, 1, 2, 3, 8, 10, 11 }));
+    assert(ParseCpuList(""sv).empty());
+
+    const std::vector<NumaNode> nodes = GetNumaNodes();
+    assert(!nodes.empty());
+    for (const NumaNode& node : nodes) {
+        assert(!node.cpus.empty());
+    }
+    //закрепление за всеми процессорами первого узла должно удаваться и без прав администратора
+    std::thread([&nodes] { assert(PinCurrentThread(nodes[0].cpus)); }).join();
+
+    const std::vector<std::string> documents = {
+        "white cat and fancy collar"s, "fluffy cat fluffy tail"s, "groomed dog expressive eyes"s,
+        "groomed starling eugene"s, "fluffy dog and cat"s,
+    };
+    const auto build = [&documents](SearchServer& replica) {
+        for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+            replica.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { id });
+        }
+    };
+    SearchServer server("and"s);
+    build(server);
+    std::vector<std::string> queries;
+    for (int i = 0; i < 100; ++i) {
+        queries.push_back(std::vector<std::string>{ "fluffy cat"s, "groomed -dog"s, "eyes collar"s, "nobody"s }[i % 4]);
+    }
+    const std::vector<std::vector<Document>> expected = ProcessQueries(server, queries);
+
+    //потоков больше, чем процессоров, - несколько на одном ядре
+    NumaSearchServer numa_server("and"s, build, { .max_nodes = 1, .workers_per_node = 3, .pin_workers = true, .limits = {} });
+    ASSERT_EQUAL(numa_server.GetNodeCount(), 1u);
+    ASSERT_EQUAL(numa_server.GetWorkerCount(), 3u);
+    ASSERT_EQUAL(numa_server.GetReplica(0).GetDocumentCount(), 5);
+    for (int round = 0; round < 3; ++round) {
+        const std::vector<std::vector<Document>> results = numa_server.ProcessQueries(queries);
+        ASSERT_EQUAL(results.size(), expected.size());
+        for (size_t i = 0; i < results.size(); ++i) {
+            ASSERT_EQUAL(results[i].size(), expected[i].size());
+            for (size_t j = 0; j < results[i].size(); ++j) {
+                ASSERT_EQUAL(results[i][j].id, expected[i][j].id);
+            }
+        }
+    }
+    ASSERT_EQUAL(numa_server.ProcessQueries({}).size(), 0u);
+
+    //ошибка запроса доходит до вызывающего, пул после неё работает
+    try {
+        numa_server.ProcessQueries({ "cat"s, "--cat"s, "dog"s });
+        assert(false);
+    }
+    catch (const std::invalid_argument&) {
+    }
+    ASSERT_EQUAL(numa_server.ProcessQueries({ "cat"s }).at(0).size(), 3u);
+
+    //все узлы машины, без закрепления потоков
+    NumaSearchServer all_nodes("and"s, build, { .max_nodes = 0, .workers_per_node = 0, .pin_workers = false, .limits = {} });
+    ASSERT_EQUAL(all_nodes.GetNodeCount(), nodes.size());
+    ASSERT_EQUAL(all_nodes.ProcessQueries(queries).size(), queries.size());
+}
+
+//=========================================================================================
+void TestQueryBudgets() {
+    //cat - в 8 документах, dog - в 4, fluffy - в 2, groomed - в одном
+    SearchServer server("and"s);
+    server.EnablePositionalIndex();
+    const std::vector<std::string> texts = {
+        "cat dog fluffy"s, "cat dog collar"s, "cat dog tail"s, "cat dog eyes"s,
+        "cat fluffy tail"s, "cat white collar"s, "cat groomed"s, "cat"s,
+    };
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id });
+    }
+    const std::string query = "cat dog fluffy groomed"s;
+
+    //без ограничений - та же выдача, что у FindTopDocuments
+    BudgetedSearchResult result = server.FindTopDocumentsWithBudget(query, DocumentStatus::ACTUAL, {});
+    const std::vector<Document> expected = server.FindTopDocuments(query);
+    assert(!result.is_truncated);
+    ASSERT_EQUAL(result.postings_scanned, 15u);
+    ASSERT_EQUAL(result.documents.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQUAL(result.documents[i].id, expected[i].id);
+    }
+
+    //в 7 постингов помещаются groomed, fluffy и dog, но не cat
+    result = server.FindTopDocumentsWithBudget(query, DocumentStatus::ACTUAL, { .max_postings = 7, .deadline = std::nullopt });
+    assert(result.is_truncated);
+    ASSERT_EQUAL(result.postings_scanned, 7u);
+    ASSERT_EQUAL(result.documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    ASSERT_EQUAL(result.documents[0].id, 6);
+    for (const Document& document : result.documents) {
+        //документы только с cat не найдены
+        assert(document.id != 5 && document.id != 7);
+    }
+
+    //обрезка по числу постингов детерминирована
+    const BudgetedSearchResult repeated = server.FindTopDocumentsWithBudget(query, DocumentStatus::ACTUAL, { .max_postings = 7, .deadline = std::nullopt });
+    ASSERT_EQUAL(repeated.documents.size(), result.documents.size());
+    for (size_t i = 0; i < result.documents.size(); ++i) {
+        ASSERT_EQUAL(repeated.documents[i].id, result.documents[i].id);
+        ASSERT_EQUAL(repeated.documents[i].relevance, result.documents[i].relevance);
+    }
+
+    //минус-слова применяются, даже если на них бюджета нет
+    result = server.FindTopDocumentsWithBudget("fluffy dog -cat"s, DocumentStatus::ACTUAL, { .max_postings = 6, .deadline = std::nullopt });
+    assert(!result.is_truncated);
+    assert(result.documents.empty());
+    result = server.FindTopDocumentsWithBudget("fluffy groomed cat -tail"s, DocumentStatus::ACTUAL, { .max_postings = 3, .deadline = std::nullopt });
+    assert(result.is_truncated);
+    ASSERT_EQUAL(result.documents.size(), 2u);
+
+    //слишком частое первое слово - пустая приблизительная выдача
+    result = server.FindTopDocumentsWithBudget("cat"s, DocumentStatus::ACTUAL, { .max_postings = 5, .deadline = std::nullopt });
+    assert(result.is_truncated);
+    assert(result.documents.empty());
+    ASSERT_EQUAL(result.postings_scanned, 0u);
+
+    //срок уже истёк
+    result = server.FindTopDocumentsWithBudget(query, DocumentStatus::ACTUAL,
+        { .max_postings = 0, .deadline = std::chrono::steady_clock::now() - std::chrono::seconds(1) });
+    assert(result.is_truncated);
+    assert(result.documents.empty());
+
+    //предикат и своя функция ранжирования
+    result = server.FindTopDocumentsWithBudget(query,
+        [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; },
+        Bm25Scorer{}, { .max_postings = 7, .deadline = std::nullopt });
+    assert(result.is_truncated);
+    for (const Document& document : result.documents) {
+        ASSERT_EQUAL(document.id % 2, 0);
+    }
+    ASSERT_EQUAL(result.documents.size(), 4u);
+
+    //булев запрос выполняется целиком, если постинги всех его слов помещаются в бюджет
+    result = server.FindTopDocumentsWithBudget("cat AND dog"s, DocumentStatus::ACTUAL, { .max_postings = 11, .deadline = std::nullopt });
+    assert(result.is_truncated);
+    assert(result.documents.empty());
+    result = server.FindTopDocumentsWithBudget("cat AND dog"s, DocumentStatus::ACTUAL, { .max_postings = 12, .deadline = std::nullopt });
+    assert(!result.is_truncated);
+    ASSERT_EQUAL(result.postings_scanned, 12u);
+    ASSERT_EQUAL(result.documents.size(), 4u);
+
+    //фраза стоит постингов всех своих слов
+    result = server.FindTopDocumentsWithBudget("\"cat dog\""s, DocumentStatus::ACTUAL, { .max_postings = 11, .deadline = std::nullopt });
+    assert(result.is_truncated);
+    assert(result.documents.empty());
+    result = server.FindTopDocumentsWithBudget("\"cat dog\" groomed"s, DocumentStatus::ACTUAL, { .max_postings = 13, .deadline = std::nullopt });
+    assert(!result.is_truncated);
+    ASSERT_EQUAL(result.documents.size(), 5u);
+
+    //постраничная выдача с бюджетом - те же документы, что у FindTopDocumentsWithBudget
+    PageRequest page;
+    page.budget.max_postings = 7;
+    const SearchPage budgeted_page = server.FindPage(query, DocumentStatus::ACTUAL, page);
+    assert(budgeted_page.is_truncated);
+    result = server.FindTopDocumentsWithBudget(query, DocumentStatus::ACTUAL, page.budget);
+    ASSERT_EQUAL(budgeted_page.documents.size(), result.documents.size());
+    for (size_t i = 0; i < result.documents.size(); ++i) {
+        ASSERT_EQUAL(budgeted_page.documents[i].id, result.documents[i].id);
+    }
+    assert(!server.FindPage(query, DocumentStatus::ACTUAL, PageRequest{}).is_truncated);
+
+    //бюджет сервисов поверх SearchServer
+    const QueryLimits limits{ .max_postings = 7, .timeout = std::chrono::microseconds(0) };
+    result = server.FindTopDocumentsWithBudget(query, DocumentStatus::ACTUAL, limits.MakeBudget(std::chrono::steady_clock::now()));
+    const auto check_ids = [&result](const std::vector<Document>& documents) {
+        ASSERT_EQUAL(documents.size(), result.documents.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            ASSERT_EQUAL(documents[i].id, result.documents[i].id);
+        }
+    };
+    {
+        AsyncSearchServer::Options options;
+        options.limits = limits;
+        AsyncSearchServer async_server(server, options);
+        check_ids(async_server.FindTopDocumentsAsync(query).get());
+        ASSERT_EQUAL(async_server.GetCounters().truncated, 1u);
+    }
+    {
+        HttpRequest request;
+        ParseHttpRequest("GET /search?query=cat+dog+fluffy+groomed&max_postings=7 HTTP/1.1\r\n\r\n"sv, request);
+        std::string response;
+        HandleHttpRequest(server, request, response);
+        assert(response.find("\"truncated\":true"s) != std::string::npos);
+        assert(response.find("\"id\":7"s) == std::string::npos);
+        response.clear();
+        ParseHttpRequest("GET /search?query=cat+dog+fluffy+groomed&timeout_ms=1000 HTTP/1.1\r\n\r\n"sv, request);
+        HandleHttpRequest(server, request, response);
+        assert(response.find("\"truncated\":false"s) != std::string::npos);
+        response.clear();
+        ParseHttpRequest("GET /search?query=cat HTTP/1.1\r\n\r\n"sv, request);
+        HandleHttpRequest(server, request, response);
+        assert(response.find("truncated"s) == std::string::npos);
+    }
+    {
+        NumaSearchServer numa_server("and"s, [&texts](SearchServer& replica) {
+            replica.EnablePositionalIndex();
+            for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+                replica.AddDocument(id, texts[id], DocumentStatus::ACTUAL, { id });
+            }
+        }, { .max_nodes = 1, .workers_per_node = 1, .pin_workers = false, .limits = limits });
+        check_ids(numa_server.ProcessQueries({ query })[0]);
+    }
+}
+
 //=========================================================================================
 void PrintMatchDocumentResultUTest(int document_id, const std::vector<std::string_view>& words,
     DocumentStatus status) {
@@ -326,6 +2378,30 @@ void TestSearchServer() {
     TestStatusFiltering();
     TestPredicateFiltering();
     TestDublicates();
+    TestMatchDocumentsBatch();
+    TestMatchDocumentLongQuery();
+    TestProfilingHistogram();
+    TestRequestQueue();
+    TestRequestStatisticsWindows();
+    TestLoadDocuments();
+    TestPhraseQueries();
+    TestBm25Ranking();
+    TestWildcardQueries();
+    TestFuzzyQueries();
+    TestShardedSearchServer();
+    TestAsyncSearchServer();
+    TestHttpService();
+    TestPagination();
+    TestWriteAheadLog();
+    TestUpdateDocument();
+    TestQueryArena();
+    TestBooleanQueries();
+    TestDocumentFields();
+    TestTextAnalyzer();
+    TestMemoryStats();
+    TestTermTiers();
+    TestNumaSearchServer();
+    TestQueryBudgets();
 
     cout << "tests.h: All old tests OK"s << endl;
 
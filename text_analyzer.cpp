@@ -0,0 +1,349 @@
+#include "text_analyzer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+enum class CharClass : uint8_t {
+    SPACE,
+    PUNCTUATION,
+    JOINER,     // дефис и апостроф: внутри слова - его часть, по краям - разделитель
+    WILDCARD,   // '*' и '?': в шаблоне - часть слова, иначе пунктуация
+    WORD,
+};
+
+struct AsciiTables {
+    array<CharClass, 128> classes{};
+    array<char, 128> lower{};
+
+    constexpr AsciiTables() {
+        for (int c = 0; c < 128; ++c) {
+            lower[c] = static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+            if (c <= ' ' || c == 0x7F) {
+                classes[c] = CharClass::SPACE;
+            }
+            else if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+                classes[c] = CharClass::WORD;
+            }
+            else if (c == '-' || c == '\'') {
+                classes[c] = CharClass::JOINER;
+            }
+            else if (c == '*' || c == '?') {
+                classes[c] = CharClass::WILDCARD;
+            }
+            else {
+                classes[c] = CharClass::PUNCTUATION;
+            }
+        }
+    }
+};
+
+constexpr AsciiTables ASCII_TABLES;
+
+constexpr char32_t INVALID_CHAR = 0xFFFFFFFF;
+
+//символ UTF-8 с позиции pos и его длина; некорректная последовательность - INVALID_CHAR длиной 1.
+//Некорректны и избыточно длинные формы, суррогаты и символы после U+10FFFF
+pair<char32_t, size_t> DecodeChar(string_view text, size_t pos) {
+    const unsigned char lead = static_cast<unsigned char>(text[pos]);
+    const size_t length = lead >= 0xF0 && lead <= 0xF4 ? 4 : lead >= 0xE0 && lead <= 0xEF ? 3 : lead >= 0xC2 && lead <= 0xDF ? 2 : 0;
+    if (length == 0 || pos + length > text.size()) {
+        return { INVALID_CHAR, 1 };
+    }
+    //допустимый второй байт: E0 и F0 отсекают избыточные формы, ED - суррогаты, F4 - всё выше U+10FFFF
+    const unsigned char second_min = lead == 0xE0 ? 0xA0 : lead == 0xF0 ? 0x90 : 0x80;
+    const unsigned char second_max = lead == 0xED ? 0x9F : lead == 0xF4 ? 0x8F : 0xBF;
+    char32_t c = lead & (0xFF >> (length + 1));
+    for (size_t i = 1; i < length; ++i) {
+        const unsigned char byte = static_cast<unsigned char>(text[pos + i]);
+        if ((byte & 0xC0) != 0x80 || (i == 1 && (byte < second_min || byte > second_max))) {
+            return { INVALID_CHAR, 1 };
+        }
+        c = (c << 6) | (byte & 0x3F);
+    }
+    return { c, length };
+}
+
+template <typename String>
+void AppendUtf8(char32_t c, String& out) {
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    }
+    else if (c < 0x800) {
+        out += static_cast<char>(0xC0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000) {
+        out += static_cast<char>(0xE0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+    else {
+        out += static_cast<char>(0xF0 | (c >> 18));
+        out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+}
+
+//класс не-ASCII символа: пробелы и пунктуация Latin-1, General Punctuation, CJK и полноширинных форм
+CharClass ClassifyChar(char32_t c) {
+    if (c < 0xA0 || c == 0x1680 || (c >= 0x2000 && c <= 0x200B) || c == 0x2028 || c == 0x2029
+        || c == 0x202F || c == 0x205F || c == 0x3000 || c == 0xFEFF) {
+        return CharClass::SPACE;
+    }
+    if (c == 0x2010 || c == 0x2011 || c == 0x2019) {
+        return CharClass::JOINER;
+    }
+    if ((c <= 0xBF && c != 0xAA && c != 0xB2 && c != 0xB3 && c != 0xB5 && c != 0xB9 && c != 0xBA)
+        || c == 0xD7 || c == 0xF7
+        || (c >= 0x2012 && c <= 0x2027) || (c >= 0x2030 && c <= 0x205E)
+        || (c >= 0x2E00 && c <= 0x2E7F) || (c >= 0x3001 && c <= 0x303F)
+        || (c >= 0xFF01 && c <= 0xFF0F) || (c >= 0xFF1A && c <= 0xFF20)
+        || (c >= 0xFF3B && c <= 0xFF40) || (c >= 0xFF5B && c <= 0xFF65)) {
+        return CharClass::PUNCTUATION;
+    }
+    return CharClass::WORD;
+}
+
+char32_t FoldCase(char32_t c) {
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7) {
+        return c + 0x20;
+    }
+    if (c >= 0x100 && c <= 0x17F) {
+        if (c == 0x130) {
+            return 'i';
+        }
+        if (c == 0x178) {
+            return 0xFF;
+        }
+        const bool even_upper = c <= 0x137 || (c >= 0x14A && c <= 0x177);
+        const bool odd_upper = (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E);
+        return (even_upper && c % 2 == 0) || (odd_upper && c % 2 == 1) ? c + 1 : c;
+    }
+    if (c >= 0x386 && c <= 0x3A9) {
+        if (c >= 0x391 && c != 0x3A2) {
+            return c + 0x20;
+        }
+        switch (c) {
+        case 0x386: return 0x3AC;
+        case 0x388: case 0x389: case 0x38A: return c + 0x25;
+        case 0x38C: return 0x3CC;
+        case 0x38E: case 0x38F: return c + 0x3F;
+        }
+        return c;
+    }
+    if (c == 0x3C2) {
+        return 0x3C3;   //конечная сигма
+    }
+    if (c >= 0x400 && c <= 0x4BF) {
+        if (c == 0x401 || c == 0x451) {
+            return 0x435;   //ё -> е
+        }
+        if (c < 0x410) {
+            return c + 0x50;
+        }
+        if (c < 0x430) {
+            return c + 0x20;
+        }
+        if (c >= 0x460 && c % 2 == 0 && (c < 0x482 || c >= 0x48A)) {
+            return c + 1;
+        }
+    }
+    return c;
+}
+
+//окончания для русского стемминга, от длинных к коротким: отсекается самое длинное подходящее
+constexpr string_view RUSSIAN_ENDINGS[] = {
+    "иями"sv,
+    "ями"sv, "ами"sv, "ого"sv, "его"sv, "ому"sv, "ему"sv, "ыми"sv, "ими"sv, "ией"sv, "иях"sv,
+    "ать"sv, "ять"sv, "ить"sv, "еть"sv, "ешь"sv, "ете"sv, "ишь"sv, "ите"sv, "ают"sv, "яют"sv, "ует"sv, "уют"sv,
+    "ая"sv, "яя"sv, "ое"sv, "ее"sv, "ые"sv, "ие"sv, "ый"sv, "ий"sv, "ой"sv, "ей"sv, "ом"sv, "ем"sv,
+    "ам"sv, "ям"sv, "ах"sv, "ях"sv, "ов"sv, "ев"sv, "ую"sv, "юю"sv, "ия"sv, "ию"sv, "ии"sv,
+    "ит"sv, "ет"sv, "ут"sv, "ют"sv, "ат"sv, "ят"sv, "ал"sv, "ил"sv, "ла"sv, "ло"sv, "ли"sv, "ть"sv,
+    "а"sv, "я"sv, "о"sv, "е"sv, "ы"sv, "и"sv, "у"sv, "ю"sv, "ь"sv, "й"sv,
+};
+//основа после отсечения - не короче стольких символов
+constexpr size_t MIN_STEM_CHARS = 2;
+constexpr size_t MIN_ENGLISH_STEM = 3;
+
+} // namespace
+
+TextAnalyzer::TextAnalyzer(AnalyzerOptions options)
+    : options_(options)
+{}
+
+size_t TextAnalyzer::GetStemLength(string_view word) {
+    const auto ends_with = [&word](string_view suffix) {
+        return word.size() >= suffix.size() && word.substr(word.size() - suffix.size()) == suffix;
+    };
+    size_t last_char = word.size();
+    while (last_char > 0 && (static_cast<unsigned char>(word[last_char - 1]) & 0xC0) == 0x80) {
+        --last_char;
+    }
+    if (last_char == 0) {
+        return word.size();
+    }
+    const unsigned char last_lead = static_cast<unsigned char>(word[last_char - 1]);
+    if (last_lead == 0xD0 || last_lead == 0xD1) {
+        for (const string_view ending : RUSSIAN_ENDINGS) {
+            if (!ends_with(ending)) {
+                continue;
+            }
+            const size_t stem_length = word.size() - ending.size();
+            const size_t stem_chars = count_if(word.begin(), word.begin() + stem_length,
+                [](char c) { return (static_cast<unsigned char>(c) & 0xC0) != 0x80; });
+            if (stem_chars >= MIN_STEM_CHARS) {
+                return stem_length;
+            }
+        }
+        return word.size();
+    }
+    if (!all_of(word.begin(), word.end(), [](char c) { return c >= 'a' && c <= 'z'; })) {
+        return word.size();
+    }
+    //английские слова: множественное число (шаг 1a Портера), затем -ing и -ed
+    size_t length = word.size();
+    if (ends_with("sses"sv) || ends_with("ies"sv)) {
+        length -= 2;
+    }
+    else if (ends_with("s"sv) && !ends_with("ss"sv) && !ends_with("us"sv) && !ends_with("is"sv) && length > MIN_ENGLISH_STEM) {
+        length -= 1;
+    }
+    for (const string_view ending : { "ing"sv, "ed"sv }) {
+        const string_view stem = word.substr(0, length);
+        if (stem.size() >= ending.size() + MIN_ENGLISH_STEM && stem.substr(stem.size() - ending.size()) == ending
+            && stem.substr(0, stem.size() - ending.size()).find_first_of("aeiouy"sv) != stem.npos) {
+            length -= ending.size();
+            break;
+        }
+    }
+    return length;
+}
+
+template <typename String>
+void TextAnalyzer::NormalizeTo(string_view text, String& out, bool is_pattern) const {
+    const bool fold_case = options_.fold_case;
+    const bool strip_punctuation = options_.strip_punctuation;
+    const bool stem = options_.stem && !is_pattern;
+    bool need_space = !out.empty();
+    size_t word_begin = string_view::npos;
+    size_t pending_joiners = 0;   //дефисы в конце слова - отбрасываются, если за ними не будет букв
+
+    const auto begin_word = [&] {
+        if (word_begin == string_view::npos) {
+            if (need_space) {
+                out += ' ';
+            }
+            word_begin = out.size();
+            need_space = true;
+        }
+        pending_joiners = 0;
+    };
+    const auto end_word = [&] {
+        if (word_begin == string_view::npos) {
+            return;
+        }
+        out.resize(out.size() - pending_joiners);
+        if (stem) {
+            out.resize(word_begin + GetStemLength(string_view(out).substr(word_begin)));
+        }
+        word_begin = string_view::npos;
+        pending_joiners = 0;
+    };
+    //что делать с символом класса char_class, если он не буква
+    const auto resolve = [is_pattern, strip_punctuation](CharClass char_class) {
+        if (char_class == CharClass::WILDCARD) {
+            char_class = is_pattern ? CharClass::WORD : CharClass::PUNCTUATION;
+        }
+        if (!strip_punctuation && (char_class == CharClass::PUNCTUATION || char_class == CharClass::JOINER)) {
+            char_class = CharClass::WORD;
+        }
+        return char_class;
+    };
+    const auto add_ascii = [&](unsigned char c) {
+        switch (resolve(ASCII_TABLES.classes[c])) {
+        case CharClass::WORD:
+            begin_word();
+            out += fold_case ? ASCII_TABLES.lower[c] : static_cast<char>(c);
+            break;
+        case CharClass::JOINER:
+            if (word_begin != string_view::npos) {
+                out += static_cast<char>(c);
+                ++pending_joiners;
+            }
+            break;
+        default:
+            end_word();
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        //восемь байт без старшего бита - ASCII целиком, без проверки каждого байта на UTF-8
+        if (pos + 8 <= text.size()) {
+            uint64_t chunk;
+            memcpy(&chunk, text.data() + pos, sizeof(chunk));
+            if ((chunk & 0x8080808080808080ULL) == 0) {
+                for (const size_t end = pos + 8; pos < end; ++pos) {
+                    add_ascii(static_cast<unsigned char>(text[pos]));
+                }
+                continue;
+            }
+        }
+        const unsigned char byte = static_cast<unsigned char>(text[pos]);
+        if (byte < 0x80) {
+            add_ascii(byte);
+            ++pos;
+            continue;
+        }
+        const auto [c, length] = DecodeChar(text, pos);
+        const string_view original = text.substr(pos, length);
+        pos += length;
+        if (c == INVALID_CHAR) {
+            begin_word();
+            out += original;
+            continue;
+        }
+        switch (resolve(ClassifyChar(c))) {
+        case CharClass::WORD:
+            begin_word();
+            if (fold_case) {
+                AppendUtf8(FoldCase(c), out);
+            }
+            else {
+                out += original;
+            }
+            break;
+        case CharClass::JOINER:
+            if (word_begin != string_view::npos) {
+                out += c == 0x2019 ? '\'' : '-';
+                ++pending_joiners;
+            }
+            break;
+        default:
+            end_word();
+        }
+    }
+    end_word();
+}
+
+void TextAnalyzer::Normalize(string_view text, string& out, bool is_pattern) const {
+    NormalizeTo(text, out, is_pattern);
+}
+
+void TextAnalyzer::Normalize(string_view text, pmr::string& out, bool is_pattern) const {
+    NormalizeTo(text, out, is_pattern);
+}
+
+string TextAnalyzer::Normalize(string_view text) const {
+    string out;
+    out.reserve(text.size());
+    NormalizeTo(text, out, false);
+    return out;
+}
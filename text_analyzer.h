@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+// Нормализация текста перед индексацией, одна и та же для документов и слов запроса.
+//
+// Слова разделяются пробельными символами ASCII и Unicode (табуляция, перевод строки, неразрывный
+// пробел) и, если включено, пунктуацией. Дефис и апостроф внутри слова его не разрывают:
+// кто-то, don't; типографские ’ и ‐ заменяются на ASCII. Регистр сворачивается у латиницы
+// (с Latin-1 и Latin Extended-A), греческого и кириллицы, ё становится е. Стемминг - лёгкое
+// отсечение окончаний русских и английских слов, без словаря.
+//
+// ASCII разбирается по таблицам классов и нижнего регистра байт, а проверка, что следующие
+// 8 байт - ASCII, делается одним сравнением слова; декодируются только не-ASCII символы.
+// Некорректные байты UTF-8 остаются в слове как есть.
+//
+//   TextAnalyzer analyzer({ .stem = true });
+//   analyzer.Normalize("Пушистые КОШКИ, и ёжик!"sv) == "пушист кошк и ежик"s
+
+struct AnalyzerOptions {
+    bool fold_case = true;
+    bool strip_punctuation = true;  // false - разделяют только пробельные символы
+    bool stem = false;
+};
+
+class TextAnalyzer {
+public:
+    explicit TextAnalyzer(AnalyzerOptions options = {});
+
+    const AnalyzerOptions& GetOptions() const {
+        return options_;
+    }
+
+    // дописывает в out нормализованные слова text через один пробел, без пробелов по краям.
+    // is_pattern - шаблон запроса: '*' и '?' остаются частью слова, стемминга нет
+    void Normalize(std::string_view text, std::string& out, bool is_pattern = false) const;
+    void Normalize(std::string_view text, std::pmr::string& out, bool is_pattern = false) const;
+    std::string Normalize(std::string_view text) const;
+
+    // длина основы слова после отсечения окончания; слово уже в нижнем регистре
+    static size_t GetStemLength(std::string_view word);
+
+private:
+    AnalyzerOptions options_;
+
+    template <typename String>
+    void NormalizeTo(std::string_view text, String& out, bool is_pattern) const;
+};
@@ -0,0 +1,853 @@
+#include "write_ahead_log.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+//---- CRC-32C ----
+
+constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78; // отражённый многочлен Кастаньоли
+
+// таблицы для обработки по 8 байт за шаг (slice-by-8)
+constexpr array<array<uint32_t, 256>, 8> MakeCrc32cTables() {
+    array<array<uint32_t, 256>, 8> tables{};
+    for (uint32_t byte = 0; byte < 256; ++byte) {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+        tables[0][byte] = crc;
+    }
+    for (uint32_t byte = 0; byte < 256; ++byte) {
+        for (size_t slice = 1; slice < 8; ++slice) {
+            const uint32_t previous = tables[slice - 1][byte];
+            tables[slice][byte] = (previous >> 8) ^ tables[0][previous & 0xFF];
+        }
+    }
+    return tables;
+}
+
+constexpr array<array<uint32_t, 256>, 8> CRC32C_TABLES = MakeCrc32cTables();
+
+//---- формат файлов ----
+
+constexpr char LOG_MAGIC[8] = { 'S', 'S', 'W', 'A', 'L', '0', '1', '\n' };
+constexpr char SNAPSHOT_MAGIC[8] = { 'S', 'S', 'S', 'N', 'P', '0', '1', '\n' };
+// сигнатура и uint64 LSN: у журнала - номер первой записи, у снимка - последней учтённой
+constexpr size_t HEADER_SIZE = 16;
+// длина и контрольная сумма перед телом записи
+constexpr size_t FRAME_HEADER_SIZE = 8;
+// запись длиннее считается мусором, а не документом
+constexpr uint32_t MAX_RECORD_SIZE = 1u << 30;
+// журнал и снимок при восстановлении читаются такими кусками
+constexpr size_t REPLAY_CHUNK_SIZE = 1 << 20;
+
+template <typename T>
+void Put(string& out, T value) {
+    static_assert(is_trivially_copyable_v<T>);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+class Reader {
+public:
+    explicit Reader(string_view data)
+        : data_(data)
+    {}
+
+    template <typename T>
+    T Get() {
+        static_assert(is_trivially_copyable_v<T>);
+        T value;
+        memcpy(&value, Take(sizeof(T)).data(), sizeof(T));
+        return value;
+    }
+
+    string_view Take(size_t size) {
+        if (data_.size() < size) {
+            throw runtime_error("Malformed log record"s);
+        }
+        const string_view bytes = data_.substr(0, size);
+        data_.remove_prefix(size);
+        return bytes;
+    }
+
+private:
+    string_view data_;
+};
+
+void AppendRecord(string& out, const LogRecord& record, uint64_t lsn) {
+    const size_t frame_begin = out.size();
+    out.append(FRAME_HEADER_SIZE, '\0');
+    Put(out, lsn);
+    Put(out, record.type);
+    Put(out, static_cast<int32_t>(record.document_id));
+    const bool is_fielded = record.type == LogRecordType::ADD_FIELDED_DOCUMENT
+        || record.type == LogRecordType::UPDATE_FIELDED_DOCUMENT;
+    const bool is_add = record.type == LogRecordType::ADD_DOCUMENT || record.type == LogRecordType::ADD_FIELDED_DOCUMENT;
+    if (is_add || record.type == LogRecordType::SET_STATUS) {
+        Put(out, static_cast<uint8_t>(record.status));
+    }
+    if (is_add || record.type == LogRecordType::SET_RATINGS) {
+        Put(out, static_cast<uint32_t>(record.ratings.size()));
+        for (const int rating : record.ratings) {
+            Put(out, static_cast<int32_t>(rating));
+        }
+    }
+    const auto put_string = [&out](string_view text) {
+        Put(out, static_cast<uint32_t>(text.size()));
+        out.append(text);
+    };
+    if (is_fielded) {
+        Put(out, static_cast<uint32_t>(record.fields.size()));
+        for (const DocumentField& field : record.fields) {
+            put_string(field.name);
+            put_string(field.text);
+        }
+    }
+    else if (is_add || record.type == LogRecordType::UPDATE_DOCUMENT) {
+        put_string(record.text);
+    }
+    const string_view body = string_view(out).substr(frame_begin + FRAME_HEADER_SIZE);
+    const uint32_t size = static_cast<uint32_t>(body.size());
+    const uint32_t crc = Crc32c(body);
+    memcpy(out.data() + frame_begin, &size, sizeof(size));
+    memcpy(out.data() + frame_begin + sizeof(size), &crc, sizeof(crc));
+}
+
+void DecodeRecord(string_view body, LogRecord& record) {
+    Reader reader(body);
+    record.lsn = reader.Get<uint64_t>();
+    record.type = reader.Get<LogRecordType>();
+    record.document_id = reader.Get<int32_t>();
+    record.status = DocumentStatus::ACTUAL;
+    record.ratings.clear();
+    record.text = {};
+    record.fields.clear();
+    const auto read_ratings = [&reader, &record] {
+        record.ratings.resize(reader.Get<uint32_t>());
+        for (int& rating : record.ratings) {
+            rating = reader.Get<int32_t>();
+        }
+    };
+    const auto read_fields = [&reader, &record] {
+        record.fields.resize(reader.Get<uint32_t>());
+        for (DocumentField& field : record.fields) {
+            field.name = reader.Take(reader.Get<uint32_t>());
+            field.text = reader.Take(reader.Get<uint32_t>());
+        }
+    };
+    switch (record.type) {
+    case LogRecordType::ADD_DOCUMENT:
+        record.status = static_cast<DocumentStatus>(reader.Get<uint8_t>());
+        read_ratings();
+        record.text = reader.Take(reader.Get<uint32_t>());
+        break;
+    case LogRecordType::REMOVE_DOCUMENT:
+        break;
+    case LogRecordType::UPDATE_DOCUMENT:
+        record.text = reader.Take(reader.Get<uint32_t>());
+        break;
+    case LogRecordType::SET_STATUS:
+        record.status = static_cast<DocumentStatus>(reader.Get<uint8_t>());
+        break;
+    case LogRecordType::SET_RATINGS:
+        read_ratings();
+        break;
+    case LogRecordType::ADD_FIELDED_DOCUMENT:
+        record.status = static_cast<DocumentStatus>(reader.Get<uint8_t>());
+        read_ratings();
+        read_fields();
+        break;
+    case LogRecordType::UPDATE_FIELDED_DOCUMENT:
+        read_fields();
+        break;
+    default:
+        throw runtime_error("Unknown log record type "s + to_string(static_cast<int>(record.type)));
+    }
+}
+
+// вызывает handler(record, frame) для записей data начиная с offset до первой оборванной или
+// повреждённой; возвращает смещение конца последней целой записи. В required - сколько байт
+// от этого смещения нужно, чтобы дочитать оборванную запись; 0 - следующая запись повреждена
+template <typename Handler>
+size_t ParseFrames(string_view data, size_t offset, Handler handler, size_t& required) {
+    LogRecord record;
+    while (true) {
+        if (data.size() - offset < FRAME_HEADER_SIZE) {
+            required = FRAME_HEADER_SIZE;
+            return offset;
+        }
+        uint32_t size = 0;
+        uint32_t crc = 0;
+        memcpy(&size, data.data() + offset, sizeof(size));
+        memcpy(&crc, data.data() + offset + sizeof(size), sizeof(crc));
+        if (size > MAX_RECORD_SIZE) {
+            required = 0;
+            return offset;
+        }
+        if (size > data.size() - offset - FRAME_HEADER_SIZE) {
+            required = FRAME_HEADER_SIZE + size;
+            return offset;
+        }
+        const string_view body = data.substr(offset + FRAME_HEADER_SIZE, size);
+        if (Crc32c(body) != crc) {
+            required = 0;
+            return offset;
+        }
+        DecodeRecord(body, record);
+        handler(record, data.substr(offset, FRAME_HEADER_SIZE + size));
+        offset += FRAME_HEADER_SIZE + size;
+    }
+}
+
+// то же для файла, целиком прочитанного в data (с заголовком)
+template <typename Handler>
+size_t ParseRecords(string_view data, Handler handler) {
+    size_t required = 0;
+    return ParseFrames(data, HEADER_SIZE, handler, required);
+}
+
+string MakeHeader(const char (&magic)[8], uint64_t lsn) {
+    string header(magic, sizeof(magic));
+    Put(header, lsn);
+    return header;
+}
+
+// LSN из заголовка; бросает исключение, если это не файл нужного вида
+uint64_t CheckHeader(string_view data, const char (&magic)[8], const string& path) {
+    if (data.size() < HEADER_SIZE || data.substr(0, sizeof(magic)) != string_view(magic, sizeof(magic))) {
+        throw runtime_error(path + " is not a search server log or snapshot"s);
+    }
+    uint64_t lsn = 0;
+    memcpy(&lsn, data.data() + sizeof(magic), sizeof(lsn));
+    return lsn;
+}
+
+//---- файловые операции ----
+
+[[noreturn]] void ThrowSystemError(const string& what) {
+    throw system_error(errno, generic_category(), what);
+}
+
+void WriteAll(int fd, string_view data, const string& path) {
+    while (!data.empty()) {
+        const ssize_t written = ::write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("Write "s + path);
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+}
+
+void SyncData(int fd, const string& path) {
+    if (::fdatasync(fd) != 0) {
+        ThrowSystemError("fdatasync "s + path);
+    }
+}
+
+uint64_t GetFileSize(int fd, const string& path) {
+    struct stat file_stat {};
+    if (::fstat(fd, &file_stat) != 0) {
+        ThrowSystemError("Stat "s + path);
+    }
+    return static_cast<uint64_t>(file_stat.st_size);
+}
+
+// дописывает в out до size байт файла с offset; меньше - только если файл кончился
+void ReadAt(int fd, const string& path, uint64_t offset, size_t size, string& out) {
+    const size_t begin = out.size();
+    out.resize(begin + size);
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t received = ::pread(fd, out.data() + begin + done, size - done, static_cast<off_t>(offset + done));
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("Read "s + path);
+        }
+        if (received == 0) {
+            break;
+        }
+        done += static_cast<size_t>(received);
+    }
+    out.resize(begin + done);
+}
+
+string ReadAll(int fd, const string& path) {
+    string data;
+    ReadAt(fd, path, 0, static_cast<size_t>(GetFileSize(fd, path)), data);
+    return data;
+}
+
+// заголовок файла, не длиннее HEADER_SIZE
+string ReadHeader(int fd, const string& path) {
+    string header;
+    ReadAt(fd, path, 0, HEADER_SIZE, header);
+    return header;
+}
+
+// ParseRecords для файла, который читается кусками по REPLAY_CHUNK_SIZE: в памяти кусок
+// и недочитанная запись, а не весь журнал. Возвращает смещение конца последней целой записи
+template <typename Handler>
+uint64_t StreamRecords(int fd, const string& path, uint64_t file_size, Handler handler) {
+    string buffer;
+    uint64_t buffer_offset = HEADER_SIZE;   // где в файле начинается buffer
+    while (true) {
+        size_t required = 0;
+        const size_t parsed = ParseFrames(buffer, 0, handler, required);
+        const uint64_t read_end = buffer_offset + buffer.size();
+        if (required == 0 || read_end >= file_size) {
+            return buffer_offset + parsed;
+        }
+        buffer.erase(0, parsed);
+        buffer_offset += parsed;
+        const size_t wanted = max(REPLAY_CHUNK_SIZE, required - buffer.size());
+        const size_t old_size = buffer.size();
+        ReadAt(fd, path, read_end, static_cast<size_t>(min<uint64_t>(wanted, file_size - read_end)), buffer);
+        if (buffer.size() == old_size) {
+            return buffer_offset; //файл укоротили во время чтения
+        }
+    }
+}
+
+// false - файла нет
+bool ReadFile(const string& path, string& data) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return false;
+        }
+        ThrowSystemError("Open "s + path);
+    }
+    try {
+        data = ReadAll(fd, path);
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    return true;
+}
+
+// пишет файл рядом и переименовывает: после сбоя на диске либо старый файл, либо новый целиком
+void WriteFileAtomically(const string& path, const vector<string_view>& parts) {
+    const string temporary_path = path + ".tmp"s;
+    const int fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ThrowSystemError("Create "s + temporary_path);
+    }
+    try {
+        for (const string_view part : parts) {
+            WriteAll(fd, part, temporary_path);
+        }
+        if (::fsync(fd) != 0) {
+            ThrowSystemError("fsync "s + temporary_path);
+        }
+    }
+    catch (...) {
+        ::close(fd);
+        ::unlink(temporary_path.c_str());
+        throw;
+    }
+    ::close(fd);
+    if (::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        ThrowSystemError("Rename "s + temporary_path);
+    }
+    //переименование сохранится только вместе с каталогом
+    const string directory = filesystem::path(path).parent_path().string();
+    const int directory_fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd >= 0) {
+        ::fsync(directory_fd);
+        ::close(directory_fd);
+    }
+}
+
+} // namespace
+
+uint32_t Crc32c(string_view data, uint32_t crc) {
+    crc = ~crc;
+    const char* position = data.data();
+    size_t size = data.size();
+#if defined(__SSE4_2__)
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, position += 8) {
+        uint64_t word;
+        memcpy(&word, position, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; --size, ++position) {
+        crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*position));
+    }
+#else
+    if constexpr (endian::native == endian::little) {
+        for (; size >= 8; size -= 8, position += 8) {
+            uint64_t word;
+            memcpy(&word, position, sizeof(word));
+            word ^= crc;
+            crc = CRC32C_TABLES[7][word & 0xFF] ^ CRC32C_TABLES[6][(word >> 8) & 0xFF]
+                ^ CRC32C_TABLES[5][(word >> 16) & 0xFF] ^ CRC32C_TABLES[4][(word >> 24) & 0xFF]
+                ^ CRC32C_TABLES[3][(word >> 32) & 0xFF] ^ CRC32C_TABLES[2][(word >> 40) & 0xFF]
+                ^ CRC32C_TABLES[1][(word >> 48) & 0xFF] ^ CRC32C_TABLES[0][word >> 56];
+        }
+    }
+    for (; size > 0; --size, ++position) {
+        crc = CRC32C_TABLES[0][(crc ^ static_cast<uint8_t>(*position)) & 0xFF] ^ (crc >> 8);
+    }
+#endif
+    return ~crc;
+}
+
+void ApplyLogRecord(SearchServer& server, const LogRecord& record) {
+    switch (record.type) {
+    case LogRecordType::ADD_DOCUMENT:
+        server.AddDocument(record.document_id, record.text, record.status, record.ratings);
+        break;
+    case LogRecordType::REMOVE_DOCUMENT:
+        server.RemoveDocument(record.document_id);
+        break;
+    case LogRecordType::UPDATE_DOCUMENT:
+        server.UpdateDocument(record.document_id, record.text);
+        break;
+    case LogRecordType::SET_STATUS:
+        server.SetStatus(record.document_id, record.status);
+        break;
+    case LogRecordType::SET_RATINGS:
+        server.SetRatings(record.document_id, record.ratings);
+        break;
+    case LogRecordType::ADD_FIELDED_DOCUMENT:
+        server.AddDocument(record.document_id, record.fields, record.status, record.ratings);
+        break;
+    case LogRecordType::UPDATE_FIELDED_DOCUMENT:
+        server.UpdateDocument(record.document_id, record.fields);
+        break;
+    }
+}
+
+//==================== WriteAheadLog ====================
+
+WriteAheadLog::WriteAheadLog(const string& path)
+    : WriteAheadLog(path, Options{})
+{}
+
+WriteAheadLog::WriteAheadLog(const string& path, Options options, const ReplayHandler& replay)
+    : path_(path)
+    , options_(options)
+{
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        ThrowSystemError("Open "s + path);
+    }
+    try {
+        const uint64_t file_size = GetFileSize(fd_, path_);
+        if (file_size < HEADER_SIZE) {
+            //новый журнал или сбой до того, как заголовок был дописан
+            if (::ftruncate(fd_, 0) != 0) {
+                ThrowSystemError("Truncate "s + path_);
+            }
+            WriteAll(fd_, MakeHeader(LOG_MAGIC, 1), path_);
+            SyncData(fd_, path_);
+        }
+        else {
+            const uint64_t first_lsn = CheckHeader(ReadHeader(fd_, path_), LOG_MAGIC, path_);
+            uint64_t last_lsn = first_lsn - 1;
+            const uint64_t valid_size = StreamRecords(fd_, path_, file_size, [&](const LogRecord& record, string_view) {
+                last_lsn = record.lsn;
+                if (replay) {
+                    replay(record);
+                }
+            });
+            if (valid_size < file_size) {
+                if (::ftruncate(fd_, static_cast<off_t>(valid_size)) != 0) {
+                    ThrowSystemError("Truncate "s + path_);
+                }
+                SyncData(fd_, path_);
+            }
+            next_lsn_ = last_lsn + 1;
+            durable_lsn_ = last_lsn;
+        }
+    }
+    catch (...) {
+        ::close(fd_);
+        throw;
+    }
+    flusher_ = thread([this] { FlushLoop(); });
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    has_data_.notify_all();
+    flusher_.join();
+    ::close(fd_);
+}
+
+uint64_t WriteAheadLog::Append(const LogRecord& record) {
+    uint64_t lsn = 0;
+    {
+        lock_guard guard(mutex_);
+        if (failure_) {
+            rethrow_exception(failure_);
+        }
+        lsn = next_lsn_++;
+        AppendRecord(buffer_, record, lsn);
+        ++stats_.records;
+    }
+    has_data_.notify_one();
+    return lsn;
+}
+
+void WriteAheadLog::WaitDurable(uint64_t lsn) {
+    unique_lock lock(mutex_);
+    durable_.wait(lock, [this, lsn] { return durable_lsn_ >= lsn || failure_; });
+    if (durable_lsn_ < lsn) {
+        rethrow_exception(failure_);
+    }
+}
+
+uint64_t WriteAheadLog::GetLastLsn() const {
+    lock_guard guard(mutex_);
+    return next_lsn_ - 1;
+}
+
+WriteAheadLog::Stats WriteAheadLog::GetStats() const {
+    lock_guard guard(mutex_);
+    return stats_;
+}
+
+void WriteAheadLog::Reset(uint64_t min_next_lsn) {
+    unique_lock lock(mutex_);
+    durable_.wait(lock, [this] { return failure_ || (buffer_.empty() && durable_lsn_ + 1 == next_lsn_); });
+    if (failure_) {
+        rethrow_exception(failure_);
+    }
+    next_lsn_ = max(next_lsn_, min_next_lsn);
+    durable_lsn_ = next_lsn_ - 1;
+    //поток записи простаивает, пока буфер пуст, поэтому файл можно переписать под замком
+    if (::ftruncate(fd_, 0) != 0) {
+        ThrowSystemError("Truncate "s + path_);
+    }
+    WriteAll(fd_, MakeHeader(LOG_MAGIC, next_lsn_), path_);
+    SyncData(fd_, path_);
+}
+
+void WriteAheadLog::FlushLoop() {
+    string batch;
+    unique_lock lock(mutex_);
+    while (true) {
+        has_data_.wait(lock, [this] { return stopping_ || !buffer_.empty(); });
+        if (buffer_.empty()) {
+            return;
+        }
+        if (options_.group_commit_delay.count() > 0 && !stopping_) {
+            has_data_.wait_for(lock, options_.group_commit_delay, [this] { return stopping_; });
+        }
+        //буферы меняются местами, чтобы не выделять память под каждый пакет
+        batch.clear();
+        batch.swap(buffer_);
+        const uint64_t batch_lsn = next_lsn_ - 1;
+        lock.unlock();
+
+        exception_ptr error;
+        try {
+            WriteAll(fd_, batch, path_);
+            if (options_.sync) {
+                SyncData(fd_, path_);
+            }
+        }
+        catch (...) {
+            error = current_exception();
+        }
+
+        lock.lock();
+        if (error) {
+            //неизвестно, что из пакета дошло до диска: журнал больше не принимает записей
+            failure_ = error;
+            buffer_.clear();
+        }
+        else {
+            durable_lsn_ = batch_lsn;
+            ++stats_.batches;
+            stats_.bytes += batch.size();
+        }
+        durable_.notify_all();
+    }
+}
+
+uint64_t ReadSnapshot(const string& path, const WriteAheadLog::ReplayHandler& handler) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        ThrowSystemError("Open "s + path);
+    }
+    uint64_t lsn = 0;
+    try {
+        const uint64_t file_size = GetFileSize(fd, path);
+        lsn = CheckHeader(ReadHeader(fd, path), SNAPSHOT_MAGIC, path);
+        //снимок пишется атомарно, поэтому оборванная запись в нём - повреждение, а не сбой при записи
+        if (StreamRecords(fd, path, file_size, [&handler](const LogRecord& record, string_view) { handler(record); }) != file_size) {
+            throw runtime_error("Snapshot "s + path + " is corrupted"s);
+        }
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    return lsn;
+}
+
+//==================== DurableSearchServer ====================
+
+DurableSearchServer::DurableSearchServer(SearchServer& server, const string& directory, WriteAheadLog::Options options)
+    : server_(server)
+    , snapshot_path_((filesystem::path(directory) / "snapshot").string())
+    , log_path_((filesystem::path(directory) / "wal").string())
+{
+    const auto start = chrono::steady_clock::now();
+    filesystem::create_directories(directory);
+    const uint64_t snapshot_lsn = ReadSnapshot(snapshot_path_, [this](const LogRecord& record) {
+        ApplyLogRecord(server_, record);
+        ++recovery_stats_.snapshot_documents;
+    });
+    //записи до snapshot_lsn уже в снимке: журнал мог не успеть очиститься после Checkpoint
+    log_ = make_unique<WriteAheadLog>(log_path_, options, [this, snapshot_lsn](const LogRecord& record) {
+        if (record.lsn <= snapshot_lsn) {
+            return;
+        }
+        //запись, которую индекс отверг при изменении (например, недопустимый символ в тексте), попала
+        //в журнал раньше проверки. Индекс она не изменила, и при восстановлении отвергается так же
+        try {
+            ApplyLogRecord(server_, record);
+            ++recovery_stats_.replayed_records;
+        }
+        catch (const invalid_argument&) {
+            rejected_lsns_.insert(record.lsn);
+        }
+        catch (const out_of_range&) {
+            rejected_lsns_.insert(record.lsn);
+        }
+    });
+    recovery_stats_.rejected_records = rejected_lsns_.size();
+    //журнал пропал или моложе снимка: новые записи должны получить номера после снимка
+    if (log_->GetLastLsn() < snapshot_lsn) {
+        log_->Reset(snapshot_lsn + 1);
+    }
+    recovery_stats_.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void DurableSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    unique_lock lock(mutex_);
+    CheckNewDocumentId(document_id);
+    LogRecord record;
+    record.type = LogRecordType::ADD_DOCUMENT;
+    record.document_id = document_id;
+    record.status = status;
+    record.ratings = ratings;
+    record.text = document;
+    Commit(record, lock);
+}
+
+void DurableSearchServer::AddDocument(int document_id, const vector<DocumentField>& fields, DocumentStatus status,
+    const vector<int>& ratings)
+{
+    unique_lock lock(mutex_);
+    CheckNewDocumentId(document_id);
+    LogRecord record;
+    record.type = LogRecordType::ADD_FIELDED_DOCUMENT;
+    record.document_id = document_id;
+    record.status = status;
+    record.ratings = ratings;
+    record.fields = fields;
+    Commit(record, lock);
+}
+
+void DurableSearchServer::RemoveDocument(int document_id) {
+    unique_lock lock(mutex_);
+    if (!server_.HasDocument(document_id)) {
+        return;
+    }
+    LogRecord record;
+    record.type = LogRecordType::REMOVE_DOCUMENT;
+    record.document_id = document_id;
+    Commit(record, lock);
+}
+
+void DurableSearchServer::UpdateDocument(int document_id, string_view document) {
+    unique_lock lock(mutex_);
+    CheckDocumentId(document_id);
+    LogRecord record;
+    record.type = LogRecordType::UPDATE_DOCUMENT;
+    record.document_id = document_id;
+    record.text = document;
+    Commit(record, lock);
+}
+
+void DurableSearchServer::UpdateDocument(int document_id, const vector<DocumentField>& fields) {
+    unique_lock lock(mutex_);
+    CheckDocumentId(document_id);
+    LogRecord record;
+    record.type = LogRecordType::UPDATE_FIELDED_DOCUMENT;
+    record.document_id = document_id;
+    record.fields = fields;
+    Commit(record, lock);
+}
+
+void DurableSearchServer::SetStatus(int document_id, DocumentStatus status) {
+    unique_lock lock(mutex_);
+    CheckDocumentId(document_id);
+    LogRecord record;
+    record.type = LogRecordType::SET_STATUS;
+    record.document_id = document_id;
+    record.status = status;
+    Commit(record, lock);
+}
+
+void DurableSearchServer::SetRatings(int document_id, const vector<int>& ratings) {
+    unique_lock lock(mutex_);
+    CheckDocumentId(document_id);
+    LogRecord record;
+    record.type = LogRecordType::SET_RATINGS;
+    record.document_id = document_id;
+    record.ratings = ratings;
+    Commit(record, lock);
+}
+
+void DurableSearchServer::CheckNewDocumentId(int document_id) const {
+    if (document_id < 0 || server_.HasDocument(document_id)) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+}
+
+void DurableSearchServer::CheckDocumentId(int document_id) const {
+    if (!server_.HasDocument(document_id)) {
+        throw out_of_range("Unknown document_id "s + to_string(document_id));
+    }
+}
+
+void DurableSearchServer::Commit(const LogRecord& record, unique_lock<mutex>& lock) {
+    //сначала журнал: если он не принимает записей, индекс не меняется. Применяется та же запись
+    //тем же ApplyLogRecord, что и при восстановлении, и под тем же замком - в порядке LSN
+    const uint64_t lsn = log_->Append(record);
+    try {
+        ApplyLogRecord(server_, record);
+    }
+    catch (...) {
+        rejected_lsns_.insert(lsn);
+        throw;
+    }
+    //fdatasync ждём без замка, чтобы следующие изменения попали в тот же пакет
+    lock.unlock();
+    log_->WaitDurable(lsn);
+}
+
+void DurableSearchServer::Checkpoint() {
+    lock_guard guard(mutex_);
+    const uint64_t lsn = log_->GetLastLsn();
+    log_->WaitDurable(lsn);
+
+    //живые документы - последние записи ADD_DOCUMENT, после которых не было удаления. Нетронутые
+    //после добавления попадают в снимок готовыми кадрами, изменённые сворачиваются в новую ADD_DOCUMENT
+    struct LiveDocument {
+        string_view frame;
+        LogRecord record;           //состояние документа, если он менялся после добавления
+        bool is_changed = false;
+    };
+    string snapshot_data;
+    string log_data;
+    map<int, LiveDocument> live_documents;
+    const auto apply = [&live_documents](const LogRecord& record, string_view frame) {
+        if (record.type == LogRecordType::ADD_DOCUMENT || record.type == LogRecordType::ADD_FIELDED_DOCUMENT) {
+            live_documents[record.document_id] = LiveDocument{ frame, {}, false };
+            return;
+        }
+        if (record.type == LogRecordType::REMOVE_DOCUMENT) {
+            live_documents.erase(record.document_id);
+            return;
+        }
+        const auto it = live_documents.find(record.document_id);
+        if (it == live_documents.end()) {
+            return;
+        }
+        LiveDocument& document = it->second;
+        if (!document.is_changed) {
+            DecodeRecord(document.frame.substr(FRAME_HEADER_SIZE), document.record);
+            document.is_changed = true;
+        }
+        //новый текст или новые поля меняют и вид записи документа
+        if (record.type == LogRecordType::UPDATE_DOCUMENT) {
+            document.record.type = LogRecordType::ADD_DOCUMENT;
+            document.record.text = record.text;
+            document.record.fields.clear();
+        }
+        else if (record.type == LogRecordType::UPDATE_FIELDED_DOCUMENT) {
+            document.record.type = LogRecordType::ADD_FIELDED_DOCUMENT;
+            document.record.text = {};
+            document.record.fields = record.fields;
+        }
+        else if (record.type == LogRecordType::SET_STATUS) {
+            document.record.status = record.status;
+        }
+        else if (record.type == LogRecordType::SET_RATINGS) {
+            document.record.ratings = record.ratings;
+        }
+    };
+    uint64_t snapshot_lsn = 0;
+    if (ReadFile(snapshot_path_, snapshot_data)) {
+        snapshot_lsn = CheckHeader(snapshot_data, SNAPSHOT_MAGIC, snapshot_path_);
+        ParseRecords(snapshot_data, apply);
+    }
+    ReadFile(log_path_, log_data);
+    CheckHeader(log_data, LOG_MAGIC, log_path_);
+    ParseRecords(log_data, [this, &apply, snapshot_lsn](const LogRecord& record, string_view frame) {
+        if (record.lsn > snapshot_lsn && !rejected_lsns_.count(record.lsn)) {
+            apply(record, frame);
+        }
+    });
+
+    const string header = MakeHeader(SNAPSHOT_MAGIC, lsn);
+    string changed_frames;
+    vector<string_view> parts;
+    parts.reserve(live_documents.size() + 2);
+    parts.push_back(header);
+    for (const auto& [_, document] : live_documents) {
+        if (document.is_changed) {
+            AppendRecord(changed_frames, document.record, document.record.lsn);
+        }
+        else {
+            parts.push_back(document.frame);
+        }
+    }
+    parts.push_back(changed_frames);
+    WriteFileAtomically(snapshot_path_, parts);
+    log_->Reset();
+    rejected_lsns_.clear();
+}